@@ -14,27 +14,45 @@
 #include <SFML/Graphics/Sprite.hpp>
 // Include standard library C++ libraries.
 #include <deque>
-#include <stack>
 #include <iostream>
-#include <list>
 #include <iterator>
+#include <map>
+#include <vector>
 #include <stdlib.h>
 // Project header files
-#include "Command.hpp"
+#include "Latency.hpp"
+#include "Metrics.hpp"
+#include "PaintCore.hpp"
+#include "StrokeSimplifier.hpp"
 #include "UDPNetworkServer.hpp"
 #include "UDPNetworkClient.hpp"
 
-class App {
+// The paint program: the windows, GUI and networking around a PaintCore.
+class App : public PaintCore {
 private:
 // Member variables
-    // Stack stores the next commands to redo.
-    std::stack<std::list<Command *>> m_redo;
-    // Stack that stores the last actions to occur.
-    std::stack<std::list<Command *>> m_undo;
     /*!
-     * sf::Image of the app
+     * sf::Image of the part of the canvas in view, refreshed from the canvas when it is asked for
      */
     sf::Image *m_image;
+    /*!
+     * Revision of the canvas that m_image was last copied from
+     */
+    std::uint64_t m_imageRevision;
+    /*!
+     * Canvas coordinates of the top-left pixel in view. The windows show a window-sized view of a
+     * canvas which may be much larger; the texture holds just that view.
+     */
+    int m_viewX;
+    int m_viewY;
+    /*!
+     * Whether the view moved since the texture was last uploaded, so all of it must be uploaded
+     */
+    bool m_viewMoved;
+    /*!
+     * Rows of the view copied out of the canvas on their way to the texture
+     */
+    std::vector<Canvas::Pixel> m_uploadBuffer;
     /*!
      * sf::Sprite of the app
      */
@@ -58,6 +76,22 @@ private:
      */
     int m_displayOffset;
 
+    /*!
+     * Runtime metrics, registered with the MetricsRegistry in the constructor.
+     */
+    Histogram *m_frameTimeMetric;
+    Histogram *m_remoteApplyMetric;
+
+    /*!
+     * Input-to-present latency of stroke samples applied to this App.
+     */
+    LatencyTracker m_latency;
+
+    /*!
+     * Thins out the samples of the local user's stroke before they are sent.
+     */
+    StrokeSimplifier m_strokeSimplifier;
+
 // Member functions
     // Store the address of our function pointer
     // for each of the callback functions.
@@ -80,21 +114,6 @@ private:
 public:
 // Member Variables
 
-    /*!
-     * Mouse x-coordinate.
-     */
-    unsigned int mouseX;
-
-    /*!
-     * Mouse y-coordinate.
-     */
-    unsigned int mouseY;
-
-    /*!
-    * Current paintbrush size (radius)
-    */
-    int strokeSize;
-
     /*!
     * Whether this instance is running as a server or client. (not initialized in App constructor)
     */
@@ -111,47 +130,59 @@ public:
     sf::Color receivedColor;
 
     /*!
-     * Paint function pointer, which is a pointer to a function that edits the sf::Image.
+     * Whether a click on the canvas flood fills the region under it instead of painting.
      */
-    std::map<std::pair<int, int>, sf::Color> (*m_paintFunc)(App *, sf::Color color, int size, int m_x, int m_y);
+    bool bucketTool;
 
     /*!
-     * The server for our app. (not initialized in App constructor)
+     * Color tolerance of the bucket tool: the largest channel difference from the clicked pixel
+     * which is still filled (0 = exact match).
      */
-    UDPNetworkServer *appServer;
+    int fillTolerance;
 
     /*!
-     * The client for our app. (not initialized in App constructor)
+     * Size of the canvas Init() creates, which may be larger than the windows; see SetView().
      */
-    UDPNetworkClient *appClient;
+    unsigned canvasWidth;
+    unsigned canvasHeight;
 
     /*!
-     * Canvas of the App.
+     * The server for our app. (not initialized in App constructor)
      */
-    sf::Color m_canvas;
+    UDPNetworkServer *appServer;
 
     /*!
-     * Current paint color.
+     * The client for our app. (not initialized in App constructor)
      */
-    sf::Color m_color;
-    // Pixels that the user has painted in the current brush stroke
-    std::list<Command *> m_paintedPixels;
+    UDPNetworkClient *appClient;
 
 // Member functions
     // Constructor
     App();
 
-    // Add a command to stack
-    void AddCommand();
+    // Get app image, a read-only copy of the part of the canvas in view
+    const sf::Image &GetImage();
+
+    // Copy the rows in view of the canvas that changed since the last call into the texture
+    void UploadCanvas();
+
+    // Copy the part of an image of the canvas's size in view into a texture of the view's size
+    void UploadView(const Canvas &canvas, sf::Texture &texture);
 
-    // Undo a command
-    void UndoCommand();
+    // Scroll the view so that canvas pixel (x, y) is at its top-left, as near as the canvas allows
+    void SetView(int x, int y);
 
-    // Redo a command
-    void RedoCommand();
+    // Recreate the canvas, blank, at another size, e.g. the session's when joining it
+    void ResizeCanvas(unsigned width, unsigned height);
 
-    // Get app image
-    sf::Image &GetImage();
+    // Canvas coordinates of the top-left pixel in view
+    sf::Vector2i GetView() const;
+
+    // Size of the view: the canvas window's, or the canvas's if it is smaller
+    sf::Vector2u GetViewSize();
+
+    // Canvas coordinates of a point in the canvas window
+    sf::Vector2i ToCanvas(int windowX, int windowY) const;
 
     // Get app texture
     sf::Texture &GetTexture();
@@ -172,32 +203,31 @@ public:
     sf::Vector2u GetDisplayDimensions();
 
     // Destroy the app
-    void Destroy();
+    void Destroy() override;
 
     // Initialize app
     void Init(void (*initFunction)(void));
 
-    // Execute individual pixel command
-    void ExecuteCommand(Command *command);
-
-    // Fill display with one color command
-    void FillDisplay(Command *command);
-
     // Update callback function
     void UpdateCallback(void (*updateFunction)(App *));
 
     // Draw function
     void DrawCallback(void (*drawFunction)(App *));
 
-    // Update paintbrush function
-    void UpdatePaintbrush(
-            std::map<std::pair<int, int>, sf::Color> (*paintFunction)(App *, sf::Color, int size, int m_x, int m_y));
-
     // Main app loop
     void Loop();
 
-    // Get app current color
-    int getColor();
+    // Record how long one iteration of the main loop took
+    void RecordFrameTime(std::int64_t microseconds);
+
+    // Record how long applying one packet from another peer took
+    void RecordRemoteApplyTime(std::int64_t microseconds);
+
+    // Get the input-to-present latency tracker
+    LatencyTracker &GetLatencyTracker();
+
+    // Get the simplifier for the local user's strokes
+    StrokeSimplifier &GetStrokeSimplifier();
 
     // Destructor for app
     virtual ~App();
@@ -0,0 +1,139 @@
+/**
+ *  @file   Autosave.hpp
+ *  @brief  Incremental autosave: a journal of the tiles changed between checkpoints, over a base project file.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef AUTOSAVE_HPP
+#define AUTOSAVE_HPP
+
+// Include standard library C++ libraries.
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+// Project header files
+#include "LayerStack.hpp"
+#include "Metrics.hpp"
+#include "ProjectFile.hpp"
+#include "ThreadPool.hpp"
+
+// The tiles written between two checkpoints, and the layers as they were at the second
+struct AutosaveRecord {
+    // Whether the layers were created afresh, so that the record replaces everything before it
+    bool reset = false;
+    ProjectSnapshot changes;
+};
+
+// Incremental autosave. A checkpoint copies only the tiles written since the previous one and
+// appends them, with the layer table, to a journal next to a base project file, so it costs what
+// changed rather than the size of the drawing. When the journal outgrows the base, a background
+// task folds it into a new base. recover() rebuilds the drawing from the base and the journal; a
+// record torn by a crash, and anything after it, is ignored.
+//
+// <path> is the base, a project file which does not exist until the first compaction;
+// <path>.journal takes new records; <path>.journal.old holds the records being compacted, so that
+// checkpoints go on while a compaction runs. Records hold whole tiles, so replaying a record twice
+// changes nothing, and a crash at any point of a compaction loses nothing.
+class AutosaveJournal {
+public:
+    // "CPJR" read as a little-endian integer
+    static constexpr std::uint32_t kRecordMagic = 0x524A5043;
+    // Journal size below which it is not compacted, however small the base
+    static constexpr std::uint64_t kMinCompactBytes = 4 * 1024 * 1024;
+
+    // Constructor; nothing is written until the first checkpoint
+    explicit AutosaveJournal(const std::string &path);
+
+    // Destructor waits for the checkpoint and compaction in progress
+    virtual ~AutosaveJournal();
+
+    // The base file's path
+    const std::string &getPath() const {
+        return m_path;
+    }
+
+    // Take the tiles marked unsaved on the layers, or every painted tile if the layers were created afresh
+    std::shared_ptr<AutosaveRecord> capture(LayerStack &layers, int activeLayer);
+
+    // Capture the layers, flattened since they last changed, and append the record on pool; false
+    // if the previous checkpoint is still being written, in which case nothing is taken
+    bool checkpoint(LayerStack &layers, int activeLayer, ThreadPool &pool);
+
+    // Append a record to the journal now; false (with error set) if it cannot be written
+    bool append(const AutosaveRecord &record, std::string &error);
+
+    // Fold the journal into the base now; false (with error set) if that fails
+    bool compact(std::string &error);
+
+    // Make snapshot, which the layers hold, the base and drop the journal, e.g. after recovering
+    bool rebase(const ProjectSnapshot &snapshot, LayerStack &layers, std::string &error);
+
+    // Compact once the journal is larger than this and than the base
+    void setCompactBytes(std::uint64_t bytes) {
+        m_compactBytes = bytes;
+    }
+
+    // Bytes in the journal since the last compaction started
+    std::uint64_t getJournalBytes() const {
+        return m_journalBytes;
+    }
+
+    // Wait for the checkpoint and compaction in progress, if any
+    void wait();
+
+    // Rebuild the drawing saved at path from its base and journal; false (with error set) if there is
+    // nothing to recover or the base is damaged
+    static bool recover(const std::string &path, ProjectSnapshot &snapshot, std::string &error);
+
+    // Append a record, framed with its length and checksum
+    static void encodeRecord(const AutosaveRecord &record, std::vector<std::uint8_t> &out);
+
+    // Decode the record at data; returns the bytes it took, or 0 if it is torn or damaged
+    static std::size_t decodeRecord(const std::uint8_t *data, std::size_t size, AutosaveRecord &record);
+
+private:
+    // Apply the base at path, if there is one, then every intact record of the journals in order
+    static bool replay(const std::string &path, const std::vector<std::string> &journals, ProjectSnapshot &snapshot,
+                       bool &found, std::string &error);
+
+    // Count a background task in or out, for wait()
+    void beginTask();
+    void endTask();
+
+    std::string m_path;
+    std::string m_journalPath;
+    std::string m_oldPath;
+    std::uint64_t m_compactBytes;
+    // Generation of the layers the journal follows; a new one makes the next record a reset
+    std::uint64_t m_generation;
+    // What the last record said of the layers, to skip checkpoints with nothing new
+    std::vector<ProjectLayer> m_lastLayers;
+    int m_lastActiveLayer;
+
+    // Serialises appends with moving the journal aside for compaction
+    std::mutex m_fileMutex;
+    std::atomic<bool> m_writing;
+    std::atomic<bool> m_compacting;
+    // Set when a record could not be written, so that the next one is a reset
+    std::atomic<bool> m_failed;
+    std::atomic<std::uint64_t> m_journalBytes;
+    std::atomic<std::uint64_t> m_baseBytes;
+    // Background tasks in progress
+    std::mutex m_taskMutex;
+    std::condition_variable m_idle;
+    int m_tasks;
+
+    // METRICS
+    Counter *m_checkpoints;
+    Counter *m_skipped;
+    Counter *m_tilesSaved;
+    Counter *m_bytesSaved;
+    Counter *m_compactions;
+    Gauge *m_journalBytesMetric;
+};
+
+#endif
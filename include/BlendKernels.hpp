@@ -0,0 +1,64 @@
+/**
+ *  @file   BlendKernels.hpp
+ *  @brief  Row kernels blending one layer's pixels onto the layers below it.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef BLENDKERNELS_HPP
+#define BLENDKERNELS_HPP
+
+// Include standard library C++ libraries.
+#include <cstdint>
+// Project header files
+#include "Canvas.hpp"
+
+// How a layer's color combines with the color below it, before its alpha and opacity are applied
+enum class BlendMode : std::uint8_t {
+    Normal,
+    Multiply,
+    Screen,
+    Add,
+    Count
+};
+
+// Blending of layer pixels (straight alpha) onto an opaque destination. For a source color s with
+// alpha a, layer opacity o and destination d, each channel becomes
+//   blend(s, d) * a' + d * (255 - a'), divided by 255, with a' = a * o / 255
+// in exact integer arithmetic (rounded division by 255), and the result stays opaque. The SIMD
+// kernel works on four pixels at a time with the same arithmetic as the scalar one, so the result
+// does not depend on the machine and peers compositing the same layers see the same pixels.
+//
+// Brushes paint with a coverage mask instead: a color whose alpha at each pixel is the mask times
+// a strength is composited source-over onto a layer that may itself be transparent. Where the
+// layer is opaque this is the Normal blend above; elsewhere the color is divided by the new alpha
+// with rounded integer division, so this too is exact on every machine.
+class BlendKernels {
+public:
+    // Blend count source pixels onto count destination pixels, with SIMD where the CPU has it
+    static void blendRow(Canvas::Pixel *dst, const Canvas::Pixel *src, int count, BlendMode mode,
+                         std::uint8_t opacity);
+
+    // The same, one pixel at a time (the reference the SIMD kernel must match)
+    static void blendRowScalar(Canvas::Pixel *dst, const Canvas::Pixel *src, int count, BlendMode mode,
+                               std::uint8_t opacity);
+
+    // Blend one color through a row of coverage bytes onto count pixels, source-over: coverage
+    // times strength (0-255) is the color's alpha at each pixel. With SIMD where the CPU has it
+    static void sourceOverMasked(Canvas::Pixel *dst, const std::uint8_t *coverage, int count, Canvas::Pixel color,
+                                 std::uint8_t strength);
+
+    // The same, one pixel at a time (the reference the SIMD kernel must match)
+    static void sourceOverMaskedScalar(Canvas::Pixel *dst, const std::uint8_t *coverage, int count,
+                                       Canvas::Pixel color, std::uint8_t strength);
+
+    // Lower the alpha of count pixels by coverage times strength (destination-out), e.g. for an eraser
+    static void eraseMasked(Canvas::Pixel *dst, const std::uint8_t *coverage, int count, std::uint8_t strength);
+
+    // Whether blendRow() runs a SIMD kernel on this build
+    static bool hasSimd();
+
+    // Name of a blend mode, e.g. for the GUI
+    static const char *getName(BlendMode mode);
+};
+
+#endif
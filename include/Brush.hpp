@@ -0,0 +1,220 @@
+/**
+ *  @file   Brush.hpp
+ *  @brief  Brush engine: rasterizes brush strokes onto a Canvas as horizontal spans.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef BRUSH_HPP
+#define BRUSH_HPP
+
+// Include standard library C++ libraries.
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+// Project header files
+#include "Canvas.hpp"
+
+// Brushes the engine can rasterize a stroke with
+enum class BrushId {
+    // Hard-edged square which overwrites the pixels it covers
+    Square = 0,
+    // Antialiased disc blended source-over, with a hardness and an opacity
+    Round = 1
+};
+
+// The brush a stroke is painted with and how it feels. Draw messages carry it packed into one int.
+struct BrushTip {
+    BrushId id;
+    // Fraction of the round brush's radius painted at full strength, 0 (soft) to 255 (hard edge)
+    std::uint8_t hardness;
+    // Strength of the round brush, 0 to 255; the stroke's color alpha scales it further
+    std::uint8_t opacity;
+
+    // Constructor; a BrushId alone gives that brush at full hardness and opacity
+    BrushTip(BrushId brush = BrushId::Square, std::uint8_t brushHardness = 255, std::uint8_t brushOpacity = 255)
+            : id(brush), hardness(brushHardness), opacity(brushOpacity) {}
+
+    bool operator==(const BrushTip &other) const {
+        return id == other.id && hardness == other.hardness && opacity == other.opacity;
+    }
+
+    // The tip as one int: the id in the low byte, then the hardness, then the opacity
+    int pack() const {
+        return static_cast<int>(id) | (hardness << 8) | (opacity << 16);
+    }
+
+    // The tip packed by pack(); 0 (what older peers send) is the square brush
+    static BrushTip unpack(int packed) {
+        BrushId brush = (packed & 0xFF) == static_cast<int>(BrushId::Round) ? BrushId::Round : BrushId::Square;
+        if (brush == BrushId::Square) {
+            return BrushTip();
+        }
+        return BrushTip(brush, static_cast<std::uint8_t>(packed >> 8), static_cast<std::uint8_t>(packed >> 16));
+    }
+};
+
+// Everything the brush engine needs to paint a stroke segment: the brush and how it feels, its
+// radius and its color
+struct BrushDescriptor {
+    BrushTip tip;
+    int radius;
+    Canvas::Pixel color;
+};
+
+// How a brush puts its color on the canvas
+enum class BrushBlend : std::uint8_t {
+    // Overwrite the covered pixels (the square brush)
+    Replace,
+    // Composite the color through the coverage mask
+    SourceOver,
+    // Lower the alpha of the covered pixels (the round brush with a fully transparent color)
+    Erase,
+    Count
+};
+
+// Paints one stroke segment of one brush, inside a clip rectangle
+typedef void (*SegmentKernel)(Canvas &canvas, int x0, int y0, int x1, int y1, bool continues,
+                              const BrushDescriptor &brush, const CanvasRect &clip);
+
+// Segment kernels instantiated at compile time for each brush shape, blend and radius up to
+// kMaxFixedRadius, and a generic one of each shape and blend for any radius. A kernel for a fixed
+// radius has the dab size as a constant, so merging a dab's stamp into the coverage mask is a
+// fully unrolled loop of branch-free max operations, and a square dab is a run of fills with no
+// intersection arithmetic. The blend is decided once per kernel rather than once per row. Every
+// kernel paints exactly the pixels the generic one does.
+class BrushKernels {
+public:
+    // Largest radius with kernels of its own
+    static constexpr int kMaxFixedRadius = 8;
+
+    // How a brush puts its color on the canvas
+    static BrushBlend blendOf(const BrushDescriptor &brush);
+
+    // The fastest kernel for a brush, from the dispatch table
+    static SegmentKernel select(const BrushDescriptor &brush);
+
+    // The kernel for any radius of the brush's shape and blend, e.g. to compare against
+    static SegmentKernel generic(const BrushDescriptor &brush);
+};
+
+// Antialiased coverage masks ("stamps") of the round brush. A dab's center is rounded to a quarter
+// pixel, and a stamp holds, for each pixel of the (2 * radius + 1) square box around the dab, how
+// much of it the disc covers (0-255, from 8 x 8 samples per pixel). Inside hardness * radius the
+// brush is at full strength; beyond it strength falls off with the squared distance to the edge.
+// Stamps are computed with integers only, so every peer gets the same masks. Hard stamps for
+// small radii are tables generated at compile time; the others are made once and cached.
+class BrushStamps {
+public:
+    // Dab centers are rounded to 1 / kSubPixel of a pixel in each direction
+    static constexpr int kSubPixel = 4;
+    // Largest radius with compile-time tables (for hardness 255)
+    static constexpr int kMaxTableRadius = 8;
+
+    // The stamps of one radius and hardness, one for each sub-pixel position of the dab's center;
+    // each is size * size coverage bytes, rows top to bottom
+    struct StampSet {
+        int size;
+        const std::uint8_t *coverage;
+        // Keeps stamps made at run time alive while they are used, even if the cache drops them
+        std::shared_ptr<const std::vector<std::uint8_t>> owner;
+
+        // Stamp of a dab centered subX / kSubPixel, subY / kSubPixel of a pixel right of and below
+        // a pixel corner; the box's top-left pixel is radius pixels left of and above that corner
+        const std::uint8_t *at(int subX, int subY) const {
+            return coverage + static_cast<std::size_t>(subY * kSubPixel + subX) * size * size;
+        }
+    };
+
+    // Stamps of a radius (at least 1) and hardness: a compile-time table, else made and cached
+    static StampSet get(int radius, std::uint8_t hardness);
+
+    // Work out one stamp's coverage into out (size * size bytes), as the tables were
+    static void generate(int radius, std::uint8_t hardness, int subX, int subY, std::uint8_t *out);
+
+    // Number of stamps made and cached at run time
+    static std::size_t cachedCount();
+};
+
+// A set of pixel values kept as horizontal runs: either the pixels a brush operation overwrote,
+// so they can be put back, or the pixels an operation wrote, so it can be replayed.
+class SpanRecord {
+public:
+    // Constructor
+    SpanRecord();
+
+    // Copy the current values of pixels [x0, x1) of row y (already clipped to the canvas)
+    void save(const Canvas &canvas, int y, int x0, int x1);
+
+    // Write every saved pixel back, most recent run first
+    void write(Canvas &canvas) const;
+
+    // Write the saved pixels which fall inside clip, most recent run first
+    void write(Canvas &canvas, const CanvasRect &clip) const;
+
+    // Smallest rectangle holding every saved pixel
+    CanvasRect getBounds() const {
+        return m_bounds;
+    }
+
+    // Forget every saved run
+    void clear();
+
+    // Whether nothing was saved
+    bool empty() const {
+        return m_spans.empty();
+    }
+
+    // Number of saved pixels
+    std::size_t pixelCount() const {
+        return m_pixels.size();
+    }
+
+    // Approximate bytes held
+    std::size_t getByteSize() const;
+
+private:
+    struct Span {
+        int y;
+        int x;
+        int length;
+        std::size_t offset;
+    };
+
+    std::vector<Span> m_spans;
+    std::vector<Canvas::Pixel> m_pixels;
+    CanvasRect m_bounds;
+};
+
+// Rasterizes strokes with integer arithmetic only (and, for blending, exactly rounded division), so
+// every peer produces the same pixels for the same input regardless of platform or compiler.
+class BrushEngine {
+public:
+    // Paint a stroke segment: the square brush of half-width radius swept from (x0, y0) to
+    // (x1, y1). A dab at one point covers columns [x - radius, x + radius) and the same rows,
+    // exactly like the original per-sample brush. When prior is non-null the overwritten
+    // pixels are saved into it first.
+    static void strokeSegment(Canvas &canvas, int x0, int y0, int x1, int y1, int radius, Canvas::Pixel pixel,
+                              SpanRecord *prior);
+
+    // Paint only the part of a stroke segment inside clip
+    static void strokeSegment(Canvas &canvas, int x0, int y0, int x1, int y1, int radius, Canvas::Pixel pixel,
+                              SpanRecord *prior, const CanvasRect &clip);
+
+    // Rectangle holding every pixel a stroke segment can cover
+    static CanvasRect segmentBounds(int x0, int y0, int x1, int y1, int radius);
+
+    // Paint, inside clip, a stroke segment with a brush, through the kernel BrushKernels::select()
+    // picks for it. A segment which continues a stroke starts where the previous one ended; the round
+    // brush leaves out the dab there, which that segment painted.
+    static void paintSegment(Canvas &canvas, int x0, int y0, int x1, int y1, bool continues,
+                             const BrushDescriptor &brush, const CanvasRect &clip);
+
+    // Rectangle holding every pixel a round brush segment can cover
+    static CanvasRect roundBounds(int x0, int y0, int x1, int y1, int radius);
+
+    // Columns [first, last] of row y covered by the swept brush; false if the row is not covered
+    static bool segmentRowSpan(int x0, int y0, int x1, int y1, int radius, int y, int &first, int &last);
+};
+
+#endif
@@ -0,0 +1,43 @@
+/**
+ *  @file   ByteOrder.hpp
+ *  @brief  Little-endian integers in byte buffers, for the formats written to disk.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef BYTEORDER_HPP
+#define BYTEORDER_HPP
+
+// Include standard library C++ libraries.
+#include <cstdint>
+#include <vector>
+
+// Files are written least significant byte first whatever the machine, so that they can be read
+// anywhere.
+class ByteOrder {
+public:
+    // Append a 32-bit integer
+    static void putU32(std::vector<std::uint8_t> &out, std::uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            out.push_back(static_cast<std::uint8_t>(value >> shift));
+        }
+    }
+
+    // Append a 64-bit integer
+    static void putU64(std::vector<std::uint8_t> &out, std::uint64_t value) {
+        putU32(out, static_cast<std::uint32_t>(value));
+        putU32(out, static_cast<std::uint32_t>(value >> 32));
+    }
+
+    // Read a 32-bit integer
+    static std::uint32_t getU32(const std::uint8_t *data) {
+        return static_cast<std::uint32_t>(data[0]) | static_cast<std::uint32_t>(data[1]) << 8 |
+               static_cast<std::uint32_t>(data[2]) << 16 | static_cast<std::uint32_t>(data[3]) << 24;
+    }
+
+    // Read a 64-bit integer
+    static std::uint64_t getU64(const std::uint8_t *data) {
+        return static_cast<std::uint64_t>(getU32(data)) | static_cast<std::uint64_t>(getU32(data + 4)) << 32;
+    }
+};
+
+#endif
@@ -0,0 +1,323 @@
+/**
+ *  @file   Canvas.hpp
+ *  @brief  The pixel buffer that all painting operates on.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef CANVAS_HPP
+#define CANVAS_HPP
+
+// Include standard library C++ libraries.
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TileBudget;
+class TileStore;
+
+// Axis-aligned pixel rectangle covering columns [left, right) and rows [top, bottom)
+struct CanvasRect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+
+    // Whether the rectangle covers no pixels
+    bool empty() const {
+        return left >= right || top >= bottom;
+    }
+
+    // Whether the two rectangles share any pixel
+    bool intersects(const CanvasRect &other) const {
+        return left < other.right && other.left < right && top < other.bottom && other.top < bottom;
+    }
+
+    // The pixels covered by both rectangles
+    CanvasRect intersect(const CanvasRect &other) const {
+        return CanvasRect{left > other.left ? left : other.left, top > other.top ? top : other.top,
+                          right < other.right ? right : other.right, bottom < other.bottom ? bottom : other.bottom};
+    }
+};
+
+// RGBA pixel buffer. Each pixel is one 32-bit word whose bytes are R, G, B, A in memory order,
+// which is the layout sf::Texture::update() takes.
+// The pixels live in kTileSize square tiles which are only allocated when something is written to
+// them: every other tile shows the canvas's background through one shared tile, so memory grows with
+// the area drawn on rather than with the canvas, up to kMaxSize pixels a side. Tiles filled with one
+// value (see fillRect()) share one tile too, and copying a canvas shares its tiles until either copy
+// writes to them.
+// A canvas may also page its tiles out to a file (see enablePaging()), keeping only a budget of them
+// in memory, which several canvases may share; the others are read back when they are next used, so
+// the rest of the API is the same.
+// Writes go through setPixel()/fillSpan()/writeSpan()/fillRect(), which keep track of the rows that
+// changed since the last upload, and separately of the tiles changed since they were last
+// composited, and bump a revision counter. Tracking can be paused while several threads write
+// disjoint tiles; the rows they wrote are marked when it resumes.
+class Canvas {
+public:
+    typedef std::uint32_t Pixel;
+
+    // Side of the square tiles pixels are stored and changes are tracked in
+    static constexpr int kTileSize = 64;
+    static constexpr int kTileShift = 6;
+
+    // Largest width and height
+    static constexpr unsigned kMaxSize = 65536;
+
+    // One tile's pixels, row by row. A uniform tile holds a single value and may be shared by any
+    // number of tiles of any canvas, so it is never written to.
+    struct Tile {
+        Pixel pixels[kTileSize * kTileSize];
+        bool uniform;
+    };
+
+    // Sequential reads along one row, finding each tile's part of the row once
+    class RowReader {
+    public:
+        RowReader(const Canvas &canvas, int y) : m_canvas(&canvas), m_y(y), m_tileX(-1), m_row(nullptr) {}
+
+        // The pixel in column x, which must lie on the canvas
+        Pixel operator[](int x) {
+            if ((x >> kTileShift) != m_tileX) {
+                m_tileX = x >> kTileShift;
+                m_row = m_canvas->getTileRow(m_tileX, m_y);
+            }
+            return m_row[x & (kTileSize - 1)];
+        }
+
+    private:
+        const Canvas *m_canvas;
+        int m_y;
+        int m_tileX;
+        const Pixel *m_row;
+    };
+
+    // Constructor for an empty canvas
+    Canvas();
+
+    // Constructor for a canvas filled with one pixel value
+    Canvas(unsigned width, unsigned height, Pixel fill);
+
+    // Copies of a paging canvas page too, under the same budget
+    Canvas(const Canvas &other);
+    Canvas &operator=(const Canvas &other);
+    Canvas(Canvas &&other) noexcept;
+    Canvas &operator=(Canvas &&other) noexcept;
+
+    // Destructor
+    ~Canvas();
+
+    // (Re)create the canvas, every pixel the background fill; width and height at most kMaxSize
+    void create(unsigned width, unsigned height, Pixel fill);
+
+    // Width in pixels
+    unsigned getWidth() const {
+        return m_width;
+    }
+
+    // Height in pixels
+    unsigned getHeight() const {
+        return m_height;
+    }
+
+    // The whole canvas as a rectangle
+    CanvasRect getBounds() const {
+        return CanvasRect{0, 0, static_cast<int>(m_width), static_cast<int>(m_height)};
+    }
+
+    // Whether (x, y) lies on the canvas
+    bool contains(int x, int y) const {
+        return x >= 0 && y >= 0 && static_cast<unsigned>(x) < m_width && static_cast<unsigned>(y) < m_height;
+    }
+
+    // The value of the pixels nothing was written to
+    Pixel getBackground() const {
+        return m_fill;
+    }
+
+    // Read a pixel; (x, y) must lie on the canvas
+    Pixel getPixel(int x, int y) const {
+        return getTileRow(x >> kTileShift, y)[x & (kTileSize - 1)];
+    }
+
+    // Read-only pointer to the kTileSize pixels of row y in tile column tileX; row y must lie on the
+    // canvas. Past the right edge of the canvas the row holds the background.
+    const Pixel *getTileRow(int tileX, int y) const {
+        const std::size_t index = tileIndex(tileX, y);
+        const Tile *tile = m_store == nullptr ? m_tiles[index].get() : residentTile(index);
+        return (tile != nullptr ? tile : m_background.get())->pixels + (y & (kTileSize - 1)) * kTileSize;
+    }
+
+    // Copy count pixels of row y starting at x into out; the run must lie on the canvas
+    void readSpan(int y, int x, int count, Pixel *out) const;
+
+    // Write a pixel; (x, y) must lie on the canvas
+    void setPixel(int x, int y, Pixel pixel);
+
+    // Fill pixels [x0, x1) of row y with one value, clipped to the canvas
+    void fillSpan(int y, int x0, int x1, Pixel pixel);
+
+    // Copy count pixels into row y starting at x; the run must lie on the canvas
+    void writeSpan(int y, int x, int count, const Pixel *pixels);
+
+    // Fill a rectangle, clipped to the canvas, with one value; whole tiles share a uniform tile
+    void fillRect(const CanvasRect &rect, Pixel pixel);
+
+    // Whether a tile holds one value throughout, and which; true for tiles never written to
+    bool isUniformTile(int tileX, int tileY, Pixel &pixel) const;
+
+    // Number of tiles holding pixels of their own, in memory or paged out
+    std::size_t getAllocatedTiles() const;
+
+    // Approximate bytes held in memory: the tiles of its own and the maps over all tiles
+    std::size_t getByteSize() const;
+
+    // Keep at most residentTiles tiles with pixels of their own in memory from now on, paging the
+    // others out to a file created in directory; false (with error set) if the file cannot be created
+    bool enablePaging(const std::string &directory, std::size_t residentTiles, std::string &error);
+
+    // Page as above, keeping the tiles in memory within a budget shared with other canvases
+    bool enablePaging(const std::string &directory, const std::shared_ptr<TileBudget> &budget, std::string &error);
+
+    // The budget the canvas pages under, or nullptr if it does not page
+    std::shared_ptr<TileBudget> getTileBudget() const;
+
+    // Whether tiles are paged out
+    bool isPaging() const {
+        return m_store != nullptr;
+    }
+
+    // Page out the least recently used tiles beyond the budget. Only while no other thread uses the
+    // canvas, since the tiles' memory goes.
+    void trimTiles();
+
+    // Start reading the paged tiles a rectangle touches back in the background
+    void prefetch(const CanvasRect &rect);
+
+    // Wait until the tiles paged out so far are written and those prefetched are read
+    void waitForPaging();
+
+    // Number of tiles with pixels of their own in memory
+    std::size_t getResidentTiles() const;
+
+    // A tile's pixels without bringing a paged tile back into memory: shared if it is in memory, else
+    // read from the file; nullptr if it shows the background
+    std::shared_ptr<const Tile> peekTile(int tileX, int tileY) const;
+
+    // Counter which changes every time a pixel is written
+    std::uint64_t getRevision() const {
+        return m_revision;
+    }
+
+    // Get and reset the band of rows written since the last call; false if nothing changed
+    bool takeDirtyRows(int &firstRow, int &lastRow);
+
+    // Number of tile columns and rows covering the canvas
+    int getTileColumns() const {
+        return m_columns;
+    }
+    int getTileRows() const {
+        return m_rows;
+    }
+
+    // Set tiles[i] for every tile written since the last call (row-major, one byte per tile) and
+    // reset; false if nothing changed
+    bool takeDirtyTiles(std::vector<std::uint8_t> &tiles);
+
+    // Stop recording written rows, so that several threads may write disjoint tiles at once
+    void pauseTracking() {
+        m_tracking = false;
+    }
+
+    // Record writes again, marking rows [firstRow, lastRow] (all their tiles) as written while paused
+    void resumeTracking(int firstRow, int lastRow);
+
+    // Record writes again, marking rows [firstRow, lastRow] as written but only the tiles set in tiles
+    // (row-major, one byte per tile), when the threads kept to those tiles
+    void resumeTracking(int firstRow, int lastRow, const std::vector<std::uint8_t> &tiles);
+
+    // Whether writes are being recorded
+    bool isTracking() const {
+        return m_tracking;
+    }
+
+    // Pixel from a color in sf::Color::toInteger() form (0xRRGGBBAA)
+    static Pixel fromRGBA(std::uint32_t rgba) {
+        std::uint8_t bytes[4] = {static_cast<std::uint8_t>(rgba >> 24), static_cast<std::uint8_t>(rgba >> 16),
+                                 static_cast<std::uint8_t>(rgba >> 8), static_cast<std::uint8_t>(rgba)};
+        Pixel pixel;
+        std::memcpy(&pixel, bytes, sizeof(pixel));
+        return pixel;
+    }
+
+    // Color in sf::Color::toInteger() form (0xRRGGBBAA) from a pixel
+    static std::uint32_t toRGBA(Pixel pixel) {
+        std::uint8_t bytes[4];
+        std::memcpy(bytes, &pixel, sizeof(pixel));
+        return (static_cast<std::uint32_t>(bytes[0]) << 24) | (static_cast<std::uint32_t>(bytes[1]) << 16) |
+               (static_cast<std::uint32_t>(bytes[2]) << 8) | static_cast<std::uint32_t>(bytes[3]);
+    }
+
+private:
+    // Tile index of a pixel row and tile column
+    std::size_t tileIndex(int tileX, int y) const {
+        return static_cast<std::size_t>(y >> kTileShift) * m_columns + tileX;
+    }
+
+    // A tile of a paging canvas, read back if it is paged out; nullptr for the background
+    const Tile *residentTile(std::size_t index) const;
+
+    // Whether a tile shows the background: nothing was written to it, or it was filled with it
+    bool isBackgroundTile(std::size_t index) const;
+
+    // The pixels of a tile, ready to be written: allocated, read back or copied if it is shared
+    Pixel *writableTile(std::size_t index);
+
+    // Fill pixels [x0, x1) of row y, which lie on the canvas in one tile
+    void fillTileRow(int y, int x0, int x1, Pixel pixel);
+
+    // Grow the dirty band to include rows [firstRow, lastRow] and mark the tiles of columns [left, right)
+    void markDirty(int left, int right, int firstRow, int lastRow) {
+        if (!m_tracking) {
+            return;
+        }
+        if (firstRow < m_dirtyFirst) {
+            m_dirtyFirst = firstRow;
+        }
+        if (lastRow > m_dirtyLast) {
+            m_dirtyLast = lastRow;
+        }
+        for (int tileY = firstRow / kTileSize; tileY <= lastRow / kTileSize; tileY++) {
+            std::uint8_t *tiles = &m_dirtyTiles[static_cast<std::size_t>(tileY) * m_columns];
+            std::memset(tiles + left / kTileSize, 1, (right - 1) / kTileSize - left / kTileSize + 1);
+        }
+        m_tilesDirty = true;
+        m_revision++;
+    }
+
+    unsigned m_width;
+    unsigned m_height;
+    int m_columns;
+    int m_rows;
+    // The background value and the shared tile of it
+    Pixel m_fill;
+    std::shared_ptr<Tile> m_background;
+    // Every tile, row-major; nullptr for the background or a tile paged out. A tile shared with
+    // another tile or canvas is copied before it is written. Reading a paged tile puts it back.
+    mutable std::vector<std::shared_ptr<Tile>> m_tiles;
+    // Where tiles are paged out to, if they are; shared with the store's background task
+    std::shared_ptr<TileStore> m_store;
+    std::uint64_t m_revision;
+    // Band of rows changed since the last takeDirtyRows(); empty when first > last
+    int m_dirtyFirst;
+    int m_dirtyLast;
+    // Tiles changed since the last takeDirtyTiles(), one byte per tile, and whether any is set
+    std::vector<std::uint8_t> m_dirtyTiles;
+    bool m_tilesDirty;
+    // False while threads write rows in parallel; see pauseTracking()
+    bool m_tracking;
+};
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ *  @file   Checksum.hpp
+ *  @brief  CRC-32 of byte ranges, for detecting corrupt records on disk.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+// Include standard library C++ libraries.
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 as used by zlib and PNG (reflected polynomial 0xEDB88320), table driven. A checksum can be
+// built up over several ranges by passing the previous result back in.
+class Checksum {
+public:
+    // CRC-32 of size bytes, continuing from crc (0 to start)
+    static std::uint32_t crc32(const void *data, std::size_t size, std::uint32_t crc = 0);
+};
+
+#endif
@@ -8,6 +8,7 @@
 #define COMMAND_HPP
 
 // Include standard library C++ libraries.
+#include <cstddef>
 #include <string>
 
 class Command {
@@ -37,6 +38,15 @@ public:
     // Get the affected pixel Y value
     virtual int getPixelY() = 0;
 
+    // Approximate heap and object bytes held by this command (for history accounting)
+    virtual std::size_t getByteSize();
+
+    // Commands are allocated from the CommandPool
+    static void *operator new(std::size_t size);
+
+    // Give a command's storage back to the CommandPool
+    static void operator delete(void *block, std::size_t size);
+
 };
 
 
@@ -0,0 +1,73 @@
+/**
+ *  @file   CommandPool.hpp
+ *  @brief  Pooled storage which every Command object is allocated from.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef COMMANDPOOL_HPP
+#define COMMANDPOOL_HPP
+
+// Include standard library C++ libraries.
+#include <cstddef>
+#include <mutex>
+#include <vector>
+// Project header files
+#include "Metrics.hpp"
+
+// Slab allocator for commands. Memory is carved from 64 KiB chunks into blocks of a few size
+// classes; a released block goes on its class's free list and is handed out again before any new
+// chunk is taken. Brush strokes create and release commands of the same few sizes over and over,
+// so after warm-up the pool stops growing and no command touches the general heap. Chunks are
+// kept until exit. Objects larger than the biggest class fall back to the global operator new.
+class CommandPool {
+public:
+    // Granularity of the size classes
+    static constexpr std::size_t kGranule = 16;
+    // Largest block size served from the pool
+    static constexpr std::size_t kMaxBlock = 256;
+    // Bytes taken from the heap at once
+    static constexpr std::size_t kChunkBytes = 64 * 1024;
+
+    // Process-wide pool. It is never destroyed, so commands may be released during exit.
+    static CommandPool &Get();
+
+    // Get a block of at least size bytes
+    void *allocate(std::size_t size);
+
+    // Give back a block allocated with the same size
+    void release(void *block, std::size_t size);
+
+    // Bytes held by live commands
+    std::size_t liveBytes();
+
+    // Number of live commands
+    std::size_t liveCount();
+
+    // Bytes of chunks taken from the heap
+    std::size_t reservedBytes();
+
+private:
+    // Number of size classes
+    static constexpr std::size_t kClasses = kMaxBlock / kGranule;
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    CommandPool();
+
+    // Take a new chunk and split it into blocks of one class
+    void grow(std::size_t sizeClass);
+
+    std::mutex m_mutex;
+    FreeBlock *m_free[kClasses];
+    std::vector<unsigned char *> m_chunks;
+    std::size_t m_liveBytes;
+    std::size_t m_liveCount;
+
+    // METRICS
+    Gauge *m_liveBytesMetric;
+    Gauge *m_reservedBytesMetric;
+};
+
+#endif
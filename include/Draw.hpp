@@ -10,14 +10,15 @@
 // Include standard library C++ libraries.
 #include <string>
 // Project header files
+#include "PaintCore.hpp"
 #include "Command.hpp"
-#include "App.hpp"
+#include "StrokeStore.hpp"
 
 
 class Draw : public Command {
 
     // Minipaint app object to operate upon
-    App *minipaint;
+    PaintCore *minipaint;
 
     // x coordinate
     int m_x;
@@ -31,21 +32,41 @@ class Draw : public Command {
     // Color of brush
     sf::Color color;
 
-    // Prior color of paint brush
-    sf::Color prior_color;
+    // Paint function to paint with, or nullptr when the brush engine paints this command
+    std::map<std::pair<int, int>, sf::Color> (*paintFunc)(PaintCore *, sf::Color color, int size, int m_x, int m_y);
 
-    // Prior color of pixel, or pixel and surrounding pixels if brush diameter > 1
-    std::map<std::pair<int, int>, sf::Color> priorDrawnPixels;
+    // Whether this command paints a stroke segment ending at (m_x, m_y) rather than a single dab
+    bool isSegment;
 
-    // Paint function to paint with
-    std::map<std::pair<int, int>, sf::Color> (*paintFunc)(App *, sf::Color color, int size, int m_x, int m_y);
+    // Start of the segment
+    int m_fromX;
+    int m_fromY;
+
+    // Whether this command's operation is in the PaintCore's stroke store yet, and its number there
+    bool recorded;
+    StrokeStore::OpId m_op;
+
+    // Layer the command paints on
+    int m_layer;
+
+    // Brush the brush engine paints with
+    BrushTip m_brush;
 
 public:
     // Constructor
-    Draw(App *app);
+    Draw(PaintCore *app);
+
+    // Second constructor, with parameters, for a dab of the brush engine
+    Draw(PaintCore *app, int x, int y, sf::Color color, int size);
 
-    // Second constructor, with parameters
-    Draw(App *app, int x, int y, sf::Color color, int size);
+    // Constructor for a stroke segment from the previous sample (fromX, fromY) to (x, y)
+    Draw(PaintCore *app, int fromX, int fromY, int x, int y, sf::Color color, int size);
+
+    // Paint on a given layer, e.g. the one a peer's message names, rather than the active one
+    void setLayer(int layer);
+
+    // Paint with a given brush, e.g. the one a peer's message names, rather than the current one
+    void setBrush(const BrushTip &brush);
 
     // Execute method
     bool execute() override;
@@ -59,6 +80,9 @@ public:
     // Get pixel y coordinate
     int getPixelY() override;
 
+    // Approximate bytes held
+    std::size_t getByteSize() override;
+
     // Destructor
     virtual ~Draw();
 };
@@ -11,11 +11,12 @@
 #include <string>
 // Project header files
 #include "Command.hpp"
-#include "App.hpp"
+#include "PaintCore.hpp"
+#include "StrokeStore.hpp"
 
 class FillDisplay : public Command {
-    // App to operate upon
-    App *minipaint;
+    // PaintCore to operate upon
+    PaintCore *minipaint;
 
     // Color to fill app display with
     sf::Color color;
@@ -26,12 +27,19 @@ class FillDisplay : public Command {
     // Y coordinate of mouse
     int m_y;
 
-    // Prior pixel values for all pixels in the canvas prior to fill
-    std::map<std::pair<int, int>, sf::Color> priorPixelValues;
+    // Whether the fill is in the PaintCore's stroke store yet, and its number there
+    bool recorded;
+    StrokeStore::OpId m_op;
+
+    // Layer the command paints on
+    int m_layer;
 
 public:
     // Constructor for FillDisplay command
-    FillDisplay(App *app, int color);
+    FillDisplay(PaintCore *app, int color);
+
+    // Paint on a given layer, e.g. the one a peer's message names, rather than the active one
+    void setLayer(int layer);
 
     // Execute a fill display operation
     bool execute() override;
@@ -45,6 +53,9 @@ public:
     // Get mouse y coordinate
     int getPixelY() override;
 
+    // Approximate bytes held
+    std::size_t getByteSize() override;
+
     // Destructor
     virtual ~FillDisplay();
 };
@@ -0,0 +1,62 @@
+/**
+ *  @file   FloodFill.hpp
+ *  @brief  Bucket (flood) fill actions interface.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef FLOODFILL_H
+#define FLOODFILL_H
+
+// Project header files
+#include "Command.hpp"
+#include "PaintCore.hpp"
+#include "StrokeStore.hpp"
+
+class FloodFill : public Command {
+    // PaintCore to operate upon
+    PaintCore *minipaint;
+
+    // Color to fill the region with
+    sf::Color color;
+
+    // Seed pixel of the region
+    int m_x;
+    int m_y;
+
+    // Largest channel difference from the seed color which is still filled (0 = exact match)
+    int tolerance;
+
+    // Whether the fill is in the PaintCore's stroke store yet, and its number there
+    bool recorded;
+    StrokeStore::OpId m_op;
+
+    // Layer the command paints on
+    int m_layer;
+
+public:
+    // Constructor for FloodFill command
+    FloodFill(PaintCore *app, int x, int y, int color, int tolerance);
+
+    // Paint on a given layer, e.g. the one a peer's message names, rather than the active one
+    void setLayer(int layer);
+
+    // Execute a flood fill operation
+    bool execute() override;
+
+    // Undo a flood fill operation
+    bool undo() override;
+
+    // Get seed x coordinate
+    int getPixelX() override;
+
+    // Get seed y coordinate
+    int getPixelY() override;
+
+    // Approximate bytes held
+    std::size_t getByteSize() override;
+
+    // Destructor
+    virtual ~FloodFill();
+};
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ *  @file   HistoryTimeline.hpp
+ *  @brief  Read-only time-lapse of a drawing: keyframes and per-operation tile diffs of the flattened image.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef HISTORYTIMELINE_HPP
+#define HISTORYTIMELINE_HPP
+
+// Include standard library C++ libraries.
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+// Project header files
+#include "Canvas.hpp"
+#include "Metrics.hpp"
+
+// One tile of the flattened image as a frame left it, compressed as in project files
+struct TimelineTile {
+    int tileX;
+    int tileY;
+    // ProjectFile::kRawChunk or kRunChunk
+    std::uint32_t encoding;
+    std::vector<std::uint8_t> data;
+};
+
+// The image after one operation: the tiles it changed, or for a keyframe every tile ever drawn on,
+// the others holding the background. A tile which did not change since an earlier frame is shared
+// with it, so a keyframe costs memory only for the tiles changed in its own operation.
+struct TimelineFrame {
+    // When it was captured, in microseconds on the monotonic clock
+    std::int64_t time = 0;
+    bool keyframe = false;
+    unsigned width = 0;
+    unsigned height = 0;
+    Canvas::Pixel background = 0;
+    std::vector<std::shared_ptr<const TimelineTile>> tiles;
+    // Compressed bytes of the tiles, i.e. what seeking through the frame decodes
+    std::size_t bytes = 0;
+};
+
+// How the drawing evolved, for scrubbing back through it. After each operation the owner hands in
+// the flattened image; the tiles it marks as written are copied (only this runs on the caller's
+// thread), then a background task of the shared ThreadPool keeps those which really changed as the
+// frame's diff, compressed. Every keyframeInterval frames, or sooner once the diffs since the last
+// keyframe outgrow it, a frame holds the whole image instead. seek() therefore decodes one keyframe
+// and at most keyframeInterval diffs, whose size is bounded by the keyframe's, however long the
+// history is. Once the frames hold more than the byte budget, the oldest keyframe and its diffs
+// are dropped, so the first frames are forgotten rather than memory growing with the session.
+// The timeline keeps its own copy of everything, so seeking never touches the live drawing, its
+// layers or anybody's undo history. While the drawing pages its tiles, that copy of the image, and
+// the images exports rebuild, page theirs under the same budget (see enablePaging()).
+//
+// A timeline is owned through a std::shared_ptr, which its background tasks and exports hold too,
+// so it outlives its owner until they finish.
+class HistoryTimeline : public std::enable_shared_from_this<HistoryTimeline> {
+public:
+    // Frames between keyframes
+    static constexpr std::size_t kDefaultKeyframeInterval = 64;
+    // Compressed bytes the frames may hold
+    static constexpr std::uint64_t kDefaultByteBudget = 64 * 1024 * 1024;
+    // Draw segments which make up one frame while a stroke goes on
+    static constexpr int kSegmentsPerFrame = 32;
+
+    // Constructor
+    explicit HistoryTimeline(std::size_t keyframeInterval = kDefaultKeyframeInterval,
+                             std::uint64_t byteBudget = kDefaultByteBudget);
+
+    // Destructor
+    virtual ~HistoryTimeline();
+
+    // Record the image after an operation; false if no tile was written since the last capture
+    bool capture(Canvas &flattened, std::int64_t time);
+
+    // Wait until every capture so far is a frame
+    void wait();
+
+    // Page the image the timeline keeps, and those exports rebuild, out to files in directory within
+    // budget, which the drawing's canvases share; false (with error set) if a file cannot be created
+    bool enablePaging(const std::string &directory, const std::shared_ptr<TileBudget> &budget, std::string &error);
+
+    // Number of frames
+    std::size_t getFrameCount();
+
+    // When a frame was captured
+    std::int64_t getFrameTime(std::size_t frame);
+
+    // The last frame captured at or before time (0 if none was)
+    std::size_t findFrame(std::int64_t time);
+
+    // Rebuild the image of a frame into out; false if there is no such frame
+    bool seek(std::size_t frame, Canvas &out);
+
+    // Write frames first, first + step, ... up to last as <prefix>000000.ppm, <prefix>000001.ppm, ...;
+    // false (with error set) if a frame does not exist, a file cannot be written or another export runs
+    bool exportFrames(std::size_t first, std::size_t last, std::size_t step, const std::string &prefix,
+                      std::string &error);
+
+    // Claim the export for a caller which runs it later, e.g. as a background task; false if another
+    // export runs or is claimed. The claim is given back by exportClaimedFrames() or cancelExport().
+    bool tryBeginExport();
+
+    // exportFrames() under a claim taken with tryBeginExport(), which it gives back when done
+    bool exportClaimedFrames(std::size_t first, std::size_t last, std::size_t step, const std::string &prefix,
+                             std::string &error);
+
+    // Give back a claim taken with tryBeginExport() without exporting
+    void cancelExport();
+
+    // Whether an export is running or claimed
+    bool isExporting() const {
+        return m_exporting.load();
+    }
+
+    // Compressed bytes held by the frames, counting shared tiles once
+    std::uint64_t getByteSize();
+
+    // Most compressed bytes the frames hold before the oldest are dropped
+    std::uint64_t getByteBudget() const {
+        return m_byteBudget;
+    }
+
+private:
+    // Tiles copied from the flattened image by capture(), for the worker
+    struct Capture {
+        std::int64_t time;
+        unsigned width;
+        unsigned height;
+        Canvas::Pixel background;
+        // Whether every tile which is not background is included, e.g. the first capture or after the size changed
+        bool full;
+        // Tile coordinates, and their pixels one after the other, row by row, cut to the image
+        std::vector<std::pair<int, int>> tiles;
+        std::vector<Canvas::Pixel> pixels;
+    };
+
+    // Background task: encode captures until none is queued
+    void drain();
+
+    // Turn a capture into a frame
+    void encode(const Capture &capture);
+
+    // Compress one tile of m_current, making it the tile's latest
+    std::shared_ptr<const TimelineTile> encodeTile(int tileX, int tileY);
+
+    // Drop the oldest keyframe and its diffs while the frames hold more than the budget and a later
+    // keyframe is left; called with m_framesMutex held
+    void trim();
+
+    // exportFrames() once no other export runs
+    bool writeFrames(std::size_t first, std::size_t last, std::size_t step, const std::string &prefix,
+                     std::string &error);
+
+    // Frames from the keyframe at or before frame up to it; empty if there is no such frame
+    std::vector<std::shared_ptr<const TimelineFrame>> framesFor(std::size_t first, std::size_t last);
+
+    // Write a frame's tiles into out, recreating out if the size differs
+    static void applyFrame(const TimelineFrame &frame, Canvas &out);
+
+    std::size_t m_keyframeInterval;
+    std::uint64_t m_byteBudget;
+
+    // The frames; guarded by m_framesMutex
+    std::mutex m_framesMutex;
+    std::vector<std::shared_ptr<const TimelineFrame>> m_frames;
+    std::vector<std::size_t> m_keyframes;
+    std::uint64_t m_bytes;
+
+    // The image as of the last frame, each tile's latest encoding, and what was added since the last
+    // keyframe; the encoding task's own
+    Canvas m_current;
+    std::vector<std::shared_ptr<const TimelineTile>> m_latest;
+    std::size_t m_framesSinceKeyframe;
+    std::size_t m_bytesSinceKeyframe;
+    std::size_t m_keyframeBytes;
+
+    // The caller's side: the size of the last capture and the tiles written since
+    unsigned m_width;
+    unsigned m_height;
+    std::vector<std::uint8_t> m_written;
+
+    // Captures waiting to be encoded, and whether a drain() task is queued or running; guarded by
+    // m_queueMutex
+    std::mutex m_queueMutex;
+    std::condition_variable m_idle;
+    std::deque<std::unique_ptr<Capture>> m_queue;
+    bool m_busy;
+    // Where exports page the images they rebuild, and under which budget (nullptr: they do not);
+    // guarded by m_queueMutex
+    std::string m_pagingDirectory;
+    std::shared_ptr<TileBudget> m_tileBudget;
+
+    // Whether an export runs or is claimed
+    std::atomic<bool> m_exporting;
+
+    // METRICS
+    Counter *m_framesMetric;
+    Counter *m_keyframesMetric;
+    Counter *m_droppedMetric;
+    Gauge *m_bytesMetric;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ *  @file   Latency.hpp
+ *  @brief  Peer clock synchronization and input-to-present latency tracking.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+// Include standard library C++ libraries.
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+// Project header files
+#include "Metrics.hpp"
+
+// Microseconds on this machine's monotonic clock
+std::int64_t monotonicMicros();
+
+// Estimates the offset between this peer's monotonic clock and the server's from NTP-style
+// request/reply exchanges. Of the recent exchanges, the one with the shortest round trip is
+// trusted, since it had the least room for queuing delay to skew the estimate.
+class PeerClock {
+public:
+    // How many recent exchanges are considered
+    static constexpr int kWindow = 8;
+
+    // Constructor
+    PeerClock();
+
+    // Add one exchange: t0 request sent and t3 reply received on this clock, t1 request
+    // received and t2 reply sent on the server's clock
+    void addSample(std::int64_t t0, std::int64_t t1, std::int64_t t2, std::int64_t t3);
+
+    // Server clock minus local clock, in microseconds
+    std::int64_t getOffset() const;
+
+    // Round trip of the exchange the offset came from, in microseconds
+    std::int64_t getRoundTrip() const;
+
+    // Whether at least one exchange has completed
+    bool isSynchronized() const;
+
+    // Convert a local timestamp to the server's clock
+    std::int64_t toServerTime(std::int64_t local) const;
+
+    // Convert a server timestamp to the local clock
+    std::int64_t toLocalTime(std::int64_t server) const;
+
+private:
+    std::int64_t m_offsets[kWindow];
+    std::int64_t m_roundTrips[kWindow];
+    int m_samples;
+    std::int64_t m_offset;
+    std::int64_t m_roundTrip;
+};
+
+// Follows stroke samples from capture to the frame that presents them. Samples are marked when
+// they are applied to the canvas and resolved at the next presented frame, recording the
+// input-to-present latency into separate histograms for local and remote input.
+class LatencyTracker {
+public:
+    // Constructor
+    LatencyTracker();
+
+    // A sample captured at captureLocalUs (on this machine's clock) was applied to the canvas
+    void applied(std::int64_t captureLocalUs, bool remote);
+
+    // A frame was presented at presentLocalUs; resolves every sample applied before it
+    void presented(std::int64_t presentLocalUs);
+
+    // One-line summary of both histograms
+    std::string summary() const;
+
+private:
+    std::vector<std::pair<std::int64_t, bool>> m_pending;
+    Histogram *m_local;
+    Histogram *m_remote;
+};
+
+#endif
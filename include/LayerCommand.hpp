@@ -0,0 +1,69 @@
+/**
+ *  @file   LayerCommand.hpp
+ *  @brief  Layer changes (add, reorder, opacity, blend mode) as undoable commands.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef LAYERCOMMAND_HPP
+#define LAYERCOMMAND_HPP
+
+// Project header files
+#include "Command.hpp"
+#include "PaintCore.hpp"
+
+// One change to the layer stack. The command keeps only the layer id and the values before and
+// after the change, never pixels: an added layer is taken out of the stack on undo with its
+// contents intact, and put back on redo.
+class LayerCommand : public Command {
+public:
+    // What the command changes; the numbers are what travels in a layer message's x field
+    enum class Kind {
+        Add = 0,
+        Move = 1,
+        Opacity = 2,
+        Blend = 3
+    };
+
+private:
+    // PaintCore to operate upon
+    PaintCore *minipaint;
+
+    // What is changed
+    Kind m_kind;
+
+    // Id of the layer changed
+    int m_layer;
+
+    // New value: the position for an add or a move, the opacity, or the blend mode
+    int m_value;
+
+    // Value before the first execute, restored by undo
+    int m_previous;
+
+    // Whether the command has executed once
+    bool recorded;
+
+public:
+    // Constructor for a change of one layer
+    LayerCommand(PaintCore *app, Kind kind, int layer, int value);
+
+    // Apply the change
+    bool execute() override;
+
+    // Revert the change
+    bool undo() override;
+
+    // Layer commands have no pixel position; returns 0
+    int getPixelX() override;
+
+    // Layer commands have no pixel position; returns 0
+    int getPixelY() override;
+
+    // Approximate bytes held
+    std::size_t getByteSize() override;
+
+    // Destructor
+    virtual ~LayerCommand();
+};
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ *  @file   LayerStack.hpp
+ *  @brief  The drawing's layers, each with its own pixels and stroke store, and their cached flattened image.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef LAYERSTACK_HPP
+#define LAYERSTACK_HPP
+
+// Include standard library C++ libraries.
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+// Project header files
+#include "BlendKernels.hpp"
+#include "Canvas.hpp"
+#include "Metrics.hpp"
+#include "StrokeStore.hpp"
+#include "ThreadPool.hpp"
+
+// Layers from bottom to top. Each layer has its own canvas and the stroke store it is rebuilt from,
+// a blend mode and an opacity. The base layer starts filled with the canvas color; layers added
+// later start transparent. Layers are identified by ids that every peer agrees on, not by their
+// position. A layer taken out of the stack (e.g. an undone add) keeps its pixels and operations,
+// so putting it back costs nothing.
+//
+// flatten() keeps a flattened image of the stack up to date, tile by tile: only the tiles written
+// on some layer since the last flatten, or under a layer whose opacity, blend mode or position
+// changed, are composited again. A tile is composited from the layers that have ever been painted
+// there, so an empty layer costs nothing. The tiles written are also marked unsaved on their
+// layer, for an autosave to pick up.
+//
+// With paging on, the layers' canvases keep their tiles in memory within one budget, which they
+// share with the flattened image, and page the rest out. flatten() is where the tiles beyond it
+// leave: it composites bands of tile rows small enough for what they bring in to fit, and trims the
+// layers and the flattened image after each.
+class LayerStack {
+public:
+    // Id of the layer every drawing starts with
+    static constexpr int kBaseLayer = 0;
+
+    struct Layer {
+        int id;
+        Canvas canvas;
+        StrokeStore strokes;
+        // What the layer's tiles are rebuilt from: the canvas color for the base layer, else transparent
+        Canvas::Pixel background;
+        BlendMode blend;
+        std::uint8_t opacity;
+        // Whether the layer is in the stack
+        bool attached;
+        // Tiles which have been painted on this layer, one byte per tile
+        std::vector<std::uint8_t> painted;
+        // Tiles written since the last autosave took them, one byte per tile
+        std::vector<std::uint8_t> unsaved;
+    };
+
+    // Constructor
+    LayerStack();
+
+    // Start over with just the base layer, filled with background
+    void create(unsigned width, unsigned height, Canvas::Pixel background);
+
+    // The layer with an id, attached or not, or nullptr
+    Layer *find(int id);
+
+    // Position of a layer from the bottom, or -1 if it is not in the stack
+    int indexOf(int id) const;
+
+    // Layer at a position from the bottom
+    Layer &at(std::size_t position) {
+        return *m_order[position];
+    }
+
+    // Number of layers in the stack
+    std::size_t size() const {
+        return m_order.size();
+    }
+
+    // Number of layers ever created, in the stack or not
+    std::size_t createdCount() const {
+        return m_layers.size();
+    }
+
+    // Layer created index-th, in the stack or not
+    Layer &created(std::size_t index) {
+        return *m_layers[index];
+    }
+
+    // Put a layer into the stack at a position, creating it (transparent) if the id is new;
+    // false if it is already in the stack
+    bool insert(int id, std::size_t position);
+
+    // Take a layer out of the stack, keeping its contents; false if it is not in the stack
+    bool remove(int id);
+
+    // Move a layer to another position; false if it is not in the stack
+    bool move(int id, std::size_t position);
+
+    // Change a layer's opacity; false if there is no such layer
+    bool setOpacity(int id, std::uint8_t opacity);
+
+    // Change a layer's blend mode; false if there is no such layer
+    bool setBlendMode(int id, BlendMode mode);
+
+    // Rebuild the tiles of every layer's canvas marked for repair; returns the number of tiles rebuilt
+    std::size_t repair();
+
+    // Bake and drop the operations no command can change any more; returns the number dropped
+    std::size_t compact();
+
+    // End every open stroke on every layer, so that later segments start new ones
+    void closeStrokes();
+
+    // Composite the tiles which changed into out (resized to the layers if needed); returns the
+    // number of tiles composited
+    std::size_t flatten(Canvas &out, ThreadPool &pool);
+
+    // Composite every tile again on the next flatten
+    void invalidate();
+
+    // Approximate bytes held by the layers' pixels and operations
+    std::size_t getByteSize() const;
+
+    // Page the tiles of every layer, now and created later, out to files in directory, keeping those
+    // in memory within budget; false (with error set) if a file cannot be created
+    bool setPaging(const std::string &directory, const std::shared_ptr<TileBudget> &budget, std::string &error);
+
+    // The budget the layers page under, or nullptr if paging is off
+    const std::shared_ptr<TileBudget> &getTileBudget() const {
+        return m_tileBudget;
+    }
+
+    // Where the layers page their tiles to
+    const std::string &getPagingDirectory() const {
+        return m_pagingDirectory;
+    }
+
+    // Number of times the layers were created afresh; changes whenever every layer is replaced
+    std::uint64_t getGeneration() const {
+        return m_generation;
+    }
+
+private:
+    // Mark the tiles painted on a layer for compositing
+    void invalidate(const Layer &layer);
+
+    // Have a new layer's canvas page, if paging is on
+    void page(Canvas &canvas);
+
+    // Page out what every layer and out hold beyond their budgets
+    void trimTiles(Canvas &out);
+
+    // Every layer ever created, in creation order
+    std::vector<std::unique_ptr<Layer>> m_layers;
+    // The stack, bottom first
+    std::vector<Layer *> m_order;
+    // Tiles to composite on the next flatten, one byte per tile
+    std::vector<std::uint8_t> m_dirty;
+    // Opaque color under every layer
+    Canvas::Pixel m_backdrop;
+    unsigned m_width;
+    unsigned m_height;
+    std::uint64_t m_generation;
+    // Where layers page their tiles to, and the budget they share (nullptr: paging is off)
+    std::string m_pagingDirectory;
+    std::shared_ptr<TileBudget> m_tileBudget;
+
+    // METRICS
+    Counter *m_tilesComposited;
+    Gauge *m_layerCount;
+};
+
+#endif
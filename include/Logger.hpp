@@ -0,0 +1,167 @@
+/**
+ *  @file   Logger.hpp
+ *  @brief  Leveled, asynchronous logger. Messages are queued in a lock-free ring buffer and
+ *          written by a background thread so that hot paths never block on the terminal.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+// Include standard library C++ libraries.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+// Project header files
+#include "Metrics.hpp"
+
+// Severity of a log message, from most to least verbose
+enum class LogLevel {
+    Trace = 0,
+    Debug = 1,
+    Info = 2,
+    Warn = 3,
+    Error = 4,
+    Off = 5
+};
+
+// Messages below this level are compiled out entirely, e.g. -DPAINT_LOG_MIN_LEVEL=2 removes
+// every LOG_TRACE and LOG_DEBUG statement from the build.
+#ifndef PAINT_LOG_MIN_LEVEL
+#define PAINT_LOG_MIN_LEVEL 0
+#endif
+
+// Log a message built with stream syntax, e.g. LOG_DEBUG("sending data to " << port).
+// The message is only formatted if its level passes both the compile-time and the runtime
+// level, and each call site is rate limited so a message repeated in a tight loop cannot
+// flood the output.
+#define LOG_AT(level, message)                                                              \
+    do {                                                                                    \
+        if (static_cast<int>(level) >= PAINT_LOG_MIN_LEVEL && Logger::Get().isEnabled(level)) { \
+            static LogRateLimiter logRateLimiter_;                                          \
+            std::uint64_t logSuppressed_ = 0;                                               \
+            if (logRateLimiter_.allow(logSuppressed_)) {                                    \
+                std::ostringstream &logStream_ = Logger::beginMessage();                    \
+                logStream_ << message;                                                      \
+                Logger::Get().submit(level, logStream_, logSuppressed_);                    \
+            }                                                                               \
+        }                                                                                   \
+    } while (0)
+
+#define LOG_TRACE(message) LOG_AT(LogLevel::Trace, message)
+#define LOG_DEBUG(message) LOG_AT(LogLevel::Debug, message)
+#define LOG_INFO(message) LOG_AT(LogLevel::Info, message)
+#define LOG_WARN(message) LOG_AT(LogLevel::Warn, message)
+#define LOG_ERROR(message) LOG_AT(LogLevel::Error, message)
+
+// Per call site limiter: lets up to kBurst messages through per one-second window and counts
+// the rest, so the next message that gets through can report how many were dropped.
+class LogRateLimiter {
+public:
+    static constexpr std::uint32_t kBurst = 20;
+    static constexpr std::int64_t kWindowMs = 1000;
+
+    // Constructor
+    LogRateLimiter();
+
+    // Whether the message may be logged. When it may, suppressed receives the number of
+    // messages dropped at this call site since the last one that was logged.
+    bool allow(std::uint64_t &suppressed);
+
+private:
+    std::atomic<std::int64_t> m_windowStart;
+    std::atomic<std::uint32_t> m_inWindow;
+    std::atomic<std::uint64_t> m_suppressed;
+};
+
+class Logger {
+public:
+    // Longest message kept; longer messages are truncated
+    static constexpr std::size_t kMaxMessage = 240;
+    // Number of messages the ring buffer holds (a power of two)
+    static constexpr std::size_t kCapacity = 4096;
+
+    // Process-wide logger. It is never destroyed; an exit handler drains it instead.
+    static Logger &Get();
+
+    // Thread-local stream to format the next message into
+    static std::ostringstream &beginMessage();
+
+    // Name of a level, e.g. "INFO"
+    static const char *levelName(LogLevel level);
+
+    // Parse a level name (case-insensitive); returns fallback if unknown
+    static LogLevel parseLevel(const std::string &name, LogLevel fallback);
+
+    // Whether messages at this level are currently logged
+    bool isEnabled(LogLevel level) const {
+        return static_cast<int>(level) >= m_level.load(std::memory_order_relaxed);
+    }
+
+    // Change the runtime level
+    void setLevel(LogLevel level);
+
+    // Get the runtime level
+    LogLevel getLevel() const;
+
+    // Queue a formatted message. Never blocks: if the ring is full the message is dropped.
+    void submit(LogLevel level, std::ostringstream &message, std::uint64_t suppressed);
+
+    // Queue a message
+    void submit(LogLevel level, const std::string &message, std::uint64_t suppressed = 0);
+
+    // Send output somewhere other than std::cout (nullptr restores std::cout)
+    void setOutput(std::ostream *out);
+
+    // Block until every message queued so far has been written
+    void flush();
+
+    // Drain the queue and stop the writer thread
+    void shutdown();
+
+private:
+    // One ring slot. The sequence number tells producers and the consumer whose turn it is.
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        LogLevel level;
+        std::int64_t timeUs;
+        std::uint64_t suppressed;
+        std::uint32_t length;
+        char text[kMaxMessage];
+    };
+
+    Logger();
+
+    // Claim a slot and copy the message in; false if the ring is full
+    bool enqueue(LogLevel level, const char *text, std::size_t length, std::uint64_t suppressed);
+
+    // Write every queued message to the output; returns how many were written
+    std::size_t drain();
+
+    // Writer thread main loop
+    void run();
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<std::size_t> m_enqueuePos;
+    std::atomic<std::size_t> m_dequeuePos;
+    std::atomic<int> m_level;
+    std::atomic<bool> m_running;
+    std::chrono::steady_clock::time_point m_epoch;
+    // Held only by the writer while draining, and by setOutput()/flush()
+    std::mutex m_outputMutex;
+    std::ostream *m_out;
+    std::thread m_thread;
+
+    // METRICS
+    Gauge *m_queueDepth;
+    Counter *m_dropped;
+    Counter *m_suppressed;
+};
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ *  @file   Metrics.hpp
+ *  @brief  Process-wide counters, gauges and histograms, plus a background stats reporter.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+// Include standard library C++ libraries.
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Monotonically increasing count, e.g. packets received
+class Counter {
+public:
+    // Constructor
+    Counter();
+
+    // Add n to the counter
+    void increment(std::uint64_t n = 1) {
+        m_value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // Current value
+    std::uint64_t get() const {
+        return m_value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> m_value;
+};
+
+// Value that can go up and down, e.g. number of connected clients
+class Gauge {
+public:
+    // Constructor
+    Gauge();
+
+    // Replace the value
+    void set(std::int64_t value) {
+        m_value.store(value, std::memory_order_relaxed);
+    }
+
+    // Add (or subtract, with a negative delta) from the value
+    void add(std::int64_t delta) {
+        m_value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    // Current value
+    std::int64_t get() const {
+        return m_value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::int64_t> m_value;
+};
+
+// Distribution of non-negative values (typically microseconds) in log-linear buckets, in the
+// style of HdrHistogram: each power of two is split into kSubBuckets equal buckets, which keeps
+// the relative error of any reported percentile under 1 / kSubBuckets.
+class Histogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    // Constructor
+    Histogram();
+
+    // Record one value
+    void record(std::uint64_t value);
+
+    // Number of recorded values
+    std::uint64_t count() const;
+
+    // Mean of the recorded values
+    double mean() const;
+
+    // Largest recorded value
+    std::uint64_t max() const;
+
+    // Value at or below which the given fraction (0..1) of samples fall, to bucket precision
+    std::uint64_t percentile(double fraction) const;
+
+    // Forget all recorded values
+    void reset();
+
+    // Index of the bucket holding a value
+    static int bucketIndex(std::uint64_t value);
+
+    // Largest value which falls into a bucket
+    static std::uint64_t bucketUpperBound(int index);
+
+private:
+    std::atomic<std::uint64_t> m_counts[kBuckets];
+    std::atomic<std::uint64_t> m_count;
+    std::atomic<std::uint64_t> m_sum;
+    std::atomic<std::uint64_t> m_max;
+};
+
+// Owns every metric in the process. Looking a metric up takes a lock, so components look their
+// metrics up once (usually in a constructor) and keep the reference; updating a metric is a
+// single relaxed atomic operation.
+class MetricsRegistry {
+public:
+    // Process-wide registry. It is never destroyed, so cached references stay valid during exit.
+    static MetricsRegistry &Get();
+
+    // Find or create a counter
+    Counter &counter(const std::string &name);
+
+    // Find or create a gauge
+    Gauge &gauge(const std::string &name);
+
+    // Find or create a histogram
+    Histogram &histogram(const std::string &name);
+
+    // All metrics as "name value" lines, sorted by name. Histograms expand into
+    // name.count, name.mean, name.p50, name.p90, name.p99 and name.max.
+    std::string format();
+
+private:
+    MetricsRegistry();
+
+    std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<Counter>> m_counters;
+    std::map<std::string, std::unique_ptr<Gauge>> m_gauges;
+    std::map<std::string, std::unique_ptr<Histogram>> m_histograms;
+};
+
+// Background thread which periodically writes MetricsRegistry::format() to a text file
+// and/or answers connections on a local Unix socket with the same text.
+class StatsReporter {
+public:
+    // Constructor
+    StatsReporter();
+
+    // Destructor stops the reporter thread
+    virtual ~StatsReporter();
+
+    // Start reporting. Either path may be empty to disable that output.
+    // Returns 0 on success, 1 if the socket could not be opened.
+    int start(const std::string &filePath, const std::string &socketPath, int intervalMs);
+
+    // Stop reporting and join the thread
+    void stop();
+
+    // Write the current stats to the file immediately
+    bool writeFile();
+
+private:
+    // Reporter thread main loop
+    void run();
+
+    // Open and bind the Unix socket
+    int openSocket();
+
+    std::string m_filePath;
+    std::string m_socketPath;
+    int m_intervalMs;
+    int m_socket;
+    bool m_running;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,114 @@
+/**
+ *  @file   OpLog.hpp
+ *  @brief  Durable append-only log of the operations the server relays, written with group commit.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef OPLOG_HPP
+#define OPLOG_HPP
+
+// Include standard library C++ libraries.
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+// Project header files
+#include "Metrics.hpp"
+
+// The server's history of operations, in the order it relays them. append() only copies a record
+// into memory; the log's own flusher thread lets records gather for one flush interval, or until
+// flushBytes are pending, then writes them with one write() and makes them durable with one
+// fdatasync(), so the cost of durability is paid per batch rather than per packet (group commit).
+// Each record is framed with its size, a sequence number and a CRC-32, so replay() stops cleanly at
+// a record torn by a crash. The log is split into segments of about segmentBytes, <prefix>.000000,
+// <prefix>.000001, ...; a segment is only ever appended to by the log which created it, so
+// reopening a log starts a new segment.
+class OpLog {
+public:
+    // "CPOL" read as a little-endian integer
+    static constexpr std::uint32_t kRecordMagic = 0x4C4F5043;
+    // Bytes before each record's payload: magic, size, sequence number and checksum
+    static constexpr std::size_t kFrameBytes = 20;
+
+    struct Options {
+        // How long appended records may wait to be written
+        std::chrono::milliseconds flushInterval{10};
+        // Pending bytes which are written at once, without waiting for the interval to pass
+        std::size_t flushBytes = 1024 * 1024;
+        // Segment size after which the next segment is started
+        std::uint64_t segmentBytes = 64 * 1024 * 1024;
+        // Whether each flush waits for the disk (fdatasync) or only hands the bytes to the OS
+        bool durable = true;
+    };
+
+    // A record read back by replay()
+    using Visitor = std::function<void(std::uint64_t sequence, const std::uint8_t *data, std::size_t size)>;
+
+    // Open a log at prefix, continuing the sequence numbers of its existing segments
+    OpLog(const std::string &prefix, const Options &options);
+
+    // Destructor stops the flusher, which writes what is still pending
+    virtual ~OpLog();
+
+    // Append a record; returns its sequence number. It is durable once getDurableSequence() reaches it.
+    std::uint64_t append(const void *data, std::size_t size);
+
+    // Write and sync everything appended so far, now; false if it could not be written
+    bool flush();
+
+    // Sequence number of the last record written (and synced, if durable); 0 before any
+    std::uint64_t getDurableSequence() const {
+        return m_durable;
+    }
+
+    // Sequence number the next append will get
+    std::uint64_t getNextSequence();
+
+    // Read every intact record of the log at prefix, oldest first; returns the number of records
+    static std::uint64_t replay(const std::string &prefix, const Visitor &visit);
+
+    // Path of a segment of the log at prefix
+    static std::string segmentPath(const std::string &prefix, std::uint32_t segment);
+
+private:
+    // Write out a batch and sync it; called with m_writeMutex held
+    bool writeBatch(const std::vector<std::uint8_t> &batch, std::uint64_t lastSequence);
+
+    // Open the next segment
+    bool openSegment();
+
+    // Body of the flusher thread
+    void run();
+
+    std::string m_prefix;
+    Options m_options;
+    // Records appended since the last flush, framed; guarded by m_appendMutex
+    std::mutex m_appendMutex;
+    std::vector<std::uint8_t> m_pending;
+    std::uint64_t m_nextSequence;
+    // The open segment; guarded by m_writeMutex, which one flush holds at a time
+    std::mutex m_writeMutex;
+    int m_fd;
+    std::uint32_t m_segment;
+    std::uint64_t m_segmentBytes;
+    std::atomic<std::uint64_t> m_durable;
+    // The flusher thread, woken by the first record of a batch and by a batch reaching flushBytes
+    std::condition_variable m_wake;
+    bool m_stopping;
+    std::thread m_flusher;
+
+    // METRICS
+    Counter *m_records;
+    Counter *m_bytes;
+    Counter *m_flushes;
+    Counter *m_errors;
+    Gauge *m_flushTime;
+    Gauge *m_segments;
+};
+
+#endif
@@ -59,4 +59,82 @@ public:
     }
 };
 
+// The decoded contents of a packet. Every packet starts with the same five integers
+// (command, x, y, color, size); fields added later are appended after them, so a reader
+// which does not know about a field simply leaves it unread.
+struct PaintMessage {
+    /*!
+     * Largest brush size the UI offers. Sizes of received draw messages are clamped to it, and
+     * flood fill tolerances to 0-255, so a peer cannot make everyone paint an arbitrarily large brush.
+     */
+    static constexpr int kMaxBrushSize = 64;
+
+    /*!
+     * What to do: 0 join / clock sync (in the server's reply x and y are the canvas's width and
+     * height), 1 draw, 2 end of stroke, 3 undo, 4 redo, 5 fill, 6 leave, 7 flood fill the region
+     * around (x, y), 8 layer change (x is the LayerCommand::Kind, y the layer id and color the new
+     * value).
+     */
+    int command = 0;
+
+    /*!
+     * Canvas x-coordinate.
+     */
+    int x = 0;
+
+    /*!
+     * Canvas y-coordinate.
+     */
+    int y = 0;
+
+    /*!
+     * Color as returned by sf::Color::toInteger().
+     */
+    int color = 0;
+
+    /*!
+     * Brush size, or for a flood fill the color tolerance (0 = exact match).
+     */
+    int size = 0;
+
+    /*!
+     * When the input behind this message was captured, in microseconds on the server's clock
+     * (0 if unknown). For a clock sync request it is the sender's local send time instead.
+     */
+    sf::Int64 stamp = 0;
+
+    /*!
+     * Previous sample of the same stroke for a draw message, or -1 when this sample starts the stroke.
+     * Receivers paint the whole segment from (fromX, fromY) to (x, y), so a stroke stays continuous
+     * however sparse its samples are. Older peers ignore these fields and paint just the dab at (x, y).
+     */
+    int fromX = -1;
+    int fromY = -1;
+
+    /*!
+     * Id of the client whose action this is, or -1 if the sender did not say. Undo and redo only
+     * apply to the actions of the client who sends them.
+     */
+    int client = -1;
+
+    /*!
+     * Id of the layer a draw, fill or flood fill paints on. Older peers leave it out and paint on the
+     * base layer (0).
+     */
+    int layer = 0;
+
+    /*!
+     * Brush of a draw message, as BrushTip::pack() gives it. Older peers leave it out (0), which is
+     * the square brush.
+     */
+    int brush = 0;
+};
+
+// Write a message into a packet
+sf::Packet &operator<<(sf::Packet &packet, const PaintMessage &message);
+
+// Read a message from a packet; fields missing from the packet keep their defaults, and the brush size
+// or tolerance is clamped to what the UI can send
+sf::Packet &operator>>(sf::Packet &packet, PaintMessage &message);
+
 #endif
@@ -0,0 +1,344 @@
+/**
+ *  @file   PaintCore.hpp
+ *  @brief  The drawing and its shared undo history, without any window.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef PAINTCORE_HPP
+#define PAINTCORE_HPP
+
+// Include our Third-Party SFML header
+#include <SFML/Graphics/Color.hpp>
+// Include standard library C++ libraries.
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+// Project header files
+#include "Canvas.hpp"
+#include "Command.hpp"
+#include "LayerStack.hpp"
+#include "Metrics.hpp"
+#include "StrokeStore.hpp"
+
+class AutosaveJournal;
+class HistoryTimeline;
+struct PaintMessage;
+struct ProjectSnapshot;
+
+// Everything a paint session needs apart from windows: the layers, each with the stroke store it is
+// built from, their flattened image, the current brush, and each client's undo and redo history.
+// Commands act on a PaintCore, so the drawing engine runs the same in the GUI (App), in tests and on
+// a display-less server.
+class PaintCore {
+private:
+// Member variables
+    // The commands of one user action, e.g. a brush stroke. The PaintCore owns them.
+    struct Action {
+        std::vector<Command *> commands;
+        // When the action entered the history, counted across all clients
+        std::uint64_t sequence;
+        // Approximate bytes held by the commands
+        std::size_t bytes;
+    };
+    // Undo and redo history of one client in the session.
+    struct ClientHistory {
+        // Stack stores the next commands to redo.
+        std::vector<Action> redo;
+        // Stack that stores the last actions to occur, oldest first.
+        std::vector<Action> undo;
+        // Commands of the client's stroke in progress. The local client's are in m_paintedPixels.
+        std::vector<Command *> pending;
+        // Approximate bytes held by the commands on the undo and redo stacks.
+        std::size_t undoBytes = 0;
+        std::size_t redoBytes = 0;
+    };
+    /*!
+     * History of every client, keyed by the client id carried in its packets. Each user undoes and
+     * redoes only their own actions; the canvas is rebuilt around them from the stroke store.
+     */
+    std::map<int, ClientHistory> m_histories;
+    /*!
+     * Client id of the local user.
+     */
+    int m_localClient;
+    /*!
+     * Sequence number of the next action added to a history.
+     */
+    std::uint64_t m_nextSequence;
+    /*!
+     * Most bytes the undo and redo stacks of all clients may hold (0 = no limit). The oldest actions
+     * are dropped beyond it and can no longer be undone.
+     */
+    std::size_t m_historyBudget;
+    /*!
+     * The flattened image of the layers, as shown. Only flattening writes here.
+     */
+    Canvas *m_surface;
+    /*!
+     * The layers. Paint operations write to one layer's canvas and are kept in its stroke store, which
+     * undo and redo rebuild the canvas from.
+     */
+    LayerStack m_layers;
+    /*!
+     * Layer the local user paints on.
+     */
+    int m_activeLayer;
+    /*!
+     * Number of layers the local user has created, for making up layer ids.
+     */
+    int m_createdLayers;
+
+    /*!
+     * History metrics, registered with the MetricsRegistry in the constructor.
+     */
+    Gauge *m_undoDepthMetric;
+    Gauge *m_redoDepthMetric;
+    Gauge *m_strokeDepthMetric;
+    Gauge *m_historyBytesMetric;
+    /*!
+     * Save and load metrics: time the caller spends copying a snapshot, and time to load a file.
+     */
+    Gauge *m_saveCaptureMetric;
+    Gauge *m_loadTimeMetric;
+    /*!
+     * Outcome of the last save, which runs in the background.
+     */
+    std::shared_future<bool> m_lastSave;
+    /*!
+     * Incremental autosave, if enabled: the journal, how often to checkpoint and when it last did.
+     */
+    std::unique_ptr<AutosaveJournal> m_autosave;
+    std::chrono::milliseconds m_autosaveInterval;
+    std::chrono::steady_clock::time_point m_lastAutosave;
+    Gauge *m_autosaveCaptureMetric;
+    /*!
+     * Time-lapse of the drawing, if enabled, and the draw segments applied since its last frame.
+     */
+    std::shared_ptr<HistoryTimeline> m_timeline;
+    int m_timelineSegments;
+
+// Member functions
+    // Publish the current undo/redo depth and history size
+    void UpdateHistoryMetrics();
+
+    // Add a frame to the timeline, if it is on, after an operation with the given command
+    void RecordTimeline(int command);
+
+    // Commands of a client's stroke in progress
+    std::vector<Command *> &PendingCommands(int client);
+
+    // Add an action to a client's undo stack, drop its redo stack, and keep within the budget
+    void PushAction(ClientHistory &history, std::vector<Command *> &commands);
+
+    // Delete the commands of every action on a stack and empty it
+    void ReleaseActions(std::vector<Action> &actions);
+
+    // Drop the oldest undo actions until the history fits its budget
+    void EnforceHistoryBudget();
+
+    // Delete every client's history and stroke in progress
+    void ClearHistory();
+
+    // Replace the drawing with a snapshot, starting a new history; false (with error set) if it is unusable
+    bool RestoreSnapshot(const ProjectSnapshot &snapshot, std::string &error);
+
+public:
+// Member Variables
+    // Default canvas size
+    static constexpr unsigned kCanvasWidth = 1000;
+    static constexpr unsigned kCanvasHeight = 850;
+
+    /*!
+     * Mouse x-coordinate.
+     */
+    unsigned int mouseX;
+
+    /*!
+     * Mouse y-coordinate.
+     */
+    unsigned int mouseY;
+
+    /*!
+    * Current paintbrush size (radius)
+    */
+    int strokeSize;
+
+    /*!
+    * Brush the brush engine paints with, and its hardness and opacity
+    */
+    BrushTip brushTip;
+
+    /*!
+     * Paint function pointer, which is a pointer to a function that edits the canvas.
+     */
+    std::map<std::pair<int, int>, sf::Color> (*m_paintFunc)(PaintCore *, sf::Color color, int size, int m_x, int m_y);
+
+    /*!
+     * Background color of the canvas.
+     */
+    sf::Color m_canvas;
+
+    /*!
+     * Current paint color.
+     */
+    sf::Color m_color;
+    // Pixels that the user has painted in the current brush stroke
+    std::vector<Command *> m_paintedPixels;
+
+// Member functions
+    // Constructor
+    PaintCore();
+
+    // Create the canvas
+    void InitCanvas(unsigned width = kCanvasWidth, unsigned height = kCanvasHeight);
+
+    // Add a command to stack
+    void AddCommand();
+
+    // Add a client's stroke in progress to its undo stack
+    void AddCommand(int client);
+
+    // Undo a command
+    void UndoCommand();
+
+    // Undo a client's last action
+    void UndoCommand(int client);
+
+    // Redo a command
+    void RedoCommand();
+
+    // Redo a client's last undone action
+    void RedoCommand(int client);
+
+    // Set the client id of the local user
+    void SetLocalClient(int client);
+
+    // Get the client id of the local user
+    int GetLocalClient();
+
+    // Set the most bytes the undo and redo history may hold (0 = no limit)
+    void SetHistoryBudget(std::size_t bytes);
+
+    // Get the approximate bytes held by the undo and redo history of all clients
+    std::size_t GetHistoryBytes();
+
+    // Get the canvas of the layer the local user paints on
+    Canvas &GetCanvas();
+
+    // Get the canvas of a layer (the base layer's if there is no such layer)
+    Canvas &GetCanvas(int layer);
+
+    // Get the store of operations the active layer's canvas is built from
+    StrokeStore &GetStrokeStore();
+
+    // Get the store of operations a layer's canvas is built from
+    StrokeStore &GetStrokeStore(int layer);
+
+    // Get the layers
+    LayerStack &GetLayers();
+
+    // Composite the layers where they changed and get the flattened image
+    Canvas &GetFlattened();
+
+    // Choose the layer the local user paints on
+    void SelectLayer(int layer);
+
+    // Get the layer the local user paints on
+    int GetActiveLayer();
+
+    // Make up an id, unique across the session, for a layer the local user creates; -1 if none is free
+    int NewLayerId();
+
+    // Color the eraser paints with on the active layer
+    sf::Color EraserColor();
+
+    // Execute individual pixel command
+    void ExecuteCommand(Command *command);
+
+    // Execute a pixel command as part of a client's stroke in progress
+    void ExecuteCommand(Command *command, int client);
+
+    // Fill display with one color command
+    void FillDisplay(Command *command);
+
+    // Fill display with one color (or flood fill a region) on behalf of a client
+    void FillDisplay(Command *command, int client);
+
+    // Execute a command which is a whole user action by itself, e.g. a layer change, on behalf of a client
+    void ExecuteAction(Command *command, int client);
+
+    // Apply an operation received from a peer or read back from a log, on behalf of the client it names
+    void ApplyMessage(const PaintMessage &message);
+
+    // Update paintbrush function
+    void UpdatePaintbrush(
+            std::map<std::pair<int, int>, sf::Color> (*paintFunction)(PaintCore *, sf::Color, int size, int m_x, int m_y));
+
+    // Paint with one of the brush engine's brushes instead of a paint function
+    void UpdatePaintbrush(const BrushTip &brush);
+
+    // Get current color
+    int getColor();
+
+    // Save the drawing to a project file in the background; the future tells whether it was written
+    std::shared_future<bool> SaveProject(const std::string &path);
+
+    // Replace the drawing with a project file, starting a new history; false (with error set) if it cannot be read
+    bool LoadProject(const std::string &path, std::string &error);
+
+    // Autosave to a journal over the base file at path, every interval (0: only when Autosave() is called)
+    void EnableAutosave(const std::string &path, std::chrono::milliseconds interval);
+
+    // The autosave journal, or nullptr if autosave is off
+    AutosaveJournal *GetAutosave() {
+        return m_autosave.get();
+    }
+
+    // Checkpoint the tiles changed since the last autosave; false if autosave is off or still writing
+    bool Autosave();
+
+    // Autosave if the interval has passed since the last checkpoint
+    bool AutosaveIfDue();
+
+    // Replace the drawing with what the autosave files hold; false (with error set) if there is nothing usable
+    bool RecoverAutosave(std::string &error);
+
+    // Keep a time-lapse of the drawing with a keyframe every keyframeInterval frames, in at most about
+    // byteBudget compressed bytes
+    void EnableTimeline(std::size_t keyframeInterval, std::uint64_t byteBudget);
+
+    // The time-lapse, or nullptr if it is off; hold on to it for work which may outlast Destroy()
+    std::shared_ptr<HistoryTimeline> GetTimeline() {
+        return m_timeline;
+    }
+
+    // Page the tiles of the layers, the flattened image and the time-lapse out to files in directory,
+    // keeping about bytes of them in memory in all; false (with error set) if a file cannot be created
+    bool EnableTilePaging(const std::string &directory, std::size_t bytes, std::string &error);
+
+    // Apply every operation in the op log at prefix, in order; returns the number applied
+    std::uint64_t ReplayOpLog(const std::string &prefix);
+
+    // Release the history and the canvas; calling it again does nothing
+    virtual void Destroy();
+
+    // Destructor releases what Destroy() has not
+    virtual ~PaintCore();
+};
+
+// Canvas pixel holding an SFML color
+inline Canvas::Pixel pixelFromColor(const sf::Color &color) {
+    return Canvas::fromRGBA(color.toInteger());
+}
+
+// SFML color of a canvas pixel
+inline sf::Color colorFromPixel(Canvas::Pixel pixel) {
+    return sf::Color(Canvas::toRGBA(pixel));
+}
+
+#endif
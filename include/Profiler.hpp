@@ -0,0 +1,126 @@
+/**
+ *  @file   Profiler.hpp
+ *  @brief  Scoped timing zones recorded per thread and exported as Chrome trace events.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+// Include standard library C++ libraries.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The zone macros only record anything when the build defines PAINT_PROFILING
+// (cmake -DPAINT_ENABLE_PROFILING=ON). Otherwise they expand to nothing, so the
+// instrumented hot paths pay no cost at all.
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef PAINT_PROFILING
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(profileZone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD_NAME(name) Profiler::Get().setThreadName(name)
+#define PROFILE_FLUSH() Profiler::Get().flush()
+#else
+#define PROFILE_ZONE(name) ((void) 0)
+#define PROFILE_FUNCTION() ((void) 0)
+#define PROFILE_THREAD_NAME(name) ((void) 0)
+#define PROFILE_FLUSH() ((void) 0)
+#endif
+
+class Profiler {
+public:
+    // One completed zone. Names must be string literals (or otherwise outlive the profiler).
+    struct Event {
+        const char *name;
+        std::int64_t startNs;
+        std::int64_t durationNs;
+    };
+
+    // RAII timer which records a zone into the calling thread's buffer when it goes out of scope
+    class Zone {
+    public:
+        explicit Zone(const char *name);
+
+        ~Zone();
+
+        Zone(const Zone &) = delete;
+
+        Zone &operator=(const Zone &) = delete;
+
+    private:
+        const char *m_name;
+        std::int64_t m_startNs;
+    };
+
+    // Number of events each thread keeps before the oldest ones are overwritten
+    static constexpr std::size_t kEventsPerThread = 1 << 16;
+
+    // Process-wide profiler
+    static Profiler &Get();
+
+    // Monotonic time in nanoseconds since the profiler was created
+    std::int64_t now() const;
+
+    // Append a completed zone to the calling thread's buffer
+    void record(const char *name, std::int64_t startNs, std::int64_t durationNs);
+
+    // Label the calling thread in the trace output
+    void setThreadName(const std::string &name);
+
+    // Where flush() writes to (defaults to $PAINT_TRACE_FILE or paint_trace.json)
+    void setOutputPath(const std::string &path);
+
+    // Get the current output path
+    std::string getOutputPath();
+
+    // Write every buffered event to the output path as Chrome trace-event JSON
+    bool flush();
+
+    // Write every buffered event to the given path as Chrome trace-event JSON
+    bool flush(const std::string &path);
+
+    // Collect a copy of every event still held in the thread buffers
+    std::vector<Event> snapshot();
+
+    // Drop all buffered events
+    void clear();
+
+    // Destructor flushes whatever is buffered when profiling is compiled in
+    ~Profiler();
+
+private:
+    // Single-producer ring owned by one thread. The owner publishes each event with a
+    // release store of m_head, so readers never need to take a lock on the hot path.
+    struct ThreadBuffer {
+        ThreadBuffer();
+
+        std::vector<Event> events;
+        std::atomic<std::uint64_t> head;
+        int threadId;
+        std::string threadName;
+    };
+
+    Profiler();
+
+    // Find (or lazily create) the calling thread's buffer
+    ThreadBuffer &localBuffer();
+
+    // Copy the events of one buffer that were not overwritten while copying
+    static void copyEvents(ThreadBuffer &buffer, std::vector<Event> &out);
+
+    std::chrono::steady_clock::time_point m_epoch;
+    // Guards registration of thread buffers and the output path; never taken while recording
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+    std::string m_outputPath;
+    int m_nextThreadId;
+};
+
+#endif
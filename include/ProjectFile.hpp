@@ -0,0 +1,162 @@
+/**
+ *  @file   ProjectFile.hpp
+ *  @brief  The native project format: layer metadata and compressed, checksummed tile chunks with an index.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef PROJECTFILE_HPP
+#define PROJECTFILE_HPP
+
+// Include standard library C++ libraries.
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+// Project header files
+#include "BlendKernels.hpp"
+#include "Canvas.hpp"
+#include "LayerStack.hpp"
+#include "ThreadPool.hpp"
+
+// One layer of a saved drawing, without its pixels
+struct ProjectLayer {
+    int id;
+    // What the layer's unsaved tiles hold: the canvas color for the base layer, else transparent
+    Canvas::Pixel background;
+    BlendMode blend;
+    std::uint8_t opacity;
+    // Position in the stack from the bottom, or -1 if the layer is not in the stack (e.g. an undone add)
+    int position;
+};
+
+// The pixels of one tile of one layer
+struct ProjectChunk {
+    // Index of the layer in ProjectSnapshot::layers
+    std::uint32_t layer;
+    int tileX;
+    int tileY;
+    // The tile's pixels, row by row; edge tiles are cut to the canvas
+    std::vector<Canvas::Pixel> pixels;
+    // The pixels encoded instead (see ProjectFile::encodeChunk()), and how, for a tile a capture took
+    // from a paging canvas; empty for any other
+    std::vector<std::uint8_t> encoded;
+    std::uint32_t encoding = 0;
+};
+
+// A drawing as saved or loaded: its size, its layers and the pixels of every tile painted on them.
+// A snapshot taken for saving owns copies of those tiles, so the drawing can go on changing while
+// the snapshot is written. The tiles of a paging canvas are copied encoded, so that a snapshot
+// of a canvas larger than memory holds what it compresses to.
+struct ProjectSnapshot {
+    unsigned width = 0;
+    unsigned height = 0;
+    int activeLayer = LayerStack::kBaseLayer;
+    // Every layer, in the order they were created
+    std::vector<ProjectLayer> layers;
+    std::vector<ProjectChunk> chunks;
+};
+
+// Reads a project file through its index. open() reads only the header, the layer table and the
+// index; each chunk is then read, checked and decompressed on its own, so a reader can load just
+// the tiles it needs.
+class ProjectReader {
+public:
+    // Where one chunk is in the file
+    struct ChunkEntry {
+        std::uint32_t layer;
+        std::uint32_t tileX;
+        std::uint32_t tileY;
+        // 0: raw pixels, 1: run-length encoded
+        std::uint32_t encoding;
+        std::uint64_t offset;
+        std::uint32_t size;
+        // CRC-32 of the stored bytes
+        std::uint32_t crc;
+    };
+
+    // Open a file and read its index; false (see getError()) if it is missing or damaged
+    bool open(const std::string &path);
+
+    // Size and layers of the drawing; the chunks are left empty
+    const ProjectSnapshot &getInfo() const {
+        return m_info;
+    }
+
+    // The index, one entry per saved tile
+    const std::vector<ChunkEntry> &getChunks() const {
+        return m_chunks;
+    }
+
+    // Read, check and decompress one chunk; false if it is damaged
+    bool readChunk(std::size_t index, ProjectChunk &out);
+
+    // What went wrong in the last failed call
+    const std::string &getError() const {
+        return m_error;
+    }
+
+private:
+    // Record an error; always false
+    bool fail(const std::string &error);
+
+    std::ifstream m_file;
+    ProjectSnapshot m_info;
+    std::vector<ChunkEntry> m_chunks;
+    std::string m_error;
+};
+
+// Saving and loading drawings in the native format. A file is a fixed header, the layer table,
+// the chunks and, at the end, an index of the chunks' positions. Each chunk is one tile of one
+// layer, run-length encoded unless that does not make it smaller, and has its own CRC-32; the
+// header, layer table and index have theirs too. Tiles which hold just the layer's background are
+// not stored. Files are written next to the target and renamed over it, so a crash during a save
+// leaves the previous file intact.
+class ProjectFile {
+public:
+    // "CPNT" read as a little-endian integer
+    static constexpr std::uint32_t kMagic = 0x544E5043;
+    static constexpr std::uint32_t kVersion = 1;
+    // Chunk encodings
+    static constexpr std::uint32_t kRawChunk = 0;
+    static constexpr std::uint32_t kRunChunk = 1;
+    // Bytes of one layer table entry
+    static constexpr std::size_t kLayerBytes = 16;
+
+    // Copy the layers' metadata and the tiles ever painted on them, or only (clearing their marks)
+    // the tiles marked unsaved
+    static std::shared_ptr<ProjectSnapshot> capture(LayerStack &layers, int activeLayer, bool unsavedOnly = false);
+
+    // Write a snapshot to a temporary file, flush it to disk and rename it over path; false (with error set)
+    // if it cannot be written
+    static bool write(const ProjectSnapshot &snapshot, const std::string &path, std::string &error);
+
+    // Write a snapshot on a background thread of pool; the future tells whether it was written
+    static std::future<bool> writeAsync(std::shared_ptr<const ProjectSnapshot> snapshot, const std::string &path,
+                                        ThreadPool &pool);
+
+    // Read a whole file; false (with error set) if it is missing or damaged
+    static bool read(const std::string &path, ProjectSnapshot &snapshot, std::string &error);
+
+    // Compress pixels into out; returns false, leaving out empty, if that would not make them smaller
+    static bool encodeRuns(const Canvas::Pixel *pixels, std::size_t count, std::vector<std::uint8_t> &out);
+
+    // Decompress exactly count pixels; false if the data is malformed
+    static bool decodeRuns(const std::uint8_t *data, std::size_t size, Canvas::Pixel *pixels, std::size_t count);
+
+    // Encode a chunk's pixels into out, compressed if that helps; returns the encoding
+    static std::uint32_t encodeChunk(const ProjectChunk &chunk, std::vector<std::uint8_t> &out);
+
+    // Decode the pixels of a chunk whose tile is set, on a canvas of width x height; false if malformed
+    static bool decodeChunk(std::uint32_t encoding, const std::uint8_t *data, std::size_t size, unsigned width,
+                            unsigned height, ProjectChunk &chunk);
+
+    // Append a layer table entry of kLayerBytes
+    static void putLayer(std::vector<std::uint8_t> &out, const ProjectLayer &layer);
+
+    // Read a layer table entry; false if it is malformed
+    static bool getLayer(const std::uint8_t *data, ProjectLayer &layer);
+};
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ *  @file   RegionOps.hpp
+ *  @brief  Whole-canvas and large-region operations, split across threads by bands of tile rows.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef REGIONOPS_HPP
+#define REGIONOPS_HPP
+
+// Include standard library C++ libraries.
+#include <functional>
+// Project header files
+#include "Canvas.hpp"
+#include "ScanlineFill.hpp"
+#include "ThreadPool.hpp"
+
+// Operations touching large parts of the canvas. Each band of ThreadPool::kBandRows rows is one
+// task, and a pixel's value never depends on which thread wrote it or in what order the bands
+// ran, so the results are bit-identical to running serially and peers stay converged.
+class RegionOps {
+public:
+    // Call body(top, bottom) for bands of rows covering [top, bottom), in parallel. Canvas tracking
+    // is paused meanwhile and the rows marked afterwards; when it is already paused (the caller
+    // is itself one band of a parallel operation) it is left alone.
+    static void forEachBand(Canvas &canvas, int top, int bottom, ThreadPool &pool,
+                            const std::function<void(int, int)> &body);
+
+    // Fill a rectangle with one pixel value, e.g. clear the canvas
+    static void fillRect(Canvas &canvas, const CanvasRect &rect, Canvas::Pixel pixel, ThreadPool &pool);
+
+    // Fill the part of a region inside clip with one pixel value
+    static void fillRegion(Canvas &canvas, const FillRegion &region, Canvas::Pixel pixel, const CanvasRect &clip,
+                           ThreadPool &pool);
+
+    // Copy a snapshot over the canvas
+    static void restore(Canvas &canvas, const Canvas &snapshot, ThreadPool &pool);
+};
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ *  @file   ScanlineFill.hpp
+ *  @brief  Scanline flood fill, producing the filled region as a list of horizontal spans.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef SCANLINEFILL_HPP
+#define SCANLINEFILL_HPP
+
+// Include standard library C++ libraries.
+#include <cstddef>
+#include <vector>
+// Project header files
+#include "Canvas.hpp"
+#include "ThreadPool.hpp"
+
+// A region of the canvas as horizontal spans, sorted by row and then column, that do not
+// overlap. A flood fill is kept as its region and one color, a few bytes per row, instead of
+// the pixels it covered.
+class FillRegion {
+public:
+    // Pixels [x0, x1) of row y
+    struct Span {
+        int y;
+        int x0;
+        int x1;
+    };
+
+    // Constructor
+    FillRegion();
+
+    // Add a span; spans must be added in row, then column order
+    void add(int y, int x0, int x1);
+
+    // Fill every span with one pixel value
+    void write(Canvas &canvas, Canvas::Pixel pixel) const;
+
+    // Fill the part of every span inside clip with one pixel value
+    void write(Canvas &canvas, Canvas::Pixel pixel, const CanvasRect &clip) const;
+
+    // Whether (x, y) is in the region
+    bool contains(int x, int y) const;
+
+    // The spans, in row then column order
+    const std::vector<Span> &getSpans() const {
+        return m_spans;
+    }
+
+    // Smallest rectangle holding the region
+    CanvasRect getBounds() const {
+        return m_bounds;
+    }
+
+    // Whether the region has no pixels
+    bool empty() const {
+        return m_spans.empty();
+    }
+
+    // Number of pixels in the region
+    std::size_t pixelCount() const {
+        return m_pixelCount;
+    }
+
+    // Forget every span
+    void clear();
+
+    // Approximate bytes held
+    std::size_t getByteSize() const;
+
+private:
+    std::vector<Span> m_spans;
+    CanvasRect m_bounds;
+    std::size_t m_pixelCount;
+};
+
+// Finds the 4-connected region around a seed pixel whose pixels match the seed's color. It works
+// a row at a time: each span popped off an explicit stack is extended left and right along the
+// canvas row, and only the starts of matching runs in the rows above and below are pushed, so
+// the stack holds a few entries per row rather than one per pixel. Integer arithmetic only, so
+// every peer finds the same region on the same canvas.
+class ScanlineFill {
+public:
+    // Find the region around (x, y). A pixel matches when no channel (R, G, B or A) differs from
+    // the seed's by more than tolerance (0 = exact match). The region is empty if (x, y) is off
+    // the canvas.
+    static void findRegion(const Canvas &canvas, int x, int y, int tolerance, FillRegion &region);
+
+    // Fills covering more pixels than this are handed to the thread pool
+    static constexpr std::size_t kSerialPixels = std::size_t(1) << 16;
+
+    // As above, but a fill which grows past kSerialPixels is redone in parallel: the runs of
+    // matching pixels are found a band of rows per task, joined into connected sets within each
+    // band, and the sets merged across band boundaries. The region is identical to the serial one.
+    static void findRegion(const Canvas &canvas, int x, int y, int tolerance, FillRegion &region,
+                           ThreadPool &pool);
+
+    // Find every pixel on the canvas matching color within tolerance, connected or not, e.g. to
+    // replace one color by another. Bands of rows are searched in parallel.
+    static void findMatching(const Canvas &canvas, Canvas::Pixel color, int tolerance, FillRegion &region,
+                             ThreadPool &pool);
+};
+
+#endif
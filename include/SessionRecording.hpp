@@ -0,0 +1,164 @@
+/**
+ *  @file   SessionRecording.hpp
+ *  @brief  Recording the messages of a session to a compact file, and replaying them through the headless core.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef SESSIONRECORDING_HPP
+#define SESSIONRECORDING_HPP
+
+// Include standard library C++ libraries.
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+// Project header files
+#include "Canvas.hpp"
+
+// One message of a recorded session
+struct SessionEvent {
+    enum class Direction : std::uint8_t {
+        // Received from a peer
+        Inbound = 0,
+        // Made by the local user, applied here and sent to the peers
+        Outbound = 1
+    };
+
+    Direction direction = Direction::Inbound;
+    // When the message was applied, in microseconds since the recording started
+    std::int64_t time = 0;
+    // The packet's bytes
+    std::vector<std::uint8_t> data;
+};
+
+// Writes every message a session applies, in the order it applies them, with when it did. The file
+// is a header (magic, version, canvas size and the local client id) and then one record per message:
+// its direction, the microseconds since the previous message and the packet's size as variable
+// length integers, then the packet. A typical draw message takes under 60 bytes.
+class SessionRecorder {
+public:
+    // "CPSR" read as a little-endian integer
+    static constexpr std::uint32_t kMagic = 0x52535043;
+    static constexpr std::uint32_t kVersion = 1;
+
+    // Constructor; nothing is recorded until open()
+    SessionRecorder();
+
+    // Destructor closes the file
+    virtual ~SessionRecorder();
+
+    // Start recording a session on a canvas of width x height whose local user is localClient
+    bool open(const std::string &path, unsigned width, unsigned height, int localClient, std::int64_t startMicros);
+
+    // Whether a recording is open
+    bool isOpen() const {
+        return m_file.is_open();
+    }
+
+    // Record a message applied at timeMicros (on the clock startMicros was read from)
+    void record(SessionEvent::Direction direction, std::int64_t timeMicros, const void *data, std::size_t size);
+
+    // Write what is buffered and close the file
+    void close();
+
+    // Number of messages recorded
+    std::uint64_t getEventCount() const {
+        return m_events;
+    }
+
+private:
+    // Write the buffered records to the file
+    void flush();
+
+    std::ofstream m_file;
+    std::vector<std::uint8_t> m_buffer;
+    std::int64_t m_lastTime;
+    std::uint64_t m_events;
+};
+
+// Reads a file written by SessionRecorder, one message at a time
+class SessionReader {
+public:
+    // Open a recording and read its header; false (see getError()) if it is not one
+    bool open(const std::string &path);
+
+    // Read the next message; false at the end, or at a record cut short when the session ended
+    bool next(SessionEvent &event);
+
+    unsigned getWidth() const {
+        return m_width;
+    }
+
+    unsigned getHeight() const {
+        return m_height;
+    }
+
+    int getLocalClient() const {
+        return m_localClient;
+    }
+
+    const std::string &getError() const {
+        return m_error;
+    }
+
+private:
+    std::ifstream m_file;
+    unsigned m_width = 0;
+    unsigned m_height = 0;
+    int m_localClient = 0;
+    std::int64_t m_time = 0;
+    std::string m_error;
+};
+
+// Replays a recording through a headless PaintCore, either as fast as possible or at the recorded
+// pace, timing each subsystem. The flattened image is brought up to date once per recorded frame
+// (16 ms), as the app does when it draws. The hash of the final image tells whether two replays,
+// e.g. before and after a change, painted the same.
+class SessionReplay {
+public:
+    enum class Subsystem {
+        // Reading and decoding messages
+        Decode = 0,
+        // Draw segments and ends of strokes
+        Paint,
+        // Undo and redo
+        History,
+        // Fills and flood fills
+        Fill,
+        // Layer changes
+        Layers,
+        // Bringing the flattened image up to date
+        Composite,
+        Count
+    };
+
+    struct Report {
+        std::uint64_t events = 0;
+        std::array<double, static_cast<std::size_t>(Subsystem::Count)> milliseconds{};
+        std::array<std::uint64_t, static_cast<std::size_t>(Subsystem::Count)> calls{};
+        // Time the replay took, and the time the session took when it was recorded
+        double wallMilliseconds = 0;
+        double recordedMilliseconds = 0;
+        unsigned width = 0;
+        unsigned height = 0;
+        std::uint32_t canvasHash = 0;
+
+        // A table of the time per subsystem, and the hash
+        std::string summary() const;
+    };
+
+    // Length of a recorded frame, after which the flattened image is updated
+    static constexpr std::int64_t kFrameMicros = 16000;
+
+    // Name of a subsystem, for reports
+    static const char *subsystemName(Subsystem subsystem);
+
+    // Replay a recording; false (with error set) if it cannot be read
+    static bool run(const std::string &path, bool realTime, Report &report, std::string &error);
+
+    // Hash of an image's size and every pixel
+    static std::uint32_t canvasHash(const Canvas &canvas);
+};
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ *  @file   SpatialIndex.hpp
+ *  @brief  Grid index answering "which operations after S touch rectangle R".
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef SPATIALINDEX_HPP
+#define SPATIALINDEX_HPP
+
+// Include standard library C++ libraries.
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+// Project header files
+#include "Canvas.hpp"
+
+// Uniform grid over canvas coordinates. Every id is listed in each cell its bounds overlap, and
+// since ids are inserted in increasing order each cell's list stays sorted, so the ids from a
+// sequence number onwards are found with a binary search. Cells live in a hash map, so any
+// coordinate works, including off-canvas ones. Ids whose bounds cover very many cells (e.g. a
+// fill) are kept on a separate list instead of being copied into every cell. The ids before a
+// number can be discarded as a block; the ids after keep their numbers.
+class SpatialIndex {
+public:
+    typedef std::size_t Id;
+
+    // Side of a grid cell; matches the tiles the canvas is rebuilt in
+    static constexpr int kCellSize = 64;
+    // Ids covering more cells than this go on the large list
+    static constexpr std::int64_t kMaxCells = 256;
+
+    // Constructor
+    SpatialIndex();
+
+    // Add the next id, which must equal size(), with its bounds
+    void insert(Id id, const CanvasRect &bounds);
+
+    // Append, in increasing order, every id >= since whose bounds intersect rect
+    void query(const CanvasRect &rect, Id since, std::vector<Id> &out) const;
+
+    // Bounds an id was inserted with; the id must not have been discarded
+    const CanvasRect &getBounds(Id id) const {
+        return m_bounds[id - m_first];
+    }
+
+    // Number of ids inserted, including those discarded since
+    std::size_t size() const {
+        return m_first + m_bounds.size();
+    }
+
+    // Forget every id before first
+    void discard(Id first);
+
+    // Forget every id
+    void clear();
+
+    // Approximate bytes held
+    std::size_t getByteSize() const;
+
+private:
+    // Hash key of a cell
+    static std::uint64_t cellKey(std::int64_t cellX, std::int64_t cellY);
+
+    std::unordered_map<std::uint64_t, std::vector<Id>> m_cells;
+    std::vector<Id> m_large;
+    // Bounds of the ids from m_first on
+    std::vector<CanvasRect> m_bounds;
+    Id m_first;
+    // Number of ids listed across all cells
+    std::size_t m_entries;
+};
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ *  @file   StrokeSimplifier.hpp
+ *  @brief  Streaming polyline simplification of brush strokes before they are sent.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef STROKESIMPLIFIER_HPP
+#define STROKESIMPLIFIER_HPP
+
+// Include standard library C++ libraries.
+#include <cstdint>
+#include <vector>
+// Project header files
+#include "Metrics.hpp"
+
+// Drops stroke samples that lie within a pixel tolerance of the line between the samples around
+// them, in the spirit of Ramer-Douglas-Peucker but over a sliding window so it can run while the
+// stroke is being drawn. Samples are held back until a later sample leaves the tolerance band,
+// the stroke ends, or the oldest held sample has waited longer than the delay bound.
+// Kept points are handed out as segments from the previously kept point.
+class StrokeSimplifier {
+public:
+    // One mouse sample
+    struct Sample {
+        int x;
+        int y;
+        // Capture time on the server's clock, passed through to the packet
+        std::int64_t stamp;
+    };
+
+    // A kept point joined to the one kept before it; fromX and fromY are -1 for the first point of a stroke
+    struct Segment {
+        int fromX;
+        int fromY;
+        int x;
+        int y;
+        std::int64_t stamp;
+    };
+
+    // Most samples held back at once
+    static constexpr std::size_t kMaxWindow = 64;
+
+    // Constructor
+    explicit StrokeSimplifier(double tolerance = 1.0, std::int64_t maxDelayUs = 30000);
+
+    // Largest distance in pixels a dropped sample may lie from the simplified stroke (0 keeps
+    // every sample that is not exactly on the line, which paints identical pixels)
+    void setTolerance(double tolerance);
+
+    // Get the tolerance
+    double getTolerance() const;
+
+    // Longest a sample may be held back before it is sent anyway
+    void setMaxDelay(std::int64_t microseconds);
+
+    // Add a sample, starting a stroke if none is active; appends any segments ready to send
+    void addSample(const Sample &sample, std::int64_t nowUs, std::vector<Segment> &out);
+
+    // Send the newest held sample if the oldest one has waited past the delay bound
+    void poll(std::int64_t nowUs, std::vector<Segment> &out);
+
+    // End the stroke, sending whatever is held
+    void finish(std::vector<Segment> &out);
+
+    // Whether a stroke is in progress
+    bool isActive() const;
+
+    // Simplify a complete recorded stroke without a delay bound, e.g. to measure the packet reduction
+    static std::vector<Segment> simplify(const std::vector<Sample> &samples, double tolerance);
+
+private:
+    // Whether every held sample lies within the tolerance of the line from the anchor to end
+    bool fitsWindow(const Sample &end) const;
+
+    // Send a sample as the next kept point and make it the anchor
+    void emit(const Sample &sample, std::vector<Segment> &out);
+
+    double m_tolerance;
+    std::int64_t m_maxDelayUs;
+    bool m_active;
+    // Last kept point
+    Sample m_anchor;
+    // Samples after the anchor which have not been sent yet
+    std::vector<Sample> m_window;
+    // When the oldest held sample arrived
+    std::int64_t m_heldSince;
+
+    // METRICS
+    Counter *m_samplesIn;
+    Counter *m_segmentsOut;
+};
+
+#endif
@@ -0,0 +1,205 @@
+/**
+ *  @file   StrokeStore.hpp
+ *  @brief  Every drawing operation kept as compact vector data which can be re-rasterized on demand.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef STROKESTORE_HPP
+#define STROKESTORE_HPP
+
+// Include standard library C++ libraries.
+#include <cstdint>
+#include <vector>
+// Project header files
+#include "Brush.hpp"
+#include "Canvas.hpp"
+#include "Metrics.hpp"
+#include "ScanlineFill.hpp"
+#include "SpatialIndex.hpp"
+#include "ThreadPool.hpp"
+
+// The drawing as an ordered list of operations: stroke segments (points of polyline strokes with
+// a color, radius and brush), canvas fills, flood-filled regions kept as span lists, and explicit
+// pixel runs for anything the brush engine cannot describe (custom paint functions). Operations are
+// numbered in the order they were applied. Hiding or showing an operation only marks the tiles
+// it covers; repair() rebuilds those tiles from the background by replaying the visible operations
+// that touch them, so undo needs no saved pixels. A spatial index finds the operations touching a
+// tile, so rebuilding it costs what is drawn there rather than the length of the history. Tiles
+// never share pixels, so rows of tiles are repaired in parallel.
+//
+// An operation is settled once no command can hide or show it any more (its action left the history).
+// compact() bakes the settled operations at the start of the list into a canvas of their own, which
+// later rebuilds start from instead of the background, and drops them with their records, so the
+// store holds what the history can still change rather than everything ever drawn. Operation
+// numbers do not change when earlier operations are dropped.
+class StrokeStore {
+public:
+    // Side of the square tiles the canvas is rebuilt in
+    static constexpr int kTileSize = 64;
+
+    // Number an operation gets, in the order operations were applied
+    typedef std::size_t OpId;
+
+    struct StrokePoint {
+        int x;
+        int y;
+    };
+
+    // One polyline stroke
+    struct StrokeRecord {
+        BrushTip brush;
+        Canvas::Pixel color;
+        int radius;
+        std::vector<StrokePoint> points;
+    };
+
+    // Constructor
+    StrokeStore();
+
+    // Add a stroke segment to (x, y). If continues is set, the segment runs from (fromX, fromY) and
+    // extends an open stroke ending there with the same look; otherwise it is a dab starting a stroke.
+    OpId addSegment(const BrushTip &brush, Canvas::Pixel color, int radius, bool continues, int fromX, int fromY, int x,
+                    int y);
+
+    // Add a fill of the whole canvas
+    OpId addFill(Canvas::Pixel color);
+
+    // Add a flood fill of a region with one color
+    OpId addRegion(FillRegion region, Canvas::Pixel color);
+
+    // Add explicit pixel values
+    OpId addPixels(SpanRecord pixels);
+
+    // End every open stroke, so that later segments start new ones
+    void closeStrokes();
+
+    // Paint one operation onto the canvas, within clip
+    void rasterize(OpId op, Canvas &canvas, const CanvasRect &clip) const;
+
+    // Hide (undo) or show (redo) an operation and mark the tiles it covers for repair
+    void setVisible(OpId op, bool visible);
+
+    // Note that an operation will not be hidden or shown again, e.g. when its command is released
+    void settle(OpId op);
+
+    // Bake the settled operations at the start of the list and drop them, if there are enough of them
+    // to be worth it; canvas and background are the layer's. Returns the number of operations dropped.
+    std::size_t compact(const Canvas &canvas, Canvas::Pixel background);
+
+    // The canvas the dropped operations were baked into, or nullptr if none were yet
+    Canvas *getBaked() {
+        return m_bakedOps > 0 ? &m_baked : nullptr;
+    }
+
+    // Whether an operation is shown
+    bool isVisible(OpId op) const;
+
+    // Rectangle holding every pixel an operation can paint
+    CanvasRect getBounds(OpId op) const;
+
+    // Append, in order, every operation numbered since or later (shown or hidden) which touches rect
+    void query(const CanvasRect &rect, OpId since, std::vector<OpId> &out) const;
+
+    // Mark a rectangle of the canvas for repair
+    void invalidate(const CanvasRect &rect);
+
+    // Rebuild every tile marked since the last repair; returns the number of tiles rebuilt
+    std::size_t repair(Canvas &canvas, Canvas::Pixel background);
+
+    // Rebuild one rectangle of the canvas from the background, or what was baked, and the visible operations
+    void rebuild(Canvas &canvas, const CanvasRect &rect, Canvas::Pixel background) const;
+
+    // Use a different thread pool for repairs and large fills (the shared pool by default)
+    void setThreadPool(ThreadPool &pool);
+
+    // The thread pool repairs and large fills run on
+    ThreadPool &getThreadPool() const {
+        return *m_pool;
+    }
+
+    // Number of operations kept, i.e. not yet baked
+    std::size_t size() const;
+
+    // Number of the next operation added
+    OpId nextOp() const {
+        return m_firstOp + m_ops.size();
+    }
+
+    // Number of polyline strokes
+    std::size_t strokeCount() const;
+
+    // Approximate bytes held
+    std::size_t getByteSize() const;
+
+private:
+    enum class OpKind : std::uint8_t {
+        Segment,
+        Fill,
+        Region,
+        Pixels
+    };
+
+    struct Op {
+        OpKind kind;
+        bool visible;
+        bool settled;
+        // Index into m_strokes, m_fills, m_regions or m_pixels depending on kind
+        std::uint32_t record;
+        // For a segment, the point it ends at; it starts at the point before (a dab if there is none)
+        std::uint32_t point;
+    };
+
+    // Append an operation, index it and publish the size metrics
+    OpId push(OpKind kind, std::uint32_t record, std::uint32_t point);
+
+    // Work out the rectangle an operation can paint from its record
+    CanvasRect computeBounds(const Op &entry) const;
+
+    // The operation numbered op, which must be kept
+    const Op &entry(OpId op) const {
+        return m_ops[op - m_firstOp];
+    }
+
+    // Drop the first count operations, and the records no operation kept or open stroke refers to
+    void dropOps(std::size_t count);
+
+    // Operations from m_firstOp on; records are numbered from m_first* on
+    std::vector<Op> m_ops;
+    OpId m_firstOp;
+    std::uint32_t m_firstStroke;
+    std::uint32_t m_firstFill;
+    std::uint32_t m_firstPixels;
+    std::uint32_t m_firstRegion;
+    std::vector<StrokeRecord> m_strokes;
+    std::vector<Canvas::Pixel> m_fills;
+    std::vector<SpanRecord> m_pixels;
+    // Flood-filled regions and their colors
+    std::vector<FillRegion> m_regions;
+    std::vector<Canvas::Pixel> m_regionColors;
+    // Numbers of the fill operations, in order
+    std::vector<OpId> m_fillOps;
+    // Operations by the rectangle they cover
+    SpatialIndex m_index;
+    // Strokes which later segments may still extend, oldest first
+    std::vector<std::uint32_t> m_openStrokes;
+    // Rectangles marked for repair
+    std::vector<CanvasRect> m_invalid;
+    // Threads that repairs and whole-canvas operations are split across
+    ThreadPool *m_pool;
+    // Bytes held by the pixel records
+    std::size_t m_pixelBytes;
+    // Bytes held by the regions
+    std::size_t m_regionBytes;
+    // Number of stroke points
+    std::size_t m_pointCount;
+    // The dropped operations painted over the background, and how many there were
+    Canvas m_baked;
+    std::size_t m_bakedOps;
+
+    // METRICS
+    Gauge *m_opsMetric;
+    Gauge *m_bytesMetric;
+    Counter *m_tilesRepaired;
+};
+
+#endif
@@ -0,0 +1,187 @@
+/**
+ *  @file   ThreadPool.hpp
+ *  @brief  Work-stealing task scheduler shared by every subsystem that runs work on several cores.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+// Include standard library C++ libraries.
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+// Project header files
+#include "Metrics.hpp"
+
+class TaskGroup;
+
+// One set of worker threads for the whole process. Each worker keeps its own deques of tasks: it
+// takes its newest task first (what it just split off is still in cache) and, when it has none,
+// steals the oldest task of another worker, so uneven work balances itself. Tasks go in one of two
+// lanes. Interactive work (painting, fills, tile repair) is always taken before background work
+// (compression, autosave), and background tasks may occupy all but one worker, so a stroke never
+// waits behind a long background job. A thread waiting for a TaskGroup runs the group's lane of
+// tasks meanwhile, so the caller of a parallel loop works too and waits nest without deadlock.
+// There is always at least one worker, even on one core, so background tasks never run on the thread
+// which submits them; only parallel loops and task groups of a one-thread pool run on the caller.
+class ThreadPool {
+public:
+    // Bands of this many rows are the unit of parallel canvas work; matches the repair tiles
+    static constexpr int kBandRows = 64;
+
+    // Priority lane of a task
+    enum class Lane {
+        Interactive = 0,
+        Background = 1
+    };
+
+    // What one worker has done since the pool started
+    struct WorkerStats {
+        std::uint64_t tasks;
+        // Tasks it took from another worker's deque
+        std::uint64_t steals;
+        std::uint64_t busyMicros;
+        // Share of the pool's lifetime spent running tasks, 0 to 1
+        double utilization;
+    };
+
+    // Constructor; threads counts the caller, so threads - 1 workers are started, but at least one
+    explicit ThreadPool(unsigned threads);
+
+    // Destructor runs the tasks still queued, then stops and joins the workers
+    virtual ~ThreadPool();
+
+    // Process-wide pool, sized by the PAINT_THREADS environment variable (default: one thread
+    // per core). It is never destroyed.
+    static ThreadPool &Get();
+
+    // Number of threads that run parallel loops, including the caller
+    unsigned size() const {
+        return m_inline ? 1 : static_cast<unsigned>(m_workers.size()) + 1;
+    }
+
+    // Call body(i) for every i in [0, count), spread over the threads, and return when all are done
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)> &body, Lane lane = Lane::Interactive);
+
+    // Call body(first, last) for consecutive ranges of at most grain items covering [begin, end),
+    // e.g. ranges of tiles, and return when all are done
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+                     const std::function<void(std::size_t, std::size_t)> &body, Lane lane = Lane::Interactive);
+
+    // Run a task nobody waits for, e.g. a background save, on a worker
+    void submit(std::function<void()> task, Lane lane = Lane::Background);
+
+    // What each worker has done so far
+    std::vector<WorkerStats> getWorkerStats() const;
+
+    // Index of the worker of this pool running the calling thread, or -1 for any other thread
+    int currentWorker() const;
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> body;
+        // Group waiting for the task, if any
+        TaskGroup *group;
+        Lane lane;
+        // Whether it holds one of the background slots while it runs
+        bool limited;
+    };
+
+    struct Worker {
+        // Guards the deques
+        std::mutex mutex;
+        // Tasks of each lane, oldest first
+        std::deque<Task> lanes[2];
+        // Tasks only this worker may run (affinity)
+        std::deque<Task> pinned;
+        std::atomic<std::size_t> pinnedCount;
+        std::thread thread;
+        // Statistics, also published as metrics
+        std::atomic<std::uint64_t> tasks;
+        std::atomic<std::uint64_t> steals;
+        std::atomic<std::uint64_t> busyMicros;
+        Counter *tasksMetric;
+        Counter *busyMetric;
+    };
+
+    // Queue a task: on a worker's pinned deque if worker >= 0, else on the calling worker's deque,
+    // or the shared deque for threads outside the pool
+    void push(Task task, int worker);
+
+    // Take one task the thread may run; background tasks only if allowed and below the limit
+    bool take(int self, bool background, Task &task);
+
+    // Take and run one task; false if there was none
+    bool runOne(int self, bool background);
+
+    // Run a task and account for it
+    void execute(int self, Task &task);
+
+    // Wake every sleeping thread, after something they wait for changed
+    void wakeAll();
+
+    // Whether a thread could find a task now
+    bool hasWork(int self, bool background) const;
+
+    // Worker thread main loop
+    void run(int self);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    // Whether parallel loops and task groups run on the caller, as the pool was made for one thread
+    bool m_inline;
+    // Tasks queued by threads outside the pool, per lane
+    std::mutex m_sharedMutex;
+    std::deque<Task> m_shared[2];
+    // Tasks queued and not yet taken, per lane (pinned tasks are not counted)
+    std::atomic<std::size_t> m_queued[2];
+    // Background tasks running, and how many may run at once
+    std::atomic<unsigned> m_backgroundRunning;
+    unsigned m_backgroundLimit;
+    // Sleeping threads wait here for work, or for a group to finish
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_stopping;
+    std::chrono::steady_clock::time_point m_start;
+    Counter *m_stealsMetric;
+};
+
+// Tasks which someone waits for together, e.g. the bands of one parallel operation. wait() runs
+// tasks while it waits: the group's lane, and interactive tasks in any case.
+class TaskGroup {
+public:
+    // Constructor
+    explicit TaskGroup(ThreadPool &pool, ThreadPool::Lane lane = ThreadPool::Lane::Interactive);
+
+    // Destructor waits for the tasks still running
+    virtual ~TaskGroup();
+
+    // Run a task on any thread
+    void run(std::function<void()> task);
+
+    // Run a task on one worker (affinity), e.g. to keep a tile's data in that core's cache.
+    // Only that worker runs it; an index outside the pool runs it on any thread.
+    void runOn(int worker, std::function<void()> task);
+
+    // Return when every task of the group has finished
+    void wait();
+
+private:
+    friend class ThreadPool;
+
+    ThreadPool &m_pool;
+    ThreadPool::Lane m_lane;
+    std::atomic<std::size_t> m_pending;
+};
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ *  @file   TileStore.hpp
+ *  @brief  Paging a canvas's tiles out to a file and back, so that a canvas can be larger than the memory it uses.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+#ifndef TILESTORE_HPP
+#define TILESTORE_HPP
+
+// Include standard library C++ libraries.
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+// Project header files
+#include "Canvas.hpp"
+#include "Metrics.hpp"
+
+// The tiles every canvas paging under it may keep in memory together (see Canvas::enablePaging()).
+// A store pages out its least recently used tiles while the total is over the limit and it holds
+// more than an even share of it, so once every canvas sharing the budget was trimmed the total is
+// within the limit, and a canvas in use may hold more than its share while others hold less.
+class TileBudget {
+public:
+    // Constructor for a budget of limit tiles (at least 1), which no store uses yet
+    explicit TileBudget(std::size_t limit);
+
+    // Most tiles kept in memory by every store together
+    std::size_t getLimit() const {
+        return m_limit;
+    }
+
+    // Tiles with pixels of their own in memory across the stores
+    std::size_t getResident() const {
+        return m_resident.load(std::memory_order_relaxed);
+    }
+
+    // Tiles each store may keep whatever the others hold: the limit split evenly among the stores
+    std::size_t getShare() const;
+
+private:
+    friend class TileStore;
+
+    std::size_t m_limit;
+    std::atomic<std::size_t> m_resident;
+    std::atomic<std::size_t> m_stores;
+};
+
+// Backing store for the tiles of one canvas (see Canvas::enablePaging()). The canvas keeps the tiles
+// its budget allows with pixels of their own in memory; the others live in a file which has a slot
+// per tile at a fixed offset, so only the tiles ever paged out take disk space. The file is removed
+// as soon as it is created and disappears with the store, or with the process.
+//
+// Which tiles leave is decided by the clock algorithm, an approximation of least recently used:
+// every read or write of a tile sets its referenced flag, and the hand going round the tiles takes
+// the first resident tile whose flag is clear, clearing the flags it passes. A tile changed since it
+// was last written out is queued and written back by a task on the shared thread pool while the
+// canvas carries on; one read back before its write finished is copied from the queue. The same
+// task reads tiles ahead of need when asked to prefetch them. Jobs run one at a time, in order; a
+// thread which has to wait for them runs them itself rather than wait for a busy pool. The task
+// holds the store, so a store goes only once its jobs are done.
+//
+// The canvas's own threads call in here for distinct tiles only, as they write the canvas; the
+// state shared with the task is guarded by a mutex.
+class TileStore : public std::enable_shared_from_this<TileStore> {
+public:
+    typedef std::shared_ptr<Canvas::Tile> TilePtr;
+
+    // Constructor for a store keeping its tiles within budget, which it shares with other stores
+    explicit TileStore(std::shared_ptr<TileBudget> budget);
+
+    // Destructor closes the file and gives the store's tiles back to the budget
+    virtual ~TileStore();
+
+    // Create the backing file in directory for a canvas of tileCount tiles; false (with error set) if it cannot be
+    bool open(const std::string &directory, std::size_t tileCount, std::string &error);
+
+    // Forget every tile, dropping what is queued, e.g. when the canvas is recreated with tileCount tiles
+    void reset(std::size_t tileCount);
+
+    // Whether a tile's pixels are out in the file
+    bool isPaged(std::size_t index) const {
+        return m_paged[index] != 0;
+    }
+
+    // Note that a resident tile was read
+    void touch(std::size_t index) {
+        m_flags[index] |= kReferenced;
+    }
+
+    // Note that a tile with pixels of its own is about to be written
+    void written(std::size_t index);
+
+    // Note that a tile no longer has pixels of its own (it became the background or uniform)
+    void dropped(std::size_t index);
+
+    // Bring a paged tile back into memory
+    TilePtr pageIn(std::size_t index);
+
+    // A paged tile's pixels for a copy of the canvas, leaving the tile where it is
+    TilePtr read(std::size_t index);
+
+    // The next tile to page out while more tiles are resident than the budget allows; false if none need to be
+    bool nextVictim(std::size_t &index);
+
+    // Take a resident tile out of memory, writing it back in the background if it changed
+    void pageOut(std::size_t index, TilePtr tile);
+
+    // Read a paged tile back in the background, ahead of a pageIn()
+    void prefetch(std::size_t index);
+
+    // Wait until every write and prefetch asked for so far is done
+    void wait();
+
+    // Number of tiles with pixels of their own in memory
+    std::size_t getResidentTiles() const {
+        return m_resident.load(std::memory_order_relaxed);
+    }
+
+    // Number of tiles out in the file
+    std::size_t getPagedTiles();
+
+    // The budget the store shares
+    const std::shared_ptr<TileBudget> &getBudget() const {
+        return m_budget;
+    }
+
+    // Where the file was created
+    const std::string &getDirectory() const {
+        return m_directory;
+    }
+
+private:
+    // Bits of m_flags
+    static constexpr std::uint8_t kResident = 1;
+    static constexpr std::uint8_t kReferenced = 2;
+    // Changed since it was last written to the file
+    static constexpr std::uint8_t kChanged = 4;
+
+    // A write-back, or (tile == nullptr) a prefetch
+    struct Job {
+        std::size_t index;
+        TilePtr tile;
+    };
+
+    // Background task: run the queued jobs until none is left
+    void drain();
+
+    // Run the job at the front of the queue; called with lock held on m_mutex, while no job runs
+    void runJob(std::unique_lock<std::mutex> &lock);
+
+    // Have a drain() task run the queue unless one is queued or running; called with lock held on
+    // m_mutex, which this releases
+    void schedule(std::unique_lock<std::mutex> &lock);
+
+    // Count tiles coming into memory (delta > 0) or leaving it, here and in the budget
+    void addResident(std::int64_t delta);
+
+    // Read a tile's pixels from the file into a new tile
+    TilePtr load(std::size_t index);
+
+    // Write a tile's pixels to its slot in the file; false if it could not
+    bool store(std::size_t index, const Canvas::Tile &tile);
+
+    std::shared_ptr<TileBudget> m_budget;
+    int m_file;
+    std::string m_directory;
+    std::string m_path;
+
+    // Resident, referenced and changed bits per tile, and the clock hand; the canvas's own
+    std::vector<std::uint8_t> m_flags;
+    std::size_t m_hand;
+    std::atomic<std::size_t> m_resident;
+
+    // Guards what follows, which the background task shares
+    std::mutex m_mutex;
+    // Whether each tile is out in the file (written by the canvas's threads under the mutex only)
+    std::vector<std::uint8_t> m_paged;
+    std::size_t m_pagedCount;
+    // Tiles queued or being written back, and tiles read ahead, by index
+    std::unordered_map<std::size_t, TilePtr> m_pending;
+    std::unordered_map<std::size_t, TilePtr> m_prefetched;
+    std::deque<Job> m_queue;
+    std::condition_variable m_idle;
+    // Whether a job runs, and whether a drain() task is queued or running
+    bool m_busy;
+    bool m_scheduled;
+
+    // METRICS
+    Counter *m_pagedInMetric;
+    Counter *m_pagedOutMetric;
+    Counter *m_writtenBackMetric;
+    Counter *m_prefetchedMetric;
+    Counter *m_prefetchHitsMetric;
+    Gauge *m_residentMetric;
+};
+
+#endif
@@ -12,6 +12,8 @@
 #include <SFML/Graphics/Color.hpp>
 // Project header files
 #include "Command.hpp"
+#include "Latency.hpp"
+#include "Metrics.hpp"
 #include "Packet.hpp"
 // Include standard library C++ libraries.
 #include <string>
@@ -49,6 +51,15 @@ public:
     // Handler for when the client leaves
     void handleClientLeaving();
 
+    // Send a clock sync request to the server
+    int syncClock();
+
+    // Estimated offset between this client's clock and the server's
+    const PeerClock &getClock() const;
+
+    // The size of the session's canvas, once, after the server's welcome; false until then and after
+    bool takeCanvasSize(unsigned &width, unsigned &height);
+
 private:
     // Username of the client
     std::string username;
@@ -61,6 +72,33 @@ private:
     // A UDP socket for our client to create an end-to-end communcation
     // with another machine
     sf::UdpSocket socket;
+
+    // Estimated offset to the server's clock
+    PeerClock m_clock;
+    // Local send time of the outstanding clock sync request (0 if none)
+    std::int64_t m_syncSentAt{};
+    // Time since the last clock sync request
+    sf::Clock m_syncTimer;
+    // Size of the session's canvas from the server's welcome (0 until it arrives), and whether it
+    // is still to be taken
+    unsigned m_canvasWidth{};
+    unsigned m_canvasHeight{};
+    bool m_canvasSizePending{};
+
+    // Complete a clock sync exchange if the packet is the server's reply
+    void handleClockSync(const sf::Packet &in);
+
+    // Look up this client's metrics in the MetricsRegistry
+    void registerMetrics();
+
+    // Count one packet (or string) sent to the server
+    void countSent(std::size_t bytes);
+
+    // METRICS
+    Counter *m_packetsIn;
+    Counter *m_packetsOut;
+    Counter *m_bytesIn;
+    Counter *m_bytesOut;
 };
 
 #endif
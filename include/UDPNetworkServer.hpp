@@ -12,6 +12,8 @@
 #include <SFML/Network.hpp>
 // Project header files
 #include "Command.hpp"
+#include "Metrics.hpp"
+#include "OpLog.hpp"
 #include "Packet.hpp"
 // Include standard library C++ libraries.
 #include <string>
@@ -48,12 +50,23 @@ public:
     // Member function to set username
     int setUsername(std::string new_name);
 
+    // Append every operation the server relays or sends to a log, in that order; nullptr for none
+    void setOpLog(OpLog *log);
+
+    // Size of the session's canvas, which clients are told when they join
+    void setCanvasSize(unsigned width, unsigned height);
+
 private:
     // Name for the server
     std::string name;
 
     // Handles when client joins the server
-    int clientJoining(unsigned short clientPort, sf::IpAddress clientIp);
+    int clientJoining(unsigned short clientPort, sf::IpAddress clientIp, sf::Int64 requestSent,
+                      sf::Int64 requestReceived);
+
+    // Answer a client's clock sync request
+    sf::Socket::Status sendClockSync(unsigned short clientPort, sf::IpAddress clientIp, sf::Int64 requestSent,
+                                     sf::Int64 requestReceived);
 
     // Flag signaling if the server should stop
     bool flag;
@@ -70,11 +83,31 @@ private:
     // Capture status of server
     bool m_status;
 
+    // Size of the session's canvas; 0 until it is set
+    unsigned m_canvasWidth;
+    unsigned m_canvasHeight;
+
+    // Send a packet to one client and count it
+    sf::Socket::Status sendTo(sf::Packet &p, const sf::IpAddress &ip, unsigned short port);
+
+    // Append an operation packet to the op log, if there is one
+    void logOperation(const sf::Packet &p, const PaintMessage &message);
+
+    // Look up this server's metrics in the MetricsRegistry
+    void registerMetrics();
+
+    // METRICS
+    Counter *m_packetsIn;
+    Counter *m_packetsOut;
+    Counter *m_bytesIn;
+    Counter *m_bytesOut;
+    Gauge *m_activeClientsMetric;
+
     // DATA STRUCTURES
     // Map to hold all of the clients
     std::map<unsigned short, sf::IpAddress> activeClients;
-    // Vector to hold all packets
-    std::vector<std::string> packetHistory;
+    // Every operation relayed, in the order the server relayed it; not owned, nullptr if not kept
+    OpLog *m_opLog;
 };
 
 #endif
@@ -1,6 +1,6 @@
 /** 
  *  @file   App.cpp 
- *  @brief  Class for running paint app
+ *  @brief  Class for running paint app: the windows and GUI around a PaintCore
  *  @author Mike and Team FunctionalPointers
  *  @date   2020-07-12
  ***********************************************/
@@ -11,9 +11,11 @@
 #include <SFML/Graphics/Texture.hpp>
 #include <SFML/Graphics/Sprite.hpp>
 // Include standard library C++ libraries.
+#include <algorithm>
 #include <cassert>
 // Project header files
 #include "App.hpp"
+#include "Profiler.hpp"
 
 #define WINDOW_WIDTH 1000
 #define WINDOW_HEIGHT 1000
@@ -29,109 +31,205 @@ App::App() {
     void (*m_initFunc)(void) = nullptr;
     void (*m_updateFunc)(void) = nullptr;
     void (*m_drawFunc)(void) = nullptr;
-    std::map<std::pair<int, int>, sf::Color> (*m_paintFunc)(sf::Color, int) = nullptr;
-
-    // Drawing variables
-    App::mouseX = 0;
-    App::mouseY = 0;
-    App::m_canvas = sf::Color::White;
-    App::m_color = sf::Color::Black;
-    App::strokeSize = 1;
 
     // Canvas variables
     App::m_window = nullptr;
     App::m_gui = nullptr;
     App::m_image = new sf::Image;
+    App::m_imageRevision = 0;
+    App::m_viewX = 0;
+    App::m_viewY = 0;
+    App::m_viewMoved = false;
+    App::canvasWidth = PaintCore::kCanvasWidth;
+    App::canvasHeight = PaintCore::kCanvasHeight;
     App::m_sprite = new sf::Sprite;
     App::m_texture = new sf::Texture;
     App::m_displayOffset = 150;
+
+    // Tools
+    App::bucketTool = false;
+    App::fillTolerance = 0;
+
+    // Metrics
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    App::m_frameTimeMetric = &metrics.histogram("app.frame_time_us");
+    App::m_remoteApplyMetric = &metrics.histogram("app.remote_apply_us");
 }
 
 /*! \brief
- *		Execute a command on a single pixel, and store it in a stack of pixels affected by this user action.
- *		Reset the "redo" stack so that no actions can be redone after this command is executed.
-* @param command the Command to be executed
+ * Record the duration of one iteration of the main loop.
+ * @param microseconds the frame time
  * @return void
 */
-void App::ExecuteCommand(Command *command) {
-    if (command->execute()) {
-        m_paintedPixels.push_back(command);
-        m_redo = std::stack<std::list<Command *>>();
-    }
+void App::RecordFrameTime(std::int64_t microseconds) {
+    m_frameTimeMetric->record(static_cast<std::uint64_t>(microseconds));
 }
 
 /*! \brief
- * Add all the pixels affected by a single user action, e.g
- * . click-and-drag brushstroke, to the "undo" stack.
- * @return void
-*
+ * Return the tracker which follows stroke samples from capture until they are presented.
+ * @return LatencyTracker& the latency tracker
 */
-void App::AddCommand() {
-    m_undo.push(m_paintedPixels);
+LatencyTracker &App::GetLatencyTracker() {
+    return m_latency;
 }
 
 /*! \brief
- * Undo a prior command, e.g. a brushstroke or filling the canvas with a color. Push the undone command
- * to the "redo" stack.
+ * Return the simplifier which decides which samples of the local user's strokes are sent.
+ * @return StrokeSimplifier& the stroke simplifier
+*/
+StrokeSimplifier &App::GetStrokeSimplifier() {
+    return m_strokeSimplifier;
+}
+
+/*! \brief
+ * Record how long it took to apply one packet received from another peer.
+ * @param microseconds the time spent applying the packet
  * @return void
+*/
+void App::RecordRemoteApplyTime(std::int64_t microseconds) {
+    m_remoteApplyMetric->record(static_cast<std::uint64_t>(microseconds));
+}
+
+/*! \brief 	Return a read-only sf::Image copy of the part of the flattened layers in view. The copy is
+*		only refreshed when they changed, or the view moved, since the last call.
+ *		@return the Image of this app
 *
 */
-void App::UndoCommand() {
-    if (m_undo.empty()) {
+const sf::Image &App::GetImage() {
+    const Canvas &canvas = GetFlattened();
+    const sf::Vector2u size = GetViewSize();
+    if (m_imageRevision != canvas.getRevision() || m_image->getSize() != size) {
+        m_uploadBuffer.resize(static_cast<std::size_t>(size.x) * size.y);
+        for (unsigned y = 0; y < size.y; y++) {
+            canvas.readSpan(m_viewY + static_cast<int>(y), m_viewX, static_cast<int>(size.x),
+                            &m_uploadBuffer[static_cast<std::size_t>(y) * size.x]);
+        }
+        m_image->create(size.x, size.y, reinterpret_cast<const sf::Uint8 *>(m_uploadBuffer.data()));
+        m_imageRevision = canvas.getRevision();
+    }
+    return *m_image;
+}
+
+/*! \brief 	Composite the tiles changed on any layer and copy the rows in view changed since the last
+*		upload into the texture. A brush stroke only touches a few rows, so this is far cheaper than
+*		reloading the whole view; after the view moves all of it is reloaded.
+ *		@return void
+*
+*/
+void App::UploadCanvas() {
+    Canvas &canvas = GetFlattened();
+    int firstRow;
+    int lastRow;
+    const bool changed = canvas.takeDirtyRows(firstRow, lastRow);
+    const sf::Vector2u size = GetViewSize();
+    if (m_viewMoved || m_texture->getSize() != size) {
+        m_viewMoved = false;
+        UploadView(canvas, *m_texture);
+        m_sprite->setTexture(*m_texture, true);
+        return;
+    }
+    firstRow = std::max(firstRow, m_viewY);
+    lastRow = std::min(lastRow, m_viewY + static_cast<int>(size.y) - 1);
+    if (!changed || firstRow > lastRow) {
         return;
     }
-    std::list<Command *> userAction = m_undo.top();
-    std::list<Command *>::reverse_iterator it;
-    for (it = userAction.rbegin(); it != userAction.rend(); ++it) {
-        mouseX = (*it)->getPixelX();
-        mouseY = (*it)->getPixelY();
-        (*it)->undo();
+    m_uploadBuffer.resize(static_cast<std::size_t>(size.x) * (lastRow - firstRow + 1));
+    for (int y = firstRow; y <= lastRow; y++) {
+        canvas.readSpan(y, m_viewX, static_cast<int>(size.x),
+                        &m_uploadBuffer[static_cast<std::size_t>(y - firstRow) * size.x]);
     }
-    m_redo.push(userAction);
-    m_undo.pop();
+    m_texture->update(reinterpret_cast<const sf::Uint8 *>(m_uploadBuffer.data()), size.x,
+                      static_cast<unsigned>(lastRow - firstRow + 1), 0, static_cast<unsigned>(firstRow - m_viewY));
 }
 
-/*! \brief
- * Redo an undone command, e.g. a brushstroke or filling the canvas with a color. Push the redone command
- * to the "undo" stack.
- * @return void
+/*! \brief 	Copy the part of an image in view into a texture, e.g. a frame of the timeline. The
+*		texture is recreated at the view's size if it differs.
+ *		@param canvas an image of the canvas's size
+ *		@param texture the texture to fill
+ *		@return void
+*
 */
-void App::RedoCommand() {
-    if (m_redo.empty()) {
-        return;
+void App::UploadView(const Canvas &canvas, sf::Texture &texture) {
+    const sf::Vector2u size = GetViewSize();
+    if (texture.getSize() != size) {
+        texture.create(size.x, size.y);
     }
-    std::list<Command *> userAction = m_redo.top();
-    std::list<Command *>::iterator it;
-    for (it = userAction.begin(); it != userAction.end(); ++it) {
-        mouseX = (*it)->getPixelX();
-        mouseY = (*it)->getPixelY();
-        (*it)->execute();
+    m_uploadBuffer.resize(static_cast<std::size_t>(size.x) * size.y);
+    for (unsigned y = 0; y < size.y; y++) {
+        canvas.readSpan(m_viewY + static_cast<int>(y), m_viewX, static_cast<int>(size.x),
+                        &m_uploadBuffer[static_cast<std::size_t>(y) * size.x]);
     }
-    m_undo.push(userAction);
-    m_redo.pop();
+    texture.update(reinterpret_cast<const sf::Uint8 *>(m_uploadBuffer.data()), size.x, size.y, 0, 0);
 }
 
-/*!
- * \brief Fill the display screen with the current color, and record this action as a command in the undo stack.
- *
- * @param command the FillDisplay command to be completed
- * @return void
- */
-void App::FillDisplay(Command *command) {
-    if (command->execute()) {
-        std::list<Command *> fillCommand{command};
-        m_undo.push(fillCommand);
-        m_redo = std::stack<std::list<Command *>>();
+/*! \brief 	Scroll the view over the canvas. It is kept on the canvas, so near an edge it stops short
+*		of (x, y). The texture is reloaded at the next upload. If the canvas pages its tiles, those
+*		within half a view around the new view start coming back, for the next scroll.
+ *		@param x the canvas x-coordinate for the left of the view
+ *		@param y the canvas y-coordinate for the top of the view
+ *		@return void
+*
+*/
+void App::SetView(int x, int y) {
+    const Canvas &canvas = GetFlattened();
+    const sf::Vector2u size = GetViewSize();
+    x = std::max(0, std::min(x, static_cast<int>(canvas.getWidth() - size.x)));
+    y = std::max(0, std::min(y, static_cast<int>(canvas.getHeight() - size.y)));
+    if (x != m_viewX || y != m_viewY) {
+        m_viewX = x;
+        m_viewY = y;
+        m_viewMoved = true;
+        const int marginX = static_cast<int>(size.x / 2);
+        const int marginY = static_cast<int>(size.y / 2);
+        GetFlattened().prefetch(CanvasRect{x - marginX, y - marginY, x + static_cast<int>(size.x) + marginX,
+                                           y + static_cast<int>(size.y) + marginY});
     }
 }
 
-/*! \brief 	Return a reference to our m_image, so that
-*		we do not have to publicly expose it.
- *		@return the Image of this app
+/*! \brief 	Recreate the canvas at another size, every layer blank and the history empty, and show it
+*		from its top-left. The texture is reloaded at the view's new size.
+ *		@param width the canvas width, at most Canvas::kMaxSize
+ *		@param height the canvas height, at most Canvas::kMaxSize
+ *		@return void
 *
 */
-sf::Image &App::GetImage() {
-    return *m_image;
+void App::ResizeCanvas(unsigned width, unsigned height) {
+    canvasWidth = width;
+    canvasHeight = height;
+    InitCanvas(width, height);
+    m_viewX = 0;
+    m_viewY = 0;
+    m_viewMoved = true;
+    UploadCanvas();
+}
+
+/*! \brief 	Return the canvas coordinates of the top-left pixel in view.
+ *		@return Vector2i the coordinates
+*
+*/
+sf::Vector2i App::GetView() const {
+    return sf::Vector2i(m_viewX, m_viewY);
+}
+
+/*! \brief 	Return the size of the view: the canvas window's, or the canvas's where it is smaller.
+ *		@return Vector2u the width and height in pixels
+*
+*/
+sf::Vector2u App::GetViewSize() {
+    const Canvas &canvas = GetFlattened();
+    return sf::Vector2u(std::min(canvas.getWidth(), static_cast<unsigned>(WINDOW_WIDTH)),
+                        std::min(canvas.getHeight(), static_cast<unsigned>(CANVAS_WINDOW_HEIGHT)));
+}
+
+/*! \brief 	Translate a point in the canvas window to the canvas, which tools, the network and saved
+*		files all work in.
+ *		@param windowX the x-coordinate in the window
+ *		@param windowY the y-coordinate in the window
+ *		@return Vector2i the canvas coordinates
+*
+*/
+sf::Vector2i App::ToCanvas(int windowX, int windowY) const {
+    return sf::Vector2i(windowX + m_viewX, windowY + m_viewY);
 }
 
 /*! \brief 	Return a reference to our m_Texture so that
@@ -190,6 +288,7 @@ sf::Vector2u App::GetDisplayDimensions() {
 *
 */
 void App::Destroy() {
+    PaintCore::Destroy();
     delete m_image;
     delete m_sprite;
     delete m_texture;
@@ -218,11 +317,14 @@ void App::Init(void (*initFunction)(void)) {
     m_gui->setActive(true);
 
 
-    // Create an image which stores the pixels we will update
-    m_image->create(WINDOW_WIDTH, CANVAS_WINDOW_HEIGHT, m_canvas);
-    assert(m_image != nullptr && "m_image != nullptr");
-    // Create a texture which lives in the GPU and will render our image
-    m_texture->loadFromImage(*m_image);
+    // Create the canvas which stores the pixels we will update; the window shows the part in view
+    InitCanvas(canvasWidth, canvasHeight);
+    // Create a texture which lives in the GPU and will render the view of our canvas
+    m_texture->loadFromImage(GetImage());
+    // The texture now holds every row, so start dirty tracking afresh
+    int firstRow;
+    int lastRow;
+    GetFlattened().takeDirtyRows(firstRow, lastRow);
     assert(m_texture != nullptr && "m_texture != nullptr");
     // Create a sprite which is the entity that can be textured
     m_sprite->setTexture(*m_texture);
@@ -242,17 +344,6 @@ void App::UpdateCallback(void (*updateFunction)(App *)) {
     m_updateFunc = updateFunction;
 }
 
-/*! \brief Update the app's paintbrush function. Any method with the specified parameters and return
- * types could be used for painting in the display.
- * @param (*paintFunction)(App *, sf::Color, int size, int m_x, int m_y)) - the paint function
- * @return void
- *
- */
-void App::UpdatePaintbrush(
-        std::map<std::pair<int, int>, sf::Color> (*paintFunction)(App *, sf::Color, int size, int m_x, int m_y)) {
-    m_paintFunc = paintFunction;
-}
-
 /*! \brief 	Set a callback function which will be called
 		each iteration of the main loop after update.
 		@param void (*drawFunction)(App *) - the draw callback
@@ -286,14 +377,6 @@ void App::Loop() {
 
 }
 
-/*! \brief 	Get color element in the App object.
- * @return int representing color
-*
-*/
-int App::getColor() {
-    return m_color.toInteger();
-}
-
 /*! \brief 	Delete this App object.
  * @return void
 *
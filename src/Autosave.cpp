@@ -0,0 +1,466 @@
+/**
+ *  @file   Autosave.cpp
+ *  @brief  Implementation of Autosave.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+// Project header files
+#include "Autosave.hpp"
+#include "ByteOrder.hpp"
+#include "Checksum.hpp"
+#include "Logger.hpp"
+
+// Bytes before a record's payload: magic, payload size and payload checksum
+static constexpr std::size_t kFrameBytes = 12;
+// Bytes of the fixed part of a payload: flags, width, height, active layer, layer and chunk counts
+static constexpr std::size_t kRecordHeaderBytes = 24;
+// Bytes before each chunk's pixels: layer, tile column and row, encoding and size
+static constexpr std::size_t kChunkHeaderBytes = 20;
+// Record flags
+static constexpr std::uint32_t kResetFlag = 1;
+
+/*! \brief Size of a file.
+ * @param path the file
+ * @return std::uint64_t its size in bytes, 0 if it does not exist
+ */
+static std::uint64_t fileSize(const std::string &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file ? static_cast<std::uint64_t>(file.tellg()) : 0;
+}
+
+/*! \brief Whether a file exists.
+ * @param path the file
+ * @return bool whether it can be opened
+ */
+static bool fileExists(const std::string &path) {
+    return std::ifstream(path).good();
+}
+
+/*! \brief Key of a tile of a layer, for finding a chunk again.
+ * @param chunk the chunk
+ * @return std::uint64_t the key
+ */
+static std::uint64_t tileKey(const ProjectChunk &chunk) {
+    return static_cast<std::uint64_t>(chunk.layer) << 42 | static_cast<std::uint64_t>(chunk.tileY) << 21 |
+           static_cast<std::uint64_t>(chunk.tileX);
+}
+
+/*! \brief Whether two layer tables say the same.
+ * @param a a table
+ * @param b another table
+ * @return bool whether every layer matches
+ */
+static bool sameLayers(const std::vector<ProjectLayer> &a, const std::vector<ProjectLayer> &b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const ProjectLayer &x, const ProjectLayer &y) {
+        return x.id == y.id && x.background == y.background && x.blend == y.blend && x.opacity == y.opacity &&
+               x.position == y.position;
+    });
+}
+
+/*! \brief Construct a journal for the base file at path. The journal and base already there, e.g.
+ * from a session which crashed, are kept: recover() reads them, and new records follow them.
+ * @param path the base file
+ */
+AutosaveJournal::AutosaveJournal(const std::string &path) {
+    m_path = path;
+    m_journalPath = path + ".journal";
+    m_oldPath = path + ".journal.old";
+    m_compactBytes = kMinCompactBytes;
+    // No generation of layers is 0, so the first record is a reset
+    m_generation = 0;
+    m_lastActiveLayer = LayerStack::kBaseLayer;
+    m_writing = false;
+    m_compacting = false;
+    m_failed = false;
+    m_journalBytes = fileSize(m_journalPath);
+    m_baseBytes = fileSize(m_path);
+    m_tasks = 0;
+
+    // Metrics
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_checkpoints = &metrics.counter("autosave.checkpoints");
+    m_skipped = &metrics.counter("autosave.skipped");
+    m_tilesSaved = &metrics.counter("autosave.tiles");
+    m_bytesSaved = &metrics.counter("autosave.bytes");
+    m_compactions = &metrics.counter("autosave.compactions");
+    m_journalBytesMetric = &metrics.gauge("autosave.journal_bytes");
+}
+
+/*! \brief Destructor: wait for the background work, which refers to this journal.
+ */
+AutosaveJournal::~AutosaveJournal() {
+    wait();
+}
+
+/*! \brief Take what the next record needs from the layers. Normally that is the tiles written since
+ * the last capture, which costs what changed; after the layers were created afresh (or a record
+ * was lost) it is every painted tile, in a record which replaces everything before it.
+ * @param layers the layers, flattened since they last changed
+ * @param activeLayer the layer the local user paints on
+ * @return std::shared_ptr<AutosaveRecord> the record
+ */
+std::shared_ptr<AutosaveRecord> AutosaveJournal::capture(LayerStack &layers, int activeLayer) {
+    std::shared_ptr<AutosaveRecord> record = std::make_shared<AutosaveRecord>();
+    if (m_failed.exchange(false) || layers.getGeneration() != m_generation) {
+        m_generation = layers.getGeneration();
+        record->reset = true;
+        record->changes = std::move(*ProjectFile::capture(layers, activeLayer));
+        for (std::size_t i = 0; i < layers.createdCount(); i++) {
+            std::vector<std::uint8_t> &unsaved = layers.created(i).unsaved;
+            std::fill(unsaved.begin(), unsaved.end(), 0);
+        }
+    } else {
+        record->changes = std::move(*ProjectFile::capture(layers, activeLayer, true));
+    }
+    return record;
+}
+
+/*! \brief Checkpoint the layers: capture the changes on this thread, then encode and append them
+ * in the background lane of pool. Only one checkpoint is written at a time; while one is, later
+ * checkpoints are skipped and their tiles stay marked for the next. A checkpoint with no changed
+ * tile or layer writes nothing. Once the journal outgrows the base, a compaction is started.
+ * @param layers the layers, flattened since they last changed
+ * @param activeLayer the layer the local user paints on
+ * @param pool the threads to write on
+ * @return bool false if a checkpoint was still being written
+ */
+bool AutosaveJournal::checkpoint(LayerStack &layers, int activeLayer, ThreadPool &pool) {
+    if (m_writing.exchange(true)) {
+        m_skipped->increment();
+        return false;
+    }
+    std::shared_ptr<AutosaveRecord> record = capture(layers, activeLayer);
+    if (!record->reset && record->changes.chunks.empty() && activeLayer == m_lastActiveLayer &&
+        sameLayers(record->changes.layers, m_lastLayers)) {
+        m_writing = false;
+        return true;
+    }
+    m_lastLayers = record->changes.layers;
+    m_lastActiveLayer = activeLayer;
+    m_checkpoints->increment();
+    beginTask();
+    pool.submit([this, record, &pool]() {
+        std::string error;
+        if (!append(*record, error)) {
+            LOG_ERROR("Could not autosave to " << m_journalPath << ": " << error);
+            m_failed = true;
+        }
+        m_writing = false;
+        if (m_journalBytes > std::max(m_compactBytes, m_baseBytes.load()) && !m_compacting.exchange(true)) {
+            beginTask();
+            pool.submit([this]() {
+                std::string error;
+                if (!compact(error)) {
+                    LOG_ERROR("Could not compact " << m_journalPath << ": " << error);
+                }
+                m_compacting = false;
+                endTask();
+            }, ThreadPool::Lane::Background);
+        }
+        endTask();
+    }, ThreadPool::Lane::Background);
+    return true;
+}
+
+/*! \brief Encode a record and append it to the journal in one write.
+ * @param record the record
+ * @param error receives what went wrong
+ * @return bool whether it was written
+ */
+bool AutosaveJournal::append(const AutosaveRecord &record, std::string &error) {
+    std::vector<std::uint8_t> bytes;
+    encodeRecord(record, bytes);
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    std::ofstream file(m_journalPath, std::ios::binary | std::ios::app);
+    file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    file.close();
+    if (!file) {
+        error = "cannot append to " + m_journalPath;
+        return false;
+    }
+    m_journalBytes += bytes.size();
+    m_journalBytesMetric->set(static_cast<std::int64_t>(m_journalBytes));
+    m_tilesSaved->increment(record.changes.chunks.size());
+    m_bytesSaved->increment(bytes.size());
+    return true;
+}
+
+/*! \brief Fold the journal into the base. The journal is moved aside first, under the lock appends
+ * take, so checkpoints carry on into a new journal meanwhile; the base is then rebuilt from the old
+ * base and the moved journal without the lock, and replaced in one rename. A moved journal left by
+ * a compaction which did not finish is folded in first.
+ * @param error receives what went wrong
+ * @return bool whether the journal was folded in, or there was nothing to fold
+ */
+bool AutosaveJournal::compact(std::string &error) {
+    {
+        std::lock_guard<std::mutex> lock(m_fileMutex);
+        if (!fileExists(m_oldPath)) {
+            if (!fileExists(m_journalPath)) {
+                return true;
+            }
+            if (std::rename(m_journalPath.c_str(), m_oldPath.c_str()) != 0) {
+                error = "cannot move " + m_journalPath + " aside";
+                return false;
+            }
+            m_journalBytes = 0;
+        }
+    }
+    ProjectSnapshot snapshot;
+    bool found = false;
+    if (!replay(m_path, {m_oldPath}, snapshot, found, error)) {
+        return false;
+    }
+    if (found && !ProjectFile::write(snapshot, m_path, error)) {
+        return false;
+    }
+    std::remove(m_oldPath.c_str());
+    m_baseBytes = fileSize(m_path);
+    m_journalBytesMetric->set(static_cast<std::int64_t>(m_journalBytes));
+    m_compactions->increment();
+    return true;
+}
+
+/*! \brief Start the files over from a snapshot of the layers: write it as the base and drop the
+ * journals. The layers' unsaved marks are cleared, so the next checkpoint holds only what changes
+ * from here.
+ * @param snapshot the drawing, as the layers hold it
+ * @param layers the layers
+ * @param error receives what went wrong
+ * @return bool whether the base was written
+ */
+bool AutosaveJournal::rebase(const ProjectSnapshot &snapshot, LayerStack &layers, std::string &error) {
+    wait();
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    if (!ProjectFile::write(snapshot, m_path, error)) {
+        return false;
+    }
+    std::remove(m_oldPath.c_str());
+    std::remove(m_journalPath.c_str());
+    m_journalBytes = 0;
+    m_baseBytes = fileSize(m_path);
+    m_generation = layers.getGeneration();
+    m_lastLayers = snapshot.layers;
+    m_lastActiveLayer = snapshot.activeLayer;
+    for (std::size_t i = 0; i < layers.createdCount(); i++) {
+        std::vector<std::uint8_t> &unsaved = layers.created(i).unsaved;
+        std::fill(unsaved.begin(), unsaved.end(), 0);
+    }
+    return true;
+}
+
+/*! \brief Wait until no checkpoint or compaction of this journal is running.
+ * @return void
+ */
+void AutosaveJournal::wait() {
+    std::unique_lock<std::mutex> lock(m_taskMutex);
+    m_idle.wait(lock, [this]() { return m_tasks == 0; });
+}
+
+/*! \brief Count a background task in.
+ * @return void
+ */
+void AutosaveJournal::beginTask() {
+    std::lock_guard<std::mutex> lock(m_taskMutex);
+    m_tasks++;
+}
+
+/*! \brief Count a background task out, waking wait() after the last.
+ * @return void
+ */
+void AutosaveJournal::endTask() {
+    std::lock_guard<std::mutex> lock(m_taskMutex);
+    if (--m_tasks == 0) {
+        m_idle.notify_all();
+    }
+}
+
+/*! \brief Rebuild a drawing from the files an AutosaveJournal for path writes.
+ * @param path the base file
+ * @param snapshot receives the drawing
+ * @param error receives what went wrong
+ * @return bool false if there is neither a base nor an intact record, or the base is damaged
+ */
+bool AutosaveJournal::recover(const std::string &path, ProjectSnapshot &snapshot, std::string &error) {
+    bool found = false;
+    if (!replay(path, {path + ".journal.old", path + ".journal"}, snapshot, found, error)) {
+        return false;
+    }
+    if (!found) {
+        error = "nothing to recover at " + path;
+        return false;
+    }
+    return true;
+}
+
+/*! \brief Load the base, then apply the records of each journal in turn. A record's layer table
+ * replaces the drawing's, and its tiles replace the same tiles; a reset record drops every tile
+ * first. Reading a journal stops at its first torn or damaged record, which is what a crash
+ * during an append leaves.
+ * @param path the base file, which need not exist
+ * @param journals the journals, oldest first; missing ones are skipped
+ * @param snapshot receives the drawing
+ * @param found set if the base or any record was read
+ * @param error receives what went wrong
+ * @return bool false if the base exists but is damaged
+ */
+bool AutosaveJournal::replay(const std::string &path, const std::vector<std::string> &journals,
+                             ProjectSnapshot &snapshot, bool &found, std::string &error) {
+    snapshot = ProjectSnapshot();
+    found = false;
+    if (fileExists(path)) {
+        if (!ProjectFile::read(path, snapshot, error)) {
+            return false;
+        }
+        found = true;
+    }
+    std::map<std::uint64_t, std::size_t> tiles;
+    for (std::size_t i = 0; i < snapshot.chunks.size(); i++) {
+        tiles[tileKey(snapshot.chunks[i])] = i;
+    }
+    for (const std::string &journal : journals) {
+        std::ifstream file(journal, std::ios::binary);
+        if (!file) {
+            continue;
+        }
+        const std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(file)),
+                                              std::istreambuf_iterator<char>());
+        std::size_t offset = 0;
+        std::size_t records = 0;
+        AutosaveRecord record;
+        while (offset < bytes.size()) {
+            const std::size_t used = decodeRecord(bytes.data() + offset, bytes.size() - offset, record);
+            if (used == 0) {
+                LOG_WARN("Ignoring " << bytes.size() - offset << " bytes of " << journal << " after record "
+                         << records << ": torn or damaged");
+                break;
+            }
+            if (record.reset) {
+                snapshot.chunks.clear();
+                tiles.clear();
+            }
+            snapshot.width = record.changes.width;
+            snapshot.height = record.changes.height;
+            snapshot.activeLayer = record.changes.activeLayer;
+            snapshot.layers = std::move(record.changes.layers);
+            for (ProjectChunk &chunk : record.changes.chunks) {
+                auto existing = tiles.find(tileKey(chunk));
+                if (existing != tiles.end()) {
+                    snapshot.chunks[existing->second] = std::move(chunk);
+                } else {
+                    tiles[tileKey(chunk)] = snapshot.chunks.size();
+                    snapshot.chunks.push_back(std::move(chunk));
+                }
+            }
+            offset += used;
+            records++;
+            found = true;
+        }
+    }
+    return true;
+}
+
+/*! \brief Append a record: a frame of the magic, the payload's size and its CRC-32, then the
+ * payload of the flags, the canvas size, the active layer, the layer table and each chunk with
+ * its tile, encoding and size. Chunks are kept even when they hold just the background, since
+ * they may overwrite a tile painted earlier.
+ * @param record the record
+ * @param out the bytes to append to
+ * @return void
+ */
+void AutosaveJournal::encodeRecord(const AutosaveRecord &record, std::vector<std::uint8_t> &out) {
+    const std::size_t frame = out.size();
+    out.resize(frame + kFrameBytes);
+    const ProjectSnapshot &changes = record.changes;
+    ByteOrder::putU32(out, record.reset ? kResetFlag : 0);
+    ByteOrder::putU32(out, changes.width);
+    ByteOrder::putU32(out, changes.height);
+    ByteOrder::putU32(out, static_cast<std::uint32_t>(changes.activeLayer));
+    ByteOrder::putU32(out, static_cast<std::uint32_t>(changes.layers.size()));
+    ByteOrder::putU32(out, static_cast<std::uint32_t>(changes.chunks.size()));
+    for (const ProjectLayer &layer : changes.layers) {
+        ProjectFile::putLayer(out, layer);
+    }
+    std::vector<std::uint8_t> encoded;
+    for (const ProjectChunk &chunk : changes.chunks) {
+        const std::uint32_t encoding = ProjectFile::encodeChunk(chunk, encoded);
+        ByteOrder::putU32(out, chunk.layer);
+        ByteOrder::putU32(out, static_cast<std::uint32_t>(chunk.tileX));
+        ByteOrder::putU32(out, static_cast<std::uint32_t>(chunk.tileY));
+        ByteOrder::putU32(out, encoding);
+        ByteOrder::putU32(out, static_cast<std::uint32_t>(encoded.size()));
+        out.insert(out.end(), encoded.begin(), encoded.end());
+    }
+    const std::size_t payload = out.size() - frame - kFrameBytes;
+    std::vector<std::uint8_t> header;
+    ByteOrder::putU32(header, kRecordMagic);
+    ByteOrder::putU32(header, static_cast<std::uint32_t>(payload));
+    ByteOrder::putU32(header, Checksum::crc32(out.data() + frame + kFrameBytes, payload));
+    std::copy(header.begin(), header.end(), out.begin() + static_cast<std::ptrdiff_t>(frame));
+}
+
+/*! \brief Decode a record written by encodeRecord(), checking its frame and every field.
+ * @param data the bytes from the record's start
+ * @param size the number of bytes available
+ * @param record receives the record
+ * @return std::size_t the bytes the record takes, or 0 if it is torn or damaged
+ */
+std::size_t AutosaveJournal::decodeRecord(const std::uint8_t *data, std::size_t size, AutosaveRecord &record) {
+    if (size < kFrameBytes || ByteOrder::getU32(data) != kRecordMagic) {
+        return 0;
+    }
+    const std::size_t payloadSize = ByteOrder::getU32(data + 4);
+    if (payloadSize < kRecordHeaderBytes || payloadSize > size - kFrameBytes) {
+        return 0;
+    }
+    const std::uint8_t *payload = data + kFrameBytes;
+    if (Checksum::crc32(payload, payloadSize) != ByteOrder::getU32(data + 8)) {
+        return 0;
+    }
+    record = AutosaveRecord();
+    record.reset = (ByteOrder::getU32(payload) & kResetFlag) != 0;
+    ProjectSnapshot &changes = record.changes;
+    changes.width = ByteOrder::getU32(payload + 4);
+    changes.height = ByteOrder::getU32(payload + 8);
+    changes.activeLayer = static_cast<int>(ByteOrder::getU32(payload + 12));
+    const std::uint32_t layerCount = ByteOrder::getU32(payload + 16);
+    const std::uint32_t chunkCount = ByteOrder::getU32(payload + 20);
+    std::size_t offset = kRecordHeaderBytes;
+    if (layerCount > (payloadSize - offset) / ProjectFile::kLayerBytes) {
+        return 0;
+    }
+    for (std::uint32_t i = 0; i < layerCount; i++) {
+        ProjectLayer layer;
+        if (!ProjectFile::getLayer(payload + offset, layer)) {
+            return 0;
+        }
+        changes.layers.push_back(layer);
+        offset += ProjectFile::kLayerBytes;
+    }
+    for (std::uint32_t i = 0; i < chunkCount; i++) {
+        if (payloadSize - offset < kChunkHeaderBytes) {
+            return 0;
+        }
+        const std::uint8_t *entry = payload + offset;
+        ProjectChunk chunk{ByteOrder::getU32(entry), static_cast<int>(ByteOrder::getU32(entry + 4)),
+                           static_cast<int>(ByteOrder::getU32(entry + 8)), std::vector<Canvas::Pixel>(),
+                           std::vector<std::uint8_t>(), 0};
+        const std::uint32_t encoding = ByteOrder::getU32(entry + 12);
+        const std::size_t bytes = ByteOrder::getU32(entry + 16);
+        offset += kChunkHeaderBytes;
+        if (chunk.layer >= layerCount || chunk.tileX < 0 || chunk.tileY < 0 || bytes > payloadSize - offset ||
+            !ProjectFile::decodeChunk(encoding, payload + offset, bytes, changes.width, changes.height, chunk)) {
+            return 0;
+        }
+        changes.chunks.push_back(std::move(chunk));
+        offset += bytes;
+    }
+    return offset == payloadSize ? kFrameBytes + payloadSize : 0;
+}
@@ -0,0 +1,348 @@
+/**
+ *  @file   BlendKernels.cpp
+ *  @brief  Implementation of BlendKernels.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+// Project header files
+#include "BlendKernels.hpp"
+
+/*! \brief Divide by 255 with rounding, exactly, for 0 <= x <= 255 * 255.
+ * @param x the dividend
+ * @return unsigned the rounded quotient
+ */
+static inline unsigned div255(unsigned x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/*! \brief One channel of the blend mode's color, before alpha is applied.
+ * @param source the layer's channel
+ * @param below the channel below it
+ * @return unsigned the blended channel
+ */
+template <BlendMode Mode>
+static inline unsigned blendChannel(unsigned source, unsigned below) {
+    switch (Mode) {
+        case BlendMode::Multiply:
+            return div255(source * below);
+        case BlendMode::Screen:
+            return 255 - div255((255 - source) * (255 - below));
+        case BlendMode::Add:
+            return std::min(source + below, 255u);
+        default:
+            return source;
+    }
+}
+
+/*! \brief Scalar kernel for one blend mode.
+ * @param dst the opaque pixels to blend onto
+ * @param src the layer's pixels
+ * @param count the number of pixels
+ * @param opacity the layer's opacity
+ * @return void
+ */
+template <BlendMode Mode>
+static void blendScalar(Canvas::Pixel *dst, const Canvas::Pixel *src, int count, unsigned opacity) {
+    for (int i = 0; i < count; i++) {
+        std::uint8_t source[4];
+        std::uint8_t below[4];
+        std::memcpy(source, &src[i], sizeof(source));
+        const unsigned alpha = div255(source[3] * opacity);
+        if (alpha == 0) {
+            continue;
+        }
+        std::memcpy(below, &dst[i], sizeof(below));
+        for (int channel = 0; channel < 3; channel++) {
+            const unsigned blended = blendChannel<Mode>(source[channel], below[channel]);
+            below[channel] = static_cast<std::uint8_t>(div255(blended * alpha + below[channel] * (255 - alpha)));
+        }
+        below[3] = 255;
+        std::memcpy(&dst[i], below, sizeof(below));
+    }
+}
+
+#if defined(__SSE2__)
+/*! \brief Divide eight 16-bit lanes by 255 with rounding, as div255().
+ * @param x the dividends, each at most 255 * 255
+ * @return __m128i the quotients
+ */
+static inline __m128i div255x8(__m128i x) {
+    __m128i t = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+/*! \brief Blend two pixels widened to 16-bit channels, as blendScalar() does.
+ * @param source the layer's two pixels
+ * @param below the two pixels below
+ * @param opacity the opacity in every lane
+ * @return __m128i the two blended pixels, 16 bits per channel
+ */
+template <BlendMode Mode>
+static inline __m128i blendPair(__m128i source, __m128i below, __m128i opacity) {
+    const __m128i full = _mm_set1_epi16(255);
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(source, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = div255x8(_mm_mullo_epi16(alpha, opacity));
+    __m128i blended;
+    switch (Mode) {
+        case BlendMode::Multiply:
+            blended = div255x8(_mm_mullo_epi16(source, below));
+            break;
+        case BlendMode::Screen:
+            blended = _mm_sub_epi16(
+                    full, div255x8(_mm_mullo_epi16(_mm_sub_epi16(full, source), _mm_sub_epi16(full, below))));
+            break;
+        case BlendMode::Add:
+            blended = _mm_min_epi16(_mm_add_epi16(source, below), full);
+            break;
+        default:
+            blended = source;
+            break;
+    }
+    return div255x8(_mm_add_epi16(_mm_mullo_epi16(blended, alpha), _mm_mullo_epi16(below, _mm_sub_epi16(full, alpha))));
+}
+
+/*! \brief SSE2 kernel for one blend mode: four pixels per step, the remainder done by blendScalar().
+ * Groups of four fully transparent source pixels are skipped, so sparse layers cost little.
+ * @param dst the opaque pixels to blend onto
+ * @param src the layer's pixels
+ * @param count the number of pixels
+ * @param opacity the layer's opacity
+ * @return void
+ */
+template <BlendMode Mode>
+static void blendSse2(Canvas::Pixel *dst, const Canvas::Pixel *src, int count, unsigned opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(Canvas::fromRGBA(0xFF)));
+    const __m128i opacityLanes = _mm_set1_epi16(static_cast<short>(opacity));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(source, alphaMask), zero)) == 0xFFFF) {
+            continue;
+        }
+        const __m128i below = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+        __m128i low = blendPair<Mode>(_mm_unpacklo_epi8(source, zero), _mm_unpacklo_epi8(below, zero), opacityLanes);
+        __m128i high = blendPair<Mode>(_mm_unpackhi_epi8(source, zero), _mm_unpackhi_epi8(below, zero), opacityLanes);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_or_si128(_mm_packus_epi16(low, high), alphaMask));
+    }
+    blendScalar<Mode>(dst + i, src + i, count - i, opacity);
+}
+
+/*! \brief SSE2 source-over of one color through a coverage mask: four pixels per step. Groups
+ * with no coverage are skipped; groups whose pixels are not all opaque, where the color has to
+ * be divided by the new alpha, are left to sourceOverMaskedScalar().
+ * @param dst the pixels to paint
+ * @param coverage the mask, one byte per pixel
+ * @param count the number of pixels
+ * @param color the color
+ * @param strength scales the mask, 0-255
+ * @return void
+ */
+static void sourceOverSse2(Canvas::Pixel *dst, const std::uint8_t *coverage, int count, Canvas::Pixel color,
+                           std::uint8_t strength) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(Canvas::fromRGBA(0xFF)));
+    const __m128i strengthLanes = _mm_set1_epi16(static_cast<short>(strength));
+    const __m128i colorLanes = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(color)), zero);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        std::int32_t mask;
+        std::memcpy(&mask, coverage + i, sizeof(mask));
+        if (mask == 0) {
+            continue;
+        }
+        const __m128i below = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(below, alphaMask), alphaMask)) != 0xFFFF) {
+            BlendKernels::sourceOverMaskedScalar(dst + i, coverage + i, 4, color, strength);
+            continue;
+        }
+        // The color's alpha at the four pixels, then each spread over its pixel's four channels
+        __m128i alpha = div255x8(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(mask), zero), strengthLanes));
+        alpha = _mm_unpacklo_epi16(alpha, alpha);
+        const __m128i lowAlpha = _mm_unpacklo_epi32(alpha, alpha);
+        const __m128i highAlpha = _mm_unpackhi_epi32(alpha, alpha);
+        __m128i low = _mm_unpacklo_epi8(below, zero);
+        __m128i high = _mm_unpackhi_epi8(below, zero);
+        low = div255x8(_mm_add_epi16(_mm_mullo_epi16(colorLanes, lowAlpha),
+                                     _mm_mullo_epi16(low, _mm_sub_epi16(full, lowAlpha))));
+        high = div255x8(_mm_add_epi16(_mm_mullo_epi16(colorLanes, highAlpha),
+                                      _mm_mullo_epi16(high, _mm_sub_epi16(full, highAlpha))));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_or_si128(_mm_packus_epi16(low, high), alphaMask));
+    }
+    BlendKernels::sourceOverMaskedScalar(dst + i, coverage + i, count - i, color, strength);
+}
+#endif
+
+/*! \brief Blend a row of layer pixels onto the opaque pixels below, with the SSE2 kernel where
+ * the build targets it and the scalar one otherwise.
+ * @param dst the opaque pixels to blend onto; they stay opaque
+ * @param src the layer's pixels
+ * @param count the number of pixels
+ * @param mode the layer's blend mode
+ * @param opacity the layer's opacity (255 = as painted)
+ * @return void
+ */
+void BlendKernels::blendRow(Canvas::Pixel *dst, const Canvas::Pixel *src, int count, BlendMode mode,
+                            std::uint8_t opacity) {
+#if defined(__SSE2__)
+    if (opacity == 0) {
+        return;
+    }
+    switch (mode) {
+        case BlendMode::Multiply:
+            blendSse2<BlendMode::Multiply>(dst, src, count, opacity);
+            break;
+        case BlendMode::Screen:
+            blendSse2<BlendMode::Screen>(dst, src, count, opacity);
+            break;
+        case BlendMode::Add:
+            blendSse2<BlendMode::Add>(dst, src, count, opacity);
+            break;
+        default:
+            blendSse2<BlendMode::Normal>(dst, src, count, opacity);
+            break;
+    }
+#else
+    blendRowScalar(dst, src, count, mode, opacity);
+#endif
+}
+
+/*! \brief Blend a row of layer pixels onto the opaque pixels below, one pixel at a time.
+ * @param dst the opaque pixels to blend onto; they stay opaque
+ * @param src the layer's pixels
+ * @param count the number of pixels
+ * @param mode the layer's blend mode
+ * @param opacity the layer's opacity (255 = as painted)
+ * @return void
+ */
+void BlendKernels::blendRowScalar(Canvas::Pixel *dst, const Canvas::Pixel *src, int count, BlendMode mode,
+                                  std::uint8_t opacity) {
+    if (opacity == 0) {
+        return;
+    }
+    switch (mode) {
+        case BlendMode::Multiply:
+            blendScalar<BlendMode::Multiply>(dst, src, count, opacity);
+            break;
+        case BlendMode::Screen:
+            blendScalar<BlendMode::Screen>(dst, src, count, opacity);
+            break;
+        case BlendMode::Add:
+            blendScalar<BlendMode::Add>(dst, src, count, opacity);
+            break;
+        default:
+            blendScalar<BlendMode::Normal>(dst, src, count, opacity);
+            break;
+    }
+}
+
+/*! \brief Paint one color through a coverage mask, source-over, with the SSE2 kernel where the
+ * build targets it and the scalar one otherwise.
+ * @param dst the pixels to paint; they may be transparent
+ * @param coverage the mask, one byte per pixel
+ * @param count the number of pixels
+ * @param color the color; its own alpha is ignored
+ * @param strength the color's alpha where the mask is 255
+ * @return void
+ */
+void BlendKernels::sourceOverMasked(Canvas::Pixel *dst, const std::uint8_t *coverage, int count,
+                                    Canvas::Pixel color, std::uint8_t strength) {
+    if (strength == 0) {
+        return;
+    }
+#if defined(__SSE2__)
+    sourceOverSse2(dst, coverage, count, color, strength);
+#else
+    sourceOverMaskedScalar(dst, coverage, count, color, strength);
+#endif
+}
+
+/*! \brief Paint one color through a coverage mask, source-over, one pixel at a time. With
+ * a = coverage * strength / 255 and the pixel's alpha d, the new alpha is a + d * (255 - a) / 255
+ * and each channel the alpha-weighted mean of the color and the pixel, rounded.
+ * @param dst the pixels to paint; they may be transparent
+ * @param coverage the mask, one byte per pixel
+ * @param count the number of pixels
+ * @param color the color; its own alpha is ignored
+ * @param strength the color's alpha where the mask is 255
+ * @return void
+ */
+void BlendKernels::sourceOverMaskedScalar(Canvas::Pixel *dst, const std::uint8_t *coverage, int count,
+                                          Canvas::Pixel color, std::uint8_t strength) {
+    std::uint8_t source[4];
+    std::memcpy(source, &color, sizeof(source));
+    for (int i = 0; i < count; i++) {
+        const unsigned alpha = div255(coverage[i] * static_cast<unsigned>(strength));
+        if (alpha == 0) {
+            continue;
+        }
+        std::uint8_t below[4];
+        std::memcpy(below, &dst[i], sizeof(below));
+        // Where the pixel is opaque, kept is 255 - alpha and this is the Normal blend
+        const unsigned kept = div255(below[3] * (255 - alpha));
+        const unsigned total = alpha + kept;
+        for (int channel = 0; channel < 3; channel++) {
+            below[channel] = static_cast<std::uint8_t>((source[channel] * alpha + below[channel] * kept + total / 2) /
+                                                       total);
+        }
+        below[3] = static_cast<std::uint8_t>(total);
+        std::memcpy(&dst[i], below, sizeof(below));
+    }
+}
+
+/*! \brief Erase through a coverage mask: lower each pixel's alpha by coverage * strength / 255 of it.
+ * @param dst the pixels to erase
+ * @param coverage the mask, one byte per pixel
+ * @param count the number of pixels
+ * @param strength how much full coverage erases, 0-255
+ * @return void
+ */
+void BlendKernels::eraseMasked(Canvas::Pixel *dst, const std::uint8_t *coverage, int count, std::uint8_t strength) {
+    for (int i = 0; i < count; i++) {
+        const unsigned alpha = div255(coverage[i] * static_cast<unsigned>(strength));
+        if (alpha == 0) {
+            continue;
+        }
+        std::uint8_t below[4];
+        std::memcpy(below, &dst[i], sizeof(below));
+        below[3] = static_cast<std::uint8_t>(div255(below[3] * (255 - alpha)));
+        std::memcpy(&dst[i], below, sizeof(below));
+    }
+}
+
+/*! \brief Whether blendRow() uses a SIMD kernel in this build.
+ * @return bool true when compiled for SSE2
+ */
+bool BlendKernels::hasSimd() {
+#if defined(__SSE2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*! \brief Short name of a blend mode.
+ * @param mode the blend mode
+ * @return const char* the name
+ */
+const char *BlendKernels::getName(BlendMode mode) {
+    switch (mode) {
+        case BlendMode::Multiply:
+            return "multiply";
+        case BlendMode::Screen:
+            return "screen";
+        case BlendMode::Add:
+            return "add";
+        default:
+            return "normal";
+    }
+}
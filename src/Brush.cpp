@@ -0,0 +1,665 @@
+/**
+ *  @file   Brush.cpp
+ *  @brief  Implementation of Brush.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <utility>
+// Project header files
+#include "BlendKernels.hpp"
+#include "Brush.hpp"
+#include "Metrics.hpp"
+
+// Samples per pixel side when a stamp's coverage is worked out; positions are in 1/16 pixel
+static constexpr int kStampSamples = 8;
+static constexpr int kStampUnits = 2 * kStampSamples;
+// Bytes of run-time stamps kept before the cache starts over
+static constexpr std::size_t kStampCacheBytes = 16 * 1024 * 1024;
+
+/*! \brief Coverage of one pixel of a round brush stamp, from 8 x 8 samples. A sample inside the
+ * hard radius counts fully; between it and the radius its weight falls off with the squared
+ * distance; outside it counts nothing.
+ * @param radius the brush radius in pixels
+ * @param hardness the fraction of the radius at full strength, 0-255
+ * @param subX the dab center's offset right of the pixel corner, in 1 / kSubPixel pixels
+ * @param subY the dab center's offset below the pixel corner, in 1 / kSubPixel pixels
+ * @param x the pixel's column in the stamp's box
+ * @param y the pixel's row in the stamp's box
+ * @return std::uint8_t the coverage, 0-255
+ */
+static constexpr std::uint8_t stampCoverage(int radius, int hardness, int subX, int subY, int x, int y) {
+    const std::int64_t outer = static_cast<std::int64_t>(kStampUnits) * radius;
+    const std::int64_t inner = outer * hardness / 255;
+    const std::int64_t outerSquared = outer * outer;
+    const std::int64_t innerSquared = inner * inner;
+    const int step = kStampUnits / BrushStamps::kSubPixel;
+    std::int64_t sum = 0;
+    for (int sampleY = 0; sampleY < kStampSamples; sampleY++) {
+        const std::int64_t dy = kStampUnits * (y - radius) + 2 * sampleY + 1 - step * subY;
+        for (int sampleX = 0; sampleX < kStampSamples; sampleX++) {
+            const std::int64_t dx = kStampUnits * (x - radius) + 2 * sampleX + 1 - step * subX;
+            const std::int64_t distance = dx * dx + dy * dy;
+            if (distance <= innerSquared) {
+                sum += 255;
+            } else if (distance < outerSquared) {
+                sum += 255 * (outerSquared - distance) / (outerSquared - innerSquared);
+            }
+        }
+    }
+    const std::int64_t samples = kStampSamples * kStampSamples;
+    return static_cast<std::uint8_t>((sum + samples / 2) / samples);
+}
+
+// Every stamp of a hard brush of one radius, generated at compile time
+template <int Radius>
+struct HardStampTable {
+    static constexpr int kSize = 2 * Radius + 1;
+    static constexpr int kCount = BrushStamps::kSubPixel * BrushStamps::kSubPixel * kSize * kSize;
+
+    static constexpr std::array<std::uint8_t, kCount> make() {
+        std::array<std::uint8_t, kCount> coverage{};
+        std::size_t i = 0;
+        for (int subY = 0; subY < BrushStamps::kSubPixel; subY++) {
+            for (int subX = 0; subX < BrushStamps::kSubPixel; subX++) {
+                for (int y = 0; y < kSize; y++) {
+                    for (int x = 0; x < kSize; x++) {
+                        coverage[i++] = stampCoverage(Radius, 255, subX, subY, x, y);
+                    }
+                }
+            }
+        }
+        return coverage;
+    }
+
+    static constexpr std::array<std::uint8_t, kCount> kCoverage = make();
+};
+
+// The compile-time tables by radius
+static const std::uint8_t *const kHardStamps[BrushStamps::kMaxTableRadius + 1] = {
+        nullptr,
+        HardStampTable<1>::kCoverage.data(),
+        HardStampTable<2>::kCoverage.data(),
+        HardStampTable<3>::kCoverage.data(),
+        HardStampTable<4>::kCoverage.data(),
+        HardStampTable<5>::kCoverage.data(),
+        HardStampTable<6>::kCoverage.data(),
+        HardStampTable<7>::kCoverage.data(),
+        HardStampTable<8>::kCoverage.data()};
+
+// Stamps made at run time, by radius and hardness
+static std::mutex stampMutex;
+static std::map<std::pair<int, int>, std::shared_ptr<const std::vector<std::uint8_t>>> stampCache;
+static std::size_t stampCacheBytes = 0;
+
+/*! \brief Floor of a / b for b > 0, rounding towards negative infinity for negative a as well.
+ * @param a the numerator
+ * @param b the denominator, which must be positive
+ * @return std::int64_t the quotient rounded down
+ */
+static std::int64_t floorDiv(std::int64_t a, std::int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/*! \brief Ceiling of a / b for b > 0.
+ * @param a the numerator
+ * @param b the denominator, which must be positive
+ * @return std::int64_t the quotient rounded up
+ */
+static std::int64_t ceilDiv(std::int64_t a, std::int64_t b) {
+    return -floorDiv(-a, b);
+}
+
+/*! \brief Work out the coverage of one stamp, pixel by pixel.
+ * @param radius the brush radius in pixels, at least 1
+ * @param hardness the fraction of the radius at full strength, 0-255
+ * @param subX the dab center's offset right of the pixel corner, in 1 / kSubPixel pixels
+ * @param subY the dab center's offset below the pixel corner, in 1 / kSubPixel pixels
+ * @param out receives (2 * radius + 1) squared coverage bytes, rows top to bottom
+ * @return void
+ */
+void BrushStamps::generate(int radius, std::uint8_t hardness, int subX, int subY, std::uint8_t *out) {
+    const int size = 2 * radius + 1;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            *out++ = stampCoverage(radius, hardness, subX, subY, x, y);
+        }
+    }
+}
+
+/*! \brief The stamps of a radius and hardness. Hard stamps of small radii come from tables built at
+ * compile time; others are made on first use and cached. The cache starts over once it holds
+ * kStampCacheBytes, which only sweeping through many sizes and hardnesses does.
+ * @param radius the brush radius in pixels, at least 1
+ * @param hardness the fraction of the radius at full strength, 0-255
+ * @return StampSet the stamps for every sub-pixel position
+ */
+BrushStamps::StampSet BrushStamps::get(int radius, std::uint8_t hardness) {
+    const int size = 2 * radius + 1;
+    if (hardness == 255 && radius <= kMaxTableRadius) {
+        return StampSet{size, kHardStamps[radius], nullptr};
+    }
+    static Counter &made = MetricsRegistry::Get().counter("brush.stamps_made");
+    std::lock_guard<std::mutex> lock(stampMutex);
+    auto cached = stampCache.find(std::make_pair(radius, static_cast<int>(hardness)));
+    if (cached != stampCache.end()) {
+        return StampSet{size, cached->second->data(), cached->second};
+    }
+    const std::size_t stampBytes = static_cast<std::size_t>(size) * size;
+    std::shared_ptr<std::vector<std::uint8_t>> stamps =
+            std::make_shared<std::vector<std::uint8_t>>(stampBytes * kSubPixel * kSubPixel);
+    for (int subY = 0; subY < kSubPixel; subY++) {
+        for (int subX = 0; subX < kSubPixel; subX++) {
+            generate(radius, hardness, subX, subY, stamps->data() + (subY * kSubPixel + subX) * stampBytes);
+        }
+    }
+    if (stampCacheBytes + stamps->size() > kStampCacheBytes) {
+        stampCache.clear();
+        stampCacheBytes = 0;
+    }
+    stampCache[std::make_pair(radius, static_cast<int>(hardness))] = stamps;
+    stampCacheBytes += stamps->size();
+    made.increment(kSubPixel * kSubPixel);
+    return StampSet{size, stamps->data(), stamps};
+}
+
+/*! \brief Number of stamps currently cached, made at run time.
+ * @return std::size_t the number of stamps
+ */
+std::size_t BrushStamps::cachedCount() {
+    std::lock_guard<std::mutex> lock(stampMutex);
+    return stampCache.size() * kSubPixel * kSubPixel;
+}
+
+/*! \brief Construct an empty record.
+ */
+SpanRecord::SpanRecord() {
+    m_bounds = CanvasRect{0, 0, 0, 0};
+}
+
+/*! \brief Copy the current values of a run of pixels, e.g. before they are overwritten.
+ * @param canvas the canvas being painted
+ * @param y the row
+ * @param x0 the first column, on the canvas
+ * @param x1 one past the last column, at most the canvas width
+ * @return void
+ */
+void SpanRecord::save(const Canvas &canvas, int y, int x0, int x1) {
+    if (x0 >= x1) {
+        return;
+    }
+    if (m_spans.empty()) {
+        m_bounds = CanvasRect{x0, y, x1, y + 1};
+    } else {
+        m_bounds = CanvasRect{std::min(m_bounds.left, x0), std::min(m_bounds.top, y), std::max(m_bounds.right, x1),
+                              std::max(m_bounds.bottom, y + 1)};
+    }
+    m_spans.push_back(Span{y, x0, x1 - x0, m_pixels.size()});
+    m_pixels.resize(m_pixels.size() + static_cast<std::size_t>(x1 - x0));
+    canvas.readSpan(y, x0, x1 - x0, &m_pixels[m_pixels.size() - static_cast<std::size_t>(x1 - x0)]);
+}
+
+/*! \brief Write every saved run to the canvas. Runs are written newest first, so a pixel
+ * saved twice ends up with the value it had at the first save.
+ * @param canvas the canvas to write to
+ * @return void
+ */
+void SpanRecord::write(Canvas &canvas) const {
+    for (auto span = m_spans.rbegin(); span != m_spans.rend(); ++span) {
+        canvas.writeSpan(span->y, span->x, span->length, &m_pixels[span->offset]);
+    }
+}
+
+/*! \brief Write the part of every saved run which lies inside a rectangle, newest run first.
+ * @param canvas the canvas to write to
+ * @param clip the rectangle to write within; it must lie on the canvas
+ * @return void
+ */
+void SpanRecord::write(Canvas &canvas, const CanvasRect &clip) const {
+    for (auto span = m_spans.rbegin(); span != m_spans.rend(); ++span) {
+        if (span->y < clip.top || span->y >= clip.bottom) {
+            continue;
+        }
+        int x0 = std::max(span->x, clip.left);
+        int x1 = std::min(span->x + span->length, clip.right);
+        if (x0 < x1) {
+            canvas.writeSpan(span->y, x0, x1 - x0, &m_pixels[span->offset + (x0 - span->x)]);
+        }
+    }
+}
+
+/*! \brief Forget every saved run.
+ * @return void
+ */
+void SpanRecord::clear() {
+    m_spans.clear();
+    m_pixels.clear();
+    m_bounds = CanvasRect{0, 0, 0, 0};
+}
+
+/*! \brief Approximate bytes held by the saved runs.
+ * @return std::size_t the number of bytes
+ */
+std::size_t SpanRecord::getByteSize() const {
+    return m_spans.capacity() * sizeof(Span) + m_pixels.capacity() * sizeof(Canvas::Pixel);
+}
+
+/*! \brief Find the columns of one row covered by the square brush swept along a segment.
+ * A pixel is covered when its center lies strictly inside the brush square at some point of
+ * the segment. Everything is done in doubled integer coordinates (pixel centers sit on odd
+ * numbers) and the segment parameter is kept as a fraction, so the result is exact.
+ * @param x0 the x-coordinate the segment starts at
+ * @param y0 the y-coordinate the segment starts at
+ * @param x1 the x-coordinate the segment ends at
+ * @param y1 the y-coordinate the segment ends at
+ * @param radius half the width of the brush square
+ * @param y the row
+ * @param first receives the first covered column
+ * @param last receives the last covered column
+ * @return bool whether any pixel of the row is covered
+ */
+bool BrushEngine::segmentRowSpan(int x0, int y0, int x1, int y1, int radius, int y, int &first, int &last) {
+    if (radius <= 0) {
+        return false;
+    }
+    const std::int64_t width = 2 * static_cast<std::int64_t>(radius);
+    const std::int64_t centerY = 2 * static_cast<std::int64_t>(y) + 1;
+    const std::int64_t dx = 2 * (static_cast<std::int64_t>(x1) - x0);
+    const std::int64_t dy = 2 * (static_cast<std::int64_t>(y1) - y0);
+
+    // Range of the segment parameter t = lowT / denominator .. highT / denominator over which
+    // the brush square overlaps the row's pixel centers
+    std::int64_t denominator;
+    std::int64_t lowT;
+    std::int64_t highT;
+    if (dy == 0) {
+        std::int64_t distance = centerY - 2 * static_cast<std::int64_t>(y0);
+        if (distance >= width || distance <= -width) {
+            return false;
+        }
+        denominator = 1;
+        lowT = 0;
+        highT = 1;
+    } else {
+        // Solve centerY - width < 2 * y0 + t * dy < centerY + width for t
+        std::int64_t below = centerY - 2 * static_cast<std::int64_t>(y0) - width;
+        std::int64_t above = centerY - 2 * static_cast<std::int64_t>(y0) + width;
+        if (dy > 0) {
+            denominator = dy;
+            lowT = below;
+            highT = above;
+        } else {
+            denominator = -dy;
+            lowT = -above;
+            highT = -below;
+        }
+        if (lowT >= denominator || highT <= 0) {
+            return false;
+        }
+        lowT = std::max<std::int64_t>(lowT, 0);
+        highT = std::min(highT, denominator);
+    }
+
+    // Doubled brush center x at both ends of that range, scaled by the denominator
+    std::int64_t startX = 2 * static_cast<std::int64_t>(x0) * denominator + dx * lowT;
+    std::int64_t endX = 2 * static_cast<std::int64_t>(x0) * denominator + dx * highT;
+    std::int64_t leftX = std::min(startX, endX);
+    std::int64_t rightX = std::max(startX, endX);
+
+    // Columns whose center 2i + 1 lies strictly within width of that range
+    first = static_cast<int>(floorDiv(leftX - (width + 1) * denominator, 2 * denominator) + 1);
+    last = static_cast<int>(ceilDiv(rightX + (width - 1) * denominator, 2 * denominator) - 1);
+    return first <= last;
+}
+
+/*! \brief Rectangle holding every pixel the square brush can cover along a segment.
+ * @param x0 the x-coordinate the segment starts at
+ * @param y0 the y-coordinate the segment starts at
+ * @param x1 the x-coordinate the segment ends at
+ * @param y1 the y-coordinate the segment ends at
+ * @param radius half the width of the brush square
+ * @return CanvasRect the bounds, empty if the radius is not positive
+ */
+CanvasRect BrushEngine::segmentBounds(int x0, int y0, int x1, int y1, int radius) {
+    if (radius <= 0) {
+        return CanvasRect{0, 0, 0, 0};
+    }
+    return CanvasRect{std::min(x0, x1) - radius, std::min(y0, y1) - radius, std::max(x0, x1) + radius,
+                      std::max(y0, y1) + radius};
+}
+
+/*! \brief Paint the square brush swept along a segment, one span per row. Consecutive samples
+ * of a stroke are joined this way, so fast mouse movement or sparse network samples still give
+ * a gap-free stroke, and each row is written with a single fill instead of pixel by pixel.
+ * @param canvas the canvas to paint
+ * @param x0 the x-coordinate the segment starts at
+ * @param y0 the y-coordinate the segment starts at
+ * @param x1 the x-coordinate the segment ends at
+ * @param y1 the y-coordinate the segment ends at
+ * @param radius half the width of the brush square
+ * @param pixel the value to paint
+ * @param prior receives the overwritten pixels, or nullptr
+ * @return void
+ */
+void BrushEngine::strokeSegment(Canvas &canvas, int x0, int y0, int x1, int y1, int radius, Canvas::Pixel pixel,
+                                SpanRecord *prior) {
+    strokeSegment(canvas, x0, y0, x1, y1, radius, pixel, prior, canvas.getBounds());
+}
+
+/*! \brief Paint the part of a stroke segment which lies inside a rectangle, e.g. when one tile
+ * of the canvas is rebuilt. The pixels inside are exactly those the unclipped segment paints.
+ * @param canvas the canvas to paint
+ * @param x0 the x-coordinate the segment starts at
+ * @param y0 the y-coordinate the segment starts at
+ * @param x1 the x-coordinate the segment ends at
+ * @param y1 the y-coordinate the segment ends at
+ * @param radius half the width of the brush square
+ * @param pixel the value to paint
+ * @param prior receives the overwritten pixels, or nullptr
+ * @param clip the rectangle to paint within
+ * @return void
+ */
+void BrushEngine::strokeSegment(Canvas &canvas, int x0, int y0, int x1, int y1, int radius, Canvas::Pixel pixel,
+                                SpanRecord *prior, const CanvasRect &clip) {
+    CanvasRect area = clip.intersect(canvas.getBounds());
+    if (radius <= 0 || area.empty()) {
+        return;
+    }
+    std::int64_t top = std::max<std::int64_t>(static_cast<std::int64_t>(std::min(y0, y1)) - radius, area.top);
+    std::int64_t bottom = std::min<std::int64_t>(static_cast<std::int64_t>(std::max(y0, y1)) + radius,
+                                                 area.bottom);
+    for (std::int64_t row = top; row < bottom; row++) {
+        int y = static_cast<int>(row);
+        int first;
+        int last;
+        if (!segmentRowSpan(x0, y0, x1, y1, radius, y, first, last)) {
+            continue;
+        }
+        first = std::max(first, area.left);
+        last = std::min(last, area.right - 1);
+        if (first > last) {
+            continue;
+        }
+        if (prior != nullptr) {
+            prior->save(canvas, y, first, last + 1);
+        }
+        canvas.fillSpan(y, first, last + 1, pixel);
+    }
+}
+
+/*! \brief Rectangle holding every pixel the round brush can cover along a segment: every dab's
+ * center lies between the segment's ends, and its stamp reaches radius pixels either side of the
+ * pixel corner at or before the center.
+ * @param x0 the x-coordinate the segment starts at
+ * @param y0 the y-coordinate the segment starts at
+ * @param x1 the x-coordinate the segment ends at
+ * @param y1 the y-coordinate the segment ends at
+ * @param radius the brush radius
+ * @return CanvasRect the bounds, empty if the radius is not positive
+ */
+CanvasRect BrushEngine::roundBounds(int x0, int y0, int x1, int y1, int radius) {
+    if (radius <= 0) {
+        return CanvasRect{0, 0, 0, 0};
+    }
+    return CanvasRect{std::min(x0, x1) - radius, std::min(y0, y1) - radius, std::max(x0, x1) + radius + 1,
+                      std::max(y0, y1) + radius + 1};
+}
+
+/*! \brief Merge a stamp lying wholly inside the mask into it, keeping the larger coverage at each
+ * pixel. The size is a constant, so the loops unroll.
+ * @param mask the mask pixel under the stamp's top-left pixel
+ * @param stride the mask's width
+ * @param stamp the stamp, Size * Size bytes
+ * @return void
+ */
+template <int Size>
+static inline void mergeStamp(std::uint8_t *mask, int stride, const std::uint8_t *stamp) {
+    for (int y = 0; y < Size; y++) {
+        for (int x = 0; x < Size; x++) {
+            mask[x] = std::max(mask[x], stamp[x]);
+        }
+        mask += stride;
+        stamp += Size;
+    }
+}
+
+/*! \brief Round brush kernel. Dab centers are placed along the segment in quarter pixels with
+ * integer arithmetic, the stamps of the dabs are merged into one mask by taking the largest
+ * coverage at each pixel, so overlapping dabs of one segment do not build up, and the mask is then
+ * blended into the canvas a row at a time. Each pixel's result depends only on the segment, never
+ * on the clip, so painting a segment whole or tile by tile gives the same pixels.
+ * @param canvas the canvas to paint
+ * @param x0 the x-coordinate the segment starts at
+ * @param y0 the y-coordinate the segment starts at
+ * @param x1 the x-coordinate the segment ends at
+ * @param y1 the y-coordinate the segment ends at
+ * @param continues whether the segment continues a stroke, so the dab at its start is left out
+ * @param brush the brush; Radius, when not 0, is its radius
+ * @param clip the rectangle to paint within
+ * @return void
+ */
+template <BrushBlend Blend, int Radius>
+static void roundKernel(Canvas &canvas, int x0, int y0, int x1, int y1, bool continues, const BrushDescriptor &brush,
+                        const CanvasRect &clip) {
+    const int radius = Radius > 0 ? Radius : brush.radius;
+    CanvasRect area = clip.intersect(canvas.getBounds()).intersect(BrushEngine::roundBounds(x0, y0, x1, y1, radius));
+    if (area.empty()) {
+        return;
+    }
+    const unsigned alpha = Canvas::toRGBA(brush.color) & 0xFF;
+    const std::uint8_t strength = Blend == BrushBlend::Erase
+                                  ? brush.tip.opacity
+                                  : static_cast<std::uint8_t>((alpha * brush.tip.opacity + 127) / 255);
+    if (strength == 0) {
+        return;
+    }
+
+    // Dabs every radius quarter pixels along the longer axis, the last one at the end
+    const std::int64_t startX = static_cast<std::int64_t>(x0) * BrushStamps::kSubPixel;
+    const std::int64_t startY = static_cast<std::int64_t>(y0) * BrushStamps::kSubPixel;
+    const std::int64_t dx = (static_cast<std::int64_t>(x1) - x0) * BrushStamps::kSubPixel;
+    const std::int64_t dy = (static_cast<std::int64_t>(y1) - y0) * BrushStamps::kSubPixel;
+    const std::int64_t steps = ceilDiv(std::max(std::abs(dx), std::abs(dy)), radius);
+    const std::int64_t first = continues ? 1 : 0;
+    if (first > steps) {
+        return;
+    }
+
+    const BrushStamps::StampSet stamps = BrushStamps::get(radius, brush.tip.hardness);
+    const int size = Radius > 0 ? 2 * Radius + 1 : stamps.size;
+    const int width = area.right - area.left;
+    const int height = area.bottom - area.top;
+    thread_local std::vector<std::uint8_t> mask;
+    thread_local std::vector<Canvas::Pixel> row;
+    mask.assign(static_cast<std::size_t>(width) * height, 0);
+    for (std::int64_t k = first; k <= steps; k++) {
+        // Center rounded to the nearest quarter pixel
+        const std::int64_t centerX = steps == 0 ? startX : startX + floorDiv(2 * dx * k + steps, 2 * steps);
+        const std::int64_t centerY = steps == 0 ? startY : startY + floorDiv(2 * dy * k + steps, 2 * steps);
+        const std::int64_t cornerX = floorDiv(centerX, BrushStamps::kSubPixel);
+        const std::int64_t cornerY = floorDiv(centerY, BrushStamps::kSubPixel);
+        const std::uint8_t *stamp = stamps.at(static_cast<int>(centerX - cornerX * BrushStamps::kSubPixel),
+                                              static_cast<int>(centerY - cornerY * BrushStamps::kSubPixel));
+        const int boxLeft = static_cast<int>(cornerX) - radius;
+        const int boxTop = static_cast<int>(cornerY) - radius;
+        if (Radius > 0 && boxLeft >= area.left && boxTop >= area.top && boxLeft + size <= area.right &&
+            boxTop + size <= area.bottom) {
+            const std::size_t offset = static_cast<std::size_t>(boxTop - area.top) * width + (boxLeft - area.left);
+            mergeStamp<2 * Radius + 1>(&mask[offset], width, stamp);
+            continue;
+        }
+        const int left = std::max(boxLeft, area.left);
+        const int right = std::min(boxLeft + size, area.right);
+        const int top = std::max(boxTop, area.top);
+        const int bottom = std::min(boxTop + size, area.bottom);
+        for (int y = top; y < bottom; y++) {
+            const std::uint8_t *source = stamp + static_cast<std::size_t>(y - boxTop) * size + (left - boxLeft);
+            std::uint8_t *target = &mask[static_cast<std::size_t>(y - area.top) * width + (left - area.left)];
+            for (int x = 0; x < right - left; x++) {
+                target[x] = std::max(target[x], source[x]);
+            }
+        }
+    }
+
+    row.resize(static_cast<std::size_t>(width));
+    for (int y = 0; y < height; y++) {
+        const std::uint8_t *coverage = &mask[static_cast<std::size_t>(y) * width];
+        int begin = 0;
+        int end = width;
+        while (begin < end && coverage[begin] == 0) {
+            begin++;
+        }
+        while (end > begin && coverage[end - 1] == 0) {
+            end--;
+        }
+        if (begin == end) {
+            continue;
+        }
+        canvas.readSpan(area.top + y, area.left + begin, end - begin, row.data());
+        if (Blend == BrushBlend::Erase) {
+            BlendKernels::eraseMasked(row.data(), coverage + begin, end - begin, strength);
+        } else {
+            BlendKernels::sourceOverMasked(row.data(), coverage + begin, end - begin, brush.color, strength);
+        }
+        canvas.writeSpan(area.top + y, area.left + begin, end - begin, row.data());
+    }
+}
+
+/*! \brief Square brush kernel. With a fixed radius a dab is filled row by row straight away;
+ * anything else is swept by BrushEngine::strokeSegment().
+ * @param canvas the canvas to paint
+ * @param x0 the x-coordinate the segment starts at
+ * @param y0 the y-coordinate the segment starts at
+ * @param x1 the x-coordinate the segment ends at
+ * @param y1 the y-coordinate the segment ends at
+ * @param brush the brush; Radius, when not 0, is its radius
+ * @param clip the rectangle to paint within
+ * @return void
+ */
+template <int Radius>
+static void squareKernel(Canvas &canvas, int x0, int y0, int x1, int y1, const BrushDescriptor &brush,
+                         const CanvasRect &clip) {
+    if (Radius > 0 && x0 == x1 && y0 == y1) {
+        CanvasRect dab = clip.intersect(canvas.getBounds())
+                .intersect(CanvasRect{x0 - Radius, y0 - Radius, x0 + Radius, y0 + Radius});
+        if (dab.empty()) {
+            return;
+        }
+        for (int y = dab.top; y < dab.bottom; y++) {
+            canvas.fillSpan(y, dab.left, dab.right, brush.color);
+        }
+        return;
+    }
+    BrushEngine::strokeSegment(canvas, x0, y0, x1, y1, Radius > 0 ? Radius : brush.radius, brush.color, nullptr,
+                               clip);
+}
+
+/*! \brief One entry of the dispatch table: the kernel of a shape and blend for a radius (0 = any).
+ * @param canvas the canvas to paint
+ * @param x0 the x-coordinate the segment starts at
+ * @param y0 the y-coordinate the segment starts at
+ * @param x1 the x-coordinate the segment ends at
+ * @param y1 the y-coordinate the segment ends at
+ * @param continues whether the segment continues a stroke
+ * @param brush the brush
+ * @param clip the rectangle to paint within
+ * @return void
+ */
+template <BrushId Shape, BrushBlend Blend, int Radius>
+static void segmentKernel(Canvas &canvas, int x0, int y0, int x1, int y1, bool continues,
+                          const BrushDescriptor &brush, const CanvasRect &clip) {
+    if (Shape == BrushId::Round) {
+        roundKernel<Blend, Radius>(canvas, x0, y0, x1, y1, continues, brush, clip);
+    } else {
+        squareKernel<Radius>(canvas, x0, y0, x1, y1, brush, clip);
+    }
+}
+
+/*! \brief The kernels of a shape and blend for radii 0 (any) to kMaxFixedRadius.
+ * @return std::array<SegmentKernel, N> the kernels, by radius
+ */
+template <BrushId Shape, BrushBlend Blend, std::size_t... Radii>
+static constexpr std::array<SegmentKernel, sizeof...(Radii)> kernelsByRadius(std::index_sequence<Radii...>) {
+    return {{&segmentKernel<Shape, Blend, static_cast<int>(Radii)>...}};
+}
+
+// Number of kernels of each shape and blend
+static constexpr std::size_t kKernelRadii = BrushKernels::kMaxFixedRadius + 1;
+
+// The dispatch table: square replace, round source-over and round erase, each by radius
+static constexpr std::array<std::array<SegmentKernel, kKernelRadii>, 3> kKernels = {{
+        kernelsByRadius<BrushId::Square, BrushBlend::Replace>(std::make_index_sequence<kKernelRadii>()),
+        kernelsByRadius<BrushId::Round, BrushBlend::SourceOver>(std::make_index_sequence<kKernelRadii>()),
+        kernelsByRadius<BrushId::Round, BrushBlend::Erase>(std::make_index_sequence<kKernelRadii>())}};
+
+/*! \brief How a brush puts its color on the canvas: the square brush overwrites; the round brush
+ * composites, or erases when its color is fully transparent.
+ * @param brush the brush
+ * @return BrushBlend the blend
+ */
+BrushBlend BrushKernels::blendOf(const BrushDescriptor &brush) {
+    if (brush.tip.id != BrushId::Round) {
+        return BrushBlend::Replace;
+    }
+    return (brush.color & Canvas::fromRGBA(0xFF)) == 0 ? BrushBlend::Erase : BrushBlend::SourceOver;
+}
+
+/*! \brief The row of the dispatch table for a brush's shape and blend.
+ * @param brush the brush
+ * @return const std::array<SegmentKernel, kKernelRadii>& the kernels, by radius
+ */
+static const std::array<SegmentKernel, kKernelRadii> &kernelsFor(const BrushDescriptor &brush) {
+    switch (BrushKernels::blendOf(brush)) {
+        case BrushBlend::SourceOver:
+            return kKernels[1];
+        case BrushBlend::Erase:
+            return kKernels[2];
+        default:
+            return kKernels[0];
+    }
+}
+
+/*! \brief The kernel specialized for a brush's shape, blend and radius if there is one, else the
+ * generic kernel of its shape and blend.
+ * @param brush the brush
+ * @return SegmentKernel the kernel
+ */
+SegmentKernel BrushKernels::select(const BrushDescriptor &brush) {
+    const std::array<SegmentKernel, kKernelRadii> &kernels = kernelsFor(brush);
+    return brush.radius > 0 && brush.radius <= kMaxFixedRadius ? kernels[brush.radius] : kernels[0];
+}
+
+/*! \brief The generic kernel of a brush's shape and blend, which takes the radius at run time.
+ * @param brush the brush
+ * @return SegmentKernel the kernel
+ */
+SegmentKernel BrushKernels::generic(const BrushDescriptor &brush) {
+    return kernelsFor(brush)[0];
+}
+
+/*! \brief Paint the part of a stroke segment which lies inside a rectangle, with the kernel
+ * specialized for the brush.
+ * @param canvas the canvas to paint
+ * @param x0 the x-coordinate the segment starts at
+ * @param y0 the y-coordinate the segment starts at
+ * @param x1 the x-coordinate the segment ends at
+ * @param y1 the y-coordinate the segment ends at
+ * @param continues whether the segment continues a stroke
+ * @param brush the brush
+ * @param clip the rectangle to paint within
+ * @return void
+ */
+void BrushEngine::paintSegment(Canvas &canvas, int x0, int y0, int x1, int y1, bool continues,
+                               const BrushDescriptor &brush, const CanvasRect &clip) {
+    if (brush.radius <= 0) {
+        return;
+    }
+    BrushKernels::select(brush)(canvas, x0, y0, x1, y1, continues, brush, clip);
+}
@@ -0,0 +1,582 @@
+/**
+ *  @file   Canvas.cpp
+ *  @brief  Implementation of Canvas.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+// Project header files
+#include "Canvas.hpp"
+#include "Logger.hpp"
+#include "TileStore.hpp"
+
+static_assert(Canvas::kTileSize == 1 << Canvas::kTileShift, "kTileShift is the log2 of kTileSize");
+
+/*! \brief A uniform tile of one value. Tiles of a value still in use anywhere are shared, so all
+ * the untouched tiles of every canvas with the same background are one tile.
+ * @param pixel the value
+ * @return std::shared_ptr<Canvas::Tile> the tile, which must not be written to
+ */
+static std::shared_ptr<Canvas::Tile> uniformTile(Canvas::Pixel pixel) {
+    static std::mutex mutex;
+    static std::unordered_map<Canvas::Pixel, std::weak_ptr<Canvas::Tile>> tiles;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<Canvas::Tile> tile = tiles[pixel].lock();
+    if (tile == nullptr) {
+        tile = std::make_shared<Canvas::Tile>();
+        std::fill(tile->pixels, tile->pixels + Canvas::kTileSize * Canvas::kTileSize, pixel);
+        tile->uniform = true;
+        tiles[pixel] = tile;
+        // Forget the values no canvas uses any more
+        if (tiles.size() > 64) {
+            for (auto it = tiles.begin(); it != tiles.end();) {
+                it = it->second.expired() ? tiles.erase(it) : std::next(it);
+            }
+        }
+    }
+    return tile;
+}
+
+/*! \brief Construct an empty 0x0 canvas.
+ */
+Canvas::Canvas() {
+    m_width = 0;
+    m_height = 0;
+    m_columns = 0;
+    m_rows = 0;
+    m_fill = 0;
+    m_revision = 0;
+    m_dirtyFirst = INT_MAX;
+    m_dirtyLast = INT_MIN;
+    m_tilesDirty = false;
+    m_tracking = true;
+}
+
+/*! \brief Construct a canvas filled with one pixel value.
+ * @param width the width in pixels
+ * @param height the height in pixels
+ * @param fill the initial value of every pixel
+ */
+Canvas::Canvas(unsigned width, unsigned height, Pixel fill) : Canvas() {
+    create(width, height, fill);
+}
+
+/*! \brief Construct a copy sharing the other canvas's tiles. A copy of a paging canvas pages
+ * under the same budget (see operator=()).
+ * @param other the canvas to copy
+ */
+Canvas::Canvas(const Canvas &other) : Canvas() {
+    *this = other;
+}
+
+/*! \brief Become a copy of another canvas, sharing its tiles. If it pages, so does this canvas, to
+ * a file of its own under the same budget: the tiles it paged out are read back one at a time and
+ * paged out again here as the budget requires, so copying a canvas larger than memory never holds
+ * all of it. If no file can be created they are all read back, with a warning.
+ * @param other the canvas to copy
+ * @return Canvas& this canvas
+ */
+Canvas &Canvas::operator=(const Canvas &other) {
+    if (this == &other) {
+        return *this;
+    }
+    m_width = other.m_width;
+    m_height = other.m_height;
+    m_columns = other.m_columns;
+    m_rows = other.m_rows;
+    m_fill = other.m_fill;
+    m_background = other.m_background;
+    m_tiles = other.m_tiles;
+    if (m_store != nullptr) {
+        m_store->reset(0);
+        m_store.reset();
+    }
+    if (other.m_store != nullptr) {
+        std::string error;
+        if (!enablePaging(other.m_store->getDirectory(), other.m_store->getBudget(), error)) {
+            LOG_WARN("A copy of a paging canvas holds every tile in memory: " << error);
+        }
+        for (std::size_t i = 0; i < m_tiles.size(); i++) {
+            if (m_tiles[i] == nullptr && other.m_store->isPaged(i)) {
+                m_tiles[i] = other.m_store->read(i);
+                if (m_store != nullptr) {
+                    m_store->written(i);
+                    trimTiles();
+                }
+            }
+        }
+    }
+    m_revision = other.m_revision;
+    m_dirtyFirst = other.m_dirtyFirst;
+    m_dirtyLast = other.m_dirtyLast;
+    m_dirtyTiles = other.m_dirtyTiles;
+    m_tilesDirty = other.m_tilesDirty;
+    m_tracking = other.m_tracking;
+    return *this;
+}
+
+Canvas::Canvas(Canvas &&other) noexcept = default;
+
+Canvas &Canvas::operator=(Canvas &&other) noexcept = default;
+
+/*! \brief Destructor; tile writes still queued for a paging canvas are dropped.
+ */
+Canvas::~Canvas() {
+    if (m_store != nullptr) {
+        m_store->reset(0);
+    }
+}
+
+/*! \brief (Re)create the canvas with every pixel the background value. No tile is allocated until
+ * it is written to. The whole canvas becomes dirty.
+ * @param width the width in pixels, at most kMaxSize
+ * @param height the height in pixels, at most kMaxSize
+ * @param fill the value of every pixel
+ * @return void
+ */
+void Canvas::create(unsigned width, unsigned height, Pixel fill) {
+    m_width = std::min(width, kMaxSize);
+    m_height = std::min(height, kMaxSize);
+    m_columns = static_cast<int>((m_width + kTileSize - 1) / kTileSize);
+    m_rows = static_cast<int>((m_height + kTileSize - 1) / kTileSize);
+    m_fill = fill;
+    m_background = uniformTile(fill);
+    std::vector<std::shared_ptr<Tile>>(static_cast<std::size_t>(m_columns) * m_rows).swap(m_tiles);
+    if (m_store != nullptr) {
+        m_store->reset(m_tiles.size());
+    }
+    m_dirtyFirst = INT_MAX;
+    m_dirtyLast = INT_MIN;
+    m_dirtyTiles.assign(static_cast<std::size_t>(m_columns) * m_rows, 0);
+    m_tilesDirty = false;
+    if (m_width > 0 && m_height > 0) {
+        markDirty(0, static_cast<int>(m_width), 0, static_cast<int>(m_height) - 1);
+    }
+}
+
+/*! \brief A tile of a paging canvas, read back from the file if it was paged out, and marked as
+ * recently used. Threads may call this at once for distinct tiles.
+ * @param index the tile
+ * @return const Canvas::Tile* the tile, or nullptr if it shows the background
+ */
+const Canvas::Tile *Canvas::residentTile(std::size_t index) const {
+    std::shared_ptr<Tile> &slot = m_tiles[index];
+    if (slot == nullptr) {
+        if (!m_store->isPaged(index)) {
+            return nullptr;
+        }
+        slot = m_store->pageIn(index);
+    } else if (!slot->uniform) {
+        m_store->touch(index);
+    }
+    return slot.get();
+}
+
+/*! \brief Whether a tile shows the background, as opposed to holding pixels in memory or paged out.
+ * @param index the tile
+ * @return bool whether it does
+ */
+bool Canvas::isBackgroundTile(std::size_t index) const {
+    return m_tiles[index] == nullptr && (m_store == nullptr || !m_store->isPaged(index));
+}
+
+/*! \brief The pixels of a tile ready to be written. A paged tile is read back, a background or
+ * uniform tile gets pixels of its own, and a tile shared with a copy of the canvas is copied, first.
+ * @param index the tile
+ * @return Pixel* the tile's pixels, row by row
+ */
+Canvas::Pixel *Canvas::writableTile(std::size_t index) {
+    std::shared_ptr<Tile> &slot = m_tiles[index];
+    if (slot == nullptr && m_store != nullptr && m_store->isPaged(index)) {
+        slot = m_store->pageIn(index);
+    }
+    if (slot == nullptr || slot->uniform || slot.use_count() > 1) {
+        std::shared_ptr<Tile> tile = std::make_shared<Tile>();
+        std::memcpy(tile->pixels, (slot != nullptr ? slot : m_background)->pixels, sizeof(tile->pixels));
+        tile->uniform = false;
+        slot = std::move(tile);
+    }
+    if (m_store != nullptr) {
+        m_store->written(index);
+    }
+    return slot->pixels;
+}
+
+/*! \brief Fill part of a row within one tile, leaving a uniform tile of the same value alone.
+ * @param y the row
+ * @param x0 the first column
+ * @param x1 one past the last column, in the same tile as x0
+ * @param pixel the value to write
+ * @return void
+ */
+void Canvas::fillTileRow(int y, int x0, int x1, Pixel pixel) {
+    const std::size_t index = tileIndex(x0 >> kTileShift, y);
+    const Tile *tile = m_tiles[index].get();
+    if ((pixel == m_fill && isBackgroundTile(index))
+        || (tile != nullptr && tile->uniform && pixel == tile->pixels[0])) {
+        return;
+    }
+    Pixel *row = writableTile(index) + (y & (kTileSize - 1)) * kTileSize;
+    std::fill(row + (x0 & (kTileSize - 1)), row + (x0 & (kTileSize - 1)) + (x1 - x0), pixel);
+}
+
+/*! \brief Copy a run of pixels out of a row.
+ * @param y the row
+ * @param x the first column
+ * @param count the number of pixels; x + count must not pass the end of the row
+ * @param out receives the pixels
+ * @return void
+ */
+void Canvas::readSpan(int y, int x, int count, Pixel *out) const {
+    const int end = x + count;
+    while (x < end) {
+        const int stop = std::min(end, ((x >> kTileShift) + 1) * kTileSize);
+        const Pixel *row = getTileRow(x >> kTileShift, y);
+        out = std::copy(row + (x & (kTileSize - 1)), row + (x & (kTileSize - 1)) + (stop - x), out);
+        x = stop;
+    }
+}
+
+/*! \brief Write one pixel.
+ * @param x the x-coordinate, which must lie on the canvas
+ * @param y the y-coordinate, which must lie on the canvas
+ * @param pixel the new value
+ * @return void
+ */
+void Canvas::setPixel(int x, int y, Pixel pixel) {
+    fillTileRow(y, x, x + 1, pixel);
+    markDirty(x, x + 1, y, y);
+}
+
+/*! \brief Fill a horizontal run of pixels, clipped to the canvas.
+ * @param y the row
+ * @param x0 the first column
+ * @param x1 one past the last column
+ * @param pixel the value to write
+ * @return void
+ */
+void Canvas::fillSpan(int y, int x0, int x1, Pixel pixel) {
+    if (y < 0 || static_cast<unsigned>(y) >= m_height) {
+        return;
+    }
+    x0 = std::max(x0, 0);
+    x1 = std::min(x1, static_cast<int>(m_width));
+    if (x0 >= x1) {
+        return;
+    }
+    for (int x = x0; x < x1;) {
+        const int stop = std::min(x1, ((x >> kTileShift) + 1) * kTileSize);
+        fillTileRow(y, x, stop, pixel);
+        x = stop;
+    }
+    markDirty(x0, x1, y, y);
+}
+
+/*! \brief Copy a run of pixels into a row. A part which only repeats the value of a background or
+ * uniform tile leaves the tile as it is.
+ * @param y the row
+ * @param x the first column
+ * @param count the number of pixels; x + count must not pass the end of the row
+ * @param pixels the values to write
+ * @return void
+ */
+void Canvas::writeSpan(int y, int x, int count, const Pixel *pixels) {
+    if (count <= 0) {
+        return;
+    }
+    const int x0 = x;
+    const int end = x + count;
+    while (x < end) {
+        const int stop = std::min(end, ((x >> kTileShift) + 1) * kTileSize);
+        const std::size_t index = tileIndex(x >> kTileShift, y);
+        const Tile *tile = m_tiles[index].get();
+        const Pixel *from = pixels + (x - x0);
+        const Pixel *to = pixels + (stop - x0);
+        if (isBackgroundTile(index) || (tile != nullptr && tile->uniform)) {
+            const Pixel value = tile != nullptr ? tile->pixels[0] : m_fill;
+            if (std::all_of(from, to, [value](Pixel pixel) { return pixel == value; })) {
+                x = stop;
+                continue;
+            }
+        }
+        std::copy(from, to, writableTile(index) + (y & (kTileSize - 1)) * kTileSize + (x & (kTileSize - 1)));
+        x = stop;
+    }
+    markDirty(x0, end, y, y);
+}
+
+/*! \brief Fill a rectangle, clipped to the canvas. The tiles it covers entirely (as far as they lie
+ * on the canvas) become the background or one shared uniform tile instead of being written, which
+ * frees whatever they held: filling a whole canvas allocates nothing.
+ * @param rect the rectangle
+ * @param pixel the value to write
+ * @return void
+ */
+void Canvas::fillRect(const CanvasRect &rect, Pixel pixel) {
+    const CanvasRect area = rect.intersect(getBounds());
+    if (area.empty()) {
+        return;
+    }
+    std::shared_ptr<Tile> uniform;
+    for (int tileY = area.top >> kTileShift; tileY <= (area.bottom - 1) >> kTileShift; tileY++) {
+        const int top = std::max(area.top, tileY * kTileSize);
+        const int bottom = std::min(area.bottom, (tileY + 1) * kTileSize);
+        const bool coversRows = top == tileY * kTileSize && bottom == std::min((tileY + 1) * kTileSize,
+                                                                                static_cast<int>(m_height));
+        for (int tileX = area.left >> kTileShift; tileX <= (area.right - 1) >> kTileShift; tileX++) {
+            const int left = std::max(area.left, tileX * kTileSize);
+            const int right = std::min(area.right, (tileX + 1) * kTileSize);
+            if (coversRows && left == tileX * kTileSize
+                && right == std::min((tileX + 1) * kTileSize, static_cast<int>(m_width))) {
+                const std::size_t index = static_cast<std::size_t>(tileY) * m_columns + tileX;
+                std::shared_ptr<Tile> &slot = m_tiles[index];
+                if (m_store != nullptr) {
+                    m_store->dropped(index);
+                }
+                if (pixel == m_fill) {
+                    slot.reset();
+                } else {
+                    if (uniform == nullptr) {
+                        uniform = uniformTile(pixel);
+                    }
+                    slot = uniform;
+                }
+                continue;
+            }
+            for (int y = top; y < bottom; y++) {
+                fillTileRow(y, left, right, pixel);
+            }
+        }
+    }
+    markDirty(area.left, area.right, area.top, area.bottom - 1);
+}
+
+/*! \brief Whether a tile holds one value throughout because nothing was written to it, or it was
+ * filled whole by fillRect().
+ * @param tileX the tile column
+ * @param tileY the tile row
+ * @param pixel receives the value if it does
+ * @return bool whether it does; false for a tile with pixels of its own, even if they happen to agree
+ * or are paged out
+ */
+bool Canvas::isUniformTile(int tileX, int tileY, Pixel &pixel) const {
+    const std::size_t index = static_cast<std::size_t>(tileY) * m_columns + tileX;
+    const Tile *tile = m_tiles[index].get();
+    if (tile == nullptr) {
+        pixel = m_fill;
+        return isBackgroundTile(index);
+    }
+    pixel = tile->pixels[0];
+    return tile->uniform;
+}
+
+/*! \brief Number of tiles holding pixels of their own, i.e. neither the background nor uniform,
+ * whether in memory or paged out. Tiles shared with a copy of the canvas are counted by each.
+ * @return std::size_t the number of tiles
+ */
+std::size_t Canvas::getAllocatedTiles() const {
+    return getResidentTiles() + (m_store != nullptr ? m_store->getPagedTiles() : 0);
+}
+
+/*! \brief Number of tiles holding pixels of their own in memory.
+ * @return std::size_t the number of tiles
+ */
+std::size_t Canvas::getResidentTiles() const {
+    return static_cast<std::size_t>(std::count_if(m_tiles.begin(), m_tiles.end(),
+        [](const std::shared_ptr<Tile> &tile) { return tile != nullptr && !tile->uniform; }));
+}
+
+/*! \brief A tile's pixels, leaving a paged tile out in the file: reading a canvas through this,
+ * e.g. to save it, does not bring every tile into memory.
+ * @param tileX the tile column
+ * @param tileY the tile row
+ * @return std::shared_ptr<const Canvas::Tile> the tile, shared if it is in memory and read from the
+ * file if it is paged; nullptr if it shows the background
+ */
+std::shared_ptr<const Canvas::Tile> Canvas::peekTile(int tileX, int tileY) const {
+    const std::size_t index = static_cast<std::size_t>(tileY) * m_columns + tileX;
+    if (m_tiles[index] != nullptr) {
+        return m_tiles[index];
+    }
+    if (m_store != nullptr && m_store->isPaged(index)) {
+        return m_store->read(index);
+    }
+    return nullptr;
+}
+
+/*! \brief Approximate bytes the canvas holds in memory: its resident tiles, and a pointer and a
+ * dirty flag per tile, plus the paging flags if it pages.
+ * @return std::size_t the number of bytes
+ */
+std::size_t Canvas::getByteSize() const {
+    const std::size_t perTile = sizeof(std::shared_ptr<Tile>) + 1 + (m_store != nullptr ? 2 : 0);
+    return getResidentTiles() * sizeof(Tile) + m_tiles.size() * perTile;
+}
+
+/*! \brief Page tiles out to a file from now on, keeping at most a budget of tiles with pixels of
+ * their own in memory. The tiles already held count towards it; trimTiles() pages out the excess.
+ * @param directory where to create the file, which is removed with the canvas
+ * @param residentTiles the budget, in tiles of sizeof(Tile) bytes
+ * @param error receives why the file could not be created
+ * @return bool false if it could not, leaving every tile in memory
+ */
+bool Canvas::enablePaging(const std::string &directory, std::size_t residentTiles, std::string &error) {
+    return enablePaging(directory, std::make_shared<TileBudget>(residentTiles), error);
+}
+
+/*! \brief Page tiles out to a file from now on, keeping the tiles with pixels of their own in
+ * memory within a budget shared with the other canvases given it. The tiles already held count
+ * towards it; trimTiles() pages out the excess. Tiles an earlier file holds move to the new one a
+ * tile at a time.
+ * @param directory where to create the file, which is removed with the canvas
+ * @param budget the tiles the canvases sharing it keep in memory together
+ * @param error receives why the file could not be created
+ * @return bool false if it could not, leaving the canvas as it was
+ */
+bool Canvas::enablePaging(const std::string &directory, const std::shared_ptr<TileBudget> &budget,
+                          std::string &error) {
+    std::shared_ptr<TileStore> store = std::make_shared<TileStore>(budget);
+    if (!store->open(directory, m_tiles.size(), error)) {
+        return false;
+    }
+    std::shared_ptr<TileStore> previous = std::move(m_store);
+    m_store = std::move(store);
+    for (std::size_t i = 0; i < m_tiles.size(); i++) {
+        if (m_tiles[i] == nullptr && previous != nullptr && previous->isPaged(i)) {
+            m_tiles[i] = previous->read(i);
+            m_store->written(i);
+            trimTiles();
+        } else if (m_tiles[i] != nullptr && !m_tiles[i]->uniform) {
+            m_store->written(i);
+        }
+    }
+    return true;
+}
+
+/*! \brief The budget the canvas's tiles are paged under.
+ * @return std::shared_ptr<TileBudget> the budget, or nullptr if the canvas does not page
+ */
+std::shared_ptr<TileBudget> Canvas::getTileBudget() const {
+    return m_store != nullptr ? m_store->getBudget() : nullptr;
+}
+
+/*! \brief Page out the tiles least recently used until no more are in memory than the budget
+ * allows. Those changed since they were last written out are written back in the background.
+ * Nothing else may use the canvas meanwhile: pointers from getTileRow() into the tiles paged out
+ * become invalid.
+ * @return void
+ */
+void Canvas::trimTiles() {
+    if (m_store == nullptr) {
+        return;
+    }
+    std::size_t index;
+    while (m_store->nextVictim(index)) {
+        m_store->pageOut(index, std::move(m_tiles[index]));
+        m_tiles[index].reset();
+    }
+}
+
+/*! \brief Have the paged tiles a rectangle touches read back in the background, e.g. around what
+ * is about to be shown, so that using them later does not wait for the disk.
+ * @param rect the rectangle; clipped to the canvas
+ * @return void
+ */
+void Canvas::prefetch(const CanvasRect &rect) {
+    const CanvasRect area = rect.intersect(getBounds());
+    if (m_store == nullptr || area.empty()) {
+        return;
+    }
+    for (int tileY = area.top >> kTileShift; tileY <= (area.bottom - 1) >> kTileShift; tileY++) {
+        for (int tileX = area.left >> kTileShift; tileX <= (area.right - 1) >> kTileShift; tileX++) {
+            const std::size_t index = static_cast<std::size_t>(tileY) * m_columns + tileX;
+            if (m_tiles[index] == nullptr && m_store->isPaged(index)) {
+                m_store->prefetch(index);
+            }
+        }
+    }
+}
+
+/*! \brief Wait until every tile paged out so far is in the file and every prefetch is done.
+ * @return void
+ */
+void Canvas::waitForPaging() {
+    if (m_store != nullptr) {
+        m_store->wait();
+    }
+}
+
+/*! \brief Report which rows changed since the last call and start tracking afresh. Uploading
+ * just these rows is much cheaper than the whole canvas.
+ * @param firstRow receives the first changed row
+ * @param lastRow receives the last changed row
+ * @return bool whether any row changed
+ */
+bool Canvas::takeDirtyRows(int &firstRow, int &lastRow) {
+    if (m_dirtyFirst > m_dirtyLast) {
+        return false;
+    }
+    firstRow = m_dirtyFirst;
+    lastRow = m_dirtyLast;
+    m_dirtyFirst = INT_MAX;
+    m_dirtyLast = INT_MIN;
+    return true;
+}
+
+/*! \brief Mark, in a caller's tile map, the tiles written since the last call and start tracking
+ * afresh. Several canvases of the same size can be merged into one map this way.
+ * @param tiles one byte per tile, row-major; set to 1 for each changed tile, others left as they are
+ * @return bool whether any tile changed
+ */
+bool Canvas::takeDirtyTiles(std::vector<std::uint8_t> &tiles) {
+    if (!m_tilesDirty) {
+        return false;
+    }
+    tiles.resize(m_dirtyTiles.size(), 0);
+    for (std::size_t i = 0; i < m_dirtyTiles.size(); i++) {
+        tiles[i] |= m_dirtyTiles[i];
+    }
+    std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), 0);
+    m_tilesDirty = false;
+    return true;
+}
+
+/*! \brief Record writes again after pauseTracking(), and mark the rows written in the meantime.
+ * @param firstRow the first row written while tracking was paused
+ * @param lastRow the last row written while tracking was paused
+ * @return void
+ */
+void Canvas::resumeTracking(int firstRow, int lastRow) {
+    m_tracking = true;
+    if (firstRow <= lastRow && m_width > 0) {
+        markDirty(0, static_cast<int>(m_width), firstRow, lastRow);
+    }
+}
+
+/*! \brief Record writes again after pauseTracking(), marking the rows written in the meantime but,
+ * of their tiles, only those the writers kept to. Saves consumers of the tiles, e.g. the timeline,
+ * from going over whole rows of tiles after a small change.
+ * @param firstRow the first row written while tracking was paused
+ * @param lastRow the last row written while tracking was paused
+ * @param tiles the tiles written, one byte per tile, row-major
+ * @return void
+ */
+void Canvas::resumeTracking(int firstRow, int lastRow, const std::vector<std::uint8_t> &tiles) {
+    m_tracking = true;
+    if (firstRow > lastRow || m_width == 0) {
+        return;
+    }
+    m_dirtyFirst = std::min(m_dirtyFirst, firstRow);
+    m_dirtyLast = std::max(m_dirtyLast, lastRow);
+    for (std::size_t i = 0; i < tiles.size() && i < m_dirtyTiles.size(); i++) {
+        m_dirtyTiles[i] |= tiles[i];
+    }
+    m_tilesDirty = true;
+    m_revision++;
+}
@@ -0,0 +1,43 @@
+/**
+ *  @file   Checksum.cpp
+ *  @brief  Implementation of Checksum.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <array>
+// Project header files
+#include "Checksum.hpp"
+
+/*! \brief Build the CRC-32 lookup table: the remainder of each byte value.
+ * @return std::array<std::uint32_t, 256> the table
+ */
+static constexpr std::array<std::uint32_t, 256> makeCrcTable() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t value = 0; value < 256; value++) {
+        std::uint32_t crc = value;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) != 0 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+        table[value] = crc;
+    }
+    return table;
+}
+
+static constexpr std::array<std::uint32_t, 256> kCrcTable = makeCrcTable();
+
+/*! \brief CRC-32 of a range of bytes.
+ * @param data the bytes
+ * @param size the number of bytes
+ * @param crc the checksum of the bytes before these, or 0
+ * @return std::uint32_t the checksum of everything so far
+ */
+std::uint32_t Checksum::crc32(const void *data, std::size_t size, std::uint32_t crc) {
+    const std::uint8_t *bytes = static_cast<const std::uint8_t *>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++) {
+        crc = kCrcTable[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -7,15 +7,50 @@
 
 // Project header files
 #include "Command.hpp"
+#include "CommandPool.hpp"
+#include "Metrics.hpp"
+
+/*! \brief 	Gauge of how many Command objects are currently alive.
+ * @return Gauge& the commands.live gauge
+*/
+static Gauge &liveCommands() {
+    static Gauge &gauge = MetricsRegistry::Get().gauge("commands.live");
+    return gauge;
+}
 
 /*! \brief 	Constructor for abstract Command
 *
 */
 Command::Command() {
+    liveCommands().add(1);
 }
 
 /*! \brief 	Destructor for abstract Command
 *
 */
 Command::~Command() {
-}
\ No newline at end of file
+    liveCommands().add(-1);
+}
+
+/*! \brief 	Default size estimate for a command: just the object itself.
+ * @return std::size_t the approximate number of bytes held by this command
+*/
+std::size_t Command::getByteSize() {
+    return sizeof(*this);
+}
+/*! \brief 	Allocate a command from the CommandPool rather than the general heap.
+ * @param size the size of the concrete command
+ * @return void* storage for the command
+*/
+void *Command::operator new(std::size_t size) {
+    return CommandPool::Get().allocate(size);
+}
+
+/*! \brief 	Return a command's storage to the CommandPool.
+ * @param block the storage
+ * @param size the size of the concrete command, as passed to operator new
+ * @return void
+*/
+void Command::operator delete(void *block, std::size_t size) {
+    CommandPool::Get().release(block, size);
+}
@@ -0,0 +1,116 @@
+/**
+ *  @file   CommandPool.cpp
+ *  @brief  Implementation of CommandPool.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <new>
+// Project header files
+#include "CommandPool.hpp"
+
+/*! \brief Process-wide pool, created on first use and never destroyed.
+ * @return CommandPool& the pool
+ */
+CommandPool &CommandPool::Get() {
+    static CommandPool *instance = new CommandPool();
+    return *instance;
+}
+
+/*! \brief Construct an empty pool.
+ */
+CommandPool::CommandPool() {
+    for (FreeBlock *&head : m_free) {
+        head = nullptr;
+    }
+    m_liveBytes = 0;
+    m_liveCount = 0;
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_liveBytesMetric = &metrics.gauge("commands.live_bytes");
+    m_reservedBytesMetric = &metrics.gauge("commands.pool_bytes");
+}
+
+/*! \brief Take a new chunk from the heap and put all of it on one class's free list.
+ * @param sizeClass the size class
+ * @return void
+ */
+void CommandPool::grow(std::size_t sizeClass) {
+    const std::size_t blockSize = (sizeClass + 1) * kGranule;
+    unsigned char *chunk = static_cast<unsigned char *>(::operator new(kChunkBytes));
+    m_chunks.push_back(chunk);
+    for (std::size_t offset = 0; offset + blockSize <= kChunkBytes; offset += blockSize) {
+        FreeBlock *block = reinterpret_cast<FreeBlock *>(chunk + offset);
+        block->next = m_free[sizeClass];
+        m_free[sizeClass] = block;
+    }
+    m_reservedBytesMetric->set(static_cast<std::int64_t>(m_chunks.size() * kChunkBytes));
+}
+
+/*! \brief Get a block for a command, from its size class's free list.
+ * @param size the object size
+ * @return void* the block
+ */
+void *CommandPool::allocate(std::size_t size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_liveBytes += size;
+    m_liveCount++;
+    m_liveBytesMetric->set(static_cast<std::int64_t>(m_liveBytes));
+    if (size == 0 || size > kMaxBlock) {
+        return ::operator new(size);
+    }
+    const std::size_t sizeClass = (size - 1) / kGranule;
+    if (m_free[sizeClass] == nullptr) {
+        grow(sizeClass);
+    }
+    FreeBlock *block = m_free[sizeClass];
+    m_free[sizeClass] = block->next;
+    return block;
+}
+
+/*! \brief Put a command's block back on its size class's free list.
+ * @param block the block
+ * @param size the object size it was allocated with
+ * @return void
+ */
+void CommandPool::release(void *block, std::size_t size) {
+    if (block == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_liveBytes -= size;
+    m_liveCount--;
+    m_liveBytesMetric->set(static_cast<std::int64_t>(m_liveBytes));
+    if (size == 0 || size > kMaxBlock) {
+        ::operator delete(block);
+        return;
+    }
+    const std::size_t sizeClass = (size - 1) / kGranule;
+    FreeBlock *freed = static_cast<FreeBlock *>(block);
+    freed->next = m_free[sizeClass];
+    m_free[sizeClass] = freed;
+}
+
+/*! \brief Bytes held by live commands.
+ * @return std::size_t the number of bytes
+ */
+std::size_t CommandPool::liveBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_liveBytes;
+}
+
+/*! \brief Number of live commands.
+ * @return std::size_t the number of commands
+ */
+std::size_t CommandPool::liveCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_liveCount;
+}
+
+/*! \brief Bytes of chunks taken from the heap, used or free.
+ * @return std::size_t the number of bytes
+ */
+std::size_t CommandPool::reservedBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_chunks.size() * kChunkBytes;
+}
@@ -8,26 +8,63 @@
 // Include our Third-Party SFML header
 #include <SFML/Graphics/Color.hpp>
 // Include standard library C++ libraries.
+#include <algorithm>
+#include <utility>
+#include <vector>
 // Project header files
 #include "Draw.hpp"
 
+/*! \brief Copy the pixels a paint function reported touching, as they are after painting, into
+ * horizontal runs so the operation can be replayed.
+ * @param canvas the painted canvas
+ * @param painted the map returned by the paint function; its keys are the touched pixels
+ * @return SpanRecord the painted pixels
+ */
+static SpanRecord capturePainted(const Canvas &canvas, const std::map<std::pair<int, int>, sf::Color> &painted) {
+    std::vector<std::pair<int, int>> rowMajor;
+    rowMajor.reserve(painted.size());
+    for (auto &pixel : painted) {
+        if (canvas.contains(pixel.first.first, pixel.first.second)) {
+            rowMajor.emplace_back(pixel.first.second, pixel.first.first);
+        }
+    }
+    std::sort(rowMajor.begin(), rowMajor.end());
+    SpanRecord pixels;
+    std::size_t i = 0;
+    while (i < rowMajor.size()) {
+        std::size_t end = i + 1;
+        while (end < rowMajor.size() && rowMajor[end].first == rowMajor[i].first &&
+               rowMajor[end].second == rowMajor[end - 1].second + 1) {
+            end++;
+        }
+        pixels.save(canvas, rowMajor[i].first, rowMajor[i].second, rowMajor[end - 1].second + 1);
+        i = end;
+    }
+    return pixels;
+}
+
 /*! \brief 	Draw object stores the pixel position, color information, brushstroke size,
- * prior color at the given pixel, and paint function for this command.
+ * and paint function for this command.
  * @param app the app to draw upon
 *
 */
-Draw::Draw(App *app) {
+Draw::Draw(PaintCore *app) {
     Draw::minipaint = app;
     Draw::m_x = app->mouseX;
     Draw::m_y = app->mouseY;
     Draw::size = app->strokeSize;
     Draw::color = app->m_color;
-    Draw::prior_color = app->GetImage().getPixel(m_x, m_y);
     Draw::paintFunc = app->m_paintFunc;
+    Draw::isSegment = false;
+    Draw::m_fromX = m_x;
+    Draw::m_fromY = m_y;
+    Draw::recorded = false;
+    Draw::m_op = 0;
+    Draw::m_layer = app->GetActiveLayer();
+    Draw::m_brush = app->brushTip;
 }
 
-/*! \brief 	Draw object stores the pixel position, color information, brushstroke size,
- * prior color at the given pixel, and paint function for this command.
+/*! \brief 	Draw object for a single dab of the current brush, which starts a stroke.
  * @param app the app to draw upon
  * @param x the x-coordinate of the douse
  * @param y the y-coordinate of the drawing
@@ -36,23 +73,88 @@ Draw::Draw(App *app) {
  *
 *
 */
-Draw::Draw(App *app, int x, int y, sf::Color color, int size) {
+Draw::Draw(PaintCore *app, int x, int y, sf::Color color, int size) {
     Draw::minipaint = app;
     Draw::m_x = x;
     Draw::m_y = y;
     Draw::size = size;
     Draw::color = color;
-    Draw::prior_color = app->GetImage().getPixel(m_x, m_y);
-    Draw::paintFunc = app->m_paintFunc;
+    Draw::paintFunc = nullptr;
+    Draw::isSegment = false;
+    Draw::m_fromX = x;
+    Draw::m_fromY = y;
+    Draw::recorded = false;
+    Draw::m_op = 0;
+    Draw::m_layer = app->GetActiveLayer();
+    Draw::m_brush = app->brushTip;
+}
+
+/*! \brief 	Draw object for one segment of a brush stroke, from the stroke's previous sample to the
+ * current one. The segment is rasterized by the brush engine with the current brush swept along it.
+ * @param app the app to draw upon
+ * @param fromX the x-coordinate of the previous sample
+ * @param fromY the y-coordinate of the previous sample
+ * @param x the x-coordinate of the current sample
+ * @param y the y-coordinate of the current sample
+ * @param color the color to draw in
+ * @param size the size of the brushstroke
+*
+*/
+Draw::Draw(PaintCore *app, int fromX, int fromY, int x, int y, sf::Color color, int size) {
+    Draw::minipaint = app;
+    Draw::m_x = x;
+    Draw::m_y = y;
+    Draw::size = size;
+    Draw::color = color;
+    Draw::paintFunc = nullptr;
+    Draw::isSegment = true;
+    Draw::m_fromX = fromX;
+    Draw::m_fromY = fromY;
+    Draw::recorded = false;
+    Draw::m_op = 0;
+    Draw::m_layer = app->GetActiveLayer();
+    Draw::m_brush = app->brushTip;
+}
+
+/*! \brief 	Paint on a given layer rather than the one the local user had active when the command was made.
+ * @param layer the layer id
+ * @return void
+*/
+void Draw::setLayer(int layer) {
+    m_layer = layer;
+}
+
+/*! \brief 	Paint with a given brush rather than the one the local user had chosen when the command was made.
+ * @param brush the brush, its hardness and opacity
+ * @return void
+*/
+void Draw::setBrush(const BrushTip &brush) {
+    m_brush = brush;
 }
 
-/*! \brief 	Execute a Draw command with the App's specified paint function.
+/*! \brief 	Execute a Draw command. The first time, the operation is added to the PaintCore's stroke store
+ * and painted: a brush engine stroke as vector data, a custom paint function's result as the pixels it
+ * wrote. Executing it again (redo) just shows the stored operation; the PaintCore repairs the canvas.
+ * Once the operation is in the store the command succeeds, even if its center is off the canvas, so
+ * that whatever it painted, e.g. the visible part of a brush at the edge, can be undone.
  * @return bool representing success of execute function
 *
 */
 bool Draw::execute() {
-    priorDrawnPixels = paintFunc(minipaint, color, size, m_x, m_y);
-    return minipaint->GetImage().getPixel(m_x, m_y) == color;
+    StrokeStore &store = minipaint->GetStrokeStore(m_layer);
+    if (recorded) {
+        store.setVisible(m_op, true);
+        return true;
+    }
+    Canvas &canvas = minipaint->GetCanvas(m_layer);
+    if (paintFunc == nullptr) {
+        m_op = store.addSegment(m_brush, pixelFromColor(color), size, isSegment, m_fromX, m_fromY, m_x, m_y);
+        store.rasterize(m_op, canvas, canvas.getBounds());
+    } else {
+        m_op = store.addPixels(capturePainted(canvas, paintFunc(minipaint, color, size, m_x, m_y)));
+    }
+    recorded = true;
+    return true;
 }
 
 /*! \brief Return the value of the drawn pixel's x coordinate.
@@ -69,19 +171,32 @@ int Draw::getPixelY() {
     return m_y;
 }
 
-/*! \brief 	Undo this Draw command by restoring the prior set of pixel colors affected by this command.
+/*! \brief Approximate bytes held by this command. The pixels live in the PaintCore's stroke store.
+ * @return std::size_t the approximate number of bytes
+ */
+std::size_t Draw::getByteSize() {
+    return sizeof(*this);
+}
+
+/*! \brief 	Undo this Draw command by hiding its operation in the stroke store. The PaintCore then rebuilds
+ * the tiles it covered from the operations that remain.
  * @return bool representing success of undo function
 *
 */
 bool Draw::undo() {
-    for (auto &priorDrawnPixel : priorDrawnPixels) {
-        minipaint->GetImage().setPixel(priorDrawnPixel.first.first, priorDrawnPixel.first.second,
-                                       priorDrawnPixel.second);
+    if (!recorded) {
+        return false;
     }
-    return minipaint->GetImage().getPixel(m_x, m_y) == prior_color;
+    minipaint->GetStrokeStore(m_layer).setVisible(m_op, false);
+    return true;
 }
 
-/*! \brief 	Delete this Draw object.
+/*! \brief 	Delete this Draw object. Its operation, if it made one, stays as it is from now on, so the
+ * stroke store may bake it.
 *
 */
-Draw::~Draw() {}
+Draw::~Draw() {
+    if (recorded) {
+        minipaint->GetStrokeStore(m_layer).settle(m_op);
+    }
+}
@@ -10,44 +10,51 @@
 // Include standard library C++ libraries.
 // Project header files
 #include <iostream>
-#include <App.hpp>
 #include "FillDisplay.hpp"
+#include "Logger.hpp"
 
 
 /*! \brief 	FillDisplay object stores the color information for this command,
  * as well as the mouse position.
- * FillDisplay also contains an attribute called priorScreen, which is a structure mapping pixel coordinates
- * to the prior color value of each pixel before the FillDisplay command was executed.
  * @param app the app to act upon
  * @param color an int representing the fill color value
 */
-FillDisplay::FillDisplay(App *app, int color) {
+FillDisplay::FillDisplay(PaintCore *app, int color) {
     FillDisplay::minipaint = app;
     FillDisplay::color = sf::Color(color);
     FillDisplay::m_x = app->mouseX;
     FillDisplay::m_y = app->mouseY;
+    FillDisplay::recorded = false;
+    FillDisplay::m_op = 0;
+    FillDisplay::m_layer = app->GetActiveLayer();
+}
 
+/*! \brief 	Fill a given layer rather than the one the local user had active when the command was made.
+ * @param layer the layer id
+ * @return void
+*/
+void FillDisplay::setLayer(int layer) {
+    m_layer = layer;
 }
 
-/*! \brief 	Execute a FillDisplay command, filling the display screen with the current paint color
+/*! \brief 	Execute a FillDisplay command, filling the display screen with the current paint color.
+ * The fill is kept in the PaintCore's stroke store as a single operation; executing it again (redo)
+ * just shows that operation and the PaintCore repairs the canvas.
  * @return bool representing success of execution
 *
 */
 bool FillDisplay::execute() {
-    std::cout << "executing fill screen operation - this may take a moment..." << std::endl;
-
-    bool success = true;
-    // Iterate through every pixel in the screen
-    for (int i = 0; i < minipaint->GetDisplayDimensions().x; i++) {
-        for (int j = 0; j < minipaint->GetDisplayDimensions().y; j++) {
-            priorPixelValues[std::make_pair(i, j)] = minipaint->GetImage().getPixel(i, j);
-            minipaint->GetImage().setPixel(i, j, color);
-            if (minipaint->GetImage().getPixel(i, j) != color) {
-                success = false;
-            }
-        }
+    LOG_DEBUG("executing fill screen operation");
+    StrokeStore &store = minipaint->GetStrokeStore(m_layer);
+    if (recorded) {
+        store.setVisible(m_op, true);
+        return true;
     }
-    return success;
+    Canvas &canvas = minipaint->GetCanvas(m_layer);
+    m_op = store.addFill(pixelFromColor(color));
+    store.rasterize(m_op, canvas, canvas.getBounds());
+    recorded = true;
+    return canvas.getWidth() == 0 || canvas.getPixel(0, 0) == pixelFromColor(color);
 }
 
 /*! \brief Get pixel X value of mouse upon this action
@@ -66,26 +73,34 @@ int FillDisplay::getPixelY() {
     return m_y;
 }
 
-/*! \brief 	Undo this FillDisplay command by restoring the prior set of pixel colors affected by this command.
+/*! \brief Approximate bytes held by this command. The fill itself is one entry in the stroke store.
+ * @return std::size_t the approximate number of bytes
+ */
+std::size_t FillDisplay::getByteSize() {
+    return sizeof(*this);
+}
+
+/*! \brief 	Undo this FillDisplay command by hiding it in the stroke store. The PaintCore then rebuilds the
+ * canvas from the operations that remain.
  * @return bool representing success of undo
  *
 */
 bool FillDisplay::undo() {
-    std::cout << "undoing fill screen operation - this may take a moment..." << std::endl;
-    bool success = true;
-
-    for (auto &priorPixel : priorPixelValues) {
-        minipaint->GetImage().setPixel(priorPixel.first.first, priorPixel.first.second,
-                                       priorPixel.second);
-        if (minipaint->GetImage().getPixel(priorPixel.first.first, priorPixel.first.second) != priorPixel.second) {
-            success = false;
-        }
+    LOG_DEBUG("undoing fill screen operation");
+    if (!recorded) {
+        return false;
     }
-    return success;
+    minipaint->GetStrokeStore(m_layer).setVisible(m_op, false);
+    return true;
 }
 
 
-/*! \brief 	Delete this FillDisplay object.
+/*! \brief 	Delete this FillDisplay object. Its operation, if it made one, stays as it is from now on, so the
+ * stroke store may bake it.
  *
 */
-FillDisplay::~FillDisplay() = default;
\ No newline at end of file
+FillDisplay::~FillDisplay() {
+    if (recorded) {
+        minipaint->GetStrokeStore(m_layer).settle(m_op);
+    }
+}
@@ -0,0 +1,116 @@
+/**
+ *  @file   FloodFill.cpp
+ *  @brief  FloodFill implementation, bucket fills of one region are commands.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include our Third-Party SFML header
+#include <SFML/Graphics/Color.hpp>
+// Include standard library C++ libraries.
+#include <utility>
+// Project header files
+#include "FloodFill.hpp"
+#include "Logger.hpp"
+#include "Profiler.hpp"
+#include "ScanlineFill.hpp"
+
+/*! \brief 	FloodFill object stores the seed pixel, fill color and tolerance for this command.
+ * Only these travel over the network; every peer finds the region on its own canvas.
+ * @param app the app to act upon
+ * @param x the seed x-coordinate
+ * @param y the seed y-coordinate
+ * @param color an int representing the fill color value
+ * @param tolerance the largest channel difference from the seed color which is filled
+*/
+FloodFill::FloodFill(PaintCore *app, int x, int y, int color, int tolerance) {
+    FloodFill::minipaint = app;
+    FloodFill::color = sf::Color(color);
+    FloodFill::m_x = x;
+    FloodFill::m_y = y;
+    FloodFill::tolerance = tolerance < 0 ? 0 : tolerance;
+    FloodFill::recorded = false;
+    FloodFill::m_op = 0;
+    FloodFill::m_layer = app->GetActiveLayer();
+}
+
+/*! \brief 	Fill on a given layer rather than the one the local user had active when the command was made.
+ * The region is found on that layer's pixels.
+ * @param layer the layer id
+ * @return void
+*/
+void FloodFill::setLayer(int layer) {
+    m_layer = layer;
+}
+
+/*! \brief 	Execute a FloodFill command: find the region around the seed with a scanline fill and
+ * fill it. The region is kept in the PaintCore's stroke store as its span list, so undo and redo
+ * replay the same spans rather than searching again; executing it again (redo) just shows it.
+ * @return bool false if the seed is off the canvas
+*
+*/
+bool FloodFill::execute() {
+    PROFILE_FUNCTION();
+    StrokeStore &store = minipaint->GetStrokeStore(m_layer);
+    if (recorded) {
+        store.setVisible(m_op, true);
+        return true;
+    }
+    Canvas &canvas = minipaint->GetCanvas(m_layer);
+    FillRegion region;
+    ScanlineFill::findRegion(canvas, m_x, m_y, tolerance, region, store.getThreadPool());
+    if (region.empty()) {
+        return false;
+    }
+    LOG_DEBUG("flood fill of " << region.pixelCount() << " pixels in " << region.getSpans().size() << " spans");
+    m_op = store.addRegion(std::move(region), pixelFromColor(color));
+    store.rasterize(m_op, canvas, canvas.getBounds());
+    recorded = true;
+    return true;
+}
+
+/*! \brief Get the seed x-coordinate
+ * @return int - the x coordinate the fill started from
+ *
+ */
+int FloodFill::getPixelX() {
+    return m_x;
+}
+
+/*! \brief Get the seed y-coordinate
+ * @return int - the y coordinate the fill started from
+ *
+ */
+int FloodFill::getPixelY() {
+    return m_y;
+}
+
+/*! \brief Approximate bytes held by this command. The region lives in the stroke store.
+ * @return std::size_t the approximate number of bytes
+ */
+std::size_t FloodFill::getByteSize() {
+    return sizeof(*this);
+}
+
+/*! \brief 	Undo this FloodFill command by hiding it in the stroke store. The PaintCore then
+ * rebuilds the tiles the region covered.
+ * @return bool representing success of undo
+ *
+*/
+bool FloodFill::undo() {
+    if (!recorded) {
+        return false;
+    }
+    minipaint->GetStrokeStore(m_layer).setVisible(m_op, false);
+    return true;
+}
+
+/*! \brief 	Delete this FloodFill object. Its operation, if it made one, stays as it is from now on, so the
+ * stroke store may bake it.
+ *
+*/
+FloodFill::~FloodFill() {
+    if (recorded) {
+        minipaint->GetStrokeStore(m_layer).settle(m_op);
+    }
+}
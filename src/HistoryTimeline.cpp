@@ -0,0 +1,488 @@
+/**
+ *  @file   HistoryTimeline.cpp
+ *  @brief  Implementation of HistoryTimeline.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
+// Project header files
+#include "HistoryTimeline.hpp"
+#include "ProjectFile.hpp"
+#include "ThreadPool.hpp"
+
+/*! \brief Constructor.
+ * @param keyframeInterval the frames between keyframes, at least 1
+ * @param byteBudget the compressed bytes the frames may hold; the last keyframe and its diffs are
+ * kept in any case
+ */
+HistoryTimeline::HistoryTimeline(std::size_t keyframeInterval, std::uint64_t byteBudget) {
+    m_keyframeInterval = std::max<std::size_t>(keyframeInterval, 1);
+    m_byteBudget = byteBudget;
+    m_bytes = 0;
+    m_framesSinceKeyframe = 0;
+    m_bytesSinceKeyframe = 0;
+    m_keyframeBytes = 0;
+    m_width = 0;
+    m_height = 0;
+    m_busy = false;
+    m_exporting = false;
+
+    // Metrics
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_framesMetric = &metrics.counter("timeline.frames");
+    m_keyframesMetric = &metrics.counter("timeline.keyframes");
+    m_droppedMetric = &metrics.counter("timeline.dropped_frames");
+    m_bytesMetric = &metrics.gauge("timeline.bytes");
+}
+
+/*! \brief Destructor. Nothing is queued or encoding any more, as the tasks which do hold the timeline.
+ */
+HistoryTimeline::~HistoryTimeline() {}
+
+/*! \brief Record the image after an operation. Only the tiles the image marks as written since the
+ * last capture are copied here; comparing and compressing them happens in a background task, which
+ * is started unless one is still encoding earlier captures. The timeline must be owned by a
+ * std::shared_ptr, which the task holds.
+ * @param flattened the flattened image; its record of written tiles is taken
+ * @param time when the operation was applied
+ * @return bool whether anything was written, and so queued
+ */
+bool HistoryTimeline::capture(Canvas &flattened, std::int64_t time) {
+    std::unique_ptr<Capture> capture(new Capture());
+    capture->time = time;
+    capture->width = flattened.getWidth();
+    capture->height = flattened.getHeight();
+    capture->background = flattened.getBackground();
+    capture->full = capture->width != m_width || capture->height != m_height;
+    const int columns = flattened.getTileColumns();
+    const std::size_t tileCount = static_cast<std::size_t>(columns) * flattened.getTileRows();
+    m_written.assign(tileCount, 0);
+    const bool written = flattened.takeDirtyTiles(m_written);
+    if (capture->full) {
+        // Every tile which holds more than the background
+        for (std::size_t i = 0; i < tileCount; i++) {
+            Canvas::Pixel pixel;
+            m_written[i] = !flattened.isUniformTile(static_cast<int>(i % columns), static_cast<int>(i / columns), pixel)
+                           || pixel != capture->background;
+        }
+        m_width = capture->width;
+        m_height = capture->height;
+    } else if (!written) {
+        return false;
+    }
+    for (std::size_t i = 0; i < tileCount; i++) {
+        if (m_written[i] == 0) {
+            continue;
+        }
+        const int tileX = static_cast<int>(i % columns);
+        const int tileY = static_cast<int>(i / columns);
+        capture->tiles.emplace_back(tileX, tileY);
+        const int left = tileX * Canvas::kTileSize;
+        const int right = std::min(left + Canvas::kTileSize, static_cast<int>(capture->width));
+        const int bottom = std::min((tileY + 1) * Canvas::kTileSize, static_cast<int>(capture->height));
+        // Read without bringing a paged tile back, which would leave the whole image in memory after a full capture
+        std::shared_ptr<const Canvas::Tile> source = flattened.peekTile(tileX, tileY);
+        for (int y = tileY * Canvas::kTileSize; y < bottom; y++) {
+            if (source == nullptr) {
+                capture->pixels.insert(capture->pixels.end(), static_cast<std::size_t>(right - left),
+                                       capture->background);
+                continue;
+            }
+            const Canvas::Pixel *row = source->pixels + (y - tileY * Canvas::kTileSize) * Canvas::kTileSize;
+            capture->pixels.insert(capture->pixels.end(), row, row + (right - left));
+        }
+    }
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    m_queue.push_back(std::move(capture));
+    if (!m_busy) {
+        m_busy = true;
+        lock.unlock();
+        std::shared_ptr<HistoryTimeline> self = shared_from_this();
+        ThreadPool::Get().submit([self]() { self->drain(); });
+    }
+    return true;
+}
+
+/*! \brief Wait until every capture so far is a frame.
+ * @return void
+ */
+void HistoryTimeline::wait() {
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    m_idle.wait(lock, [this]() { return m_queue.empty() && !m_busy; });
+}
+
+/*! \brief Page the image the timeline keeps out to a file, and have exports page the images they
+ * rebuild, keeping their tiles in memory within a budget the drawing's canvases share. Waits for
+ * the captures queued so far, as the encoding task writes that image.
+ * @param directory where to create the files
+ * @param budget the tiles kept in memory, together with the other canvases sharing it
+ * @param error receives why a file could not be created
+ * @return bool false if one could not; the timeline then keeps its image in memory
+ */
+bool HistoryTimeline::enablePaging(const std::string &directory, const std::shared_ptr<TileBudget> &budget,
+                                   std::string &error) {
+    wait();
+    if (!m_current.enablePaging(directory, budget, error)) {
+        return false;
+    }
+    m_current.trimTiles();
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_pagingDirectory = directory;
+    m_tileBudget = budget;
+    return true;
+}
+
+/*! \brief The encoding task: turn captures into frames, in order, until none is queued.
+ * @return void
+ */
+void HistoryTimeline::drain() {
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    while (!m_queue.empty()) {
+        std::unique_ptr<Capture> capture = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        encode(*capture);
+        lock.lock();
+    }
+    m_busy = false;
+    m_idle.notify_all();
+}
+
+/*! \brief Turn a capture into a frame. Tiles which hold what they held after the previous frame are
+ * dropped; if none is left there is no frame. The frame becomes a keyframe holding every tile ever
+ * drawn on (the rest is the background) if the size changed, if keyframeInterval frames have
+ * passed since the last one, or if the diffs since then would outgrow it. Only the changed tiles
+ * are compressed; a keyframe shares the others. Frames beyond the byte budget are then dropped.
+ * @param capture the copied tiles
+ * @return void
+ */
+void HistoryTimeline::encode(const Capture &capture) {
+    std::shared_ptr<TimelineFrame> frame(new TimelineFrame());
+    frame->time = capture.time;
+    frame->width = capture.width;
+    frame->height = capture.height;
+    frame->background = capture.background;
+    bool keyframe = capture.full;
+    if (keyframe) {
+        m_current.create(capture.width, capture.height, capture.background);
+        m_latest.assign(static_cast<std::size_t>(m_current.getTileColumns()) * m_current.getTileRows(), nullptr);
+    }
+    const Canvas::Pixel *pixels = capture.pixels.data();
+    for (const std::pair<int, int> &tile : capture.tiles) {
+        const int left = tile.first * Canvas::kTileSize;
+        const int width = std::min(left + Canvas::kTileSize, static_cast<int>(capture.width)) - left;
+        const int top = tile.second * Canvas::kTileSize;
+        const int bottom = std::min(top + Canvas::kTileSize, static_cast<int>(capture.height));
+        bool changed = capture.full;
+        for (int y = top; y < bottom; y++) {
+            const Canvas::Pixel *row = pixels + static_cast<std::size_t>(y - top) * width;
+            if (std::memcmp(m_current.getTileRow(tile.first, y), row, width * sizeof(Canvas::Pixel)) != 0) {
+                m_current.writeSpan(y, left, width, row);
+                changed = true;
+            }
+        }
+        pixels += static_cast<std::size_t>(bottom - top) * width;
+        if (changed) {
+            frame->tiles.push_back(encodeTile(tile.first, tile.second));
+            frame->bytes += frame->tiles.back()->data.size();
+        }
+        // A paging image keeps within its budget however many tiles the capture holds
+        m_current.trimTiles();
+    }
+    if (frame->tiles.empty() && !capture.full) {
+        return;
+    }
+    const std::uint64_t encoded = frame->bytes;
+    keyframe = keyframe || m_framesSinceKeyframe + 1 >= m_keyframeInterval
+               || m_bytesSinceKeyframe + frame->bytes > m_keyframeBytes;
+    if (keyframe) {
+        frame->keyframe = true;
+        frame->tiles.clear();
+        frame->bytes = 0;
+        for (const std::shared_ptr<const TimelineTile> &tile : m_latest) {
+            if (tile != nullptr) {
+                frame->tiles.push_back(tile);
+                frame->bytes += tile->data.size();
+            }
+        }
+        m_framesSinceKeyframe = 0;
+        m_bytesSinceKeyframe = 0;
+        m_keyframeBytes = frame->bytes;
+        m_keyframesMetric->increment();
+    } else {
+        m_framesSinceKeyframe++;
+        m_bytesSinceKeyframe += frame->bytes;
+    }
+    std::lock_guard<std::mutex> lock(m_framesMutex);
+    if (keyframe) {
+        m_keyframes.push_back(m_frames.size());
+    }
+    m_frames.push_back(frame);
+    m_bytes += encoded;
+    m_framesMetric->increment();
+    trim();
+    m_bytesMetric->set(static_cast<std::int64_t>(m_bytes));
+}
+
+/*! \brief Drop the oldest keyframe and the diffs after it while the frames hold more than the byte
+ * budget and a later keyframe is left. A dropped tile may live on in the next keyframe, which shares
+ * every tile still current when it was taken, so only the tiles it does not share are freed.
+ * @return void
+ */
+void HistoryTimeline::trim() {
+    while (m_bytes > m_byteBudget && m_keyframes.size() > 1) {
+        const std::size_t dropped = m_keyframes[1];
+        std::unordered_set<const TimelineTile *> kept;
+        for (const std::shared_ptr<const TimelineTile> &tile : m_frames[dropped]->tiles) {
+            kept.insert(tile.get());
+        }
+        std::unordered_set<const TimelineTile *> freed;
+        for (std::size_t i = 0; i < dropped; i++) {
+            for (const std::shared_ptr<const TimelineTile> &tile : m_frames[i]->tiles) {
+                if (kept.count(tile.get()) == 0 && freed.insert(tile.get()).second) {
+                    m_bytes -= tile->data.size();
+                }
+            }
+        }
+        m_frames.erase(m_frames.begin(), m_frames.begin() + dropped);
+        m_keyframes.erase(m_keyframes.begin());
+        for (std::size_t &keyframe : m_keyframes) {
+            keyframe -= dropped;
+        }
+        m_droppedMetric->increment(dropped);
+    }
+}
+
+/*! \brief Compress one tile of the image as of the frame being encoded, and make it the tile's
+ * latest encoding, which keyframes share until the tile changes again.
+ * @param tileX the tile's column
+ * @param tileY the tile's row
+ * @return std::shared_ptr<const TimelineTile> the compressed tile
+ */
+std::shared_ptr<const TimelineTile> HistoryTimeline::encodeTile(int tileX, int tileY) {
+    ProjectChunk chunk;
+    chunk.layer = 0;
+    chunk.tileX = tileX;
+    chunk.tileY = tileY;
+    const int left = tileX * Canvas::kTileSize;
+    const int right = std::min(left + Canvas::kTileSize, static_cast<int>(m_current.getWidth()));
+    const int bottom = std::min((tileY + 1) * Canvas::kTileSize, static_cast<int>(m_current.getHeight()));
+    for (int y = tileY * Canvas::kTileSize; y < bottom; y++) {
+        const Canvas::Pixel *row = m_current.getTileRow(tileX, y);
+        chunk.pixels.insert(chunk.pixels.end(), row, row + (right - left));
+    }
+    std::shared_ptr<TimelineTile> tile(new TimelineTile());
+    tile->tileX = tileX;
+    tile->tileY = tileY;
+    tile->encoding = ProjectFile::encodeChunk(chunk, tile->data);
+    m_latest[static_cast<std::size_t>(tileY) * m_current.getTileColumns() + tileX] = tile;
+    return tile;
+}
+
+/*! \brief Number of frames.
+ * @return std::size_t the frames encoded so far
+ */
+std::size_t HistoryTimeline::getFrameCount() {
+    std::lock_guard<std::mutex> lock(m_framesMutex);
+    return m_frames.size();
+}
+
+/*! \brief When a frame was captured.
+ * @param frame the frame
+ * @return std::int64_t its time, or 0 if there is no such frame
+ */
+std::int64_t HistoryTimeline::getFrameTime(std::size_t frame) {
+    std::lock_guard<std::mutex> lock(m_framesMutex);
+    return frame < m_frames.size() ? m_frames[frame]->time : 0;
+}
+
+/*! \brief The last frame captured at or before a time.
+ * @param time the time
+ * @return std::size_t the frame, or 0 if none was captured by then
+ */
+std::size_t HistoryTimeline::findFrame(std::int64_t time) {
+    std::lock_guard<std::mutex> lock(m_framesMutex);
+    auto after = std::upper_bound(m_frames.begin(), m_frames.end(), time,
+                                  [](std::int64_t t, const std::shared_ptr<const TimelineFrame> &frame) {
+                                      return t < frame->time;
+                                  });
+    return after == m_frames.begin() ? 0 : static_cast<std::size_t>(after - m_frames.begin()) - 1;
+}
+
+/*! \brief The frames needed to rebuild frames first to last: from the keyframe at or before first
+ * up to last. Only the list is taken under the lock; the frames themselves never change.
+ * @param first the first frame wanted
+ * @param last the last frame wanted
+ * @return std::vector<std::shared_ptr<const TimelineFrame>> the frames, or empty if last does not exist
+ */
+std::vector<std::shared_ptr<const TimelineFrame>> HistoryTimeline::framesFor(std::size_t first, std::size_t last) {
+    std::lock_guard<std::mutex> lock(m_framesMutex);
+    if (first > last || last >= m_frames.size()) {
+        return {};
+    }
+    const std::size_t keyframe = *(std::upper_bound(m_keyframes.begin(), m_keyframes.end(), first) - 1);
+    return std::vector<std::shared_ptr<const TimelineFrame>>(m_frames.begin() + keyframe, m_frames.begin() + last + 1);
+}
+
+/*! \brief Write a frame's tiles into an image. An image which pages keeps within its budget as the
+ * tiles go in.
+ * @param frame the frame
+ * @param out the image; recreated, blank, for a keyframe or if its size is not the frame's
+ * @return void
+ */
+void HistoryTimeline::applyFrame(const TimelineFrame &frame, Canvas &out) {
+    if (frame.keyframe || out.getWidth() != frame.width || out.getHeight() != frame.height) {
+        out.create(frame.width, frame.height, frame.background);
+    }
+    ProjectChunk chunk;
+    for (const std::shared_ptr<const TimelineTile> &tile : frame.tiles) {
+        chunk.tileX = tile->tileX;
+        chunk.tileY = tile->tileY;
+        ProjectFile::decodeChunk(tile->encoding, tile->data.data(), tile->data.size(), frame.width, frame.height,
+                                 chunk);
+        const int left = tile->tileX * Canvas::kTileSize;
+        const int width = std::min(left + Canvas::kTileSize, static_cast<int>(frame.width)) - left;
+        const int top = tile->tileY * Canvas::kTileSize;
+        const int bottom = std::min(top + Canvas::kTileSize, static_cast<int>(frame.height));
+        for (int y = top; y < bottom; y++) {
+            out.writeSpan(y, left, width, chunk.pixels.data() + static_cast<std::size_t>(y - top) * width);
+        }
+        out.trimTiles();
+    }
+}
+
+/*! \brief Rebuild the image of a frame: decode the keyframe at or before it, then the diffs after.
+ * @param frame the frame
+ * @param out receives the image
+ * @return bool false if there is no such frame, leaving out as it was
+ */
+bool HistoryTimeline::seek(std::size_t frame, Canvas &out) {
+    const std::vector<std::shared_ptr<const TimelineFrame>> frames = framesFor(frame, frame);
+    for (const std::shared_ptr<const TimelineFrame> &step : frames) {
+        applyFrame(*step, out);
+    }
+    return !frames.empty();
+}
+
+/*! \brief Write a sequence of frames as binary PPM images, e.g. for a video encoder. Only one
+ * export runs at a time, as a second would write the same files.
+ * @param first the first frame
+ * @param last the last frame
+ * @param step the frames between two images, at least 1
+ * @param prefix the path the files' names start with
+ * @param error receives what went wrong
+ * @return bool whether every image was written
+ */
+bool HistoryTimeline::exportFrames(std::size_t first, std::size_t last, std::size_t step, const std::string &prefix,
+                                   std::string &error) {
+    if (!tryBeginExport()) {
+        error = "another export is running";
+        return false;
+    }
+    return exportClaimedFrames(first, last, step, prefix, error);
+}
+
+/*! \brief Claim the export ahead of running it, so that a second request made before the first
+ * one's task starts is refused rather than writing the same files.
+ * @return bool whether the claim was taken; false if another export runs or is claimed
+ */
+bool HistoryTimeline::tryBeginExport() {
+    bool exporting = false;
+    return m_exporting.compare_exchange_strong(exporting, true);
+}
+
+/*! \brief Write a sequence of frames, as exportFrames(), under a claim taken with tryBeginExport().
+ * The claim is given back when the frames are written or writing failed.
+ * @param first the first frame
+ * @param last the last frame
+ * @param step the frames between two images, at least 1
+ * @param prefix the path the files' names start with
+ * @param error receives what went wrong
+ * @return bool whether every image was written
+ */
+bool HistoryTimeline::exportClaimedFrames(std::size_t first, std::size_t last, std::size_t step,
+                                          const std::string &prefix, std::string &error) {
+    const bool written = writeFrames(first, last, step, prefix, error);
+    m_exporting = false;
+    return written;
+}
+
+/*! \brief Give back a claim taken with tryBeginExport() without exporting anything.
+ * @return void
+ */
+void HistoryTimeline::cancelExport() {
+    m_exporting = false;
+}
+
+/*! \brief Write a sequence of frames as binary PPM images. The first is sought; each one after is
+ * reached by applying the diffs in between. With paging on, the image they are rebuilt in pages too.
+ * @param first the first frame
+ * @param last the last frame
+ * @param step the frames between two images, at least 1
+ * @param prefix the path the files' names start with
+ * @param error receives what went wrong
+ * @return bool whether every image was written
+ */
+bool HistoryTimeline::writeFrames(std::size_t first, std::size_t last, std::size_t step, const std::string &prefix,
+                                  std::string &error) {
+    const std::vector<std::shared_ptr<const TimelineFrame>> frames = framesFor(first, last);
+    if (frames.empty()) {
+        error = "no frames " + std::to_string(first) + " to " + std::to_string(last);
+        return false;
+    }
+    step = std::max<std::size_t>(step, 1);
+    // Index in frames of the first wanted frame
+    const std::size_t offset = frames.size() - (last - first + 1);
+    Canvas image;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        if (m_tileBudget != nullptr && !image.enablePaging(m_pagingDirectory, m_tileBudget, error)) {
+            return false;
+        }
+    }
+    std::vector<Canvas::Pixel> pixels;
+    std::vector<std::uint8_t> rgb;
+    std::size_t written = 0;
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        applyFrame(*frames[i], image);
+        if (i < offset || (i - offset) % step != 0) {
+            continue;
+        }
+        char number[16];
+        std::snprintf(number, sizeof(number), "%06zu", written++);
+        const std::string path = prefix + number + ".ppm";
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << "P6\n" << image.getWidth() << " " << image.getHeight() << "\n255\n";
+        rgb.resize(static_cast<std::size_t>(image.getWidth()) * 3);
+        pixels.resize(image.getWidth());
+        for (unsigned y = 0; y < image.getHeight(); y++) {
+            image.readSpan(static_cast<int>(y), 0, static_cast<int>(pixels.size()), pixels.data());
+            if ((y + 1) % Canvas::kTileSize == 0) {
+                image.trimTiles();
+            }
+            for (unsigned x = 0; x < image.getWidth(); x++) {
+                std::memcpy(&rgb[x * 3], &pixels[x], 3);
+            }
+            file.write(reinterpret_cast<const char *>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+        }
+        if (!file) {
+            error = "cannot write " + path;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! \brief Compressed bytes held by the frames.
+ * @return std::uint64_t the bytes
+ */
+std::uint64_t HistoryTimeline::getByteSize() {
+    std::lock_guard<std::mutex> lock(m_framesMutex);
+    return m_bytes;
+}
@@ -0,0 +1,139 @@
+/**
+ *  @file   Latency.cpp
+ *  @brief  Implementation of Latency.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <chrono>
+#include <sstream>
+// Project header files
+#include "Latency.hpp"
+
+/*! \brief Microseconds on the monotonic clock. Only differences and offsets between peers are
+ * meaningful; the epoch is arbitrary.
+ * @return std::int64_t the current time in microseconds
+ */
+std::int64_t monotonicMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*! \brief Construct an unsynchronized clock with zero offset.
+ */
+PeerClock::PeerClock() {
+    m_samples = 0;
+    m_offset = 0;
+    m_roundTrip = 0;
+}
+
+/*! \brief Add one request/reply exchange and re-pick the best estimate in the window.
+ * offset = ((t1 - t0) + (t2 - t3)) / 2 and round trip = (t3 - t0) - (t2 - t1).
+ * @param t0 request sent, local clock
+ * @param t1 request received, server clock
+ * @param t2 reply sent, server clock
+ * @param t3 reply received, local clock
+ * @return void
+ */
+void PeerClock::addSample(std::int64_t t0, std::int64_t t1, std::int64_t t2, std::int64_t t3) {
+    std::int64_t roundTrip = (t3 - t0) - (t2 - t1);
+    if (roundTrip < 0) {
+        return;
+    }
+    int slot = m_samples % kWindow;
+    m_offsets[slot] = ((t1 - t0) + (t2 - t3)) / 2;
+    m_roundTrips[slot] = roundTrip;
+    m_samples++;
+
+    int count = m_samples < kWindow ? m_samples : kWindow;
+    int best = 0;
+    for (int i = 1; i < count; i++) {
+        if (m_roundTrips[i] < m_roundTrips[best]) {
+            best = i;
+        }
+    }
+    m_offset = m_offsets[best];
+    m_roundTrip = m_roundTrips[best];
+}
+
+/*! \brief Server clock minus local clock.
+ * @return std::int64_t the offset in microseconds
+ */
+std::int64_t PeerClock::getOffset() const {
+    return m_offset;
+}
+
+/*! \brief Round trip of the exchange the offset was taken from.
+ * @return std::int64_t the round trip in microseconds
+ */
+std::int64_t PeerClock::getRoundTrip() const {
+    return m_roundTrip;
+}
+
+/*! \brief Whether an exchange has completed.
+ * @return bool true once the offset is based on a measurement
+ */
+bool PeerClock::isSynchronized() const {
+    return m_samples > 0;
+}
+
+/*! \brief Convert a local timestamp to the server's clock.
+ * @param local the local timestamp
+ * @return std::int64_t the same instant on the server's clock
+ */
+std::int64_t PeerClock::toServerTime(std::int64_t local) const {
+    return local + m_offset;
+}
+
+/*! \brief Convert a server timestamp to the local clock.
+ * @param server the server timestamp
+ * @return std::int64_t the same instant on the local clock
+ */
+std::int64_t PeerClock::toLocalTime(std::int64_t server) const {
+    return server - m_offset;
+}
+
+/*! \brief Construct a tracker recording into the latency.input_to_present histograms.
+ */
+LatencyTracker::LatencyTracker() {
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_local = &metrics.histogram("latency.input_to_present.local_us");
+    m_remote = &metrics.histogram("latency.input_to_present.remote_us");
+}
+
+/*! \brief Remember a sample which has just been applied to the canvas.
+ * @param captureLocalUs when the input was captured, on this machine's clock
+ * @param remote whether the input came from another peer
+ * @return void
+ */
+void LatencyTracker::applied(std::int64_t captureLocalUs, bool remote) {
+    m_pending.emplace_back(captureLocalUs, remote);
+}
+
+/*! \brief Resolve every pending sample against the time the frame was presented. A small
+ * negative latency can only come from clock offset error, so it is clamped to zero.
+ * @param presentLocalUs when the frame was presented, on this machine's clock
+ * @return void
+ */
+void LatencyTracker::presented(std::int64_t presentLocalUs) {
+    for (auto &sample : m_pending) {
+        std::int64_t latency = presentLocalUs - sample.first;
+        (sample.second ? m_remote : m_local)->record(static_cast<std::uint64_t>(latency > 0 ? latency : 0));
+    }
+    m_pending.clear();
+}
+
+/*! \brief Summarise both histograms in one line, e.g. for the log.
+ * @return std::string the summary
+ */
+std::string LatencyTracker::summary() const {
+    std::ostringstream out;
+    out << "input-to-present latency (us): local n=" << m_local->count()
+        << " p50=" << m_local->percentile(0.50) << " p99=" << m_local->percentile(0.99)
+        << " max=" << m_local->max()
+        << "; remote n=" << m_remote->count()
+        << " p50=" << m_remote->percentile(0.50) << " p99=" << m_remote->percentile(0.99)
+        << " max=" << m_remote->max();
+    return out.str();
+}
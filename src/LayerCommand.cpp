@@ -0,0 +1,129 @@
+/**
+ *  @file   LayerCommand.cpp
+ *  @brief  LayerCommand implementation, every layer change is a command.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+// Project header files
+#include "LayerCommand.hpp"
+#include "Logger.hpp"
+
+/*! \brief 	LayerCommand object stores the layer and the new value of the change. Only these travel
+ * over the network.
+ * @param app the app to act upon
+ * @param kind what to change
+ * @param layer the id of the layer, or of the new layer for an add
+ * @param value the position for an add or a move, the opacity (0-255), or the blend mode
+*/
+LayerCommand::LayerCommand(PaintCore *app, Kind kind, int layer, int value) {
+    LayerCommand::minipaint = app;
+    LayerCommand::m_kind = kind;
+    LayerCommand::m_layer = layer;
+    LayerCommand::m_value = value;
+    LayerCommand::m_previous = 0;
+    LayerCommand::recorded = false;
+}
+
+/*! \brief 	Execute a LayerCommand. The first time, the current value is saved for undo; a change which
+ * would change nothing (e.g. moving a layer to where it is) fails, so it never enters the history.
+ * @return bool false if there is no such layer or nothing changes
+*
+*/
+bool LayerCommand::execute() {
+    LayerStack &layers = minipaint->GetLayers();
+    bool changed = false;
+    switch (m_kind) {
+        case Kind::Add:
+            changed = layers.insert(m_layer, static_cast<std::size_t>(std::max(m_value, 0)));
+            break;
+        case Kind::Move: {
+            int index = layers.indexOf(m_layer);
+            if (index < 0 || (!recorded && index == m_value)) {
+                return false;
+            }
+            m_previous = recorded ? m_previous : index;
+            changed = layers.move(m_layer, static_cast<std::size_t>(std::max(m_value, 0)));
+            break;
+        }
+        case Kind::Opacity: {
+            LayerStack::Layer *layer = layers.find(m_layer);
+            const int opacity = std::min(std::max(m_value, 0), 255);
+            if (layer == nullptr || (!recorded && layer->opacity == opacity)) {
+                return false;
+            }
+            m_previous = recorded ? m_previous : layer->opacity;
+            changed = layers.setOpacity(m_layer, static_cast<std::uint8_t>(opacity));
+            break;
+        }
+        case Kind::Blend: {
+            LayerStack::Layer *layer = layers.find(m_layer);
+            if (layer == nullptr || m_value < 0 || m_value >= static_cast<int>(BlendMode::Count) ||
+                (!recorded && static_cast<int>(layer->blend) == m_value)) {
+                return false;
+            }
+            m_previous = recorded ? m_previous : static_cast<int>(layer->blend);
+            changed = layers.setBlendMode(m_layer, static_cast<BlendMode>(m_value));
+            break;
+        }
+    }
+    LOG_DEBUG("layer change " << static_cast<int>(m_kind) << " of layer " << m_layer << " to " << m_value);
+    recorded = recorded || changed;
+    return changed;
+}
+
+/*! \brief Layer commands have no pixel position.
+ * @return int - always 0
+ *
+ */
+int LayerCommand::getPixelX() {
+    return 0;
+}
+
+/*! \brief Layer commands have no pixel position.
+ * @return int - always 0
+ *
+ */
+int LayerCommand::getPixelY() {
+    return 0;
+}
+
+/*! \brief Approximate bytes held by this command: just the object, whatever the layer holds.
+ * @return std::size_t the approximate number of bytes
+ */
+std::size_t LayerCommand::getByteSize() {
+    return sizeof(*this);
+}
+
+/*! \brief 	Undo this LayerCommand by restoring the value saved on execute. An added layer is taken out
+ * of the stack; if the local user was painting on it they go back to the base layer.
+ * @return bool representing success of undo
+ *
+*/
+bool LayerCommand::undo() {
+    if (!recorded) {
+        return false;
+    }
+    LayerStack &layers = minipaint->GetLayers();
+    switch (m_kind) {
+        case Kind::Add:
+            if (minipaint->GetActiveLayer() == m_layer) {
+                minipaint->SelectLayer(LayerStack::kBaseLayer);
+            }
+            return layers.remove(m_layer);
+        case Kind::Move:
+            return layers.move(m_layer, static_cast<std::size_t>(m_previous));
+        case Kind::Opacity:
+            return layers.setOpacity(m_layer, static_cast<std::uint8_t>(m_previous));
+        case Kind::Blend:
+            return layers.setBlendMode(m_layer, static_cast<BlendMode>(m_previous));
+    }
+    return false;
+}
+
+/*! \brief 	Delete this LayerCommand object.
+ *
+*/
+LayerCommand::~LayerCommand() = default;
@@ -0,0 +1,405 @@
+/**
+ *  @file   LayerStack.cpp
+ *  @brief  Implementation of LayerStack.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+// Project header files
+#include "LayerStack.hpp"
+#include "Logger.hpp"
+#include "TileStore.hpp"
+
+static_assert(Canvas::kTileSize == StrokeStore::kTileSize, "layers are composited in the tiles they are repaired in");
+static_assert(Canvas::kTileSize == ThreadPool::kBandRows, "a row of tiles is one band of rows");
+
+/*! \brief Construct a stack with no layers; create() adds the base layer.
+ */
+LayerStack::LayerStack() {
+    m_backdrop = Canvas::fromRGBA(0xFFFFFFFF);
+    m_width = 0;
+    m_height = 0;
+    m_generation = 0;
+
+    // Metrics
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_tilesComposited = &metrics.counter("layers.tiles_composited");
+    m_layerCount = &metrics.gauge("layers.count");
+}
+
+/*! \brief Drop every layer and start over with the base layer alone, filled with one value. It
+ * becomes the opaque backdrop under the layers too. This starts a new generation of layers.
+ * @param width the width in pixels
+ * @param height the height in pixels
+ * @param background the canvas color
+ * @return void
+ */
+void LayerStack::create(unsigned width, unsigned height, Canvas::Pixel background) {
+    m_width = width;
+    m_height = height;
+    m_backdrop = background | Canvas::fromRGBA(0xFF);
+    m_generation++;
+    m_layers.clear();
+    m_order.clear();
+    std::unique_ptr<Layer> base(new Layer{kBaseLayer, Canvas(width, height, background), StrokeStore(), background,
+                                          BlendMode::Normal, 255, true, std::vector<std::uint8_t>(),
+                                          std::vector<std::uint8_t>()});
+    page(base->canvas);
+    std::vector<std::uint8_t> created;
+    base->canvas.takeDirtyTiles(created);
+    base->painted.assign(created.size(), 1);
+    base->unsaved.assign(created.size(), 0);
+    m_order.push_back(base.get());
+    m_layers.push_back(std::move(base));
+    invalidate();
+    m_layerCount->set(1);
+}
+
+/*! \brief Find a layer by id, whether or not it is in the stack.
+ * @param id the layer id
+ * @return Layer* the layer, or nullptr if no layer has that id
+ */
+LayerStack::Layer *LayerStack::find(int id) {
+    for (auto &layer : m_layers) {
+        if (layer->id == id) {
+            return layer.get();
+        }
+    }
+    return nullptr;
+}
+
+/*! \brief Position of a layer in the stack, counted from the bottom.
+ * @param id the layer id
+ * @return int the position, or -1 if the layer is not in the stack
+ */
+int LayerStack::indexOf(int id) const {
+    for (std::size_t i = 0; i < m_order.size(); i++) {
+        if (m_order[i]->id == id) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+/*! \brief Put a layer into the stack. A new id gets a new transparent layer; a layer taken out
+ * earlier comes back with its pixels and operations as they were.
+ * @param id the layer id
+ * @param position where to put it, from the bottom; clamped to the top
+ * @return bool false if the layer is already in the stack
+ */
+bool LayerStack::insert(int id, std::size_t position) {
+    Layer *layer = find(id);
+    if (layer == nullptr) {
+        std::unique_ptr<Layer> created(new Layer{id, Canvas(m_width, m_height, 0), StrokeStore(), 0,
+                                                 BlendMode::Normal, 255, false, std::vector<std::uint8_t>(),
+                                                 std::vector<std::uint8_t>()});
+        page(created->canvas);
+        // A new layer is transparent; creating its pixels paints nothing
+        std::vector<std::uint8_t> tiles;
+        created->canvas.takeDirtyTiles(tiles);
+        created->painted.assign(tiles.size(), 0);
+        created->unsaved.assign(tiles.size(), 0);
+        layer = created.get();
+        m_layers.push_back(std::move(created));
+    } else if (layer->attached) {
+        return false;
+    }
+    layer->attached = true;
+    m_order.insert(m_order.begin() + std::min(position, m_order.size()), layer);
+    invalidate(*layer);
+    m_layerCount->set(static_cast<std::int64_t>(m_order.size()));
+    return true;
+}
+
+/*! \brief Take a layer out of the stack. Its contents are kept for when it is put back.
+ * @param id the layer id
+ * @return bool false if the layer is not in the stack
+ */
+bool LayerStack::remove(int id) {
+    int index = indexOf(id);
+    if (index < 0) {
+        return false;
+    }
+    Layer *layer = m_order[index];
+    invalidate(*layer);
+    layer->attached = false;
+    m_order.erase(m_order.begin() + index);
+    m_layerCount->set(static_cast<std::int64_t>(m_order.size()));
+    return true;
+}
+
+/*! \brief Move a layer to another position in the stack. Only the tiles it was painted on change.
+ * @param id the layer id
+ * @param position the new position from the bottom; clamped to the top
+ * @return bool false if the layer is not in the stack
+ */
+bool LayerStack::move(int id, std::size_t position) {
+    int index = indexOf(id);
+    if (index < 0) {
+        return false;
+    }
+    Layer *layer = m_order[index];
+    m_order.erase(m_order.begin() + index);
+    m_order.insert(m_order.begin() + std::min(position, m_order.size()), layer);
+    invalidate(*layer);
+    return true;
+}
+
+/*! \brief Change how opaque a layer is shown.
+ * @param id the layer id
+ * @param opacity the opacity, 0 (hidden) to 255 (as painted)
+ * @return bool false if there is no such layer
+ */
+bool LayerStack::setOpacity(int id, std::uint8_t opacity) {
+    Layer *layer = find(id);
+    if (layer == nullptr) {
+        return false;
+    }
+    layer->opacity = opacity;
+    if (layer->attached) {
+        invalidate(*layer);
+    }
+    return true;
+}
+
+/*! \brief Change how a layer's colors combine with the layers below it.
+ * @param id the layer id
+ * @param mode the blend mode
+ * @return bool false if there is no such layer
+ */
+bool LayerStack::setBlendMode(int id, BlendMode mode) {
+    Layer *layer = find(id);
+    if (layer == nullptr) {
+        return false;
+    }
+    layer->blend = mode;
+    if (layer->attached) {
+        invalidate(*layer);
+    }
+    return true;
+}
+
+/*! \brief Rebuild the tiles marked for repair on every layer, e.g. after an undo. The rebuilt
+ * tiles count as written, so flatten() composites them again.
+ * @return std::size_t the number of tiles rebuilt
+ */
+std::size_t LayerStack::repair() {
+    std::size_t rebuilt = 0;
+    for (auto &layer : m_layers) {
+        rebuilt += layer->strokes.repair(layer->canvas, layer->background);
+    }
+    return rebuilt;
+}
+
+/*! \brief Bake and drop the settled operations of every layer's stroke store, so the stores hold
+ * what the history can still change. The canvas a store bakes into pages like its layer's.
+ * @return std::size_t the number of operations dropped
+ */
+std::size_t LayerStack::compact() {
+    std::size_t dropped = 0;
+    for (auto &layer : m_layers) {
+        dropped += layer->strokes.compact(layer->canvas, layer->background);
+        Canvas *baked = layer->strokes.getBaked();
+        if (baked != nullptr && !baked->isPaging()) {
+            page(*baked);
+        }
+    }
+    return dropped;
+}
+
+/*! \brief End the open strokes of every layer's stroke store.
+ * @return void
+ */
+void LayerStack::closeStrokes() {
+    for (auto &layer : m_layers) {
+        layer->strokes.closeStrokes();
+    }
+}
+
+/*! \brief Bring the flattened image up to date. The tiles written on any layer since the last call
+ * are gathered first; then each row of tiles is one task, compositing each dirty tile a pixel row at
+ * a time from the backdrop up through the layers painted there. A tile where every such layer holds
+ * one value, e.g. one nobody drew on, is composited from a single pixel and shares a uniform tile.
+ * With paging on, the rows go in bands of about half a canvas's share of the tile budget, each
+ * followed by paging out what the layers and out hold beyond it.
+ * @param out the flattened image; recreated if its size differs from the layers'
+ * @param pool the threads to composite on
+ * @return std::size_t the number of tiles composited
+ */
+std::size_t LayerStack::flatten(Canvas &out, ThreadPool &pool) {
+    if (out.getWidth() != m_width || out.getHeight() != m_height) {
+        out.create(m_width, m_height, m_backdrop);
+        invalidate();
+    }
+    std::vector<std::uint8_t> written;
+    for (auto &layer : m_layers) {
+        written.assign(m_dirty.size(), 0);
+        if (!layer->canvas.takeDirtyTiles(written)) {
+            continue;
+        }
+        for (std::size_t i = 0; i < written.size(); i++) {
+            if (written[i] != 0) {
+                layer->painted[i] = 1;
+                layer->unsaved[i] = 1;
+                if (layer->attached) {
+                    m_dirty[i] = 1;
+                }
+            }
+        }
+    }
+    const int columns = out.getTileColumns();
+    std::vector<int> tileRows;
+    std::size_t composited = 0;
+    for (int tileY = 0; tileY < out.getTileRows(); tileY++) {
+        const std::uint8_t *tiles = &m_dirty[static_cast<std::size_t>(tileY) * columns];
+        std::size_t count = static_cast<std::size_t>(std::count(tiles, tiles + columns, 1));
+        if (count > 0) {
+            tileRows.push_back(tileY);
+            composited += count;
+        }
+    }
+    if (tileRows.empty()) {
+        trimTiles(out);
+        return 0;
+    }
+    const std::size_t band = m_tileBudget != nullptr
+            ? std::max<std::size_t>(m_tileBudget->getShare() / (2 * static_cast<std::size_t>(columns)), 1)
+            : tileRows.size();
+    out.pauseTracking();
+    for (std::size_t first = 0; first < tileRows.size(); first += band) {
+        pool.parallelFor(std::min(band, tileRows.size() - first), [&](std::size_t task) {
+            const int tileY = tileRows[first + task];
+            const std::uint8_t *tiles = &m_dirty[static_cast<std::size_t>(tileY) * columns];
+            const int top = tileY * Canvas::kTileSize;
+            const int bottom = std::min(top + Canvas::kTileSize, static_cast<int>(m_height));
+            std::vector<Layer *> layers;
+            std::vector<Canvas::Pixel> row;
+            for (int tileX = 0; tileX < columns; tileX++) {
+                if (tiles[tileX] == 0) {
+                    continue;
+                }
+                const std::size_t index = static_cast<std::size_t>(tileY) * columns + tileX;
+                // The layers with something to show in this tile; while each holds one value throughout,
+                // so does the composite
+                layers.clear();
+                bool uniform = true;
+                Canvas::Pixel composite = m_backdrop;
+                for (Layer *layer : m_order) {
+                    if (layer->opacity == 0 || layer->painted[index] == 0) {
+                        continue;
+                    }
+                    layers.push_back(layer);
+                    Canvas::Pixel pixel;
+                    if (uniform && layer->canvas.isUniformTile(tileX, tileY, pixel)) {
+                        BlendKernels::blendRow(&composite, &pixel, 1, layer->blend, layer->opacity);
+                    } else {
+                        uniform = false;
+                    }
+                }
+                const int left = tileX * Canvas::kTileSize;
+                const int width = std::min(left + Canvas::kTileSize, static_cast<int>(m_width)) - left;
+                if (uniform) {
+                    out.fillRect(CanvasRect{left, top, left + width, bottom}, composite);
+                    continue;
+                }
+                for (int y = top; y < bottom; y++) {
+                    row.assign(static_cast<std::size_t>(width), m_backdrop);
+                    for (Layer *layer : layers) {
+                        BlendKernels::blendRow(row.data(), layer->canvas.getTileRow(tileX, y), width, layer->blend,
+                                               layer->opacity);
+                    }
+                    out.writeSpan(y, left, width, row.data());
+                }
+            }
+        });
+        trimTiles(out);
+    }
+    out.resumeTracking(tileRows.front() * Canvas::kTileSize,
+                       std::min((tileRows.back() + 1) * Canvas::kTileSize, static_cast<int>(m_height)) - 1, m_dirty);
+    std::fill(m_dirty.begin(), m_dirty.end(), 0);
+    m_tilesComposited->increment(composited);
+    return composited;
+}
+
+/*! \brief Mark every tile for compositing.
+ * @return void
+ */
+void LayerStack::invalidate() {
+    const std::size_t columns = (m_width + Canvas::kTileSize - 1) / Canvas::kTileSize;
+    const std::size_t rows = (m_height + Canvas::kTileSize - 1) / Canvas::kTileSize;
+    m_dirty.assign(columns * rows, 1);
+}
+
+/*! \brief Mark the tiles a layer was painted on for compositing, e.g. when its opacity changes.
+ * @param layer the layer
+ * @return void
+ */
+void LayerStack::invalidate(const Layer &layer) {
+    for (std::size_t i = 0; i < layer.painted.size(); i++) {
+        m_dirty[i] |= layer.painted[i];
+    }
+}
+
+/*! \brief Page out the tiles every layer's canvas and the flattened image hold beyond the tile
+ * budget; nothing if paging is off. No compositing may be going on.
+ * @param out the flattened image
+ * @return void
+ */
+void LayerStack::trimTiles(Canvas &out) {
+    for (auto &layer : m_layers) {
+        layer->canvas.trimTiles();
+        if (layer->strokes.getBaked() != nullptr) {
+            layer->strokes.getBaked()->trimTiles();
+        }
+    }
+    out.trimTiles();
+}
+
+/*! \brief Page the tiles of every layer's canvas, and of those created later, out to files, keeping
+ * the tiles all of them hold in memory within one budget.
+ * @param directory where to create the files
+ * @param budget the tiles the layers keep in memory together, with any other canvas sharing it
+ * @param error receives why a file could not be created
+ * @return bool false if one could not; layers which could page do
+ */
+bool LayerStack::setPaging(const std::string &directory, const std::shared_ptr<TileBudget> &budget,
+                           std::string &error) {
+    m_pagingDirectory = directory;
+    m_tileBudget = budget;
+    for (auto &layer : m_layers) {
+        if (!layer->canvas.enablePaging(directory, budget, error)) {
+            return false;
+        }
+        Canvas *baked = layer->strokes.getBaked();
+        if (baked != nullptr && !baked->enablePaging(directory, budget, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! \brief Have a layer's canvas page its tiles, if paging is on. A layer which cannot keeps its
+ * tiles in memory, with a warning.
+ * @param canvas the layer's canvas, or the one its stroke store bakes into
+ * @return void
+ */
+void LayerStack::page(Canvas &canvas) {
+    std::string error;
+    if (m_tileBudget != nullptr && !canvas.enablePaging(m_pagingDirectory, m_tileBudget, error)) {
+        LOG_WARN("Layer tiles stay in memory: " << error);
+    }
+}
+
+/*! \brief Approximate bytes held by every layer, in or out of the stack.
+ * @return std::size_t the number of bytes
+ */
+std::size_t LayerStack::getByteSize() const {
+    std::size_t bytes = m_dirty.size();
+    for (auto &layer : m_layers) {
+        bytes += sizeof(Layer) + layer->canvas.getByteSize() + layer->strokes.getByteSize() +
+                 layer->painted.size() * 2;
+    }
+    return bytes;
+}
@@ -0,0 +1,292 @@
+/**
+ *  @file   Logger.cpp
+ *  @brief  Implementation of Logger.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+// Project header files
+#include "Logger.hpp"
+
+/*! \brief Milliseconds on the monotonic clock, used for rate limiting windows.
+ * @return std::int64_t the current time in milliseconds
+ */
+static std::int64_t steadyMilliseconds() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*! \brief Construct a limiter with an empty window.
+ */
+LogRateLimiter::LogRateLimiter() : m_windowStart(0), m_inWindow(0), m_suppressed(0) {
+}
+
+/*! \brief Decide whether a message from this call site may be logged. Lock-free: concurrent
+ * callers may briefly disagree about the window boundary, which only changes the burst slightly.
+ * @param suppressed set to the number of messages dropped since the last allowed one
+ * @return bool whether to log the message
+ */
+bool LogRateLimiter::allow(std::uint64_t &suppressed) {
+    std::int64_t now = steadyMilliseconds();
+    std::int64_t windowStart = m_windowStart.load(std::memory_order_relaxed);
+    if (now - windowStart >= kWindowMs &&
+        m_windowStart.compare_exchange_strong(windowStart, now, std::memory_order_relaxed)) {
+        m_inWindow.store(0, std::memory_order_relaxed);
+    }
+    if (m_inWindow.fetch_add(1, std::memory_order_relaxed) < kBurst) {
+        suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+/*! \brief Return the process-wide logger, starting its writer thread on first use. The logger is
+ * intentionally leaked; an exit handler drains the queue and stops the thread instead, so messages
+ * logged right before exit() are not lost.
+ * @return Logger& the logger
+ */
+Logger &Logger::Get() {
+    static Logger *instance = [] {
+        Logger *logger = new Logger();
+        std::atexit([] { Logger::Get().shutdown(); });
+        return logger;
+    }();
+    return *instance;
+}
+
+/*! \brief Construct the logger. The runtime level defaults to INFO and may be set with the
+ * PAINT_LOG_LEVEL environment variable (trace, debug, info, warn, error or off).
+ */
+Logger::Logger() : m_slots(new Slot[kCapacity]), m_enqueuePos(0), m_dequeuePos(0) {
+    for (std::size_t i = 0; i < kCapacity; i++) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    const char *level = std::getenv("PAINT_LOG_LEVEL");
+    m_level.store(static_cast<int>(parseLevel(level != nullptr ? level : "", LogLevel::Info)));
+    m_epoch = std::chrono::steady_clock::now();
+    m_out = &std::cout;
+
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_queueDepth = &metrics.gauge("log.queue_depth");
+    m_dropped = &metrics.counter("log.dropped");
+    m_suppressed = &metrics.counter("log.suppressed");
+
+    m_running.store(true);
+    m_thread = std::thread(&Logger::run, this);
+}
+
+/*! \brief Return a cleared thread-local stream to format a message into.
+ * @return std::ostringstream& the calling thread's message stream
+ */
+std::ostringstream &Logger::beginMessage() {
+    thread_local std::ostringstream stream;
+    stream.str(std::string());
+    stream.clear();
+    return stream;
+}
+
+/*! \brief Name of a log level as printed in the output.
+ * @param level the level
+ * @return const char* the name
+ */
+const char *Logger::levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Trace:
+            return "TRACE";
+        case LogLevel::Debug:
+            return "DEBUG";
+        case LogLevel::Info:
+            return "INFO";
+        case LogLevel::Warn:
+            return "WARN";
+        case LogLevel::Error:
+            return "ERROR";
+        default:
+            return "OFF";
+    }
+}
+
+/*! \brief Parse a level name such as "debug".
+ * @param name the level name, case-insensitive
+ * @param fallback the level to return when the name is not recognised
+ * @return LogLevel the parsed level
+ */
+LogLevel Logger::parseLevel(const std::string &name, LogLevel fallback) {
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (int level = static_cast<int>(LogLevel::Trace); level <= static_cast<int>(LogLevel::Off); level++) {
+        std::string candidate = levelName(static_cast<LogLevel>(level));
+        std::transform(candidate.begin(), candidate.end(), candidate.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (candidate == lower) {
+            return static_cast<LogLevel>(level);
+        }
+    }
+    return fallback;
+}
+
+/*! \brief Change the runtime level.
+ * @param level messages below this level are discarded before they are formatted
+ * @return void
+ */
+void Logger::setLevel(LogLevel level) {
+    m_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+/*! \brief Get the runtime level.
+ * @return LogLevel the current level
+ */
+LogLevel Logger::getLevel() const {
+    return static_cast<LogLevel>(m_level.load(std::memory_order_relaxed));
+}
+
+/*! \brief Queue the contents of a message stream.
+ * @param level the message level
+ * @param message the formatted message
+ * @param suppressed how many messages the call site's rate limiter dropped before this one
+ * @return void
+ */
+void Logger::submit(LogLevel level, std::ostringstream &message, std::uint64_t suppressed) {
+    submit(level, message.str(), suppressed);
+}
+
+/*! \brief Queue a message for the writer thread. Once the logger has shut down (during exit)
+ * messages are written immediately instead.
+ * @param level the message level
+ * @param message the message text
+ * @param suppressed how many messages the call site's rate limiter dropped before this one
+ * @return void
+ */
+void Logger::submit(LogLevel level, const std::string &message, std::uint64_t suppressed) {
+    if (suppressed > 0) {
+        m_suppressed->increment(suppressed);
+    }
+    if (!enqueue(level, message.data(), message.size(), suppressed)) {
+        m_dropped->increment();
+    }
+    if (!m_running.load(std::memory_order_acquire)) {
+        flush();
+    }
+}
+
+/*! \brief Bounded multi-producer queue insert (Vyukov). A producer claims a position with one
+ * compare-and-swap, fills the slot, then publishes it by advancing the slot's sequence number.
+ * @param level the message level
+ * @param text the message text
+ * @param length the message length
+ * @param suppressed the rate limiter's suppressed count
+ * @return bool false if the ring was full and the message was dropped
+ */
+bool Logger::enqueue(LogLevel level, const char *text, std::size_t length, std::uint64_t suppressed) {
+    Slot *slot;
+    std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        slot = &m_slots[pos & (kCapacity - 1)];
+        std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    slot->level = level;
+    slot->timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_epoch).count();
+    slot->suppressed = suppressed;
+    slot->length = static_cast<std::uint32_t>(std::min(length, kMaxMessage));
+    std::memcpy(slot->text, text, slot->length);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+/*! \brief Write all published messages to the output. Callers hold m_outputMutex, so there is
+ * only ever one consumer and messages come out in queue order.
+ * @return std::size_t the number of messages written
+ */
+std::size_t Logger::drain() {
+    std::size_t written = 0;
+    char prefix[48];
+    while (true) {
+        std::size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Slot &slot = m_slots[pos & (kCapacity - 1)];
+        std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != pos + 1) {
+            break;
+        }
+        std::snprintf(prefix, sizeof(prefix), "[%10.3f] %-5s ", slot.timeUs / 1e6, levelName(slot.level));
+        *m_out << prefix;
+        m_out->write(slot.text, slot.length);
+        if (slot.suppressed > 0) {
+            *m_out << " (" << slot.suppressed << " similar messages suppressed)";
+        }
+        *m_out << '\n';
+        m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+        slot.sequence.store(pos + kCapacity, std::memory_order_release);
+        written++;
+    }
+    if (written > 0) {
+        m_out->flush();
+    }
+    m_queueDepth->set(static_cast<std::int64_t>(
+            m_enqueuePos.load(std::memory_order_relaxed) - m_dequeuePos.load(std::memory_order_relaxed)));
+    return written;
+}
+
+/*! \brief Writer thread: drain the ring in batches, sleeping briefly whenever it is empty.
+ * The output is flushed once per batch instead of once per line.
+ * @return void
+ */
+void Logger::run() {
+    while (m_running.load(std::memory_order_acquire)) {
+        std::size_t written;
+        {
+            std::lock_guard<std::mutex> lock(m_outputMutex);
+            written = drain();
+        }
+        if (written == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+}
+
+/*! \brief Redirect the output.
+ * @param out the stream to write to, or nullptr for std::cout
+ * @return void
+ */
+void Logger::setOutput(std::ostream *out) {
+    std::lock_guard<std::mutex> lock(m_outputMutex);
+    drain();
+    m_out = out != nullptr ? out : &std::cout;
+}
+
+/*! \brief Write everything queued so far before returning.
+ * @return void
+ */
+void Logger::flush() {
+    std::lock_guard<std::mutex> lock(m_outputMutex);
+    drain();
+}
+
+/*! \brief Stop the writer thread and write whatever is still queued.
+ * @return void
+ */
+void Logger::shutdown() {
+    if (m_running.exchange(false) && m_thread.joinable()) {
+        m_thread.join();
+    }
+    flush();
+}
@@ -0,0 +1,397 @@
+/**
+ *  @file   Metrics.cpp
+ *  @brief  Implementation of Metrics.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+// POSIX headers for the stats socket
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+// Project header files
+#include "Metrics.hpp"
+
+/*! \brief Construct a counter at zero.
+ */
+Counter::Counter() : m_value(0) {
+}
+
+/*! \brief Construct a gauge at zero.
+ */
+Gauge::Gauge() : m_value(0) {
+}
+
+/*! \brief Construct an empty histogram.
+ */
+Histogram::Histogram() : m_count(0), m_sum(0), m_max(0) {
+    for (auto &bucket : m_counts) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+/*! \brief Find the bucket for a value. Values below kSubBuckets get a bucket each; above that,
+ * the position of the highest set bit picks a group and the next kSubBucketBits bits pick the
+ * bucket inside it.
+ * @param value the value to place
+ * @return int the bucket index
+ */
+int Histogram::bucketIndex(std::uint64_t value) {
+    if (value < static_cast<std::uint64_t>(kSubBuckets)) {
+        return static_cast<int>(value);
+    }
+    int msb = 63;
+    while ((value >> msb) == 0) {
+        msb--;
+    }
+    int shift = msb - kSubBucketBits;
+    int sub = static_cast<int>((value >> shift) & (kSubBuckets - 1));
+    return (shift + 1) * kSubBuckets + sub;
+}
+
+/*! \brief Largest value which falls into a bucket.
+ * @param index the bucket index
+ * @return std::uint64_t the inclusive upper bound of the bucket
+ */
+std::uint64_t Histogram::bucketUpperBound(int index) {
+    if (index < kSubBuckets) {
+        return static_cast<std::uint64_t>(index);
+    }
+    int shift = index / kSubBuckets - 1;
+    std::uint64_t sub = static_cast<std::uint64_t>(index % kSubBuckets);
+    std::uint64_t lower = (static_cast<std::uint64_t>(kSubBuckets) + sub) << shift;
+    return lower + ((std::uint64_t(1) << shift) - 1);
+}
+
+/*! \brief Record one value. Lock-free; safe to call from any thread.
+ * @param value the value to record
+ * @return void
+ */
+void Histogram::record(std::uint64_t value) {
+    m_counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    std::uint64_t previous = m_max.load(std::memory_order_relaxed);
+    while (value > previous && !m_max.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+    }
+}
+
+/*! \brief Number of recorded values.
+ * @return std::uint64_t the count
+ */
+std::uint64_t Histogram::count() const {
+    return m_count.load(std::memory_order_relaxed);
+}
+
+/*! \brief Mean of the recorded values.
+ * @return double the mean, or 0 when empty
+ */
+double Histogram::mean() const {
+    std::uint64_t n = count();
+    return n == 0 ? 0.0 : static_cast<double>(m_sum.load(std::memory_order_relaxed)) / n;
+}
+
+/*! \brief Largest recorded value.
+ * @return std::uint64_t the maximum
+ */
+std::uint64_t Histogram::max() const {
+    return m_max.load(std::memory_order_relaxed);
+}
+
+/*! \brief Walk the buckets until the requested fraction of samples has been seen.
+ * @param fraction the percentile as a fraction between 0 and 1
+ * @return std::uint64_t the upper bound of the bucket containing that percentile
+ */
+std::uint64_t Histogram::percentile(double fraction) const {
+    std::uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    std::uint64_t target = static_cast<std::uint64_t>(fraction * total + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+    std::uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += m_counts[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            std::uint64_t bound = bucketUpperBound(i);
+            return bound < max() ? bound : max();
+        }
+    }
+    return max();
+}
+
+/*! \brief Forget all recorded values.
+ * @return void
+ */
+void Histogram::reset() {
+    for (auto &bucket : m_counts) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+/*! \brief Construct an empty registry.
+ */
+MetricsRegistry::MetricsRegistry() = default;
+
+/*! \brief Return the process-wide registry. Deliberately leaked so that threads and static
+ * destructors which still hold metric references during exit never see a destroyed registry.
+ * @return MetricsRegistry& the registry
+ */
+MetricsRegistry &MetricsRegistry::Get() {
+    static MetricsRegistry *instance = new MetricsRegistry();
+    return *instance;
+}
+
+/*! \brief Find or create a counter.
+ * @param name the metric name
+ * @return Counter& a reference which stays valid for the life of the process
+ */
+Counter &MetricsRegistry::counter(const std::string &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<Counter> &slot = m_counters[name];
+    if (slot == nullptr) {
+        slot.reset(new Counter());
+    }
+    return *slot;
+}
+
+/*! \brief Find or create a gauge.
+ * @param name the metric name
+ * @return Gauge& a reference which stays valid for the life of the process
+ */
+Gauge &MetricsRegistry::gauge(const std::string &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<Gauge> &slot = m_gauges[name];
+    if (slot == nullptr) {
+        slot.reset(new Gauge());
+    }
+    return *slot;
+}
+
+/*! \brief Find or create a histogram.
+ * @param name the metric name
+ * @return Histogram& a reference which stays valid for the life of the process
+ */
+Histogram &MetricsRegistry::histogram(const std::string &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<Histogram> &slot = m_histograms[name];
+    if (slot == nullptr) {
+        slot.reset(new Histogram());
+    }
+    return *slot;
+}
+
+/*! \brief Format every metric as one "name value" line, sorted by name.
+ * @return std::string the formatted metrics
+ */
+std::string MetricsRegistry::format() {
+    std::map<std::string, std::string> lines;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &counter : m_counters) {
+            lines[counter.first] = std::to_string(counter.second->get());
+        }
+        for (auto &gauge : m_gauges) {
+            lines[gauge.first] = std::to_string(gauge.second->get());
+        }
+        for (auto &entry : m_histograms) {
+            const Histogram &histogram = *entry.second;
+            char mean[32];
+            std::snprintf(mean, sizeof(mean), "%.1f", histogram.mean());
+            lines[entry.first + ".count"] = std::to_string(histogram.count());
+            lines[entry.first + ".mean"] = mean;
+            lines[entry.first + ".p50"] = std::to_string(histogram.percentile(0.50));
+            lines[entry.first + ".p90"] = std::to_string(histogram.percentile(0.90));
+            lines[entry.first + ".p99"] = std::to_string(histogram.percentile(0.99));
+            lines[entry.first + ".max"] = std::to_string(histogram.max());
+        }
+    }
+    std::ostringstream out;
+    out << "# paint stats " << std::time(nullptr) << "\n";
+    for (auto &line : lines) {
+        out << line.first << " " << line.second << "\n";
+    }
+    return out.str();
+}
+
+/*! \brief Construct an idle reporter.
+ */
+StatsReporter::StatsReporter() {
+    m_intervalMs = 5000;
+    m_socket = -1;
+    m_running = false;
+}
+
+/*! \brief Stop the reporter thread before destruction.
+ */
+StatsReporter::~StatsReporter() {
+    stop();
+}
+
+/*! \brief Start the reporter thread.
+ * @param filePath file rewritten every interval (empty to disable)
+ * @param socketPath Unix socket path which serves the stats on connect (empty to disable)
+ * @param intervalMs how often the file is rewritten
+ * @return int representing success of the operation (0 = success)
+ */
+int StatsReporter::start(const std::string &filePath, const std::string &socketPath, int intervalMs) {
+    stop();
+    m_filePath = filePath;
+    m_socketPath = socketPath;
+    m_intervalMs = intervalMs > 0 ? intervalMs : 5000;
+    int status = 0;
+    if (!m_socketPath.empty()) {
+        status = openSocket();
+    }
+    m_running = true;
+    m_thread = std::thread(&StatsReporter::run, this);
+    return status;
+}
+
+/*! \brief Stop and join the reporter thread, and remove the socket.
+ * @return void
+ */
+void StatsReporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_socket >= 0) {
+        close(m_socket);
+        unlink(m_socketPath.c_str());
+        m_socket = -1;
+    }
+}
+
+/*! \brief Write the stats to the configured file. The text goes to a temporary file which is then
+ * renamed over the old one, so a scraper never reads a half-written file.
+ * @return bool whether the file was written
+ */
+bool StatsReporter::writeFile() {
+    if (m_filePath.empty()) {
+        return false;
+    }
+    std::string tmpPath = m_filePath + ".tmp";
+    {
+        std::ofstream out(tmpPath);
+        if (!out) {
+            return false;
+        }
+        out << MetricsRegistry::Get().format();
+        if (!out) {
+            return false;
+        }
+    }
+    return std::rename(tmpPath.c_str(), m_filePath.c_str()) == 0;
+}
+
+/*! \brief Create a non-blocking listening Unix socket at m_socketPath.
+ * @return int representing success of the operation (0 = success)
+ */
+int StatsReporter::openSocket() {
+    sockaddr_un address{};
+    if (m_socketPath.size() >= sizeof(address.sun_path)) {
+        return 1;
+    }
+    m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_socket < 0) {
+        return 1;
+    }
+    address.sun_family = AF_UNIX;
+    m_socketPath.copy(address.sun_path, m_socketPath.size());
+    unlink(m_socketPath.c_str());
+    if (bind(m_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(m_socket, 4) != 0) {
+        close(m_socket);
+        m_socket = -1;
+        return 1;
+    }
+    fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+/*! \brief Send the whole of a reply on a stats connection. A scraper which disconnects early must
+ * not raise SIGPIPE, which would end the process, so the bytes are sent without it; EPIPE or any
+ * other error just means the connection is closed.
+ * @param connection the accepted connection
+ * @param text the reply
+ * @return void
+ */
+static void sendReply(int connection, const std::string &text) {
+#if defined(__APPLE__)
+    int noSignal = 1;
+    setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+    const int flags = 0;
+#else
+    const int flags = MSG_NOSIGNAL;
+#endif
+    const char *data = text.data();
+    std::size_t remaining = text.size();
+    while (remaining > 0) {
+        ssize_t sent = send(connection, data, remaining, flags);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return;
+        }
+        data += sent;
+        remaining -= static_cast<std::size_t>(sent);
+    }
+}
+
+/*! \brief Reporter loop: rewrite the file every interval and, between writes, answer socket
+ * connections by sending the current stats and closing the connection.
+ * @return void
+ */
+void StatsReporter::run() {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point nextWrite = Clock::now();
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_running) {
+                break;
+            }
+            if (m_socket < 0) {
+                m_wake.wait_until(lock, nextWrite, [this] { return !m_running; });
+                if (!m_running) {
+                    break;
+                }
+            }
+        }
+        if (m_socket >= 0) {
+            // Wake at least every 100 ms so stop() never waits for a whole interval
+            pollfd listener{m_socket, POLLIN, 0};
+            if (poll(&listener, 1, 100) > 0) {
+                int connection = accept(m_socket, nullptr, nullptr);
+                if (connection >= 0) {
+                    sendReply(connection, MetricsRegistry::Get().format());
+                    close(connection);
+                }
+            }
+        }
+        if (Clock::now() >= nextWrite) {
+            writeFile();
+            nextWrite = Clock::now() + std::chrono::milliseconds(m_intervalMs);
+        }
+    }
+}
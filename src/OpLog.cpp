@@ -0,0 +1,332 @@
+/**
+ *  @file   OpLog.cpp
+ *  @brief  Implementation of OpLog.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+// POSIX headers for unbuffered writes and fdatasync
+#include <fcntl.h>
+#include <unistd.h>
+// Project header files
+#include "ByteOrder.hpp"
+#include "Checksum.hpp"
+#include "Logger.hpp"
+#include "OpLog.hpp"
+
+/*! \brief Whether a file exists.
+ * @param path the file
+ * @return bool whether it can be opened
+ */
+static bool fileExists(const std::string &path) {
+    return std::ifstream(path).good();
+}
+
+/*! \brief Flush a file's data to the disk. Metadata which does not affect reading the data back,
+ * e.g. the modification time, is not waited for where the system allows.
+ * @param fd the open file
+ * @return bool whether it succeeded
+ */
+static bool syncData(int fd) {
+#if defined(__APPLE__)
+    return ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+}
+
+/*! \brief Make a file created in the directory of prefix durable, by syncing the directory.
+ * @param prefix the log's prefix
+ * @return void
+ */
+static void syncDirectory(const std::string &prefix) {
+    const std::size_t slash = prefix.find_last_of('/');
+    const std::string directory =
+            slash == std::string::npos ? "." : prefix.substr(0, std::max<std::size_t>(slash, 1));
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+/*! \brief Decode the record at data.
+ * @param data the bytes from the record's start
+ * @param size the number of bytes available
+ * @param sequence receives the record's sequence number
+ * @param payloadSize receives the size of its payload, which follows the frame
+ * @return std::size_t the bytes the record takes, or 0 if it is torn or damaged
+ */
+static std::size_t decodeFrame(const std::uint8_t *data, std::size_t size, std::uint64_t &sequence,
+                               std::size_t &payloadSize) {
+    if (size < OpLog::kFrameBytes || ByteOrder::getU32(data) != OpLog::kRecordMagic) {
+        return 0;
+    }
+    payloadSize = ByteOrder::getU32(data + 4);
+    if (payloadSize > size - OpLog::kFrameBytes) {
+        return 0;
+    }
+    std::uint32_t crc = Checksum::crc32(data + 8, 8);
+    crc = Checksum::crc32(data + OpLog::kFrameBytes, payloadSize, crc);
+    if (crc != ByteOrder::getU32(data + 16)) {
+        return 0;
+    }
+    sequence = ByteOrder::getU64(data + 8);
+    return OpLog::kFrameBytes + payloadSize;
+}
+
+/*! \brief Open a log. Records already in its segments keep their sequence numbers, and new
+ * records follow them in a new segment. The flusher thread starts here.
+ * @param prefix the path the segments' names start with
+ * @param options the flush interval and size, segment size and durability
+ */
+OpLog::OpLog(const std::string &prefix, const Options &options) {
+    m_prefix = prefix;
+    m_options = options;
+    m_fd = -1;
+    m_segmentBytes = 0;
+    m_durable = 0;
+    m_stopping = false;
+    m_segment = 0;
+    while (fileExists(segmentPath(prefix, m_segment))) {
+        m_segment++;
+    }
+    // New records are numbered after the last one the segments hold
+    std::uint64_t last = 0;
+    replay(prefix, [&last](std::uint64_t sequence, const std::uint8_t *, std::size_t) { last = sequence; });
+    m_nextSequence = last + 1;
+    m_durable = last;
+
+    // Metrics
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_records = &metrics.counter("oplog.records");
+    m_bytes = &metrics.counter("oplog.bytes");
+    m_flushes = &metrics.counter("oplog.flushes");
+    m_errors = &metrics.counter("oplog.errors");
+    m_flushTime = &metrics.gauge("oplog.flush_us");
+    m_segments = &metrics.gauge("oplog.segments");
+
+    m_flusher = std::thread(&OpLog::run, this);
+}
+
+/*! \brief Destructor: stop the flusher, which writes what is still pending, and close the segment.
+ */
+OpLog::~OpLog() {
+    {
+        std::lock_guard<std::mutex> lock(m_appendMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    m_flusher.join();
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+/*! \brief Append a record. Only copies it into the pending batch, so it is cheap enough for the
+ * server's receive loop; the flusher writes it within one flush interval. The flusher is only woken
+ * by the first record of a batch and by the one which brings it to flushBytes.
+ * @param data the record's bytes, e.g. a packet as received
+ * @param size the number of bytes
+ * @return std::uint64_t the record's sequence number
+ */
+std::uint64_t OpLog::append(const void *data, std::size_t size) {
+    std::uint8_t sequenceBytes[8];
+    std::unique_lock<std::mutex> lock(m_appendMutex);
+    const std::size_t pendingBefore = m_pending.size();
+    const std::uint64_t sequence = m_nextSequence++;
+    for (int i = 0; i < 8; i++) {
+        sequenceBytes[i] = static_cast<std::uint8_t>(sequence >> (8 * i));
+    }
+    std::uint32_t crc = Checksum::crc32(sequenceBytes, sizeof(sequenceBytes));
+    crc = Checksum::crc32(data, size, crc);
+    ByteOrder::putU32(m_pending, kRecordMagic);
+    ByteOrder::putU32(m_pending, static_cast<std::uint32_t>(size));
+    ByteOrder::putU64(m_pending, sequence);
+    ByteOrder::putU32(m_pending, crc);
+    const std::uint8_t *bytes = static_cast<const std::uint8_t *>(data);
+    m_pending.insert(m_pending.end(), bytes, bytes + size);
+    m_records->increment();
+    const bool wake = pendingBefore == 0 ||
+                      (pendingBefore < m_options.flushBytes && m_pending.size() >= m_options.flushBytes);
+    lock.unlock();
+    if (wake) {
+        m_wake.notify_one();
+    }
+    return sequence;
+}
+
+/*! \brief Sequence number the next append will get.
+ * @return std::uint64_t the sequence number
+ */
+std::uint64_t OpLog::getNextSequence() {
+    std::lock_guard<std::mutex> lock(m_appendMutex);
+    return m_nextSequence;
+}
+
+/*! \brief Write out the pending batch and sync it. Appends go on into a new batch meanwhile.
+ * @return bool false if the batch could not be written; it is then kept for the next flush
+ */
+bool OpLog::flush() {
+    std::lock_guard<std::mutex> writeLock(m_writeMutex);
+    std::vector<std::uint8_t> batch;
+    std::uint64_t lastSequence;
+    {
+        std::lock_guard<std::mutex> lock(m_appendMutex);
+        batch.swap(m_pending);
+        lastSequence = m_nextSequence - 1;
+    }
+    if (batch.empty()) {
+        return true;
+    }
+    return writeBatch(batch, lastSequence);
+}
+
+/*! \brief Write a batch to the open segment with one write() (more only if the system writes it
+ * in parts) and one sync, then start a new segment if this one is full. If anything fails the
+ * segment is abandoned, as it may end in a partial record, and the batch goes back in front of
+ * the pending records to be written to a new segment.
+ * @param batch the framed records
+ * @param lastSequence the sequence number of the batch's last record
+ * @return bool whether the batch was written
+ */
+bool OpLog::writeBatch(const std::vector<std::uint8_t> &batch, std::uint64_t lastSequence) {
+    auto start = std::chrono::steady_clock::now();
+    bool written = m_fd >= 0 || openSegment();
+    std::size_t done = 0;
+    while (written && done < batch.size()) {
+        ssize_t result = ::write(m_fd, batch.data() + done, batch.size() - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        written = result > 0;
+        done += written ? static_cast<std::size_t>(result) : 0;
+    }
+    if (written && m_options.durable) {
+        written = syncData(m_fd);
+    }
+    if (!written) {
+        LOG_ERROR("Could not write " << segmentPath(m_prefix, m_segment) << ": " << std::strerror(errno));
+        m_errors->increment();
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+            m_segment++;
+            m_segmentBytes = 0;
+        }
+        std::lock_guard<std::mutex> lock(m_appendMutex);
+        m_pending.insert(m_pending.begin(), batch.begin(), batch.end());
+        return false;
+    }
+    m_segmentBytes += batch.size();
+    m_durable = lastSequence;
+    m_bytes->increment(batch.size());
+    m_flushes->increment();
+    m_flushTime->set(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    if (m_segmentBytes >= m_options.segmentBytes) {
+        ::close(m_fd);
+        m_fd = -1;
+        m_segment++;
+        m_segmentBytes = 0;
+    }
+    return true;
+}
+
+/*! \brief Create the segment numbered m_segment for writing.
+ * @return bool whether it could be created
+ */
+bool OpLog::openSegment() {
+    m_fd = ::open(segmentPath(m_prefix, m_segment).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (m_fd < 0) {
+        return false;
+    }
+    if (m_options.durable) {
+        syncDirectory(m_prefix);
+    }
+    m_segmentBytes = 0;
+    m_segments->set(static_cast<std::int64_t>(m_segment) + 1);
+    return true;
+}
+
+/*! \brief The flusher thread: wait for a record, let the batch gather for one flush interval or
+ * until it reaches flushBytes, and write it. A batch which could not be written stays pending and
+ * is retried after a pause. When the log is stopped, what is pending is written before the thread ends.
+ * @return void
+ */
+void OpLog::run() {
+    const auto retryDelay = std::max(m_options.flushInterval, std::chrono::milliseconds(100));
+    std::unique_lock<std::mutex> lock(m_appendMutex);
+    for (;;) {
+        m_wake.wait(lock, [this]() { return m_stopping || !m_pending.empty(); });
+        m_wake.wait_for(lock, m_options.flushInterval,
+                        [this]() { return m_stopping || m_pending.size() >= m_options.flushBytes; });
+        const bool stopping = m_stopping;
+        lock.unlock();
+        const bool written = flush();
+        lock.lock();
+        if (stopping) {
+            return;
+        }
+        if (!written) {
+            m_wake.wait_for(lock, retryDelay, [this]() { return m_stopping; });
+        }
+    }
+}
+
+/*! \brief Read a log back. Each segment is read up to its first torn or damaged record, which a
+ * crash during a write leaves at its end; records seen before, which a failed write may have left
+ * behind in an abandoned segment, are skipped.
+ * @param prefix the path the segments' names start with
+ * @param visit called with each record's sequence number and bytes, in order
+ * @return std::uint64_t the number of records read
+ */
+std::uint64_t OpLog::replay(const std::string &prefix, const Visitor &visit) {
+    std::uint64_t records = 0;
+    std::uint64_t last = 0;
+    for (std::uint32_t segment = 0;; segment++) {
+        std::ifstream file(segmentPath(prefix, segment), std::ios::binary);
+        if (!file) {
+            break;
+        }
+        const std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(file)),
+                                              std::istreambuf_iterator<char>());
+        std::size_t offset = 0;
+        while (offset < bytes.size()) {
+            std::uint64_t sequence = 0;
+            std::size_t payloadSize = 0;
+            const std::size_t used = decodeFrame(bytes.data() + offset, bytes.size() - offset, sequence, payloadSize);
+            if (used == 0) {
+                LOG_WARN("Ignoring " << bytes.size() - offset << " bytes at the end of "
+                         << segmentPath(prefix, segment) << ": torn or damaged");
+                break;
+            }
+            if (sequence > last) {
+                visit(sequence, bytes.data() + offset + kFrameBytes, payloadSize);
+                last = sequence;
+                records++;
+            }
+            offset += used;
+        }
+    }
+    return records;
+}
+
+/*! \brief Path of a segment: the prefix, a dot and the segment's number in six digits.
+ * @param prefix the path the segments' names start with
+ * @param segment the segment's number
+ * @return std::string the path
+ */
+std::string OpLog::segmentPath(const std::string &prefix, std::uint32_t segment) {
+    char number[16];
+    std::snprintf(number, sizeof(number), ".%06u", segment);
+    return prefix + number;
+}
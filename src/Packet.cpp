@@ -5,8 +5,11 @@
  *  @date   2020-07-12
  ***********************************************/
 
+// Include standard library C++ libraries.
+#include <algorithm>
 #include <SFML/Network.hpp>
 #include "Command.hpp"
+#include "Packet.hpp"
 
 /*!
  * Write a command into packet.
@@ -26,4 +29,53 @@ sf::Packet &operator<<(sf::Packet &packet, const Command *command) {
  */
 sf::Packet &operator>>(sf::Packet &packet, const Command *command) {
     return packet >> command;
-}
\ No newline at end of file
+}
+
+/*!
+ * Write a PaintMessage into a packet.
+ * @param &packet packet to store information
+ * @param message the message to write
+ * @return the original packet with the message written
+ */
+sf::Packet &operator<<(sf::Packet &packet, const PaintMessage &message) {
+    return packet << message.command << message.x << message.y << message.color << message.size
+                  << message.stamp << message.fromX << message.fromY << message.client
+                  << message.layer << message.brush;
+}
+
+/*!
+ * Extract a PaintMessage from a packet. If the five leading integers are missing the message is
+ * left untouched; trailing fields are only read when the sender included them. A draw's brush size
+ * is clamped to [1, kMaxBrushSize] and a flood fill's tolerance to [0, 255].
+ * @param &packet packet to read from
+ * @param message the message to fill in
+ * @return the original packet with the message extracted
+ */
+sf::Packet &operator>>(sf::Packet &packet, PaintMessage &message) {
+    PaintMessage decoded;
+    if (!(packet >> decoded.command >> decoded.x >> decoded.y >> decoded.color >> decoded.size)) {
+        return packet;
+    }
+    if (!packet.endOfPacket()) {
+        packet >> decoded.stamp;
+    }
+    if (!packet.endOfPacket()) {
+        packet >> decoded.fromX >> decoded.fromY;
+    }
+    if (!packet.endOfPacket()) {
+        packet >> decoded.client;
+    }
+    if (!packet.endOfPacket()) {
+        packet >> decoded.layer;
+    }
+    if (!packet.endOfPacket()) {
+        packet >> decoded.brush;
+    }
+    if (decoded.command == 1) {
+        decoded.size = std::max(1, std::min(decoded.size, PaintMessage::kMaxBrushSize));
+    } else if (decoded.command == 7) {
+        decoded.size = std::max(0, std::min(decoded.size, 255));
+    }
+    message = decoded;
+    return packet;
+}
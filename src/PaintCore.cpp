@@ -0,0 +1,887 @@
+/**
+ *  @file   PaintCore.cpp
+ *  @brief  Implementation of PaintCore.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <chrono>
+// Project header files
+#include "Autosave.hpp"
+#include "Draw.hpp"
+#include "FillDisplay.hpp"
+#include "FloodFill.hpp"
+#include "HistoryTimeline.hpp"
+#include "LayerCommand.hpp"
+#include "Latency.hpp"
+#include "Logger.hpp"
+#include "OpLog.hpp"
+#include "Packet.hpp"
+#include "PaintCore.hpp"
+#include "Profiler.hpp"
+#include "ProjectFile.hpp"
+#include "TileStore.hpp"
+
+/*! \brief
+ * Sum the approximate byte size of every command in one user action.
+ * @param action the commands of one user action
+ * @return std::size_t the number of bytes
+*/
+static std::size_t actionBytes(const std::vector<Command *> &action) {
+    std::size_t bytes = 0;
+    for (Command *command : action) {
+        bytes += command->getByteSize();
+    }
+    return bytes;
+}
+
+/*! \brief
+ * Initialize a PaintCore with white as the canvas color and a black brush of radius 1. The
+ * canvas is empty until InitCanvas().
+*/
+PaintCore::PaintCore() {
+    // Drawing variables
+    PaintCore::mouseX = 0;
+    PaintCore::mouseY = 0;
+    PaintCore::m_canvas = sf::Color::White;
+    PaintCore::m_color = sf::Color::Black;
+    PaintCore::strokeSize = 1;
+    PaintCore::brushTip = BrushTip(BrushId::Square);
+    PaintCore::m_paintFunc = nullptr;
+    PaintCore::m_surface = new Canvas;
+    PaintCore::m_activeLayer = LayerStack::kBaseLayer;
+    PaintCore::m_createdLayers = 0;
+
+    // History of the local user, until a network client id is known
+    PaintCore::m_localClient = 0;
+    PaintCore::m_nextSequence = 0;
+    PaintCore::m_historyBudget = 0;
+
+    // Metrics
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    PaintCore::m_undoDepthMetric = &metrics.gauge("app.undo_depth");
+    PaintCore::m_redoDepthMetric = &metrics.gauge("app.redo_depth");
+    PaintCore::m_strokeDepthMetric = &metrics.gauge("app.stroke_pending_commands");
+    PaintCore::m_historyBytesMetric = &metrics.gauge("app.history_bytes");
+    PaintCore::m_saveCaptureMetric = &metrics.gauge("project.save_capture_us");
+    PaintCore::m_loadTimeMetric = &metrics.gauge("project.load_ms");
+    PaintCore::m_autosaveCaptureMetric = &metrics.gauge("autosave.capture_us");
+    PaintCore::m_autosaveInterval = std::chrono::milliseconds(0);
+    PaintCore::m_timelineSegments = 0;
+}
+
+/*! \brief
+ * Create the canvas: a base layer filled with the canvas color, which the local user paints on,
+ * and its flattened image. Every client's history starts over, since it refers to the old layers.
+ * @param width the canvas width in pixels
+ * @param height the canvas height in pixels
+ * @return void
+*/
+void PaintCore::InitCanvas(unsigned width, unsigned height) {
+    ClearHistory();
+    m_layers.create(width, height, pixelFromColor(m_canvas));
+    m_activeLayer = LayerStack::kBaseLayer;
+    m_layers.flatten(*m_surface, ThreadPool::Get());
+    int firstRow;
+    int lastRow;
+    m_surface->takeDirtyRows(firstRow, lastRow);
+}
+
+
+/*! \brief
+ * Publish the undo/redo stack depths, the number of commands in the current stroke and the
+ * approximate memory held by the history.
+ * @return void
+*/
+void PaintCore::UpdateHistoryMetrics() {
+    std::size_t undoDepth = 0;
+    std::size_t redoDepth = 0;
+    for (auto &entry : m_histories) {
+        undoDepth += entry.second.undo.size();
+        redoDepth += entry.second.redo.size();
+    }
+    m_undoDepthMetric->set(static_cast<std::int64_t>(undoDepth));
+    m_redoDepthMetric->set(static_cast<std::int64_t>(redoDepth));
+    m_strokeDepthMetric->set(static_cast<std::int64_t>(m_paintedPixels.size()));
+    m_historyBytesMetric->set(static_cast<std::int64_t>(GetHistoryBytes()));
+}
+
+/*! \brief
+ * Return the commands of a client's stroke in progress. The local user's stroke is m_paintedPixels.
+ * @param client the client id
+ * @return std::vector<Command *>& the commands executed since the client's last AddCommand
+*/
+std::vector<Command *> &PaintCore::PendingCommands(int client) {
+    if (client == m_localClient) {
+        return m_paintedPixels;
+    }
+    return m_histories[client].pending;
+}
+
+/*! \brief
+ * Set the client id of the user at this PaintCore, e.g. the port it sends packets from. Commands without a
+ * client id belong to this user.
+ * @param client the client id
+ * @return void
+*/
+void PaintCore::SetLocalClient(int client) {
+    m_localClient = client;
+}
+
+/*! \brief
+ * Return the client id of the user at this PaintCore.
+ * @return int the client id
+*/
+int PaintCore::GetLocalClient() {
+    return m_localClient;
+}
+
+/*! \brief
+ * Set the most bytes the undo and redo stacks of all clients may hold together. Beyond it the
+ * oldest actions are released and become permanent.
+ * @param bytes the budget, or 0 for no limit
+ * @return void
+*/
+void PaintCore::SetHistoryBudget(std::size_t bytes) {
+    m_historyBudget = bytes;
+    EnforceHistoryBudget();
+    UpdateHistoryMetrics();
+}
+
+/*! \brief
+ * Return the approximate bytes held by the commands on every client's undo and redo stacks.
+ * @return std::size_t the number of bytes
+*/
+std::size_t PaintCore::GetHistoryBytes() {
+    std::size_t bytes = 0;
+    for (auto &entry : m_histories) {
+        bytes += entry.second.undoBytes + entry.second.redoBytes;
+    }
+    return bytes;
+}
+
+/*! \brief
+ * Delete the commands of every action on an undo or redo stack and empty the stack. Their
+ * operations stay as they are, shown or hidden, until the stroke store bakes or drops them.
+ * @param actions the stack to release
+ * @return void
+*/
+void PaintCore::ReleaseActions(std::vector<Action> &actions) {
+    for (Action &action : actions) {
+        for (Command *command : action.commands) {
+            delete command;
+        }
+    }
+    actions.clear();
+}
+
+/*! \brief
+ * Add a finished action to a client's undo stack. New actions invalidate what the client could redo,
+ * so its redo stack is released. The operations of the released actions are settled, and the layers
+ * bake them once enough have piled up.
+ * @param history the client's history
+ * @param commands the commands of the action; left empty
+ * @return void
+*/
+void PaintCore::PushAction(ClientHistory &history, std::vector<Command *> &commands) {
+    Action action{std::move(commands), m_nextSequence++, 0};
+    commands.clear();
+    action.bytes = actionBytes(action.commands);
+    history.undoBytes += action.bytes;
+    history.undo.push_back(std::move(action));
+    ReleaseActions(history.redo);
+    history.redoBytes = 0;
+    EnforceHistoryBudget();
+    m_layers.compact();
+}
+
+/*! \brief
+ * Release the oldest undo actions, across all clients, until the history fits its budget.
+ * @return void
+*/
+void PaintCore::EnforceHistoryBudget() {
+    if (m_historyBudget == 0) {
+        return;
+    }
+    std::size_t bytes = GetHistoryBytes();
+    while (bytes > m_historyBudget) {
+        ClientHistory *oldest = nullptr;
+        for (auto &entry : m_histories) {
+            ClientHistory &history = entry.second;
+            if (!history.undo.empty() &&
+                (oldest == nullptr || history.undo.front().sequence < oldest->undo.front().sequence)) {
+                oldest = &history;
+            }
+        }
+        if (oldest == nullptr) {
+            return;
+        }
+        Action &evicted = oldest->undo.front();
+        for (Command *command : evicted.commands) {
+            delete command;
+        }
+        oldest->undoBytes -= evicted.bytes;
+        bytes -= evicted.bytes;
+        oldest->undo.erase(oldest->undo.begin());
+    }
+}
+
+/*! \brief
+ *		Execute a command on a single pixel, and store it in a stack of pixels affected by this user action.
+ *		Reset the "redo" stack so that no actions can be redone after this command is executed.
+* @param command the Command to be executed
+ * @return void
+*/
+void PaintCore::ExecuteCommand(Command *command) {
+    ExecuteCommand(command, m_localClient);
+}
+
+/*! \brief
+ *		Execute a command on behalf of a client, and store it in that client's stroke in progress.
+ *		Only that client's "redo" stack is released; other users can still redo what they undid.
+ *		The PaintCore owns the command from here on and deletes it if it does not execute.
+ * @param command the Command to be executed
+ * @param client the client id of the user who issued it
+ * @return void
+*/
+void PaintCore::ExecuteCommand(Command *command, int client) {
+    if (!command->execute()) {
+        delete command;
+        return;
+    }
+    PendingCommands(client).push_back(command);
+    ClientHistory &history = m_histories[client];
+    ReleaseActions(history.redo);
+    history.redoBytes = 0;
+    UpdateHistoryMetrics();
+}
+
+/*! \brief
+ * Add all the pixels affected by a single user action, e.g
+ * . click-and-drag brushstroke, to the "undo" stack.
+ * @return void
+*
+*/
+void PaintCore::AddCommand() {
+    AddCommand(m_localClient);
+}
+
+/*! \brief
+ * Add all the commands of a client's stroke in progress to that client's "undo" stack, as one
+ * user action, and start a new stroke.
+ * @param client the client id
+ * @return void
+*/
+void PaintCore::AddCommand(int client) {
+    m_layers.closeStrokes();
+    std::vector<Command *> &pending = PendingCommands(client);
+    if (pending.empty()) {
+        return;
+    }
+    PushAction(m_histories[client], pending);
+    UpdateHistoryMetrics();
+}
+
+/*! \brief
+ * Undo a prior command, e.g. a brushstroke or filling the canvas with a color. Push the undone command
+ * to the "redo" stack.
+ * @return void
+*
+*/
+void PaintCore::UndoCommand() {
+    UndoCommand(m_localClient);
+}
+
+/*! \brief
+ * Undo a client's last action and push it to that client's "redo" stack. Actions of other users are
+ * left alone: only the tiles the undone action covered are rebuilt, replaying whatever other users
+ * drew there afterwards, so the cost follows the action's footprint rather than the history.
+ * @param client the client id
+ * @return void
+*/
+void PaintCore::UndoCommand(int client) {
+    PROFILE_FUNCTION();
+    ClientHistory &history = m_histories[client];
+    if (history.undo.empty()) {
+        return;
+    }
+    Action &userAction = history.undo.back();
+    std::vector<Command *>::reverse_iterator it;
+    for (it = userAction.commands.rbegin(); it != userAction.commands.rend(); ++it) {
+        mouseX = (*it)->getPixelX();
+        mouseY = (*it)->getPixelY();
+        (*it)->undo();
+    }
+    // Rebuild the tiles the undone commands covered
+    m_layers.repair();
+    history.undoBytes -= userAction.bytes;
+    history.redoBytes += userAction.bytes;
+    history.redo.push_back(std::move(userAction));
+    history.undo.pop_back();
+    UpdateHistoryMetrics();
+}
+
+/*! \brief
+ * Redo an undone command, e.g. a brushstroke or filling the canvas with a color. Push the redone command
+ * to the "undo" stack.
+ * @return void
+*/
+void PaintCore::RedoCommand() {
+    RedoCommand(m_localClient);
+}
+
+/*! \brief
+ * Redo a client's last undone action and push it back to that client's "undo" stack. The action
+ * reappears at its original place in the drawing order.
+ * @param client the client id
+ * @return void
+*/
+void PaintCore::RedoCommand(int client) {
+    ClientHistory &history = m_histories[client];
+    if (history.redo.empty()) {
+        return;
+    }
+    Action &userAction = history.redo.back();
+    std::vector<Command *>::iterator it;
+    for (it = userAction.commands.begin(); it != userAction.commands.end(); ++it) {
+        mouseX = (*it)->getPixelX();
+        mouseY = (*it)->getPixelY();
+        (*it)->execute();
+    }
+    m_layers.repair();
+    history.redoBytes -= userAction.bytes;
+    history.undoBytes += userAction.bytes;
+    history.undo.push_back(std::move(userAction));
+    history.redo.pop_back();
+    UpdateHistoryMetrics();
+}
+
+/*!
+ * \brief Fill the display screen with the current color, and record this action as a command in the undo stack.
+ *
+ * @param command the FillDisplay command to be completed
+ * @return void
+ */
+void PaintCore::FillDisplay(Command *command) {
+    FillDisplay(command, m_localClient);
+}
+
+/*!
+ * \brief Fill the display screen on behalf of a client, and record this action in that client's undo stack.
+ * Any fill which is a single command, such as a FloodFill of one region, goes through here too.
+ *
+ * @param command the FillDisplay or FloodFill command to be completed
+ * @param client the client id of the user who issued it
+ * @return void
+ */
+void PaintCore::FillDisplay(Command *command, int client) {
+    ExecuteAction(command, client);
+}
+
+/*!
+ * \brief Execute a command which makes up a whole user action by itself, such as a fill or a layer
+ * change, and record it in the client's undo stack.
+ *
+ * @param command the command; the PaintCore owns it from here on and deletes it if it does not execute
+ * @param client the client id of the user who issued it
+ * @return void
+ */
+void PaintCore::ExecuteAction(Command *command, int client) {
+    if (!command->execute()) {
+        delete command;
+        return;
+    }
+    std::vector<Command *> fillCommand{command};
+    PushAction(m_histories[client], fillCommand);
+    UpdateHistoryMetrics();
+}
+
+/*! \brief 	Return a reference to the canvas of the layer the local user paints on. Painting by the
+ *		local user goes through it.
+ *		@return the Canvas of the active layer
+*
+*/
+Canvas &PaintCore::GetCanvas() {
+    return GetCanvas(m_activeLayer);
+}
+
+/*! \brief 	Return a reference to the canvas of a layer. Operations for a layer this PaintCore has not
+ *		heard of (e.g. from a peer whose layer change was lost) land on the base layer.
+ *		@param layer the layer id
+ *		@return the Canvas of the layer
+*
+*/
+Canvas &PaintCore::GetCanvas(int layer) {
+    LayerStack::Layer *found = m_layers.find(layer);
+    return found != nullptr ? found->canvas : m_layers.find(LayerStack::kBaseLayer)->canvas;
+}
+
+/*! \brief 	Return a reference to the store of operations the active layer's canvas is built from.
+ *		@return the StrokeStore of the active layer
+*
+*/
+StrokeStore &PaintCore::GetStrokeStore() {
+    return GetStrokeStore(m_activeLayer);
+}
+
+/*! \brief 	Return a reference to the store of operations a layer's canvas is built from.
+ *		@param layer the layer id
+ *		@return the StrokeStore of the layer, or of the base layer if there is no such layer
+*
+*/
+StrokeStore &PaintCore::GetStrokeStore(int layer) {
+    LayerStack::Layer *found = m_layers.find(layer);
+    return found != nullptr ? found->strokes : m_layers.find(LayerStack::kBaseLayer)->strokes;
+}
+
+/*! \brief 	Return a reference to the layers of the drawing.
+ *		@return the LayerStack of this app
+*
+*/
+LayerStack &PaintCore::GetLayers() {
+    return m_layers;
+}
+
+/*! \brief 	Composite the tiles changed on any layer since the last call and return the flattened
+ *		image, which is what the windows show. Tiles nothing changed in are kept as they are.
+ *		@return the flattened Canvas
+*
+*/
+Canvas &PaintCore::GetFlattened() {
+    PROFILE_FUNCTION();
+    m_layers.flatten(*m_surface, ThreadPool::Get());
+    return *m_surface;
+}
+
+/*! \brief 	Choose the layer the local user's commands paint on.
+ *		@param layer the layer id
+ *		@return void
+*
+*/
+void PaintCore::SelectLayer(int layer) {
+    m_activeLayer = layer;
+}
+
+/*! \brief 	Return the id of the layer the local user paints on.
+ *		@return int the layer id
+*
+*/
+int PaintCore::GetActiveLayer() {
+    return m_activeLayer;
+}
+
+/*! \brief 	Make up an id for a new layer of the local user. Ids combine the client id with one of 255
+ *		numbers, so layers created by different peers at the same time never share an id. The numbers
+ *		are handed out in turn, skipping those of layers which still exist, in the stack or not.
+ *		@return int the layer id, or -1 if every number is taken
+*
+*/
+int PaintCore::NewLayerId() {
+    for (int tries = 0; tries < 255; tries++) {
+        int id = m_localClient * 256 + 1 + m_createdLayers++ % 255;
+        if (m_layers.find(id) == nullptr) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+/*! \brief 	Return the color the eraser paints with: the canvas color on the base layer, so it stays
+ *		opaque, and transparent on the layers above, so what is below shows through.
+ *		@return sf::Color the eraser color
+*
+*/
+sf::Color PaintCore::EraserColor() {
+    return m_activeLayer == LayerStack::kBaseLayer ? m_canvas : sf::Color::Transparent;
+}
+
+/*! \brief Update the app's paintbrush function. Any method with the specified parameters and return
+ * types could be used for painting in the display.
+ * @param (*paintFunction)(PaintCore *, sf::Color, int size, int m_x, int m_y)) - the paint function
+ * @return void
+ *
+ */
+void PaintCore::UpdatePaintbrush(
+        std::map<std::pair<int, int>, sf::Color> (*paintFunction)(PaintCore *, sf::Color, int size, int m_x, int m_y)) {
+    m_paintFunc = paintFunction;
+}
+
+/*! \brief Paint with one of the brush engine's brushes. Draw commands then record the brush, its
+ * size and color as a stroke, which the engine paints with the kernel specialized for it.
+ * @param brush the brush, its hardness and opacity
+ * @return void
+ *
+ */
+void PaintCore::UpdatePaintbrush(const BrushTip &brush) {
+    m_paintFunc = nullptr;
+    brushTip = brush;
+}
+
+/*! \brief 	Get the current paint color.
+ * @return int representing color
+*
+*/
+int PaintCore::getColor() {
+    return m_color.toInteger();
+}
+
+/*! \brief 	Release every command in the history and the canvas. Call this at the end of the program;
+ *		the destructor calls it too, and a second call does nothing.
+ * @return void
+*
+*/
+void PaintCore::Destroy() {
+    if (m_lastSave.valid()) {
+        m_lastSave.wait();
+    }
+    m_autosave.reset();
+    m_timeline.reset();
+    ClearHistory();
+    delete m_surface;
+    m_surface = nullptr;
+}
+
+/*! \brief 	Delete every command in every client's history and stroke in progress. The PaintCore owns them.
+ * @return void
+*
+*/
+void PaintCore::ClearHistory() {
+    for (auto &entry : m_histories) {
+        ReleaseActions(entry.second.undo);
+        ReleaseActions(entry.second.redo);
+        for (Command *command : entry.second.pending) {
+            delete command;
+        }
+    }
+    m_histories.clear();
+    for (Command *command : m_paintedPixels) {
+        delete command;
+    }
+    m_paintedPixels.clear();
+    UpdateHistoryMetrics();
+}
+
+/*! \brief 	Apply one operation as a peer sent it: a draw segment, the end of a stroke, an undo or
+ * redo, a fill, a flood fill or a layer change, each on behalf of the client the message names.
+ * Joins and leaves change nothing. Every peer applying the same messages in the same order ends up
+ * with the same drawing, which is also how a log of them is replayed.
+ * @param message the operation
+ * @return void
+*
+*/
+void PaintCore::ApplyMessage(const PaintMessage &message) {
+    // Each client's strokes, undo and redo are kept apart; peers too old to say who they are share one history
+    const int client = message.client;
+    if (message.command == 1) {
+        const sf::Color color(static_cast<sf::Uint32>(message.color));
+        Draw *draw;
+        if (message.fromX >= 0 && message.fromY >= 0) {
+            draw = new Draw(this, message.fromX, message.fromY, message.x, message.y, color, message.size);
+        } else {
+            draw = new Draw(this, message.x, message.y, color, message.size);
+        }
+        draw->setLayer(message.layer);
+        draw->setBrush(BrushTip::unpack(message.brush));
+        ExecuteCommand(draw, client);
+    } else if (message.command == 2) {
+        // Adds the client's stroke to its undo stack and starts the next one
+        AddCommand(client);
+    } else if (message.command == 3) {
+        UndoCommand(client);
+    } else if (message.command == 4) {
+        RedoCommand(client);
+    } else if (message.command == 5) {
+        ::FillDisplay *fill = new ::FillDisplay(this, message.color);
+        fill->setLayer(message.layer);
+        FillDisplay(fill, client);
+    } else if (message.command == 7) {
+        // The seed, color and tolerance are enough: every peer finds the same region on the same canvas
+        FloodFill *fill = new FloodFill(this, message.x, message.y, message.color, message.size);
+        fill->setLayer(message.layer);
+        FillDisplay(fill, client);
+    } else if (message.command == 8) {
+        // Only the layer id and the new value travel; no layer pixels are sent or copied
+        LayerCommand::Kind kind = static_cast<LayerCommand::Kind>(message.x);
+        ExecuteAction(new LayerCommand(this, kind, message.y, message.color), client);
+        // The user who adds a layer paints on it
+        if (kind == LayerCommand::Kind::Add && client == GetLocalClient() && m_layers.indexOf(message.y) >= 0) {
+            SelectLayer(message.y);
+        }
+    }
+    RecordTimeline(message.command);
+}
+
+/*! \brief 	Add a frame to the timeline, if it is on, after an operation. Each operation is a frame
+ * but draw segments, which are gathered kSegmentsPerFrame at a time, and joins and leaves. Only
+ * copying the written tiles happens here.
+ * @param command the operation's command
+ * @return void
+*
+*/
+void PaintCore::RecordTimeline(int command) {
+    if (!m_timeline || command == 0 || command == 6) {
+        return;
+    }
+    if (command == 1 && ++m_timelineSegments < HistoryTimeline::kSegmentsPerFrame) {
+        return;
+    }
+    m_timelineSegments = 0;
+    m_timeline->capture(GetFlattened(), monotonicMicros());
+}
+
+/*! \brief 	Keep a time-lapse of the drawing from now on, starting with a keyframe of it as it is. With
+ * tile paging on, the image the time-lapse keeps pages under the drawing's budget too.
+ * @param keyframeInterval the frames between keyframes
+ * @param byteBudget the compressed bytes the frames may hold before the oldest are dropped
+ * @return void
+*
+*/
+void PaintCore::EnableTimeline(std::size_t keyframeInterval, std::uint64_t byteBudget) {
+    m_timeline.reset(new HistoryTimeline(keyframeInterval, byteBudget));
+    m_timelineSegments = 0;
+    std::string error;
+    if (m_layers.getTileBudget() != nullptr
+        && !m_timeline->enablePaging(m_layers.getPagingDirectory(), m_layers.getTileBudget(), error)) {
+        LOG_WARN("The time-lapse keeps its image in memory: " << error);
+    }
+    m_timeline->capture(GetFlattened(), monotonicMicros());
+}
+
+/*! \brief 	Keep a bounded working set of tiles in memory, for canvases too large to hold: the layers,
+ * the flattened image and the time-lapse's image share one budget of tiles, page those beyond it out
+ * to a file each, and read them back when they are used. What is held beyond the budget now is
+ * paged out at once.
+ * @param directory where to create the files, which are removed with the canvases
+ * @param bytes the memory the tiles of every canvas together may take
+ * @param error receives why a file could not be created
+ * @return bool false if one could not; the canvases which could page do
+*
+*/
+bool PaintCore::EnableTilePaging(const std::string &directory, std::size_t bytes, std::string &error) {
+    std::shared_ptr<TileBudget> budget = std::make_shared<TileBudget>(bytes / sizeof(Canvas::Tile));
+    if (!m_layers.setPaging(directory, budget, error) || !m_surface->enablePaging(directory, budget, error)
+        || (m_timeline && !m_timeline->enablePaging(directory, budget, error))) {
+        return false;
+    }
+    GetFlattened();
+    LOG_INFO("Paging tiles to " << directory << " beyond " << budget->getLimit() << " tiles in all");
+    return true;
+}
+
+/*! \brief 	Save the drawing to a project file. Only copying the painted tiles happens here; compressing
+ * and writing them runs on a background thread, so painting and the network carry on meanwhile.
+ * While an earlier save is still being written nothing new is started, so saves never overlap.
+ * @param path the file
+ * @return std::shared_future<bool> whether the file was written, once it has been; the running
+ * save's if there is one
+*
+*/
+std::shared_future<bool> PaintCore::SaveProject(const std::string &path) {
+    if (m_lastSave.valid() && m_lastSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        LOG_INFO("Not saving " << path << ": the last save is still being written");
+        return m_lastSave;
+    }
+    // Flattening brings the record of which tiles each layer was painted on up to date
+    GetFlattened();
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<ProjectSnapshot> snapshot = ProjectFile::capture(m_layers, m_activeLayer);
+    m_saveCaptureMetric->set(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    m_lastSave = ProjectFile::writeAsync(snapshot, path, ThreadPool::Get()).share();
+    return m_lastSave;
+}
+
+/*! \brief 	Replace the drawing with a project file. The time taken is logged and published as
+ * project.load_ms.
+ * @param path the file
+ * @param error receives what went wrong
+ * @return bool whether the file was loaded; if not, the drawing is unchanged
+*
+*/
+bool PaintCore::LoadProject(const std::string &path, std::string &error) {
+    auto start = std::chrono::steady_clock::now();
+    ProjectSnapshot snapshot;
+    if (!ProjectFile::read(path, snapshot, error) || !RestoreSnapshot(snapshot, error)) {
+        return false;
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_loadTimeMetric->set(static_cast<std::int64_t>(elapsed));
+    LOG_INFO("Loaded " << path << ": " << snapshot.width << "x" << snapshot.height << ", " << snapshot.layers.size()
+             << " layers, " << snapshot.chunks.size() << " tiles in " << elapsed << " ms");
+    return true;
+}
+
+/*! \brief 	Replace the drawing with a snapshot. The layers come back as they were saved; each
+ * layer's loaded pixels become the first operation in its stroke store, so later undo and repair
+ * rebuild its tiles on top of them. Every client's history starts over.
+ * @param snapshot the drawing
+ * @param error receives what went wrong
+ * @return bool whether the snapshot was usable; if not, the drawing is unchanged
+*
+*/
+bool PaintCore::RestoreSnapshot(const ProjectSnapshot &snapshot, std::string &error) {
+    if (snapshot.layers.empty() || snapshot.layers.front().id != LayerStack::kBaseLayer) {
+        error = "no base layer";
+        return false;
+    }
+    ClearHistory();
+    const ProjectLayer &base = snapshot.layers.front();
+    m_canvas = colorFromPixel(base.background);
+    m_layers.create(snapshot.width, snapshot.height, base.background);
+
+    // Layers in the stack, bottom first, then the ones out of it
+    std::vector<const ProjectLayer *> stacked;
+    for (const ProjectLayer &layer : snapshot.layers) {
+        if (layer.position >= 0) {
+            stacked.push_back(&layer);
+        }
+    }
+    std::sort(stacked.begin(), stacked.end(),
+              [](const ProjectLayer *a, const ProjectLayer *b) { return a->position < b->position; });
+    for (std::size_t i = 0; i < stacked.size(); i++) {
+        if (stacked[i]->id != LayerStack::kBaseLayer) {
+            m_layers.insert(stacked[i]->id, m_layers.size());
+        } else {
+            m_layers.move(LayerStack::kBaseLayer, i);
+        }
+    }
+    for (const ProjectLayer &layer : snapshot.layers) {
+        if (layer.position < 0 && layer.id != LayerStack::kBaseLayer) {
+            m_layers.insert(layer.id, 0);
+            m_layers.remove(layer.id);
+        }
+        m_layers.setBlendMode(layer.id, layer.blend);
+        m_layers.setOpacity(layer.id, layer.opacity);
+    }
+
+    std::vector<SpanRecord> loaded(snapshot.layers.size());
+    for (const ProjectChunk &chunk : snapshot.chunks) {
+        Canvas &canvas = m_layers.find(snapshot.layers[chunk.layer].id)->canvas;
+        const int left = chunk.tileX * Canvas::kTileSize;
+        const int top = chunk.tileY * Canvas::kTileSize;
+        const int width = std::min(Canvas::kTileSize, static_cast<int>(snapshot.width) - left);
+        for (int y = 0; static_cast<std::size_t>(y * width) < chunk.pixels.size(); y++) {
+            canvas.writeSpan(top + y, left, width, &chunk.pixels[static_cast<std::size_t>(y) * width]);
+            loaded[chunk.layer].save(canvas, top + y, left, left + width);
+        }
+    }
+    for (std::size_t i = 0; i < loaded.size(); i++) {
+        if (!loaded[i].getBounds().empty()) {
+            // No command refers to the loaded pixels, so they are settled from the start
+            StrokeStore &strokes = m_layers.find(snapshot.layers[i].id)->strokes;
+            strokes.settle(strokes.addPixels(std::move(loaded[i])));
+        }
+    }
+    m_activeLayer = m_layers.indexOf(snapshot.activeLayer) >= 0 ? snapshot.activeLayer : LayerStack::kBaseLayer;
+    m_layers.flatten(*m_surface, ThreadPool::Get());
+    if (m_timeline) {
+        m_timeline->capture(*m_surface, monotonicMicros());
+    }
+    return true;
+}
+
+/*! \brief 	Autosave the drawing incrementally to a journal next to a base project file. Files a
+ * previous session left there are kept for RecoverAutosave().
+ * @param path the base file
+ * @param interval how often AutosaveIfDue() checkpoints; 0 leaves checkpoints to Autosave()
+ * @return void
+*
+*/
+void PaintCore::EnableAutosave(const std::string &path, std::chrono::milliseconds interval) {
+    m_autosave.reset(new AutosaveJournal(path));
+    m_autosaveInterval = interval;
+    m_lastAutosave = std::chrono::steady_clock::now();
+}
+
+/*! \brief 	Checkpoint the drawing: copy the tiles written since the last checkpoint, here, and
+ * append them to the journal in the background. The time spent here is published as
+ * autosave.capture_us; it grows with what changed, not with the canvas.
+ * @return bool false if autosave is off or the last checkpoint is still being written
+*
+*/
+bool PaintCore::Autosave() {
+    if (!m_autosave) {
+        return false;
+    }
+    m_lastAutosave = std::chrono::steady_clock::now();
+    // Flattening marks the tiles written on each layer since the last checkpoint
+    GetFlattened();
+    auto start = std::chrono::steady_clock::now();
+    bool started = m_autosave->checkpoint(m_layers, m_activeLayer, ThreadPool::Get());
+    m_autosaveCaptureMetric->set(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    return started;
+}
+
+/*! \brief 	Checkpoint if autosave is on with an interval, and the interval has passed. Cheap to
+ * call every frame.
+ * @return bool whether a checkpoint was started
+*
+*/
+bool PaintCore::AutosaveIfDue() {
+    if (!m_autosave || m_autosaveInterval.count() <= 0 ||
+        std::chrono::steady_clock::now() - m_lastAutosave < m_autosaveInterval) {
+        return false;
+    }
+    return Autosave();
+}
+
+/*! \brief 	Replace the drawing with the last autosaved state: the base file plus every intact
+ * journal record. The recovered drawing is then written as the new base, so the journal starts
+ * empty and a torn record left by a crash is dropped.
+ * @param error receives what went wrong
+ * @return bool whether a drawing was recovered
+*
+*/
+bool PaintCore::RecoverAutosave(std::string &error) {
+    if (!m_autosave) {
+        error = "autosave is off";
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    ProjectSnapshot snapshot;
+    if (!AutosaveJournal::recover(m_autosave->getPath(), snapshot, error) || !RestoreSnapshot(snapshot, error)) {
+        return false;
+    }
+    if (!m_autosave->rebase(snapshot, m_layers, error)) {
+        LOG_ERROR("Could not rewrite " << m_autosave->getPath() << ": " << error);
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Recovered " << m_autosave->getPath() << ": " << snapshot.layers.size() << " layers, "
+             << snapshot.chunks.size() << " tiles in " << elapsed << " ms");
+    return true;
+}
+
+/*! \brief 	Rebuild the drawing from an op log by applying its operations in the order the server
+ * relayed them, as every peer did. Apply it to the drawing the log started from, normally a fresh
+ * canvas.
+ * @param prefix the path the log's segments' names start with
+ * @return std::uint64_t the number of operations applied
+*
+*/
+std::uint64_t PaintCore::ReplayOpLog(const std::string &prefix) {
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t applied = OpLog::replay(prefix, [this](std::uint64_t, const std::uint8_t *data, std::size_t size) {
+        sf::Packet packet;
+        packet.append(data, size);
+        PaintMessage message;
+        packet >> message;
+        ApplyMessage(message);
+    });
+    GetFlattened();
+    if (applied > 0) {
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("Replayed " << applied << " operations from " << prefix << " in " << elapsed << " ms");
+    }
+    return applied;
+}
+
+/*! \brief 	Delete this PaintCore object, releasing the history and the canvas if Destroy() was not
+ *		called, e.g. for a PaintCore on the stack.
+*
+*/
+PaintCore::~PaintCore() {
+    PaintCore::Destroy();
+}
@@ -0,0 +1,225 @@
+/**
+ *  @file   Profiler.cpp
+ *  @brief  Implementation of Profiler.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+// Project header files
+#include "Profiler.hpp"
+
+/*! \brief Start timing a zone on the calling thread.
+ * @param name a string literal naming the zone
+ */
+Profiler::Zone::Zone(const char *name) {
+    m_name = name;
+    m_startNs = Profiler::Get().now();
+}
+
+/*! \brief Stop timing and record the zone.
+ */
+Profiler::Zone::~Zone() {
+    Profiler &profiler = Profiler::Get();
+    profiler.record(m_name, m_startNs, profiler.now() - m_startNs);
+}
+
+/*! \brief Create an empty thread buffer with room for kEventsPerThread events.
+ */
+Profiler::ThreadBuffer::ThreadBuffer() : events(kEventsPerThread), head(0), threadId(0) {
+}
+
+/*! \brief Return the process-wide profiler.
+ * @return Profiler& the profiler instance
+ */
+Profiler &Profiler::Get() {
+    static Profiler instance;
+    return instance;
+}
+
+/*! \brief Construct the profiler. The output path may be overridden by the PAINT_TRACE_FILE
+ * environment variable.
+ */
+Profiler::Profiler() {
+    m_epoch = std::chrono::steady_clock::now();
+    m_nextThreadId = 1;
+    const char *path = std::getenv("PAINT_TRACE_FILE");
+    m_outputPath = path != nullptr ? path : "paint_trace.json";
+}
+
+/*! \brief Flush the remaining events when the process exits, if profiling is compiled in.
+ */
+Profiler::~Profiler() {
+#ifdef PAINT_PROFILING
+    flush();
+#endif
+}
+
+/*! \brief Monotonic nanoseconds since the profiler was created.
+ * @return std::int64_t the current time in nanoseconds
+ */
+std::int64_t Profiler::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+/*! \brief Return the calling thread's buffer, registering it on first use.
+ * The registry mutex is only taken once per thread.
+ * @return ThreadBuffer& the calling thread's buffer
+ */
+Profiler::ThreadBuffer &Profiler::localBuffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (buffer == nullptr) {
+        buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffer->threadId = m_nextThreadId++;
+        buffer->threadName = "thread " + std::to_string(buffer->threadId);
+        m_buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+/*! \brief Append a completed zone to the calling thread's ring buffer. Only the owning thread
+ * writes to the ring, so this is a plain store followed by a release of the new head.
+ * @param name the zone name
+ * @param startNs start time from now()
+ * @param durationNs zone duration in nanoseconds
+ * @return void
+ */
+void Profiler::record(const char *name, std::int64_t startNs, std::int64_t durationNs) {
+    ThreadBuffer &buffer = localBuffer();
+    std::uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    Event &event = buffer.events[head % kEventsPerThread];
+    event.name = name;
+    event.startNs = startNs;
+    event.durationNs = durationNs;
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+/*! \brief Give the calling thread a readable name in the trace.
+ * @param name the thread name
+ * @return void
+ */
+void Profiler::setThreadName(const std::string &name) {
+    ThreadBuffer &buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffer.threadName = name;
+}
+
+/*! \brief Set the file which flush() writes to.
+ * @param path the output path
+ * @return void
+ */
+void Profiler::setOutputPath(const std::string &path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_outputPath = path;
+}
+
+/*! \brief Get the file which flush() writes to.
+ * @return std::string the output path
+ */
+std::string Profiler::getOutputPath() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_outputPath;
+}
+
+/*! \brief Copy the live events of a buffer. The owner may keep writing while we copy, so the head
+ * is read again afterwards and any slot the owner could have reused in the meantime is dropped.
+ * @param buffer the buffer to read
+ * @param out the vector to append events to
+ * @return void
+ */
+void Profiler::copyEvents(ThreadBuffer &buffer, std::vector<Event> &out) {
+    std::uint64_t end = buffer.head.load(std::memory_order_acquire);
+    std::uint64_t begin = end > kEventsPerThread ? end - kEventsPerThread : 0;
+    std::vector<Event> copied;
+    copied.reserve(end - begin);
+    for (std::uint64_t i = begin; i < end; i++) {
+        copied.push_back(buffer.events[i % kEventsPerThread]);
+    }
+    std::uint64_t after = buffer.head.load(std::memory_order_acquire);
+    std::uint64_t firstValid = after + 1 > kEventsPerThread ? after + 1 - kEventsPerThread : 0;
+    std::uint64_t skip = firstValid > begin ? std::min<std::uint64_t>(firstValid - begin, copied.size()) : 0;
+    out.insert(out.end(), copied.begin() + skip, copied.end());
+}
+
+/*! \brief Collect a copy of all events still buffered by every thread.
+ * @return std::vector<Event> the events, grouped by thread
+ */
+std::vector<Profiler::Event> Profiler::snapshot() {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffers = m_buffers;
+    }
+    std::vector<Event> events;
+    for (auto &buffer : buffers) {
+        copyEvents(*buffer, events);
+    }
+    return events;
+}
+
+/*! \brief Forget all buffered events. Only safe while no other thread is recording.
+ * @return void
+ */
+void Profiler::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &buffer : m_buffers) {
+        buffer->head.store(0, std::memory_order_release);
+    }
+}
+
+/*! \brief Write the buffered events to the configured output path.
+ * @return bool whether the file was written
+ */
+bool Profiler::flush() {
+    return flush(getOutputPath());
+}
+
+/*! \brief Write the buffered events as Chrome trace-event JSON, which chrome://tracing and
+ * Perfetto can open directly. Every zone becomes a complete ("X") event in microseconds.
+ * @param path the file to write
+ * @return bool whether the file was written
+ */
+bool Profiler::flush(const std::string &path) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffers = m_buffers;
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    char line[256];
+    std::vector<Event> events;
+    for (auto &buffer : buffers) {
+        std::string threadName;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            threadName = buffer->threadName;
+        }
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+            << ",\"args\":{\"name\":\"" << threadName << "\"}}";
+
+        events.clear();
+        copyEvents(*buffer, events);
+        for (const Event &event : events) {
+            std::snprintf(line, sizeof(line),
+                          ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                          event.name, buffer->threadId, event.startNs / 1000.0, event.durationNs / 1000.0);
+            out << line;
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,517 @@
+/**
+ *  @file   ProjectFile.cpp
+ *  @brief  Implementation of ProjectFile.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+// POSIX headers for a temporary name of this process's own and fsync
+#include <fcntl.h>
+#include <unistd.h>
+// Project header files
+#include "ByteOrder.hpp"
+#include "Checksum.hpp"
+#include "Logger.hpp"
+#include "ProjectFile.hpp"
+
+// Bytes of the fixed header, its checksum included
+static constexpr std::size_t kHeaderBytes = 44;
+// Bytes of one index entry
+static constexpr std::size_t kEntryBytes = 32;
+// Most pixels one run-length control byte covers
+static constexpr std::size_t kMaxRun = 128;
+
+/*! \brief Append a pixel as its bytes in memory, R, G, B, A.
+ * @param out the bytes to append to
+ * @param pixel the pixel
+ * @return void
+ */
+static void putPixel(std::vector<std::uint8_t> &out, Canvas::Pixel pixel) {
+    std::uint8_t bytes[sizeof(pixel)];
+    std::memcpy(bytes, &pixel, sizeof(pixel));
+    out.insert(out.end(), bytes, bytes + sizeof(pixel));
+}
+
+/*! \brief Read a pixel stored as its bytes in memory.
+ * @param data the bytes
+ * @return Canvas::Pixel the pixel
+ */
+static Canvas::Pixel getPixel(const std::uint8_t *data) {
+    Canvas::Pixel pixel;
+    std::memcpy(&pixel, data, sizeof(pixel));
+    return pixel;
+}
+
+/*! \brief Number of pixels in a tile, which is cut to the canvas at the right and bottom edges.
+ * @param width the canvas width
+ * @param height the canvas height
+ * @param tileX the tile's column
+ * @param tileY the tile's row
+ * @param tileWidth receives the tile's width
+ * @param tileHeight receives the tile's height
+ * @return void
+ */
+static void tileSize(unsigned width, unsigned height, int tileX, int tileY, int &tileWidth, int &tileHeight) {
+    tileWidth = std::min(Canvas::kTileSize, static_cast<int>(width) - tileX * Canvas::kTileSize);
+    tileHeight = std::min(Canvas::kTileSize, static_cast<int>(height) - tileY * Canvas::kTileSize);
+}
+
+/*! \brief Copy what saving needs from the layers: their metadata, and the pixels of every tile
+ * painted on each of them (as of the last flatten). Tiles never painted, or which still hold only
+ * the layer's background, are not copied, so saving a large canvas costs what was drawn on it.
+ * This is the only part of a save which runs on the caller's thread. An autosave copies only the
+ * tiles marked unsaved, and clears their marks. The tiles of a paging layer are read without
+ * bringing those paged out back into memory, and encoded here one at a time, so the snapshot holds
+ * what they compress to rather than every pixel of a canvas larger than memory.
+ * @param layers the layers, flattened since they last changed
+ * @param activeLayer the layer the local user paints on
+ * @param unsavedOnly whether to copy only the tiles written since the last autosave
+ * @return std::shared_ptr<ProjectSnapshot> the snapshot
+ */
+std::shared_ptr<ProjectSnapshot> ProjectFile::capture(LayerStack &layers, int activeLayer, bool unsavedOnly) {
+    std::shared_ptr<ProjectSnapshot> snapshot = std::make_shared<ProjectSnapshot>();
+    snapshot->activeLayer = activeLayer;
+    for (std::size_t i = 0; i < layers.createdCount(); i++) {
+        LayerStack::Layer &layer = layers.created(i);
+        const Canvas &canvas = layer.canvas;
+        snapshot->width = canvas.getWidth();
+        snapshot->height = canvas.getHeight();
+        snapshot->layers.push_back(
+                ProjectLayer{layer.id, layer.background, layer.blend, layer.opacity, layers.indexOf(layer.id)});
+        const int columns = canvas.getTileColumns();
+        std::vector<std::uint8_t> &tiles = unsavedOnly ? layer.unsaved : layer.painted;
+        for (std::size_t tile = 0; tile < tiles.size(); tile++) {
+            if (tiles[tile] == 0) {
+                continue;
+            }
+            ProjectChunk chunk{static_cast<std::uint32_t>(i), static_cast<int>(tile) % columns,
+                               static_cast<int>(tile) / columns, std::vector<Canvas::Pixel>(),
+                               std::vector<std::uint8_t>(), 0};
+            // A tile the autosave journal holds must be written again, even if it is blank now
+            Canvas::Pixel uniform;
+            if (unsavedOnly) {
+                tiles[tile] = 0;
+            } else if (canvas.isUniformTile(chunk.tileX, chunk.tileY, uniform) && uniform == layer.background) {
+                continue;
+            }
+            int tileWidth;
+            int tileHeight;
+            tileSize(snapshot->width, snapshot->height, chunk.tileX, chunk.tileY, tileWidth, tileHeight);
+            chunk.pixels.resize(static_cast<std::size_t>(tileWidth) * tileHeight);
+            std::shared_ptr<const Canvas::Tile> pixels = canvas.peekTile(chunk.tileX, chunk.tileY);
+            for (int y = 0; y < tileHeight; y++) {
+                auto out = chunk.pixels.begin() + static_cast<std::ptrdiff_t>(y) * tileWidth;
+                if (pixels != nullptr) {
+                    const Canvas::Pixel *row = pixels->pixels + y * Canvas::kTileSize;
+                    std::copy(row, row + tileWidth, out);
+                } else {
+                    std::fill(out, out + tileWidth, canvas.getBackground());
+                }
+            }
+            if (canvas.isPaging()) {
+                chunk.encoding = encodeChunk(chunk, chunk.encoded);
+                std::vector<Canvas::Pixel>().swap(chunk.pixels);
+            }
+            snapshot->chunks.push_back(std::move(chunk));
+        }
+    }
+    return snapshot;
+}
+
+/*! \brief Write a snapshot to a file. Chunks holding only their layer's background are left out.
+ * The file is written under a temporary name no other write uses, even from another process, and
+ * flushed to disk before it is renamed over path, so path always holds a complete file.
+ * @param snapshot the drawing
+ * @param path the file
+ * @param error receives what went wrong
+ * @return bool whether the file was written
+ */
+bool ProjectFile::write(const ProjectSnapshot &snapshot, const std::string &path, std::string &error) {
+    static std::atomic<unsigned> writes(0);
+    const std::string temporary = path + "." + std::to_string(::getpid()) + "-" + std::to_string(writes++) + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        error = "cannot create " + temporary;
+        return false;
+    }
+    std::vector<std::uint8_t> bytes(kHeaderBytes, 0);
+    for (const ProjectLayer &layer : snapshot.layers) {
+        putLayer(bytes, layer);
+    }
+    ByteOrder::putU32(bytes, Checksum::crc32(bytes.data() + kHeaderBytes, bytes.size() - kHeaderBytes));
+    file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    std::uint64_t offset = bytes.size();
+
+    // The chunks, each written as soon as it is encoded; the index is kept until the end
+    std::vector<std::uint8_t> index;
+    std::vector<std::uint8_t> encoded;
+    std::uint32_t written = 0;
+    for (const ProjectChunk &chunk : snapshot.chunks) {
+        const Canvas::Pixel background = snapshot.layers[chunk.layer].background;
+        if (chunk.encoded.empty() && std::all_of(chunk.pixels.begin(), chunk.pixels.end(),
+                                                 [background](Canvas::Pixel pixel) { return pixel == background; })) {
+            continue;
+        }
+        const std::uint32_t encoding = encodeChunk(chunk, encoded);
+        file.write(reinterpret_cast<const char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+        ByteOrder::putU32(index, chunk.layer);
+        ByteOrder::putU32(index, static_cast<std::uint32_t>(chunk.tileX));
+        ByteOrder::putU32(index, static_cast<std::uint32_t>(chunk.tileY));
+        ByteOrder::putU32(index, encoding);
+        ByteOrder::putU64(index, offset);
+        ByteOrder::putU32(index, static_cast<std::uint32_t>(encoded.size()));
+        ByteOrder::putU32(index, Checksum::crc32(encoded.data(), encoded.size()));
+        offset += encoded.size();
+        written++;
+    }
+    ByteOrder::putU32(index, Checksum::crc32(index.data(), index.size()));
+    file.write(reinterpret_cast<const char *>(index.data()), static_cast<std::streamsize>(index.size()));
+
+    // The header last, now that the index's position is known
+    std::vector<std::uint8_t> header;
+    ByteOrder::putU32(header, kMagic);
+    ByteOrder::putU32(header, kVersion);
+    ByteOrder::putU32(header, snapshot.width);
+    ByteOrder::putU32(header, snapshot.height);
+    ByteOrder::putU32(header, static_cast<std::uint32_t>(Canvas::kTileSize));
+    ByteOrder::putU32(header, static_cast<std::uint32_t>(snapshot.activeLayer));
+    ByteOrder::putU32(header, static_cast<std::uint32_t>(snapshot.layers.size()));
+    ByteOrder::putU32(header, written);
+    ByteOrder::putU64(header, offset);
+    ByteOrder::putU32(header, Checksum::crc32(header.data(), header.size()));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+    file.close();
+    int fd = file ? ::open(temporary.c_str(), O_WRONLY) : -1;
+    bool synced = fd >= 0 && ::fsync(fd) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!synced) {
+        error = "cannot write " + temporary;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = "cannot replace " + path;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*! \brief Write a snapshot on a background thread. The snapshot is shared, so the caller may drop
+ * its reference straight away.
+ * @param snapshot the drawing
+ * @param path the file
+ * @param pool the threads to write on, in the background lane
+ * @return std::future<bool> whether the file was written, once it has been
+ */
+std::future<bool> ProjectFile::writeAsync(std::shared_ptr<const ProjectSnapshot> snapshot, const std::string &path,
+                                          ThreadPool &pool) {
+    std::shared_ptr<std::promise<bool>> done = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = done->get_future();
+    pool.submit([snapshot, path, done]() {
+        std::string error;
+        bool written = write(*snapshot, path, error);
+        if (!written) {
+            LOG_ERROR("Could not save " << path << ": " << error);
+        }
+        done->set_value(written);
+    }, ThreadPool::Lane::Background);
+    return result;
+}
+
+/*! \brief Encode a chunk's pixels: run-length encoded if that makes them smaller, else as they are.
+ * A chunk captured encoded is copied as it is.
+ * @param chunk the chunk
+ * @param out receives the encoded bytes
+ * @return std::uint32_t the encoding used, kRunChunk or kRawChunk
+ */
+std::uint32_t ProjectFile::encodeChunk(const ProjectChunk &chunk, std::vector<std::uint8_t> &out) {
+    if (!chunk.encoded.empty()) {
+        out = chunk.encoded;
+        return chunk.encoding;
+    }
+    if (encodeRuns(chunk.pixels.data(), chunk.pixels.size(), out)) {
+        return kRunChunk;
+    }
+    out.resize(chunk.pixels.size() * sizeof(Canvas::Pixel));
+    std::memcpy(out.data(), chunk.pixels.data(), out.size());
+    return kRawChunk;
+}
+
+/*! \brief Decode a chunk's pixels. The chunk's tile, already set, and the canvas size give the
+ * number of pixels expected.
+ * @param encoding kRunChunk or kRawChunk
+ * @param data the encoded bytes
+ * @param size the number of bytes
+ * @param width the canvas width
+ * @param height the canvas height
+ * @param chunk the chunk whose pixels are filled in
+ * @return bool false if the bytes are not a tile's worth of pixels in that encoding
+ */
+bool ProjectFile::decodeChunk(std::uint32_t encoding, const std::uint8_t *data, std::size_t size, unsigned width,
+                              unsigned height, ProjectChunk &chunk) {
+    int tileWidth;
+    int tileHeight;
+    tileSize(width, height, chunk.tileX, chunk.tileY, tileWidth, tileHeight);
+    if (tileWidth <= 0 || tileHeight <= 0) {
+        return false;
+    }
+    chunk.pixels.resize(static_cast<std::size_t>(tileWidth) * tileHeight);
+    if (encoding == kRawChunk) {
+        if (size != chunk.pixels.size() * sizeof(Canvas::Pixel)) {
+            return false;
+        }
+        std::memcpy(chunk.pixels.data(), data, size);
+        return true;
+    }
+    return encoding == kRunChunk && decodeRuns(data, size, chunk.pixels.data(), chunk.pixels.size());
+}
+
+/*! \brief Append a layer table entry: the id, the background, the blend mode, the opacity, two
+ * bytes of padding and the position.
+ * @param out the bytes to append to
+ * @param layer the layer
+ * @return void
+ */
+void ProjectFile::putLayer(std::vector<std::uint8_t> &out, const ProjectLayer &layer) {
+    ByteOrder::putU32(out, static_cast<std::uint32_t>(layer.id));
+    putPixel(out, layer.background);
+    out.push_back(static_cast<std::uint8_t>(layer.blend));
+    out.push_back(layer.opacity);
+    out.push_back(0);
+    out.push_back(0);
+    ByteOrder::putU32(out, static_cast<std::uint32_t>(layer.position));
+}
+
+/*! \brief Read a layer table entry written by putLayer().
+ * @param data the kLayerBytes bytes of the entry
+ * @param layer receives the layer
+ * @return bool false if the blend mode is unknown
+ */
+bool ProjectFile::getLayer(const std::uint8_t *data, ProjectLayer &layer) {
+    if (data[8] >= static_cast<std::uint8_t>(BlendMode::Count)) {
+        return false;
+    }
+    layer = ProjectLayer{static_cast<int>(ByteOrder::getU32(data)), getPixel(data + 4), static_cast<BlendMode>(data[8]),
+                         data[9], static_cast<int>(ByteOrder::getU32(data + 12))};
+    return true;
+}
+
+/*! \brief Read a whole file: the layers and every chunk.
+ * @param path the file
+ * @param snapshot receives the drawing
+ * @param error receives what went wrong
+ * @return bool whether the file was read
+ */
+bool ProjectFile::read(const std::string &path, ProjectSnapshot &snapshot, std::string &error) {
+    ProjectReader reader;
+    if (!reader.open(path)) {
+        error = reader.getError();
+        return false;
+    }
+    snapshot = reader.getInfo();
+    snapshot.chunks.resize(reader.getChunks().size());
+    for (std::size_t i = 0; i < snapshot.chunks.size(); i++) {
+        if (!reader.readChunk(i, snapshot.chunks[i])) {
+            error = reader.getError();
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! \brief Run-length encode pixels. Each control byte c is followed either, if c >= 128, by one
+ * pixel repeated c - 127 times, or else by c + 1 pixels as they are. Flat areas, which most of a
+ * drawing is, shrink to a few bytes per run.
+ * @param pixels the pixels
+ * @param count the number of pixels
+ * @param out receives the encoded bytes
+ * @return bool false, with out empty, if the encoding is not smaller than the pixels
+ */
+bool ProjectFile::encodeRuns(const Canvas::Pixel *pixels, std::size_t count, std::vector<std::uint8_t> &out) {
+    const std::size_t limit = count * sizeof(Canvas::Pixel);
+    out.clear();
+    std::size_t i = 0;
+    while (i < count) {
+        std::size_t run = 1;
+        while (i + run < count && run < kMaxRun && pixels[i + run] == pixels[i]) {
+            run++;
+        }
+        if (run >= 2) {
+            out.push_back(static_cast<std::uint8_t>(0x80 | (run - 1)));
+            putPixel(out, pixels[i]);
+            i += run;
+        } else {
+            // Literal pixels up to the start of the next run
+            std::size_t literal = 0;
+            while (i + literal < count && literal < kMaxRun &&
+                   (i + literal + 1 >= count || pixels[i + literal + 1] != pixels[i + literal])) {
+                literal++;
+            }
+            literal = std::max<std::size_t>(literal, 1);
+            out.push_back(static_cast<std::uint8_t>(literal - 1));
+            for (std::size_t k = 0; k < literal; k++) {
+                putPixel(out, pixels[i + k]);
+            }
+            i += literal;
+        }
+        if (out.size() >= limit) {
+            out.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! \brief Decode pixels encoded by encodeRuns().
+ * @param data the encoded bytes
+ * @param size the number of bytes
+ * @param pixels receives the pixels
+ * @param count the number of pixels expected
+ * @return bool false if the bytes do not decode to exactly count pixels
+ */
+bool ProjectFile::decodeRuns(const std::uint8_t *data, std::size_t size, Canvas::Pixel *pixels, std::size_t count) {
+    std::size_t in = 0;
+    std::size_t out = 0;
+    while (in < size) {
+        const std::uint8_t control = data[in++];
+        const bool run = (control & 0x80) != 0;
+        const std::size_t length = (control & 0x7F) + 1;
+        const std::size_t needed = run ? sizeof(Canvas::Pixel) : length * sizeof(Canvas::Pixel);
+        if (out + length > count || in + needed > size) {
+            return false;
+        }
+        if (run) {
+            std::fill(pixels + out, pixels + out + length, getPixel(data + in));
+        } else {
+            std::memcpy(pixels + out, data + in, needed);
+        }
+        in += needed;
+        out += length;
+    }
+    return out == count;
+}
+
+/*! \brief Open a project file and read its header, layer table and index, checking each of them.
+ * @param path the file
+ * @return bool whether the file could be opened and its index is intact
+ */
+bool ProjectReader::open(const std::string &path) {
+    m_file.close();
+    m_file.clear();
+    m_info = ProjectSnapshot();
+    m_chunks.clear();
+    m_file.open(path, std::ios::binary);
+    if (!m_file) {
+        return fail("cannot open " + path);
+    }
+    m_file.seekg(0, std::ios::end);
+    const std::uint64_t fileSize = static_cast<std::uint64_t>(m_file.tellg());
+    m_file.seekg(0);
+    std::vector<std::uint8_t> header(kHeaderBytes);
+    if (!m_file.read(reinterpret_cast<char *>(header.data()), kHeaderBytes)) {
+        return fail("truncated header");
+    }
+    if (ByteOrder::getU32(header.data()) != ProjectFile::kMagic) {
+        return fail("not a project file");
+    }
+    if (Checksum::crc32(header.data(), kHeaderBytes - 4) != ByteOrder::getU32(header.data() + 40)) {
+        return fail("damaged header");
+    }
+    if (ByteOrder::getU32(header.data() + 4) != ProjectFile::kVersion) {
+        return fail("unsupported version");
+    }
+    m_info.width = ByteOrder::getU32(header.data() + 8);
+    m_info.height = ByteOrder::getU32(header.data() + 12);
+    if (m_info.width > Canvas::kMaxSize || m_info.height > Canvas::kMaxSize) {
+        return fail("canvas too large");
+    }
+    if (ByteOrder::getU32(header.data() + 16) != static_cast<std::uint32_t>(Canvas::kTileSize)) {
+        return fail("unsupported tile size");
+    }
+    m_info.activeLayer = static_cast<int>(ByteOrder::getU32(header.data() + 20));
+    const std::uint32_t layerCount = ByteOrder::getU32(header.data() + 24);
+    const std::uint32_t chunkCount = ByteOrder::getU32(header.data() + 28);
+    const std::uint64_t indexOffset = ByteOrder::getU64(header.data() + 32);
+    const std::uint64_t tableBytes = static_cast<std::uint64_t>(layerCount) * ProjectFile::kLayerBytes + 4;
+    const std::uint64_t indexBytes = static_cast<std::uint64_t>(chunkCount) * kEntryBytes + 4;
+    if (kHeaderBytes + tableBytes > fileSize || indexOffset + indexBytes > fileSize) {
+        return fail("truncated file");
+    }
+
+    std::vector<std::uint8_t> table(static_cast<std::size_t>(tableBytes));
+    if (!m_file.read(reinterpret_cast<char *>(table.data()), static_cast<std::streamsize>(table.size())) ||
+        Checksum::crc32(table.data(), table.size() - 4) != ByteOrder::getU32(table.data() + table.size() - 4)) {
+        return fail("damaged layer table");
+    }
+    for (std::uint32_t i = 0; i < layerCount; i++) {
+        ProjectLayer layer;
+        if (!ProjectFile::getLayer(table.data() + i * ProjectFile::kLayerBytes, layer)) {
+            return fail("unknown blend mode");
+        }
+        m_info.layers.push_back(layer);
+    }
+
+    std::vector<std::uint8_t> index(static_cast<std::size_t>(indexBytes));
+    m_file.seekg(static_cast<std::streamoff>(indexOffset));
+    if (!m_file.read(reinterpret_cast<char *>(index.data()), static_cast<std::streamsize>(index.size())) ||
+        Checksum::crc32(index.data(), index.size() - 4) != ByteOrder::getU32(index.data() + index.size() - 4)) {
+        return fail("damaged index");
+    }
+    const std::uint32_t columns = (m_info.width + Canvas::kTileSize - 1) / Canvas::kTileSize;
+    const std::uint32_t rows = (m_info.height + Canvas::kTileSize - 1) / Canvas::kTileSize;
+    for (std::uint32_t i = 0; i < chunkCount; i++) {
+        const std::uint8_t *entry = index.data() + i * kEntryBytes;
+        ChunkEntry chunk{ByteOrder::getU32(entry), ByteOrder::getU32(entry + 4), ByteOrder::getU32(entry + 8),
+                         ByteOrder::getU32(entry + 12), ByteOrder::getU64(entry + 16), ByteOrder::getU32(entry + 24),
+                         ByteOrder::getU32(entry + 28)};
+        if (chunk.layer >= layerCount || chunk.tileX >= columns || chunk.tileY >= rows ||
+            chunk.encoding > ProjectFile::kRunChunk || chunk.offset + chunk.size > indexOffset) {
+            return fail("bad index entry");
+        }
+        m_chunks.push_back(chunk);
+    }
+    return true;
+}
+
+/*! \brief Read one chunk through the index, check its checksum and decompress it.
+ * @param index the chunk's position in the index
+ * @param out receives the chunk
+ * @return bool whether the chunk was intact
+ */
+bool ProjectReader::readChunk(std::size_t index, ProjectChunk &out) {
+    const ChunkEntry &entry = m_chunks[index];
+    std::vector<std::uint8_t> bytes(entry.size);
+    m_file.clear();
+    m_file.seekg(static_cast<std::streamoff>(entry.offset));
+    if (!m_file.read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()))) {
+        return fail("truncated chunk");
+    }
+    if (Checksum::crc32(bytes.data(), bytes.size()) != entry.crc) {
+        return fail("damaged chunk");
+    }
+    out.layer = entry.layer;
+    out.tileX = static_cast<int>(entry.tileX);
+    out.tileY = static_cast<int>(entry.tileY);
+    if (!ProjectFile::decodeChunk(entry.encoding, bytes.data(), bytes.size(), m_info.width, m_info.height, out)) {
+        return fail("bad chunk encoding");
+    }
+    return true;
+}
+
+/*! \brief Record what went wrong.
+ * @param error the description
+ * @return bool false
+ */
+bool ProjectReader::fail(const std::string &error) {
+    m_error = error;
+    return false;
+}
@@ -0,0 +1,100 @@
+/**
+ *  @file   RegionOps.cpp
+ *  @brief  Implementation of RegionOps.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cstring>
+// Project header files
+#include "RegionOps.hpp"
+
+/*! \brief Run a body over bands of rows in parallel, with canvas tracking paused around it.
+ * @param canvas the canvas the bands are written to
+ * @param top the first row
+ * @param bottom one past the last row
+ * @param pool the threads to run on
+ * @param body called with the first row and one past the last row of each band
+ * @return void
+ */
+void RegionOps::forEachBand(Canvas &canvas, int top, int bottom, ThreadPool &pool,
+                            const std::function<void(int, int)> &body) {
+    top = std::max(top, 0);
+    bottom = std::min(bottom, static_cast<int>(canvas.getHeight()));
+    if (top >= bottom) {
+        return;
+    }
+    // Bands are aligned to tile rows so that no two bands share a tile
+    const int firstBand = top / ThreadPool::kBandRows;
+    const int lastBand = (bottom - 1) / ThreadPool::kBandRows;
+    bool outermost = canvas.isTracking();
+    if (outermost) {
+        canvas.pauseTracking();
+    }
+    pool.parallelFor(static_cast<std::size_t>(lastBand - firstBand + 1), [&](std::size_t band) {
+        int bandTop = (firstBand + static_cast<int>(band)) * ThreadPool::kBandRows;
+        body(std::max(bandTop, top), std::min(bandTop + ThreadPool::kBandRows, bottom));
+    });
+    if (outermost) {
+        canvas.resumeTracking(top, bottom - 1);
+    }
+}
+
+/*! \brief Fill a rectangle of the canvas with one value, a band of rows per task. Whole tiles
+ * become uniform tiles rather than being written.
+ * @param canvas the canvas to write to
+ * @param rect the rectangle, clipped to the canvas
+ * @param pixel the value to fill with
+ * @param pool the threads to run on
+ * @return void
+ */
+void RegionOps::fillRect(Canvas &canvas, const CanvasRect &rect, Canvas::Pixel pixel, ThreadPool &pool) {
+    CanvasRect area = rect.intersect(canvas.getBounds());
+    if (area.empty()) {
+        return;
+    }
+    forEachBand(canvas, area.top, area.bottom, pool, [&](int top, int bottom) {
+        canvas.fillRect(CanvasRect{area.left, top, area.right, bottom}, pixel);
+    });
+}
+
+/*! \brief Fill the part of a region inside a rectangle, a band of rows per task.
+ * @param canvas the canvas to write to
+ * @param region the region
+ * @param pixel the value to fill with
+ * @param clip the rectangle to write within
+ * @param pool the threads to run on
+ * @return void
+ */
+void RegionOps::fillRegion(Canvas &canvas, const FillRegion &region, Canvas::Pixel pixel, const CanvasRect &clip,
+                           ThreadPool &pool) {
+    CanvasRect area = clip.intersect(region.getBounds());
+    if (area.empty()) {
+        return;
+    }
+    forEachBand(canvas, area.top, area.bottom, pool, [&](int top, int bottom) {
+        region.write(canvas, pixel, CanvasRect{area.left, top, area.right, bottom});
+    });
+}
+
+/*! \brief Copy every pixel of a snapshot over the canvas, a band of rows per task.
+ * @param canvas the canvas to write to
+ * @param snapshot the canvas to copy; the canvas is resized to match it if needed
+ * @param pool the threads to run on
+ * @return void
+ */
+void RegionOps::restore(Canvas &canvas, const Canvas &snapshot, ThreadPool &pool) {
+    if (snapshot.getWidth() != canvas.getWidth() || snapshot.getHeight() != canvas.getHeight()) {
+        canvas.create(snapshot.getWidth(), snapshot.getHeight(), 0);
+    }
+    const int width = static_cast<int>(canvas.getWidth());
+    forEachBand(canvas, 0, static_cast<int>(canvas.getHeight()), pool, [&](int top, int bottom) {
+        std::vector<Canvas::Pixel> row(static_cast<std::size_t>(width));
+        for (int y = top; y < bottom; y++) {
+            snapshot.readSpan(y, 0, width, row.data());
+            canvas.writeSpan(y, 0, width, row.data());
+        }
+    });
+}
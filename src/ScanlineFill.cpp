@@ -0,0 +1,450 @@
+/**
+ *  @file   ScanlineFill.cpp
+ *  @brief  Implementation of ScanlineFill.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+// Project header files
+#include "ScanlineFill.hpp"
+
+/*! \brief Construct an empty region.
+ */
+FillRegion::FillRegion() {
+    m_bounds = CanvasRect{0, 0, 0, 0};
+    m_pixelCount = 0;
+}
+
+/*! \brief Add a span. A span which continues the last one on the same row is merged into it.
+ * @param y the row
+ * @param x0 the first column
+ * @param x1 one past the last column
+ * @return void
+ */
+void FillRegion::add(int y, int x0, int x1) {
+    if (x0 >= x1) {
+        return;
+    }
+    if (m_spans.empty()) {
+        m_bounds = CanvasRect{x0, y, x1, y + 1};
+    } else {
+        m_bounds = CanvasRect{std::min(m_bounds.left, x0), std::min(m_bounds.top, y), std::max(m_bounds.right, x1),
+                              std::max(m_bounds.bottom, y + 1)};
+    }
+    m_pixelCount += static_cast<std::size_t>(x1 - x0);
+    if (!m_spans.empty() && m_spans.back().y == y && m_spans.back().x1 == x0) {
+        m_spans.back().x1 = x1;
+        return;
+    }
+    m_spans.push_back(Span{y, x0, x1});
+}
+
+/*! \brief Fill every span of the region.
+ * @param canvas the canvas to write to
+ * @param pixel the value to fill with
+ * @return void
+ */
+void FillRegion::write(Canvas &canvas, Canvas::Pixel pixel) const {
+    write(canvas, pixel, canvas.getBounds());
+}
+
+/*! \brief Fill the part of every span which lies inside a rectangle. The rows of the rectangle
+ * are found with a binary search, so a tile costs only the spans crossing it.
+ * @param canvas the canvas to write to
+ * @param pixel the value to fill with
+ * @param clip the rectangle to write within
+ * @return void
+ */
+void FillRegion::write(Canvas &canvas, Canvas::Pixel pixel, const CanvasRect &clip) const {
+    CanvasRect area = clip.intersect(canvas.getBounds());
+    if (area.empty()) {
+        return;
+    }
+    auto span = std::lower_bound(m_spans.begin(), m_spans.end(), area.top,
+                                 [](const Span &entry, int row) { return entry.y < row; });
+    for (; span != m_spans.end() && span->y < area.bottom; ++span) {
+        canvas.fillSpan(span->y, std::max(span->x0, area.left), std::min(span->x1, area.right), pixel);
+    }
+}
+
+/*! \brief Whether a pixel is in the region.
+ * @param x the x-coordinate
+ * @param y the y-coordinate
+ * @return bool true if a span covers (x, y)
+ */
+bool FillRegion::contains(int x, int y) const {
+    auto span = std::upper_bound(m_spans.begin(), m_spans.end(), std::make_pair(y, x),
+                                 [](const std::pair<int, int> &point, const Span &entry) {
+                                     return point.first < entry.y ||
+                                            (point.first == entry.y && point.second < entry.x0);
+                                 });
+    if (span == m_spans.begin()) {
+        return false;
+    }
+    --span;
+    return span->y == y && x < span->x1;
+}
+
+/*! \brief Forget every span.
+ * @return void
+ */
+void FillRegion::clear() {
+    m_spans.clear();
+    m_bounds = CanvasRect{0, 0, 0, 0};
+    m_pixelCount = 0;
+}
+
+/*! \brief Approximate bytes held by the spans.
+ * @return std::size_t the number of bytes
+ */
+std::size_t FillRegion::getByteSize() const {
+    return sizeof(*this) + m_spans.size() * sizeof(Span);
+}
+
+/*! \brief Largest difference between the channels of two pixels.
+ * @param a the first pixel
+ * @param b the second pixel
+ * @return int the difference, 0 to 255
+ */
+static int channelDistance(Canvas::Pixel a, Canvas::Pixel b) {
+    int distance = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int difference = static_cast<int>((a >> shift) & 0xff) - static_cast<int>((b >> shift) & 0xff);
+        distance = std::max(distance, difference < 0 ? -difference : difference);
+    }
+    return distance;
+}
+
+// Whether a pixel is close enough to a target color to be filled
+struct ColorMatch {
+    Canvas::Pixel target;
+    int tolerance;
+
+    bool operator()(Canvas::Pixel pixel) const {
+        return pixel == target || (tolerance > 0 && channelDistance(pixel, target) <= tolerance);
+    }
+};
+
+/*! \brief Serial scanline fill from a seed. A bit per pixel marks what the region already holds,
+ * so the fill terminates whatever color the region is later painted; only the rows the region
+ * reaches get bits, so a small fill on a large canvas stays small.
+ * @param canvas the canvas to search
+ * @param x the seed x-coordinate, on the canvas
+ * @param y the seed y-coordinate, on the canvas
+ * @param matches which pixels belong to the region
+ * @param budget the most pixels to fill before giving up
+ * @param region receives the region, in row then column order
+ * @return bool false if the region grew past the budget; the region is then incomplete
+ */
+static bool scanRegion(const Canvas &canvas, int x, int y, const ColorMatch &matches, std::size_t budget,
+                       FillRegion &region) {
+    const int width = static_cast<int>(canvas.getWidth());
+    const int height = static_cast<int>(canvas.getHeight());
+    std::vector<std::vector<std::uint64_t>> filled(static_cast<std::size_t>(height));
+    auto isFilled = [&filled](int px, int py) {
+        const std::vector<std::uint64_t> &bits = filled[static_cast<std::size_t>(py)];
+        return !bits.empty() && ((bits[static_cast<std::size_t>(px) >> 6] >> (px & 63)) & 1);
+    };
+    auto markFilled = [&filled, width](int py, int x0, int x1) {
+        std::vector<std::uint64_t> &bits = filled[static_cast<std::size_t>(py)];
+        if (bits.empty()) {
+            bits.assign((static_cast<std::size_t>(width) + 63) / 64, 0);
+        }
+        for (int bit = x0; bit < x1; bit++) {
+            bits[static_cast<std::size_t>(bit) >> 6] |= std::uint64_t(1) << (bit & 63);
+        }
+    };
+
+    struct Seed {
+        int x;
+        int y;
+    };
+    std::vector<Seed> stack{Seed{x, y}};
+    std::vector<FillRegion::Span> spans;
+    std::size_t pixels = 0;
+    while (!stack.empty()) {
+        Seed next = stack.back();
+        stack.pop_back();
+        Canvas::RowReader row(canvas, next.y);
+        if (isFilled(next.x, next.y) || !matches(row[next.x])) {
+            continue;
+        }
+        // Extend along the row in both directions
+        int x0 = next.x;
+        while (x0 > 0 && !isFilled(x0 - 1, next.y) && matches(row[x0 - 1])) {
+            x0--;
+        }
+        int x1 = next.x + 1;
+        while (x1 < width && !isFilled(x1, next.y) && matches(row[x1])) {
+            x1++;
+        }
+        markFilled(next.y, x0, x1);
+        spans.push_back(FillRegion::Span{next.y, x0, x1});
+        pixels += static_cast<std::size_t>(x1 - x0);
+        if (pixels > budget) {
+            return false;
+        }
+        // Push the start of every matching run under the span in the rows above and below
+        for (int neighbour : {next.y - 1, next.y + 1}) {
+            if (neighbour < 0 || neighbour >= height) {
+                continue;
+            }
+            Canvas::RowReader other(canvas, neighbour);
+            bool inRun = false;
+            for (int column = x0; column < x1; column++) {
+                bool open = !isFilled(column, neighbour) && matches(other[column]);
+                if (open && !inRun) {
+                    stack.push_back(Seed{column, neighbour});
+                }
+                inRun = open;
+            }
+        }
+    }
+
+    // Put the spans in row order with a counting sort, then order the few spans of each row
+    std::vector<std::size_t> rowStart(static_cast<std::size_t>(height) + 1, 0);
+    for (const FillRegion::Span &span : spans) {
+        rowStart[span.y + 1]++;
+    }
+    for (int row = 0; row < height; row++) {
+        rowStart[row + 1] += rowStart[row];
+    }
+    std::vector<FillRegion::Span> sorted(spans.size());
+    std::vector<std::size_t> next(rowStart.begin(), rowStart.end() - 1);
+    for (const FillRegion::Span &span : spans) {
+        sorted[next[span.y]++] = span;
+    }
+    for (int row = 0; row < height; row++) {
+        std::sort(sorted.begin() + rowStart[row], sorted.begin() + rowStart[row + 1],
+                  [](const FillRegion::Span &a, const FillRegion::Span &b) { return a.x0 < b.x0; });
+    }
+    for (const FillRegion::Span &span : sorted) {
+        region.add(span.y, span.x0, span.x1);
+    }
+    return true;
+}
+
+/*! \brief Find the 4-connected region of pixels matching the seed, on the calling thread.
+ * @param canvas the canvas to search
+ * @param x the seed x-coordinate
+ * @param y the seed y-coordinate
+ * @param tolerance the largest channel difference from the seed color which still matches
+ * @param region receives the region, in row then column order
+ * @return void
+ */
+void ScanlineFill::findRegion(const Canvas &canvas, int x, int y, int tolerance, FillRegion &region) {
+    region.clear();
+    if (!canvas.contains(x, y)) {
+        return;
+    }
+    scanRegion(canvas, x, y, ColorMatch{canvas.getPixel(x, y), tolerance}, SIZE_MAX, region);
+}
+
+// The maximal runs of matching pixels in one band of rows, and how they connect
+struct RunBand {
+    int top;
+    int bottom;
+    // Runs of each row, left to right; row r's are [rowStart[r - top], rowStart[r - top + 1])
+    std::vector<FillRegion::Span> runs;
+    std::vector<std::size_t> rowStart;
+    // Number of the band's first run among the runs of all bands
+    std::size_t offset;
+    // The band's part of the result
+    std::vector<FillRegion::Span> spans;
+};
+
+/*! \brief Collect the maximal runs of matching pixels in a band of rows.
+ * @param canvas the canvas to search
+ * @param matches which pixels belong to the region
+ * @param band the band, whose rows are set; receives its runs
+ * @return void
+ */
+static void findRuns(const Canvas &canvas, const ColorMatch &matches, RunBand &band) {
+    const int width = static_cast<int>(canvas.getWidth());
+    band.rowStart.assign(1, 0);
+    for (int y = band.top; y < band.bottom; y++) {
+        Canvas::RowReader row(canvas, y);
+        int x = 0;
+        while (x < width) {
+            while (x < width && !matches(row[x])) {
+                x++;
+            }
+            int start = x;
+            while (x < width && matches(row[x])) {
+                x++;
+            }
+            if (start < x) {
+                band.runs.push_back(FillRegion::Span{y, start, x});
+            }
+        }
+        band.rowStart.push_back(band.runs.size());
+    }
+}
+
+/*! \brief Root of a run's connected set, halving the path on the way.
+ * @param parent the union-find forest over all runs
+ * @param run the run
+ * @return std::size_t the root run
+ */
+static std::size_t findRoot(std::vector<std::size_t> &parent, std::size_t run) {
+    while (parent[run] != run) {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+/*! \brief Join the connected sets of runs in two consecutive rows wherever they share a column.
+ * @param parent the union-find forest over all runs
+ * @param upper the runs of the upper row, left to right
+ * @param upperCount the number of upper runs
+ * @param upperFirst the number of the first upper run
+ * @param lower the runs of the lower row, left to right
+ * @param lowerCount the number of lower runs
+ * @param lowerFirst the number of the first lower run
+ * @return void
+ */
+static void joinRows(std::vector<std::size_t> &parent, const FillRegion::Span *upper, std::size_t upperCount,
+                     std::size_t upperFirst, const FillRegion::Span *lower, std::size_t lowerCount,
+                     std::size_t lowerFirst) {
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < upperCount && j < lowerCount) {
+        if (upper[i].x0 < lower[j].x1 && lower[j].x0 < upper[i].x1) {
+            std::size_t a = findRoot(parent, upperFirst + i);
+            std::size_t b = findRoot(parent, lowerFirst + j);
+            if (a != b) {
+                parent[std::max(a, b)] = std::min(a, b);
+            }
+        }
+        if (upper[i].x1 < lower[j].x1) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+}
+
+/*! \brief Split the canvas into bands of rows for parallel work.
+ * @param canvas the canvas
+ * @return std::vector<RunBand> one band per kBandRows rows
+ */
+static std::vector<RunBand> makeBands(const Canvas &canvas) {
+    const int height = static_cast<int>(canvas.getHeight());
+    std::vector<RunBand> bands((height + ThreadPool::kBandRows - 1) / ThreadPool::kBandRows);
+    for (std::size_t b = 0; b < bands.size(); b++) {
+        bands[b].top = static_cast<int>(b) * ThreadPool::kBandRows;
+        bands[b].bottom = std::min(bands[b].top + ThreadPool::kBandRows, height);
+        bands[b].offset = 0;
+    }
+    return bands;
+}
+
+/*! \brief Find the 4-connected region of pixels matching the seed, in parallel when it is large.
+ * A small region is found by the serial fill; one which grows past kSerialPixels is found again
+ * by bands. In each band (in parallel) the maximal runs of matching pixels are collected and the
+ * runs of consecutive rows which share a column joined into sets; then the sets are merged along
+ * the band boundaries, and each band keeps the runs in the seed's set. A maximal run belongs to
+ * the region exactly when the serial fill would reach it, so both give the same spans.
+ * @param canvas the canvas to search
+ * @param x the seed x-coordinate
+ * @param y the seed y-coordinate
+ * @param tolerance the largest channel difference from the seed color which still matches
+ * @param region receives the region, in row then column order
+ * @param pool the threads to run on
+ * @return void
+ */
+void ScanlineFill::findRegion(const Canvas &canvas, int x, int y, int tolerance, FillRegion &region,
+                              ThreadPool &pool) {
+    region.clear();
+    if (!canvas.contains(x, y)) {
+        return;
+    }
+    const ColorMatch matches{canvas.getPixel(x, y), tolerance};
+    if (scanRegion(canvas, x, y, matches, pool.size() > 1 ? kSerialPixels : SIZE_MAX, region)) {
+        return;
+    }
+    region.clear();
+
+    std::vector<RunBand> bands = makeBands(canvas);
+    pool.parallelFor(bands.size(), [&](std::size_t b) {
+        findRuns(canvas, matches, bands[b]);
+    });
+    std::size_t runCount = 0;
+    for (RunBand &band : bands) {
+        band.offset = runCount;
+        runCount += band.runs.size();
+    }
+    std::vector<std::size_t> parent(runCount);
+    // Within a band only that band's runs are touched, so the bands can be joined in parallel
+    pool.parallelFor(bands.size(), [&](std::size_t b) {
+        RunBand &band = bands[b];
+        for (std::size_t run = 0; run < band.runs.size(); run++) {
+            parent[band.offset + run] = band.offset + run;
+        }
+        for (int row = 1; row < band.bottom - band.top; row++) {
+            joinRows(parent, band.runs.data() + band.rowStart[row - 1], band.rowStart[row] - band.rowStart[row - 1],
+                     band.offset + band.rowStart[row - 1], band.runs.data() + band.rowStart[row],
+                     band.rowStart[row + 1] - band.rowStart[row], band.offset + band.rowStart[row]);
+        }
+    });
+    // Merge the frontiers: the last row of each band with the first row of the next
+    for (std::size_t b = 1; b < bands.size(); b++) {
+        RunBand &upper = bands[b - 1];
+        RunBand &lower = bands[b];
+        std::size_t last = upper.rowStart.size() - 2;
+        joinRows(parent, upper.runs.data() + upper.rowStart[last], upper.rowStart[last + 1] - upper.rowStart[last],
+                 upper.offset + upper.rowStart[last], lower.runs.data(), lower.rowStart[1], lower.offset);
+    }
+    // Every run's parent has a lower number, so one pass in order points each run at its root and
+    // the parallel pass below only reads the forest
+    for (std::size_t run = 0; run < runCount; run++) {
+        parent[run] = parent[parent[run]];
+    }
+    RunBand &seedBand = bands[y / ThreadPool::kBandRows];
+    std::size_t seedRun = seedBand.offset + seedBand.rowStart[y - seedBand.top];
+    while (seedBand.runs[seedRun - seedBand.offset].x1 <= x) {
+        seedRun++;
+    }
+    const std::size_t root = parent[seedRun];
+    pool.parallelFor(bands.size(), [&](std::size_t b) {
+        RunBand &band = bands[b];
+        for (std::size_t run = 0; run < band.runs.size(); run++) {
+            if (parent[band.offset + run] == root) {
+                band.spans.push_back(band.runs[run]);
+            }
+        }
+    });
+    for (const RunBand &band : bands) {
+        for (const FillRegion::Span &span : band.spans) {
+            region.add(span.y, span.x0, span.x1);
+        }
+    }
+}
+
+/*! \brief Find every pixel matching a color within a tolerance, a band of rows per task.
+ * @param canvas the canvas to search
+ * @param color the color to match
+ * @param tolerance the largest channel difference from color which still matches
+ * @param region receives the matching pixels, in row then column order
+ * @param pool the threads to run on
+ * @return void
+ */
+void ScanlineFill::findMatching(const Canvas &canvas, Canvas::Pixel color, int tolerance, FillRegion &region,
+                                ThreadPool &pool) {
+    region.clear();
+    const ColorMatch matches{color, tolerance};
+    std::vector<RunBand> bands = makeBands(canvas);
+    pool.parallelFor(bands.size(), [&](std::size_t b) {
+        findRuns(canvas, matches, bands[b]);
+    });
+    for (const RunBand &band : bands) {
+        for (const FillRegion::Span &span : band.runs) {
+            region.add(span.y, span.x0, span.x1);
+        }
+    }
+}
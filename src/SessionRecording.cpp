@@ -0,0 +1,346 @@
+/**
+ *  @file   SessionRecording.cpp
+ *  @brief  Implementation of SessionRecording.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+// Project header files
+#include "ByteOrder.hpp"
+#include "Checksum.hpp"
+#include "Logger.hpp"
+#include "PaintCore.hpp"
+#include "Packet.hpp"
+#include "SessionRecording.hpp"
+
+// Bytes of the file header: magic, version, width, height and local client
+static constexpr std::size_t kHeaderBytes = 20;
+// Records buffered before they are written
+static constexpr std::size_t kFlushBytes = 64 * 1024;
+
+/*! \brief Append an unsigned integer in seven-bit groups, low group first, the top bit of each byte
+ * saying whether another follows.
+ * @param out the buffer
+ * @param value the integer
+ * @return void
+ */
+static void putVarint(std::vector<std::uint8_t> &out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+/*! \brief Read an integer written by putVarint().
+ * @param file the stream
+ * @param value receives the integer
+ * @return bool false at the end of the stream or at an over-long integer
+ */
+static bool getVarint(std::istream &file, std::uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const int byte = file.get();
+        if (byte == std::char_traits<char>::eof()) {
+            return false;
+        }
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*! \brief Constructor; nothing is recorded until open().
+ */
+SessionRecorder::SessionRecorder() {
+    m_lastTime = 0;
+    m_events = 0;
+}
+
+/*! \brief Destructor: write what is buffered and close the file.
+ */
+SessionRecorder::~SessionRecorder() {
+    close();
+}
+
+/*! \brief Start recording, replacing any recording at path.
+ * @param path the file
+ * @param width the canvas's width
+ * @param height the canvas's height
+ * @param localClient the local user's client id, which replay gives the core
+ * @param startMicros the time the recording starts at; records are timed from it
+ * @return bool whether the file could be created
+ */
+bool SessionRecorder::open(const std::string &path, unsigned width, unsigned height, int localClient,
+                           std::int64_t startMicros) {
+    close();
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        LOG_ERROR("Could not create the session recording " << path);
+        return false;
+    }
+    m_buffer.clear();
+    ByteOrder::putU32(m_buffer, kMagic);
+    ByteOrder::putU32(m_buffer, kVersion);
+    ByteOrder::putU32(m_buffer, width);
+    ByteOrder::putU32(m_buffer, height);
+    ByteOrder::putU32(m_buffer, static_cast<std::uint32_t>(localClient));
+    m_lastTime = startMicros;
+    m_events = 0;
+    return true;
+}
+
+/*! \brief Record a message. Only appends to a buffer, which is written every 64 KB.
+ * @param direction whether the message came from a peer or from the local user
+ * @param timeMicros when it was applied
+ * @param data the packet's bytes
+ * @param size the number of bytes
+ * @return void
+ */
+void SessionRecorder::record(SessionEvent::Direction direction, std::int64_t timeMicros, const void *data,
+                             std::size_t size) {
+    if (!m_file.is_open()) {
+        return;
+    }
+    // The clock is monotonic, but a caller may pass a time read before the last one it recorded
+    const std::int64_t delta = timeMicros > m_lastTime ? timeMicros - m_lastTime : 0;
+    m_lastTime += delta;
+    m_buffer.push_back(static_cast<std::uint8_t>(direction));
+    putVarint(m_buffer, static_cast<std::uint64_t>(delta));
+    putVarint(m_buffer, size);
+    const std::uint8_t *bytes = static_cast<const std::uint8_t *>(data);
+    m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+    m_events++;
+    if (m_buffer.size() >= kFlushBytes) {
+        flush();
+    }
+}
+
+/*! \brief Write the buffered records to the file.
+ * @return void
+ */
+void SessionRecorder::flush() {
+    if (!m_buffer.empty()) {
+        m_file.write(reinterpret_cast<const char *>(m_buffer.data()), static_cast<std::streamsize>(m_buffer.size()));
+        m_buffer.clear();
+    }
+}
+
+/*! \brief Write what is buffered and close the file.
+ * @return void
+ */
+void SessionRecorder::close() {
+    if (m_file.is_open()) {
+        flush();
+        m_file.close();
+    }
+}
+
+/*! \brief Open a recording and read its header.
+ * @param path the file
+ * @return bool false (see getError()) if it cannot be read or is not a recording this version reads
+ */
+bool SessionReader::open(const std::string &path) {
+    m_file.open(path, std::ios::binary);
+    std::uint8_t header[kHeaderBytes];
+    if (!m_file.read(reinterpret_cast<char *>(header), sizeof(header))) {
+        m_error = "cannot read " + path;
+        return false;
+    }
+    if (ByteOrder::getU32(header) != SessionRecorder::kMagic) {
+        m_error = path + " is not a session recording";
+        return false;
+    }
+    if (ByteOrder::getU32(header + 4) != SessionRecorder::kVersion) {
+        m_error = path + " was recorded by another version";
+        return false;
+    }
+    m_width = ByteOrder::getU32(header + 8);
+    m_height = ByteOrder::getU32(header + 12);
+    m_localClient = static_cast<int>(ByteOrder::getU32(header + 16));
+    m_time = 0;
+    return true;
+}
+
+/*! \brief Read the next message.
+ * @param event receives the message
+ * @return bool false at the end of the recording, including at a record cut short by a crash
+ */
+bool SessionReader::next(SessionEvent &event) {
+    const int direction = m_file.get();
+    std::uint64_t delta = 0;
+    std::uint64_t size = 0;
+    if (direction == std::char_traits<char>::eof()) {
+        return false;
+    }
+    if (direction > static_cast<int>(SessionEvent::Direction::Outbound) || !getVarint(m_file, delta)
+        || !getVarint(m_file, size) || size > (1u << 24)) {
+        LOG_WARN("Session recording ends in a damaged record");
+        return false;
+    }
+    event.data.resize(size);
+    if (!m_file.read(reinterpret_cast<char *>(event.data.data()), static_cast<std::streamsize>(size))) {
+        LOG_WARN("Session recording ends in a partial record");
+        return false;
+    }
+    m_time += static_cast<std::int64_t>(delta);
+    event.direction = static_cast<SessionEvent::Direction>(direction);
+    event.time = m_time;
+    return true;
+}
+
+/*! \brief Name of a subsystem, for reports.
+ * @param subsystem the subsystem
+ * @return const char * its name
+ */
+const char *SessionReplay::subsystemName(Subsystem subsystem) {
+    switch (subsystem) {
+        case Subsystem::Decode:
+            return "decode";
+        case Subsystem::Paint:
+            return "paint";
+        case Subsystem::History:
+            return "history";
+        case Subsystem::Fill:
+            return "fill";
+        case Subsystem::Layers:
+            return "layers";
+        case Subsystem::Composite:
+            return "composite";
+        default:
+            return "?";
+    }
+}
+
+/*! \brief The subsystem which applies a message.
+ * @param command the message's command
+ * @return SessionReplay::Subsystem the subsystem; Decode for messages which change nothing
+ */
+static SessionReplay::Subsystem subsystemOf(int command) {
+    switch (command) {
+        case 1:
+        case 2:
+            return SessionReplay::Subsystem::Paint;
+        case 3:
+        case 4:
+            return SessionReplay::Subsystem::History;
+        case 5:
+        case 7:
+            return SessionReplay::Subsystem::Fill;
+        case 8:
+            return SessionReplay::Subsystem::Layers;
+        default:
+            return SessionReplay::Subsystem::Decode;
+    }
+}
+
+/*! \brief A table of the time per subsystem, and the hash.
+ * @return std::string the report, one line per subsystem
+ */
+std::string SessionReplay::Report::summary() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << events << " messages on a " << width << "x" << height << " canvas, replayed in " << wallMilliseconds
+        << " ms (recorded over " << recordedMilliseconds << " ms)\n";
+    for (std::size_t i = 0; i < milliseconds.size(); i++) {
+        out << "  " << std::left << std::setw(10) << subsystemName(static_cast<Subsystem>(i)) << std::right
+            << std::setw(12) << milliseconds[i] << " ms" << std::setw(10) << calls[i] << " calls\n";
+    }
+    out << "canvas hash " << std::hex << std::setw(8) << std::setfill('0') << canvasHash << "\n";
+    return out.str();
+}
+
+/*! \brief Replay a recording through a new headless PaintCore on a canvas of the recorded size.
+ * Every message is decoded and applied as the app applies it, and the flattened image is brought
+ * up to date each time the recorded time enters a new frame, and at the end.
+ * @param path the recording
+ * @param realTime whether to wait until each message's recorded time, or to go as fast as possible
+ * @param report receives the time per subsystem and the final image's hash
+ * @param error receives why the recording could not be read
+ * @return bool false if the recording could not be read
+ */
+bool SessionReplay::run(const std::string &path, bool realTime, Report &report, std::string &error) {
+    using Clock = std::chrono::steady_clock;
+    SessionReader reader;
+    if (!reader.open(path)) {
+        error = reader.getError();
+        return false;
+    }
+    report = Report();
+    report.width = reader.getWidth();
+    report.height = reader.getHeight();
+    PaintCore core;
+    core.InitCanvas(report.width, report.height);
+    core.SetLocalClient(reader.getLocalClient());
+
+    const Clock::time_point start = Clock::now();
+    Clock::time_point mark = start;
+    // Charge the time since the last mark to a subsystem
+    auto charge = [&report, &mark](Subsystem subsystem) {
+        const Clock::time_point now = Clock::now();
+        const std::size_t index = static_cast<std::size_t>(subsystem);
+        report.milliseconds[index] += std::chrono::duration<double, std::milli>(now - mark).count();
+        report.calls[index]++;
+        mark = now;
+    };
+
+    SessionEvent event;
+    std::int64_t nextFrame = kFrameMicros;
+    while (reader.next(event)) {
+        if (event.time >= nextFrame) {
+            mark = Clock::now();
+            core.GetFlattened();
+            charge(Subsystem::Composite);
+            nextFrame = (event.time / kFrameMicros + 1) * kFrameMicros;
+        }
+        if (realTime) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(event.time));
+        }
+        mark = Clock::now();
+        sf::Packet packet;
+        packet.append(event.data.data(), event.data.size());
+        PaintMessage message;
+        const bool decoded = static_cast<bool>(packet >> message);
+        charge(Subsystem::Decode);
+        if (decoded) {
+            const Subsystem subsystem = subsystemOf(message.command);
+            core.ApplyMessage(message);
+            if (subsystem != Subsystem::Decode) {
+                charge(subsystem);
+            }
+        }
+        report.events++;
+        report.recordedMilliseconds = event.time / 1000.0;
+    }
+    mark = Clock::now();
+    const Canvas &flattened = core.GetFlattened();
+    charge(Subsystem::Composite);
+    report.wallMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    report.canvasHash = canvasHash(flattened);
+    core.Destroy();
+    return true;
+}
+
+/*! \brief Hash of an image: CRC-32 of its width and height, then of its rows in order.
+ * @param canvas the image
+ * @return std::uint32_t the hash
+ */
+std::uint32_t SessionReplay::canvasHash(const Canvas &canvas) {
+    std::vector<std::uint8_t> size;
+    ByteOrder::putU32(size, canvas.getWidth());
+    ByteOrder::putU32(size, canvas.getHeight());
+    std::uint32_t crc = Checksum::crc32(size.data(), size.size());
+    std::vector<Canvas::Pixel> row(canvas.getWidth());
+    for (unsigned y = 0; y < canvas.getHeight(); y++) {
+        canvas.readSpan(static_cast<int>(y), 0, static_cast<int>(row.size()), row.data());
+        crc = Checksum::crc32(row.data(), row.size() * sizeof(Canvas::Pixel), crc);
+    }
+    return crc;
+}
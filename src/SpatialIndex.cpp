@@ -0,0 +1,148 @@
+/**
+ *  @file   SpatialIndex.cpp
+ *  @brief  Implementation of SpatialIndex.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <iterator>
+// Project header files
+#include "SpatialIndex.hpp"
+
+/*! \brief Cell holding a coordinate, rounding towards negative infinity.
+ * @param coordinate the coordinate
+ * @return std::int64_t the cell coordinate
+ */
+static std::int64_t cellOf(std::int64_t coordinate) {
+    return coordinate >= 0 ? coordinate / SpatialIndex::kCellSize
+                           : -((-coordinate + SpatialIndex::kCellSize - 1) / SpatialIndex::kCellSize);
+}
+
+/*! \brief Construct an empty index.
+ */
+SpatialIndex::SpatialIndex() {
+    m_entries = 0;
+    m_first = 0;
+}
+
+/*! \brief Hash key of a cell.
+ * @param cellX the cell column
+ * @param cellY the cell row
+ * @return std::uint64_t the key
+ */
+std::uint64_t SpatialIndex::cellKey(std::int64_t cellX, std::int64_t cellY) {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cellX)) << 32) |
+           static_cast<std::uint32_t>(cellY);
+}
+
+/*! \brief Add an id. Ids are numbered in insertion order, which keeps every cell's list sorted.
+ * @param id the id, equal to the number of ids inserted so far
+ * @param bounds the rectangle the id covers
+ * @return void
+ */
+void SpatialIndex::insert(Id id, const CanvasRect &bounds) {
+    m_bounds.push_back(bounds);
+    if (bounds.empty()) {
+        return;
+    }
+    std::int64_t left = cellOf(bounds.left);
+    std::int64_t top = cellOf(bounds.top);
+    std::int64_t right = cellOf(static_cast<std::int64_t>(bounds.right) - 1);
+    std::int64_t bottom = cellOf(static_cast<std::int64_t>(bounds.bottom) - 1);
+    if ((right - left + 1) * (bottom - top + 1) > kMaxCells) {
+        m_large.push_back(id);
+        return;
+    }
+    for (std::int64_t cellY = top; cellY <= bottom; cellY++) {
+        for (std::int64_t cellX = left; cellX <= right; cellX++) {
+            m_cells[cellKey(cellX, cellY)].push_back(id);
+            m_entries++;
+        }
+    }
+}
+
+/*! \brief Find the ids from a sequence number onwards whose bounds intersect a rectangle. Each
+ * overlapped cell costs one hash lookup and one binary search, plus the matches it holds.
+ * @param rect the rectangle
+ * @param since the first id of interest
+ * @param out receives the matching ids in increasing order, without duplicates
+ * @return void
+ */
+void SpatialIndex::query(const CanvasRect &rect, Id since, std::vector<Id> &out) const {
+    if (rect.empty()) {
+        return;
+    }
+    std::size_t first = out.size();
+    auto collect = [&](const std::vector<Id> &ids) {
+        for (auto it = std::lower_bound(ids.begin(), ids.end(), since); it != ids.end(); ++it) {
+            if (m_bounds[*it - m_first].intersects(rect)) {
+                out.push_back(*it);
+            }
+        }
+    };
+    std::int64_t left = cellOf(rect.left);
+    std::int64_t top = cellOf(rect.top);
+    std::int64_t right = cellOf(static_cast<std::int64_t>(rect.right) - 1);
+    std::int64_t bottom = cellOf(static_cast<std::int64_t>(rect.bottom) - 1);
+    if ((right - left + 1) * (bottom - top + 1) > static_cast<std::int64_t>(m_cells.size())) {
+        // The rectangle spans more cells than exist; visit the ones that do
+        for (auto &cell : m_cells) {
+            collect(cell.second);
+        }
+    } else {
+        for (std::int64_t cellY = top; cellY <= bottom; cellY++) {
+            for (std::int64_t cellX = left; cellX <= right; cellX++) {
+                auto cell = m_cells.find(cellKey(cellX, cellY));
+                if (cell != m_cells.end()) {
+                    collect(cell->second);
+                }
+            }
+        }
+    }
+    collect(m_large);
+    std::sort(out.begin() + first, out.end());
+    out.erase(std::unique(out.begin() + first, out.end()), out.end());
+}
+
+/*! \brief Forget every id before a number. Since every list is sorted, that is a prefix of each;
+ * cells left empty go.
+ * @param first the first id to keep
+ * @return void
+ */
+void SpatialIndex::discard(Id first) {
+    first = std::min(first, size());
+    if (first <= m_first) {
+        return;
+    }
+    for (auto cell = m_cells.begin(); cell != m_cells.end();) {
+        std::vector<Id> &ids = cell->second;
+        auto keep = std::lower_bound(ids.begin(), ids.end(), first);
+        m_entries -= static_cast<std::size_t>(keep - ids.begin());
+        ids.erase(ids.begin(), keep);
+        cell = ids.empty() ? m_cells.erase(cell) : std::next(cell);
+    }
+    m_large.erase(m_large.begin(), std::lower_bound(m_large.begin(), m_large.end(), first));
+    m_bounds.erase(m_bounds.begin(), m_bounds.begin() + static_cast<std::ptrdiff_t>(first - m_first));
+    m_first = first;
+}
+
+/*! \brief Forget every id.
+ * @return void
+ */
+void SpatialIndex::clear() {
+    m_cells.clear();
+    m_large.clear();
+    m_bounds.clear();
+    m_entries = 0;
+    m_first = 0;
+}
+
+/*! \brief Approximate bytes held by the cells and bounds.
+ * @return std::size_t the number of bytes
+ */
+std::size_t SpatialIndex::getByteSize() const {
+    return m_entries * sizeof(Id) + m_cells.size() * (sizeof(std::vector<Id>) + 4 * sizeof(void *)) +
+           m_large.size() * sizeof(Id) + m_bounds.size() * sizeof(CanvasRect);
+}
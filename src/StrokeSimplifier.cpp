@@ -0,0 +1,190 @@
+/**
+ *  @file   StrokeSimplifier.cpp
+ *  @brief  Implementation of StrokeSimplifier.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <limits>
+// Project header files
+#include "StrokeSimplifier.hpp"
+
+/*! \brief Whether a point lies farther than the tolerance from the segment between a and b.
+ * Computed from integer cross and dot products, so points exactly on the segment always pass.
+ * @param point the point
+ * @param a one end of the segment
+ * @param b the other end of the segment
+ * @param tolerance the distance in pixels
+ * @return bool true if the point is outside the tolerance
+ */
+static bool outsideTolerance(const StrokeSimplifier::Sample &point, const StrokeSimplifier::Sample &a,
+                             const StrokeSimplifier::Sample &b, double tolerance) {
+    std::int64_t dx = b.x - a.x;
+    std::int64_t dy = b.y - a.y;
+    std::int64_t px = point.x - a.x;
+    std::int64_t py = point.y - a.y;
+    std::int64_t lengthSquared = dx * dx + dy * dy;
+    std::int64_t dot = px * dx + py * dy;
+    double limit = tolerance * tolerance;
+    if (lengthSquared == 0 || dot <= 0) {
+        return static_cast<double>(px * px + py * py) > limit;
+    }
+    if (dot >= lengthSquared) {
+        std::int64_t qx = point.x - b.x;
+        std::int64_t qy = point.y - b.y;
+        return static_cast<double>(qx * qx + qy * qy) > limit;
+    }
+    // Perpendicular distance squared is cross^2 / length^2
+    std::int64_t cross = px * dy - py * dx;
+    return static_cast<double>(cross) * static_cast<double>(cross) > limit * static_cast<double>(lengthSquared);
+}
+
+/*! \brief Construct a simplifier with no stroke in progress.
+ * @param tolerance the largest distance in pixels a dropped sample may lie from the kept stroke
+ * @param maxDelayUs the longest a sample may be held back, in microseconds
+ */
+StrokeSimplifier::StrokeSimplifier(double tolerance, std::int64_t maxDelayUs) {
+    m_tolerance = std::max(0.0, tolerance);
+    m_maxDelayUs = maxDelayUs;
+    m_active = false;
+    m_anchor = Sample{0, 0, 0};
+    m_heldSince = 0;
+    m_window.reserve(kMaxWindow);
+    m_samplesIn = &MetricsRegistry::Get().counter("stroke.samples_in");
+    m_segmentsOut = &MetricsRegistry::Get().counter("stroke.points_sent");
+}
+
+/*! \brief Set the tolerance.
+ * @param tolerance the largest distance in pixels a dropped sample may lie from the kept stroke
+ * @return void
+ */
+void StrokeSimplifier::setTolerance(double tolerance) {
+    m_tolerance = std::max(0.0, tolerance);
+}
+
+/*! \brief Get the tolerance.
+ * @return double the tolerance in pixels
+ */
+double StrokeSimplifier::getTolerance() const {
+    return m_tolerance;
+}
+
+/*! \brief Set the delay bound.
+ * @param microseconds the longest a sample may be held back
+ * @return void
+ */
+void StrokeSimplifier::setMaxDelay(std::int64_t microseconds) {
+    m_maxDelayUs = microseconds;
+}
+
+/*! \brief Whether a stroke is in progress.
+ * @return bool true between the first sample of a stroke and finish()
+ */
+bool StrokeSimplifier::isActive() const {
+    return m_active;
+}
+
+/*! \brief Check the held samples against a candidate line. Every held sample was already
+ * within the tolerance of the line to the newest one, so when this fails the newest held sample
+ * is exactly the point Ramer-Douglas-Peucker would keep for this window.
+ * @param end the candidate end of the line from the anchor
+ * @return bool whether all held samples lie within the tolerance of that line
+ */
+bool StrokeSimplifier::fitsWindow(const Sample &end) const {
+    for (const Sample &held : m_window) {
+        if (outsideTolerance(held, m_anchor, end, m_tolerance)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! \brief Send a sample as a segment from the anchor and make it the new anchor.
+ * @param sample the sample to keep
+ * @param out receives the segment
+ * @return void
+ */
+void StrokeSimplifier::emit(const Sample &sample, std::vector<Segment> &out) {
+    out.push_back(Segment{m_anchor.x, m_anchor.y, sample.x, sample.y, sample.stamp});
+    m_anchor = sample;
+    m_segmentsOut->increment();
+}
+
+/*! \brief Add a mouse sample. The first sample of a stroke is sent at once; later samples are
+ * held until one leaves the tolerance band, the window is full or the delay bound expires.
+ * @param sample the sample
+ * @param nowUs the current monotonic time in microseconds
+ * @param out receives any segments which are ready to send
+ * @return void
+ */
+void StrokeSimplifier::addSample(const Sample &sample, std::int64_t nowUs, std::vector<Segment> &out) {
+    m_samplesIn->increment();
+    if (!m_active) {
+        m_active = true;
+        m_window.clear();
+        m_anchor = sample;
+        out.push_back(Segment{-1, -1, sample.x, sample.y, sample.stamp});
+        m_segmentsOut->increment();
+        return;
+    }
+    poll(nowUs, out);
+    const Sample &last = m_window.empty() ? m_anchor : m_window.back();
+    if (sample.x == last.x && sample.y == last.y) {
+        return;
+    }
+    if (!m_window.empty() && (m_window.size() >= kMaxWindow || !fitsWindow(sample))) {
+        Sample kept = m_window.back();
+        m_window.clear();
+        emit(kept, out);
+    }
+    if (m_window.empty()) {
+        m_heldSince = nowUs;
+    }
+    m_window.push_back(sample);
+}
+
+/*! \brief Send the newest held sample if samples have been held longer than the delay bound,
+ * so a slow or paused stroke still appears on every peer promptly.
+ * @param nowUs the current monotonic time in microseconds
+ * @param out receives the segment, if one is sent
+ * @return void
+ */
+void StrokeSimplifier::poll(std::int64_t nowUs, std::vector<Segment> &out) {
+    if (m_window.empty() || nowUs - m_heldSince < m_maxDelayUs) {
+        return;
+    }
+    Sample kept = m_window.back();
+    m_window.clear();
+    emit(kept, out);
+}
+
+/*! \brief End the stroke. The last sample is always kept, so the stroke ends where the mouse did.
+ * @param out receives the final segment, if any sample is held
+ * @return void
+ */
+void StrokeSimplifier::finish(std::vector<Segment> &out) {
+    if (m_active && !m_window.empty()) {
+        Sample kept = m_window.back();
+        m_window.clear();
+        emit(kept, out);
+    }
+    m_active = false;
+}
+
+/*! \brief Simplify a whole recorded stroke at once, as the streaming path would with no delay bound.
+ * @param samples the stroke's samples in order
+ * @param tolerance the largest distance in pixels a dropped sample may lie from the kept stroke
+ * @return std::vector<Segment> the segments that would be sent
+ */
+std::vector<StrokeSimplifier::Segment> StrokeSimplifier::simplify(const std::vector<Sample> &samples,
+                                                                  double tolerance) {
+    StrokeSimplifier simplifier(tolerance, std::numeric_limits<std::int64_t>::max());
+    std::vector<Segment> segments;
+    for (const Sample &sample : samples) {
+        simplifier.addSample(sample, 0, segments);
+    }
+    simplifier.finish(segments);
+    return segments;
+}
@@ -0,0 +1,475 @@
+/**
+ *  @file   StrokeStore.cpp
+ *  @brief  Implementation of StrokeStore.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <utility>
+// Project header files
+#include "RegionOps.hpp"
+#include "StrokeStore.hpp"
+
+// Most strokes that can be extended at once, e.g. one per user drawing at the same time
+static constexpr std::size_t kMaxOpenStrokes = 16;
+// Fewest settled operations worth baking at once
+static constexpr std::size_t kMinCompact = 4096;
+
+static_assert(StrokeStore::kTileSize == ThreadPool::kBandRows, "a band of parallel work must be one row of tiles");
+
+/*! \brief Construct an empty store.
+ */
+StrokeStore::StrokeStore() {
+    m_pixelBytes = 0;
+    m_regionBytes = 0;
+    m_pointCount = 0;
+    m_firstOp = 0;
+    m_firstStroke = 0;
+    m_firstFill = 0;
+    m_firstPixels = 0;
+    m_firstRegion = 0;
+    m_bakedOps = 0;
+    m_pool = &ThreadPool::Get();
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_opsMetric = &metrics.gauge("strokes.ops");
+    m_bytesMetric = &metrics.gauge("strokes.bytes");
+    m_tilesRepaired = &metrics.counter("strokes.tiles_repaired");
+}
+
+/*! \brief Append an operation, shown, and publish the size of the store.
+ * @param kind the kind of operation
+ * @param record the index of its record
+ * @param point the stroke point it ends at, for a segment
+ * @return OpId the operation's number
+ */
+StrokeStore::OpId StrokeStore::push(OpKind kind, std::uint32_t record, std::uint32_t point) {
+    m_ops.push_back(Op{kind, true, false, record, point});
+    const OpId op = nextOp() - 1;
+    m_index.insert(op, computeBounds(m_ops.back()));
+    m_opsMetric->set(static_cast<std::int64_t>(m_ops.size()));
+    m_bytesMetric->set(static_cast<std::int64_t>(getByteSize()));
+    return op;
+}
+
+/*! \brief Add a stroke segment. A segment continuing a stroke is appended to the open stroke
+ * which ends where it starts and has the same brush, color and radius, so a stroke costs one
+ * point per segment. If there is none, e.g. because the stroke's start was lost, a new stroke
+ * is started at (fromX, fromY).
+ * @param brush the brush the stroke is painted with, and how
+ * @param color the stroke color
+ * @param radius half the width of the brush
+ * @param continues whether the segment starts at (fromX, fromY) rather than being a dab
+ * @param fromX the x-coordinate the segment starts at
+ * @param fromY the y-coordinate the segment starts at
+ * @param x the x-coordinate the segment ends at
+ * @param y the y-coordinate the segment ends at
+ * @return OpId the operation's number
+ */
+StrokeStore::OpId StrokeStore::addSegment(const BrushTip &brush, Canvas::Pixel color, int radius, bool continues,
+                                          int fromX, int fromY, int x, int y) {
+    if (continues) {
+        for (auto open = m_openStrokes.rbegin(); open != m_openStrokes.rend(); ++open) {
+            StrokeRecord &stroke = m_strokes[*open - m_firstStroke];
+            const StrokePoint &last = stroke.points.back();
+            if (stroke.brush == brush && stroke.color == color && stroke.radius == radius && last.x == fromX &&
+                last.y == fromY) {
+                stroke.points.push_back(StrokePoint{x, y});
+                m_pointCount++;
+                return push(OpKind::Segment, *open, static_cast<std::uint32_t>(stroke.points.size() - 1));
+            }
+        }
+    }
+    StrokeRecord stroke{brush, color, radius, std::vector<StrokePoint>()};
+    if (continues) {
+        stroke.points.push_back(StrokePoint{fromX, fromY});
+    }
+    stroke.points.push_back(StrokePoint{x, y});
+    m_pointCount += stroke.points.size();
+    m_strokes.push_back(std::move(stroke));
+    std::uint32_t index = static_cast<std::uint32_t>(m_firstStroke + m_strokes.size() - 1);
+    m_openStrokes.push_back(index);
+    if (m_openStrokes.size() > kMaxOpenStrokes) {
+        m_openStrokes.erase(m_openStrokes.begin());
+    }
+    return push(OpKind::Segment, index, static_cast<std::uint32_t>(m_strokes.back().points.size() - 1));
+}
+
+/*! \brief Add a fill of the whole canvas with one color.
+ * @param color the fill color
+ * @return OpId the operation's number
+ */
+StrokeStore::OpId StrokeStore::addFill(Canvas::Pixel color) {
+    m_fills.push_back(color);
+    m_fillOps.push_back(nextOp());
+    return push(OpKind::Fill, static_cast<std::uint32_t>(m_firstFill + m_fills.size() - 1), 0);
+}
+
+/*! \brief Add a flood fill: a region, as found on the canvas when the fill was made, and its color.
+ * Replaying it repaints the same spans, whatever has changed beneath them since.
+ * @param region the filled region
+ * @param color the fill color
+ * @return OpId the operation's number
+ */
+StrokeStore::OpId StrokeStore::addRegion(FillRegion region, Canvas::Pixel color) {
+    m_regionBytes += region.getByteSize();
+    m_regions.push_back(std::move(region));
+    m_regionColors.push_back(color);
+    return push(OpKind::Region, static_cast<std::uint32_t>(m_firstRegion + m_regions.size() - 1), 0);
+}
+
+/*! \brief Add explicit pixel values, for operations the brush engine cannot describe.
+ * @param pixels the pixels the operation wrote
+ * @return OpId the operation's number
+ */
+StrokeStore::OpId StrokeStore::addPixels(SpanRecord pixels) {
+    m_pixelBytes += pixels.getByteSize();
+    m_pixels.push_back(std::move(pixels));
+    return push(OpKind::Pixels, static_cast<std::uint32_t>(m_firstPixels + m_pixels.size() - 1), 0);
+}
+
+/*! \brief End every open stroke, e.g. when a mouse button is released.
+ * @return void
+ */
+void StrokeStore::closeStrokes() {
+    m_openStrokes.clear();
+}
+
+/*! \brief Paint one operation onto the canvas, within a rectangle.
+ * @param op the operation
+ * @param canvas the canvas to paint
+ * @param clip the rectangle to paint within
+ * @return void
+ */
+void StrokeStore::rasterize(OpId op, Canvas &canvas, const CanvasRect &clip) const {
+    const Op &entry = this->entry(op);
+    CanvasRect area = clip.intersect(canvas.getBounds());
+    if (area.empty()) {
+        return;
+    }
+    if (entry.kind == OpKind::Segment) {
+        const StrokeRecord &stroke = m_strokes[entry.record - m_firstStroke];
+        const StrokePoint &to = stroke.points[entry.point];
+        const StrokePoint &from = entry.point > 0 ? stroke.points[entry.point - 1] : to;
+        BrushEngine::paintSegment(canvas, from.x, from.y, to.x, to.y, entry.point > 0,
+                                  BrushDescriptor{stroke.brush, stroke.radius, stroke.color}, area);
+    } else if (entry.kind == OpKind::Fill) {
+        RegionOps::fillRect(canvas, area, m_fills[entry.record - m_firstFill], *m_pool);
+    } else if (entry.kind == OpKind::Region) {
+        const std::size_t record = entry.record - m_firstRegion;
+        RegionOps::fillRegion(canvas, m_regions[record], m_regionColors[record], area, *m_pool);
+    } else {
+        m_pixels[entry.record - m_firstPixels].write(canvas, area);
+    }
+}
+
+/*! \brief Hide or show an operation. The canvas is not touched until repair().
+ * @param op the operation
+ * @param visible whether it should be shown
+ * @return void
+ */
+void StrokeStore::setVisible(OpId op, bool visible) {
+    Op &entry = m_ops[op - m_firstOp];
+    if (entry.visible == visible) {
+        return;
+    }
+    entry.visible = visible;
+    invalidate(getBounds(op));
+}
+
+/*! \brief Whether an operation is shown.
+ * @param op the operation
+ * @return bool true unless it was hidden
+ */
+bool StrokeStore::isVisible(OpId op) const {
+    return entry(op).visible;
+}
+
+/*! \brief Note that an operation will stay as it is, shown or hidden, so that compact() may bake or
+ * drop it. Operations no longer kept, or never added (e.g. by a command of a store since replaced),
+ * are ignored.
+ * @param op the operation
+ * @return void
+ */
+void StrokeStore::settle(OpId op) {
+    if (op >= m_firstOp && op < nextOp()) {
+        m_ops[op - m_firstOp].settled = true;
+    }
+}
+
+/*! \brief Bake the run of settled operations at the start of the list into the baked canvas and
+ * drop them. Nothing is done until the run is at least kMinCompact operations and half the store,
+ * so every operation is baked once and dropping the run costs about as much as adding it did.
+ * Baking starts from the last visible fill in the run, which covers everything before it.
+ * @param canvas the layer's canvas, whose size the baked canvas takes
+ * @param background the color of the canvas before any operation
+ * @return std::size_t the number of operations dropped
+ */
+std::size_t StrokeStore::compact(const Canvas &canvas, Canvas::Pixel background) {
+    std::size_t settled = 0;
+    while (settled < m_ops.size() && m_ops[settled].settled) {
+        settled++;
+    }
+    if (settled < kMinCompact || settled < m_ops.size() / 2) {
+        return 0;
+    }
+    if (m_bakedOps == 0) {
+        m_baked.create(canvas.getWidth(), canvas.getHeight(), background);
+        // Nothing uploads or composites the baked canvas
+        m_baked.pauseTracking();
+    }
+    std::size_t start = 0;
+    for (std::size_t i = settled; i-- > 0;) {
+        if (m_ops[i].kind == OpKind::Fill && m_ops[i].visible) {
+            start = i;
+            break;
+        }
+    }
+    for (std::size_t i = start; i < settled; i++) {
+        if (m_ops[i].visible) {
+            rasterize(m_firstOp + i, m_baked, m_baked.getBounds());
+        }
+    }
+    dropOps(settled);
+    m_bakedOps += settled;
+    return settled;
+}
+
+/*! \brief Drop the first operations, with their entries in the index, and then every record before
+ * the first one a kept operation or an open stroke refers to. Records are dropped from the front of
+ * their lists only, so the numbers of the others stay the same.
+ * @param count the number of operations to drop
+ * @return void
+ */
+void StrokeStore::dropOps(std::size_t count) {
+    m_ops.erase(m_ops.begin(), m_ops.begin() + static_cast<std::ptrdiff_t>(count));
+    m_firstOp += count;
+    m_index.discard(m_firstOp);
+    m_fillOps.erase(m_fillOps.begin(), std::lower_bound(m_fillOps.begin(), m_fillOps.end(), m_firstOp));
+
+    std::uint32_t keepStroke = static_cast<std::uint32_t>(m_firstStroke + m_strokes.size());
+    std::uint32_t keepFill = static_cast<std::uint32_t>(m_firstFill + m_fills.size());
+    std::uint32_t keepPixels = static_cast<std::uint32_t>(m_firstPixels + m_pixels.size());
+    std::uint32_t keepRegion = static_cast<std::uint32_t>(m_firstRegion + m_regions.size());
+    for (const Op &op : m_ops) {
+        std::uint32_t &keep = op.kind == OpKind::Segment ? keepStroke
+                              : op.kind == OpKind::Fill  ? keepFill
+                              : op.kind == OpKind::Pixels ? keepPixels
+                                                          : keepRegion;
+        keep = std::min(keep, op.record);
+    }
+    for (std::uint32_t open : m_openStrokes) {
+        keepStroke = std::min(keepStroke, open);
+    }
+
+    const std::size_t strokes = keepStroke - m_firstStroke;
+    for (std::size_t i = 0; i < strokes; i++) {
+        m_pointCount -= m_strokes[i].points.size();
+    }
+    m_strokes.erase(m_strokes.begin(), m_strokes.begin() + static_cast<std::ptrdiff_t>(strokes));
+    m_firstStroke = keepStroke;
+    m_fills.erase(m_fills.begin(), m_fills.begin() + (keepFill - m_firstFill));
+    m_firstFill = keepFill;
+    const std::size_t pixels = keepPixels - m_firstPixels;
+    for (std::size_t i = 0; i < pixels; i++) {
+        m_pixelBytes -= m_pixels[i].getByteSize();
+    }
+    m_pixels.erase(m_pixels.begin(), m_pixels.begin() + static_cast<std::ptrdiff_t>(pixels));
+    m_firstPixels = keepPixels;
+    const std::size_t regions = keepRegion - m_firstRegion;
+    for (std::size_t i = 0; i < regions; i++) {
+        m_regionBytes -= m_regions[i].getByteSize();
+    }
+    m_regions.erase(m_regions.begin(), m_regions.begin() + static_cast<std::ptrdiff_t>(regions));
+    m_regionColors.erase(m_regionColors.begin(), m_regionColors.begin() + static_cast<std::ptrdiff_t>(regions));
+    m_firstRegion = keepRegion;
+
+    m_opsMetric->set(static_cast<std::int64_t>(m_ops.size()));
+    m_bytesMetric->set(static_cast<std::int64_t>(getByteSize()));
+}
+
+/*! \brief Rectangle holding every pixel an operation can paint.
+ * @param op the operation
+ * @return CanvasRect the bounds; a fill covers everything
+ */
+CanvasRect StrokeStore::getBounds(OpId op) const {
+    return m_index.getBounds(op);
+}
+
+/*! \brief Work out the rectangle an operation can paint from its record.
+ * @param entry the operation
+ * @return CanvasRect the bounds; a fill covers everything
+ */
+CanvasRect StrokeStore::computeBounds(const Op &entry) const {
+    if (entry.kind == OpKind::Segment) {
+        const StrokeRecord &stroke = m_strokes[entry.record - m_firstStroke];
+        const StrokePoint &to = stroke.points[entry.point];
+        const StrokePoint &from = entry.point > 0 ? stroke.points[entry.point - 1] : to;
+        if (stroke.brush.id == BrushId::Round) {
+            return BrushEngine::roundBounds(from.x, from.y, to.x, to.y, stroke.radius);
+        }
+        return BrushEngine::segmentBounds(from.x, from.y, to.x, to.y, stroke.radius);
+    }
+    if (entry.kind == OpKind::Fill) {
+        return CanvasRect{INT_MIN, INT_MIN, INT_MAX, INT_MAX};
+    }
+    if (entry.kind == OpKind::Region) {
+        return m_regions[entry.record - m_firstRegion].getBounds();
+    }
+    return m_pixels[entry.record - m_firstPixels].getBounds();
+}
+
+/*! \brief Find the operations from a sequence number onwards which touch a rectangle, through the
+ * spatial index: a hash lookup and a binary search per grid cell instead of a scan of the history.
+ * @param rect the rectangle
+ * @param since the first operation of interest
+ * @param out receives the operations in the order they were applied
+ * @return void
+ */
+void StrokeStore::query(const CanvasRect &rect, OpId since, std::vector<OpId> &out) const {
+    m_index.query(rect, since, out);
+}
+
+/*! \brief Mark a rectangle of the canvas for repair.
+ * @param rect the rectangle
+ * @return void
+ */
+void StrokeStore::invalidate(const CanvasRect &rect) {
+    if (!rect.empty()) {
+        m_invalid.push_back(rect);
+    }
+}
+
+/*! \brief Rebuild every tile which overlaps a rectangle marked since the last repair. Rows of
+ * tiles are rebuilt in parallel; each tile is replayed independently, so the pixels are the same.
+ * @param canvas the canvas to rebuild
+ * @param background the color of the canvas before any operation
+ * @return std::size_t the number of tiles rebuilt
+ */
+std::size_t StrokeStore::repair(Canvas &canvas, Canvas::Pixel background) {
+    if (m_invalid.empty()) {
+        return 0;
+    }
+    const int tilesX = (static_cast<int>(canvas.getWidth()) + kTileSize - 1) / kTileSize;
+    const int tilesY = (static_cast<int>(canvas.getHeight()) + kTileSize - 1) / kTileSize;
+    std::vector<bool> dirty(static_cast<std::size_t>(tilesX) * tilesY, false);
+    for (const CanvasRect &rect : m_invalid) {
+        CanvasRect area = rect.intersect(canvas.getBounds());
+        if (area.empty()) {
+            continue;
+        }
+        for (int ty = area.top / kTileSize; ty <= (area.bottom - 1) / kTileSize; ty++) {
+            for (int tx = area.left / kTileSize; tx <= (area.right - 1) / kTileSize; tx++) {
+                dirty[static_cast<std::size_t>(ty) * tilesX + tx] = true;
+            }
+        }
+    }
+    m_invalid.clear();
+
+    // Each band of parallel work is one row of tiles; only the rows holding dirty tiles are visited
+    int firstRow = tilesY;
+    int lastRow = -1;
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            if (dirty[static_cast<std::size_t>(ty) * tilesX + tx]) {
+                firstRow = std::min(firstRow, ty);
+                lastRow = std::max(lastRow, ty);
+                break;
+            }
+        }
+    }
+    std::atomic<std::size_t> tiles(0);
+    RegionOps::forEachBand(canvas, firstRow * kTileSize, (lastRow + 1) * kTileSize, *m_pool, [&](int top, int) {
+        const int ty = top / kTileSize;
+        for (int tx = 0; tx < tilesX; tx++) {
+            if (!dirty[static_cast<std::size_t>(ty) * tilesX + tx]) {
+                continue;
+            }
+            CanvasRect tile{tx * kTileSize, ty * kTileSize, (tx + 1) * kTileSize, (ty + 1) * kTileSize};
+            rebuild(canvas, tile, background);
+            tiles.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    std::size_t rebuilt = tiles.load();
+    m_tilesRepaired->increment(rebuilt);
+    return rebuilt;
+}
+
+/*! \brief Rebuild a rectangle of the canvas: start from the color of the last visible fill (or
+ * what was baked, or the background) and replay, in order, every visible operation after it which
+ * touches the rectangle.
+ * @param canvas the canvas to rebuild
+ * @param rect the rectangle to rebuild
+ * @param background the color of the canvas before any operation
+ * @return void
+ */
+void StrokeStore::rebuild(Canvas &canvas, const CanvasRect &rect, Canvas::Pixel background) const {
+    CanvasRect area = rect.intersect(canvas.getBounds());
+    if (area.empty()) {
+        return;
+    }
+    OpId start = m_firstOp;
+    bool filled = false;
+    for (std::size_t i = m_fillOps.size(); i-- > 0;) {
+        const Op &fill = entry(m_fillOps[i]);
+        if (fill.visible) {
+            start = m_fillOps[i] + 1;
+            canvas.fillRect(area, m_fills[fill.record - m_firstFill]);
+            filled = true;
+            break;
+        }
+    }
+    if (!filled && m_bakedOps > 0) {
+        std::vector<Canvas::Pixel> row(static_cast<std::size_t>(area.right - area.left));
+        for (int y = area.top; y < area.bottom; y++) {
+            m_baked.readSpan(y, area.left, area.right - area.left, row.data());
+            canvas.writeSpan(y, area.left, area.right - area.left, row.data());
+        }
+    } else if (!filled) {
+        canvas.fillRect(area, background);
+    }
+    std::vector<OpId> ops;
+    query(area, start, ops);
+    for (OpId op : ops) {
+        if (entry(op).visible && entry(op).kind != OpKind::Fill) {
+            rasterize(op, canvas, area);
+        }
+    }
+}
+
+/*! \brief Use a different thread pool for repairs and whole-canvas operations, e.g. to compare
+ * thread counts. The result does not depend on the pool.
+ * @param pool the pool, which must outlive the store
+ * @return void
+ */
+void StrokeStore::setThreadPool(ThreadPool &pool) {
+    m_pool = &pool;
+}
+
+/*! \brief Number of operations kept, shown or hidden; those baked are not counted.
+ * @return std::size_t the number of operations
+ */
+std::size_t StrokeStore::size() const {
+    return m_ops.size();
+}
+
+/*! \brief Number of polyline strokes.
+ * @return std::size_t the number of strokes
+ */
+std::size_t StrokeStore::strokeCount() const {
+    return m_strokes.size();
+}
+
+/*! \brief Approximate bytes held by the operations and their records.
+ * @return std::size_t the number of bytes
+ */
+std::size_t StrokeStore::getByteSize() const {
+    return m_ops.size() * sizeof(Op) + m_strokes.size() * sizeof(StrokeRecord) +
+           m_pointCount * sizeof(StrokePoint) + m_fills.size() * sizeof(Canvas::Pixel) +
+           m_pixels.size() * sizeof(SpanRecord) + m_pixelBytes + m_regionBytes +
+           m_regionColors.size() * sizeof(Canvas::Pixel) + m_fillOps.size() * sizeof(OpId) +
+           m_index.getByteSize() + (m_bakedOps > 0 ? m_baked.getByteSize() : 0);
+}
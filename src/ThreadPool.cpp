@@ -0,0 +1,422 @@
+/**
+ *  @file   ThreadPool.cpp
+ *  @brief  Implementation of ThreadPool.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+// Project header files
+#include "ThreadPool.hpp"
+
+// Pool and worker index of the calling thread, if it is a pool worker
+static thread_local const ThreadPool *t_pool = nullptr;
+static thread_local int t_worker = -1;
+
+/*! \brief Start the workers: one fewer than threads, as the caller of a parallel loop works too,
+ * but at least one, which a one-thread pool keeps for background tasks.
+ * @param threads the number of threads that run parallel loops, including the caller (at least 1)
+ */
+ThreadPool::ThreadPool(unsigned threads) {
+    unsigned workers = std::max(1u, threads > 1 ? threads - 1 : 0);
+    m_inline = threads <= 1;
+    m_queued[0].store(0);
+    m_queued[1].store(0);
+    m_backgroundRunning.store(0);
+    m_backgroundLimit = workers > 1 ? workers - 1 : 1;
+    m_stopping.store(false);
+    m_start = std::chrono::steady_clock::now();
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_stealsMetric = &metrics.counter("pool.steals");
+    for (unsigned i = 0; i < workers; i++) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->pinnedCount.store(0);
+        worker->tasks.store(0);
+        worker->steals.store(0);
+        worker->busyMicros.store(0);
+        worker->tasksMetric = &metrics.counter("pool.worker" + std::to_string(i) + ".tasks");
+        worker->busyMetric = &metrics.counter("pool.worker" + std::to_string(i) + ".busy_us");
+        m_workers.push_back(std::move(worker));
+    }
+    // Start the threads once every worker exists, since they steal from each other
+    for (unsigned i = 0; i < workers; i++) {
+        m_workers[i]->thread = std::thread(&ThreadPool::run, this, static_cast<int>(i));
+    }
+}
+
+/*! \brief Let the workers finish the queued tasks, then stop and join them.
+ */
+ThreadPool::~ThreadPool() {
+    m_stopping.store(true);
+    wakeAll();
+    for (std::unique_ptr<Worker> &worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+/*! \brief Return the process-wide pool, creating it on first use with PAINT_THREADS threads, or
+ * one per core when the variable is unset.
+ * @return ThreadPool& the shared pool
+ */
+ThreadPool &ThreadPool::Get() {
+    static ThreadPool *instance = [] {
+        const char *threads = std::getenv("PAINT_THREADS");
+        long count = threads != nullptr ? std::strtol(threads, nullptr, 10) : 0;
+        if (count <= 0) {
+            count = static_cast<long>(std::thread::hardware_concurrency());
+        }
+        return new ThreadPool(count > 0 ? static_cast<unsigned>(count) : 1);
+    }();
+    return *instance;
+}
+
+/*! \brief Index of the calling thread among this pool's workers.
+ * @return int the worker index, or -1 if the thread is not one of this pool's workers
+ */
+int ThreadPool::currentWorker() const {
+    return t_pool == this ? t_worker : -1;
+}
+
+/*! \brief Run body(i) for every i in [0, count) as tasks of one group, and wait for them. The
+ * calling thread runs tasks too while it waits.
+ * @param count the number of iterations
+ * @param body the loop body; iterations may run in any order and at the same time
+ * @param lane the lane the iterations run in
+ * @return void
+ */
+void ThreadPool::parallelFor(std::size_t count, const std::function<void(std::size_t)> &body, Lane lane) {
+    if (m_inline || count <= 1) {
+        for (std::size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+    TaskGroup group(*this, lane);
+    for (std::size_t i = 0; i < count; i++) {
+        group.run([&body, i] { body(i); });
+    }
+    group.wait();
+}
+
+/*! \brief Split [begin, end) into ranges of at most grain items, run body on each as tasks of one
+ * group, and wait for them.
+ * @param begin the first item
+ * @param end one past the last item
+ * @param grain the most items per task (at least 1)
+ * @param body called with the first item and one past the last item of each range
+ * @param lane the lane the ranges run in
+ * @return void
+ */
+void ThreadPool::parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+                             const std::function<void(std::size_t, std::size_t)> &body, Lane lane) {
+    grain = std::max<std::size_t>(grain, 1);
+    if (begin >= end) {
+        return;
+    }
+    if (m_inline || end - begin <= grain) {
+        body(begin, end);
+        return;
+    }
+    TaskGroup group(*this, lane);
+    for (std::size_t first = begin; first < end; first += grain) {
+        std::size_t last = std::min(first + grain, end);
+        group.run([&body, first, last] { body(first, last); });
+    }
+    group.wait();
+}
+
+/*! \brief Queue a task nobody waits for. It always runs on a worker, never on the calling thread.
+ * @param task the task
+ * @param lane the lane it runs in, background by default
+ * @return void
+ */
+void ThreadPool::submit(std::function<void()> task, Lane lane) {
+    push(Task{std::move(task), nullptr, lane, false}, -1);
+}
+
+/*! \brief What each worker has done since the pool started.
+ * @return std::vector<WorkerStats> one entry per worker
+ */
+std::vector<ThreadPool::WorkerStats> ThreadPool::getWorkerStats() const {
+    double uptime = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_start).count();
+    std::vector<WorkerStats> stats;
+    for (const std::unique_ptr<Worker> &worker : m_workers) {
+        WorkerStats entry;
+        entry.tasks = worker->tasks.load();
+        entry.steals = worker->steals.load();
+        entry.busyMicros = worker->busyMicros.load();
+        entry.utilization = uptime > 0 ? std::min(1.0, static_cast<double>(entry.busyMicros) / uptime) : 0.0;
+        stats.push_back(entry);
+    }
+    return stats;
+}
+
+/*! \brief Queue a task where it will be found: a worker's pinned deque, the calling worker's own
+ * deque, or the shared deque for threads outside the pool.
+ * @param task the task
+ * @param worker the worker it is pinned to, or -1
+ * @return void
+ */
+void ThreadPool::push(Task task, int worker) {
+    if (worker >= 0) {
+        Worker &target = *m_workers[worker];
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.pinned.push_back(std::move(task));
+        target.pinnedCount.fetch_add(1);
+    } else {
+        // Counted before it is visible, so that a thread which takes it never sees the count at zero
+        std::size_t lane = static_cast<std::size_t>(task.lane);
+        m_queued[lane].fetch_add(1);
+        int self = currentWorker();
+        if (self >= 0) {
+            std::lock_guard<std::mutex> lock(m_workers[self]->mutex);
+            m_workers[self]->lanes[lane].push_back(std::move(task));
+        } else {
+            std::lock_guard<std::mutex> lock(m_sharedMutex);
+            m_shared[lane].push_back(std::move(task));
+        }
+    }
+    wakeAll();
+}
+
+/*! \brief Take one task: the worker's pinned tasks first, then interactive tasks, then (if
+ * allowed and a background slot is free) background tasks. In each lane the worker's own newest
+ * task comes first, then the shared deque, then the oldest task of another worker.
+ * @param self the worker taking the task, or -1 for a thread outside the pool
+ * @param background whether background tasks may be taken
+ * @param task receives the task
+ * @return bool whether a task was taken
+ */
+bool ThreadPool::take(int self, bool background, Task &task) {
+    if (self >= 0 && m_workers[self]->pinnedCount.load() > 0) {
+        Worker &own = *m_workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.pinned.empty()) {
+            task = std::move(own.pinned.front());
+            own.pinned.pop_front();
+            own.pinnedCount.fetch_sub(1);
+            return true;
+        }
+    }
+    for (std::size_t lane = 0; lane < (background ? 2u : 1u); lane++) {
+        if (m_queued[lane].load() == 0) {
+            continue;
+        }
+        bool limited = lane == static_cast<std::size_t>(Lane::Background);
+        if (limited) {
+            unsigned running = m_backgroundRunning.load();
+            do {
+                if (running >= m_backgroundLimit) {
+                    return false;
+                }
+            } while (!m_backgroundRunning.compare_exchange_weak(running, running + 1));
+        }
+        bool found = false;
+        bool stolen = false;
+        if (self >= 0) {
+            Worker &own = *m_workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.lanes[lane].empty()) {
+                task = std::move(own.lanes[lane].back());
+                own.lanes[lane].pop_back();
+                found = true;
+            }
+        }
+        if (!found) {
+            std::lock_guard<std::mutex> lock(m_sharedMutex);
+            if (!m_shared[lane].empty()) {
+                task = std::move(m_shared[lane].front());
+                m_shared[lane].pop_front();
+                found = true;
+            }
+        }
+        const std::size_t workers = m_workers.size();
+        for (std::size_t i = 1; !found && i <= workers; i++) {
+            std::size_t victim = (static_cast<std::size_t>(self + workers) + i) % workers;
+            if (static_cast<int>(victim) == self) {
+                continue;
+            }
+            Worker &other = *m_workers[victim];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if (!other.lanes[lane].empty()) {
+                task = std::move(other.lanes[lane].front());
+                other.lanes[lane].pop_front();
+                found = true;
+                stolen = true;
+            }
+        }
+        if (found) {
+            m_queued[lane].fetch_sub(1);
+            task.limited = limited;
+            if (stolen) {
+                m_stealsMetric->increment();
+                if (self >= 0) {
+                    m_workers[self]->steals.fetch_add(1);
+                }
+            }
+            return true;
+        }
+        if (limited) {
+            m_backgroundRunning.fetch_sub(1);
+        }
+    }
+    return false;
+}
+
+/*! \brief Take and run one task.
+ * @param self the worker running it, or -1 for a thread outside the pool
+ * @param background whether background tasks may be run
+ * @return bool false if there was no task to run
+ */
+bool ThreadPool::runOne(int self, bool background) {
+    Task task;
+    if (!take(self, background, task)) {
+        return false;
+    }
+    execute(self, task);
+    return true;
+}
+
+/*! \brief Run a task, record how long the worker was busy, and tell whoever waits for it.
+ * @param self the worker running it, or -1 for a thread outside the pool
+ * @param task the task
+ * @return void
+ */
+void ThreadPool::execute(int self, Task &task) {
+    auto start = std::chrono::steady_clock::now();
+    task.body();
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    if (self >= 0) {
+        Worker &worker = *m_workers[self];
+        worker.tasks.fetch_add(1);
+        worker.busyMicros.fetch_add(static_cast<std::uint64_t>(micros.count()));
+        worker.tasksMetric->increment();
+        worker.busyMetric->increment(static_cast<std::uint64_t>(micros.count()));
+    }
+    bool wake = false;
+    if (task.limited) {
+        // A background slot is free again
+        m_backgroundRunning.fetch_sub(1);
+        wake = true;
+    }
+    // The group may be destroyed as soon as its count reaches zero, so it is not touched after
+    if (task.group != nullptr && task.group->m_pending.fetch_sub(1) == 1) {
+        wake = true;
+    }
+    if (wake) {
+        wakeAll();
+    }
+}
+
+/*! \brief Wake every sleeping thread so it checks again for work or a finished group.
+ * @return void
+ */
+void ThreadPool::wakeAll() {
+    {
+        // Whatever changed was changed before this lock, so a thread about to sleep sees it
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_all();
+}
+
+/*! \brief Whether a thread could take a task now.
+ * @param self the worker, or -1 for a thread outside the pool
+ * @param background whether background tasks may be taken
+ * @return bool true if there is a task for it
+ */
+bool ThreadPool::hasWork(int self, bool background) const {
+    if (self >= 0 && m_workers[self]->pinnedCount.load() > 0) {
+        return true;
+    }
+    if (m_queued[0].load() > 0) {
+        return true;
+    }
+    return background && m_queued[1].load() > 0 && m_backgroundRunning.load() < m_backgroundLimit;
+}
+
+/*! \brief Worker thread: run tasks while there are any, sleep until there are more, and exit
+ * once the pool stops and nothing is left.
+ * @param self the worker's index
+ * @return void
+ */
+void ThreadPool::run(int self) {
+    t_pool = this;
+    t_worker = self;
+    while (true) {
+        if (runOne(self, true)) {
+            continue;
+        }
+        // Once stopping, a worker leaves when no task is queued that it could ever take
+        auto drained = [this, self] {
+            return m_stopping.load() && m_queued[0].load() == 0 && m_queued[1].load() == 0 &&
+                   (self < 0 || m_workers[self]->pinnedCount.load() == 0);
+        };
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this, self, &drained] { return drained() || hasWork(self, true); });
+        if (drained()) {
+            return;
+        }
+    }
+}
+
+/*! \brief Create an empty group.
+ * @param pool the pool its tasks run on
+ * @param lane the lane its tasks run in
+ */
+TaskGroup::TaskGroup(ThreadPool &pool, ThreadPool::Lane lane) : m_pool(pool), m_lane(lane) {
+    m_pending.store(0);
+}
+
+/*! \brief Wait for the tasks still running, which refer to the group.
+ */
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+/*! \brief Run a task on whichever thread gets to it first. A one-thread pool runs it now.
+ * @param task the task
+ * @return void
+ */
+void TaskGroup::run(std::function<void()> task) {
+    if (m_pool.m_inline) {
+        task();
+        return;
+    }
+    m_pending.fetch_add(1);
+    m_pool.push(ThreadPool::Task{std::move(task), this, m_lane, false}, -1);
+}
+
+/*! \brief Run a task on one particular worker.
+ * @param worker the worker's index
+ * @param task the task
+ * @return void
+ */
+void TaskGroup::runOn(int worker, std::function<void()> task) {
+    if (m_pool.m_inline || worker < 0 || worker >= static_cast<int>(m_pool.m_workers.size())) {
+        run(std::move(task));
+        return;
+    }
+    m_pending.fetch_add(1);
+    m_pool.push(ThreadPool::Task{std::move(task), this, m_lane, false}, worker);
+}
+
+/*! \brief Run tasks until every task of the group has finished, sleeping when there is nothing
+ * this thread may run. An interactive group's waiter never runs background tasks.
+ * @return void
+ */
+void TaskGroup::wait() {
+    const int self = m_pool.currentWorker();
+    const bool background = m_lane == ThreadPool::Lane::Background;
+    while (m_pending.load() > 0) {
+        if (m_pool.runOne(self, background)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_pool.m_sleepMutex);
+        m_pool.m_wake.wait(lock, [this, self, background] {
+            return m_pending.load() == 0 || m_pool.hasWork(self, background);
+        });
+    }
+}
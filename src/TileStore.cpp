@@ -0,0 +1,419 @@
+/**
+ *  @file   TileStore.cpp
+ *  @brief  Implementation of TileStore.hpp
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Include standard library C++ libraries.
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+// POSIX headers for positioned reads and writes
+#include <fcntl.h>
+#include <unistd.h>
+// Project header files
+#include "Logger.hpp"
+#include "ThreadPool.hpp"
+#include "TileStore.hpp"
+
+// Bytes of one tile's slot in the file
+static constexpr std::size_t kSlotBytes = sizeof(Canvas::Tile::pixels);
+
+/*! \brief Constructor for a budget no store shares yet.
+ * @param limit the most tiles with pixels of their own the stores keep in memory together; at least 1
+ */
+TileBudget::TileBudget(std::size_t limit) {
+    m_limit = std::max<std::size_t>(limit, 1);
+    m_resident = 0;
+    m_stores = 0;
+}
+
+/*! \brief The tiles a store may keep in memory even while the stores together hold more than the
+ * limit: the limit split evenly among the stores sharing it.
+ * @return std::size_t the number of tiles, at least 1
+ */
+std::size_t TileBudget::getShare() const {
+    return std::max<std::size_t>(m_limit / std::max<std::size_t>(m_stores.load(std::memory_order_relaxed), 1), 1);
+}
+
+/*! \brief Constructor; the store pages nothing until open().
+ * @param budget the tiles the store may keep in memory, shared with the other stores given it
+ */
+TileStore::TileStore(std::shared_ptr<TileBudget> budget) {
+    m_budget = std::move(budget);
+    m_budget->m_stores.fetch_add(1, std::memory_order_relaxed);
+    m_file = -1;
+    m_hand = 0;
+    m_resident = 0;
+    m_pagedCount = 0;
+    m_busy = false;
+    m_scheduled = false;
+
+    // Metrics
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_pagedInMetric = &metrics.counter("tiles.paged_in");
+    m_pagedOutMetric = &metrics.counter("tiles.paged_out");
+    m_writtenBackMetric = &metrics.counter("tiles.written_back");
+    m_prefetchedMetric = &metrics.counter("tiles.prefetched");
+    m_prefetchHitsMetric = &metrics.counter("tiles.prefetch_hits");
+    m_residentMetric = &metrics.gauge("tiles.resident");
+}
+
+/*! \brief Destructor: close the file, which removes it, and give the tiles still counted as
+ * resident back to the budget. No job is left: a queued task holds the store.
+ */
+TileStore::~TileStore() {
+    if (m_file >= 0) {
+        ::close(m_file);
+    }
+    addResident(-static_cast<std::int64_t>(m_resident.load()));
+    m_budget->m_stores.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/*! \brief Create the backing file. The file is unlinked right away, so it never outlives the
+ * store, even if the process dies.
+ * @param directory where to create the file
+ * @param tileCount the number of tiles of the canvas
+ * @param error receives why the file could not be created
+ * @return bool whether it was
+ */
+bool TileStore::open(const std::string &directory, std::size_t tileCount, std::string &error) {
+    std::string path = (directory.empty() ? std::string(".") : directory) + "/canvas-XXXXXX.tiles";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    m_file = ::mkstemps(name.data(), 6);
+    if (m_file < 0) {
+        error = "cannot create a tile file in " + directory + ": " + std::strerror(errno);
+        return false;
+    }
+    m_directory = directory;
+    m_path = name.data();
+    ::unlink(m_path.c_str());
+    reset(tileCount);
+    return true;
+}
+
+/*! \brief Forget every tile: what is queued is dropped, once the job running is done, and the file
+ * is emptied.
+ * @param tileCount the number of tiles of the canvas from now on
+ * @return void
+ */
+void TileStore::reset(std::size_t tileCount) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue.clear();
+    m_idle.wait(lock, [this]() { return !m_busy; });
+    m_pending.clear();
+    m_prefetched.clear();
+    m_paged.assign(tileCount, 0);
+    m_pagedCount = 0;
+    m_flags.assign(tileCount, 0);
+    m_hand = 0;
+    addResident(-static_cast<std::int64_t>(m_resident.load()));
+    if (m_file >= 0 && ::ftruncate(m_file, 0) != 0) {
+        LOG_WARN("Could not empty the tile file " << m_path << ": " << std::strerror(errno));
+    }
+}
+
+/*! \brief Note that a tile with pixels of its own is about to be written: it counts as resident,
+ * recently used and changed since it was last in the file.
+ * @param index the tile
+ * @return void
+ */
+void TileStore::written(std::size_t index) {
+    if ((m_flags[index] & kResident) == 0) {
+        addResident(1);
+    }
+    m_flags[index] = kResident | kReferenced | kChanged;
+}
+
+/*! \brief Note that a tile no longer has pixels of its own, e.g. it was filled whole; a copy of it
+ * in the file or read ahead is of no use any more.
+ * @param index the tile
+ * @return void
+ */
+void TileStore::dropped(std::size_t index) {
+    if ((m_flags[index] & kResident) != 0) {
+        addResident(-1);
+    }
+    m_flags[index] = 0;
+    if (m_paged[index] != 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_paged[index] = 0;
+        m_pagedCount--;
+        m_prefetched.erase(index);
+    }
+}
+
+/*! \brief Bring a paged tile back into memory: copied from the write-back queue if it is still
+ * there, taken from the tiles read ahead if it is one, else read from the file now.
+ * @param index the tile, which must be paged
+ * @return TileStore::TilePtr the tile, with pixels of its own
+ */
+TileStore::TilePtr TileStore::pageIn(std::size_t index) {
+    TilePtr tile;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto pending = m_pending.find(index);
+        auto prefetched = m_prefetched.find(index);
+        if (pending != m_pending.end()) {
+            tile = std::make_shared<Canvas::Tile>(*pending->second);
+        } else if (prefetched != m_prefetched.end()) {
+            tile = std::move(prefetched->second);
+            m_prefetched.erase(prefetched);
+            m_prefetchHitsMetric->increment();
+        } else {
+            tile = load(index);
+        }
+        m_paged[index] = 0;
+        m_pagedCount--;
+    }
+    m_flags[index] = kResident | kReferenced;
+    addResident(1);
+    m_pagedInMetric->increment();
+    return tile;
+}
+
+/*! \brief A paged tile's pixels for a copy of the canvas. The tile stays paged; a tile from the
+ * queues is shared, which the copy copies before writing to it.
+ * @param index the tile, which must be paged
+ * @return TileStore::TilePtr the tile
+ */
+TileStore::TilePtr TileStore::read(std::size_t index) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto pending = m_pending.find(index);
+    if (pending != m_pending.end()) {
+        return pending->second;
+    }
+    auto prefetched = m_prefetched.find(index);
+    if (prefetched != m_prefetched.end()) {
+        return prefetched->second;
+    }
+    return load(index);
+}
+
+/*! \brief Advance the clock hand to the next tile to page out, while the stores sharing the budget
+ * hold more than its limit and this one more than its share. Resident tiles used since the hand
+ * last passed get another round instead, so the tiles in use stay.
+ * @param index receives the tile
+ * @return bool false if no more tiles are resident than the budget allows
+ */
+bool TileStore::nextVictim(std::size_t &index) {
+    if (m_budget->getResident() <= m_budget->getLimit()
+        || m_resident.load(std::memory_order_relaxed) <= m_budget->getShare()) {
+        return false;
+    }
+    // Two rounds clear every referenced flag, so one finds a tile unless none is resident
+    for (std::size_t step = 0; step < 2 * m_flags.size(); step++) {
+        const std::size_t tile = m_hand;
+        m_hand = m_hand + 1 < m_flags.size() ? m_hand + 1 : 0;
+        if ((m_flags[tile] & kReferenced) != 0) {
+            m_flags[tile] &= static_cast<std::uint8_t>(~kReferenced);
+        } else if ((m_flags[tile] & kResident) != 0) {
+            index = tile;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*! \brief Take a resident tile out of memory. A tile changed since it was last in the file is
+ * queued to be written back; when writes fall behind by a quarter of the store's share of the
+ * budget, this writes them itself, or waits for the one being written.
+ * @param index the tile
+ * @param tile its pixels, which nobody may write to from now on
+ * @return void
+ */
+void TileStore::pageOut(std::size_t index, TilePtr tile) {
+    const bool changed = (m_flags[index] & kChanged) != 0;
+    m_flags[index] = 0;
+    addResident(-1);
+    m_pagedOutMetric->increment();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_paged[index] = 1;
+    m_pagedCount++;
+    if (!changed) {
+        return;
+    }
+    m_pending[index] = tile;
+    m_queue.push_back(Job{index, std::move(tile)});
+    schedule(lock);
+    const std::size_t backlog = std::max<std::size_t>(m_budget->getShare() / 4, 1);
+    lock.lock();
+    while (m_queue.size() > backlog) {
+        if (m_busy) {
+            m_idle.wait(lock);
+        } else {
+            runJob(lock);
+        }
+    }
+}
+
+/*! \brief Have a paged tile read back in the background, so that its pageIn() does not wait for
+ * the disk. Asks for nothing if the tile is in memory or queued anyway, or a quarter of the store's
+ * share of the budget is read ahead already.
+ * @param index the tile
+ * @return void
+ */
+void TileStore::prefetch(std::size_t index) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_paged[index] == 0 || m_pending.count(index) != 0 || m_prefetched.count(index) != 0
+        || m_prefetched.size() >= std::max<std::size_t>(m_budget->getShare() / 4, 1)) {
+        return;
+    }
+    m_queue.push_back(Job{index, nullptr});
+    schedule(lock);
+}
+
+/*! \brief Wait until every job asked for so far is done, running those still queued here rather
+ * than waiting for the pool to get to them.
+ * @return void
+ */
+void TileStore::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_queue.empty() || m_busy) {
+        if (m_busy) {
+            m_idle.wait(lock);
+        } else {
+            runJob(lock);
+        }
+    }
+}
+
+/*! \brief Number of tiles whose pixels are out in the file.
+ * @return std::size_t the number of tiles
+ */
+std::size_t TileStore::getPagedTiles() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pagedCount;
+}
+
+/*! \brief The background task: run the queued jobs, one at a time, until none is left. A job run
+ * meanwhile by a thread waiting for the queue is waited for, so that jobs keep their order.
+ * @return void
+ */
+void TileStore::drain() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_idle.wait(lock, [this]() { return !m_busy; });
+        if (m_queue.empty()) {
+            m_scheduled = false;
+            return;
+        }
+        runJob(lock);
+    }
+}
+
+/*! \brief Write back or read ahead the tile of the job at the front of the queue. A write which
+ * fails keeps its tile in the queue's map, so its pixels are not lost.
+ * @param lock held on m_mutex, which is released during the I/O; no other job may be running
+ * @return void
+ */
+void TileStore::runJob(std::unique_lock<std::mutex> &lock) {
+    Job job = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_busy = true;
+    if (job.tile != nullptr) {
+        lock.unlock();
+        const bool stored = store(job.index, *job.tile);
+        lock.lock();
+        auto pending = m_pending.find(job.index);
+        // A later write of the same tile replaced this one in the map and is still queued
+        if (stored && pending != m_pending.end() && pending->second == job.tile) {
+            m_pending.erase(pending);
+            m_writtenBackMetric->increment();
+        }
+    } else if (m_paged[job.index] != 0 && m_pending.count(job.index) == 0 && m_prefetched.count(job.index) == 0) {
+        // Nothing writes this tile's slot meanwhile: writes are queued behind this job
+        lock.unlock();
+        TilePtr tile = load(job.index);
+        lock.lock();
+        if (m_paged[job.index] != 0 && m_pending.count(job.index) == 0) {
+            m_prefetched[job.index] = std::move(tile);
+            m_prefetchedMetric->increment();
+        }
+    }
+    m_busy = false;
+    m_idle.notify_all();
+}
+
+/*! \brief Submit a drain() task to the shared pool's background lane unless one is queued or
+ * running already. The task holds the store until it ends. Without workers it runs here, at once.
+ * @param lock held on m_mutex; released before the task is submitted
+ * @return void
+ */
+void TileStore::schedule(std::unique_lock<std::mutex> &lock) {
+    const bool start = !m_scheduled;
+    m_scheduled = true;
+    lock.unlock();
+    if (start) {
+        std::shared_ptr<TileStore> self = shared_from_this();
+        ThreadPool::Get().submit([self]() { self->drain(); }, ThreadPool::Lane::Background);
+    }
+}
+
+/*! \brief Count tiles with pixels of their own coming into memory or leaving it, in this store,
+ * the budget it shares and the tiles.resident metric.
+ * @param delta the change in the number of tiles
+ * @return void
+ */
+void TileStore::addResident(std::int64_t delta) {
+    if (delta >= 0) {
+        m_resident.fetch_add(static_cast<std::size_t>(delta), std::memory_order_relaxed);
+        m_budget->m_resident.fetch_add(static_cast<std::size_t>(delta), std::memory_order_relaxed);
+    } else {
+        m_resident.fetch_sub(static_cast<std::size_t>(-delta), std::memory_order_relaxed);
+        m_budget->m_resident.fetch_sub(static_cast<std::size_t>(-delta), std::memory_order_relaxed);
+    }
+    m_residentMetric->add(delta);
+}
+
+/*! \brief Read a tile's pixels from its slot in the file.
+ * @param index the tile
+ * @return TileStore::TilePtr a new tile with pixels of its own; the background's zeros if it cannot be read
+ */
+TileStore::TilePtr TileStore::load(std::size_t index) {
+    TilePtr tile = std::make_shared<Canvas::Tile>();
+    tile->uniform = false;
+    char *bytes = reinterpret_cast<char *>(tile->pixels);
+    const off_t offset = static_cast<off_t>(index * kSlotBytes);
+    std::size_t done = 0;
+    while (done < kSlotBytes) {
+        const ssize_t count = ::pread(m_file, bytes + done, kSlotBytes - done, offset + static_cast<off_t>(done));
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Could not read tile " << index << " from " << m_path << ": "
+                      << (count < 0 ? std::strerror(errno) : "end of file"));
+            std::memset(bytes + done, 0, kSlotBytes - done);
+            break;
+        }
+        done += static_cast<std::size_t>(count);
+    }
+    return tile;
+}
+
+/*! \brief Write a tile's pixels to its slot in the file.
+ * @param index the tile
+ * @param tile the pixels
+ * @return bool whether all of them were written
+ */
+bool TileStore::store(std::size_t index, const Canvas::Tile &tile) {
+    const char *bytes = reinterpret_cast<const char *>(tile.pixels);
+    const off_t offset = static_cast<off_t>(index * kSlotBytes);
+    std::size_t done = 0;
+    while (done < kSlotBytes) {
+        const ssize_t count = ::pwrite(m_file, bytes + done, kSlotBytes - done, offset + static_cast<off_t>(done));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            LOG_ERROR("Could not write tile " << index << " to " << m_path << ": " << std::strerror(errno));
+            return false;
+        }
+        done += static_cast<std::size_t>(count);
+    }
+    return true;
+}
@@ -7,6 +7,7 @@
 
 #include <SFML/Network.hpp>
 #include "UDPNetworkClient.hpp"
+#include "Logger.hpp"
 #include <iostream>
 
 
@@ -14,7 +15,8 @@
  * Constructor for a UDPNetwork client, with no parameters.
  */
 UDPNetworkClient::UDPNetworkClient() {
-    std::cout << "Default constructor" << std::endl;
+    registerMetrics();
+    LOG_DEBUG("Default constructor");
 }
 
 /*!
@@ -30,6 +32,27 @@ UDPNetworkClient::UDPNetworkClient() {
     socket.bind(m_port);
     // Set socket to be non-blocking
     socket.setBlocking(false);
+    registerMetrics();
+}
+
+/*!
+ * Look up the client's packet and byte metrics in the MetricsRegistry.
+ */
+void UDPNetworkClient::registerMetrics() {
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_packetsIn = &metrics.counter("client.packets_in");
+    m_packetsOut = &metrics.counter("client.packets_out");
+    m_bytesIn = &metrics.counter("client.bytes_in");
+    m_bytesOut = &metrics.counter("client.bytes_out");
+}
+
+/*!
+ * Count one successful send to the server.
+ * @param bytes the size of the data sent
+ */
+void UDPNetworkClient::countSent(std::size_t bytes) {
+    m_packetsOut->increment();
+    m_bytesOut->increment(bytes);
 }
 
 /*!
@@ -45,20 +68,89 @@ UDPNetworkClient::~UDPNetworkClient() {}
  * @return int representing success of join (0 = success)
  */
 int UDPNetworkClient::joinServer(sf::IpAddress ip, unsigned short servPort) {
-    myPacket p;
-    std::cout << "UDPClient will attempt to join server..." << std::endl;
-    p << 0 << 0 << 0 << 0 << 0;
+    LOG_INFO("UDPClient will attempt to join server...");
     serverIpAddress = ip;
     serverPort = servPort;
-    if (socket.send(p, ip, serverPort) != sf::Socket::Done) {
-        std::cout << "Could not join server" << std::endl;
+    // The join packet doubles as the first clock sync request
+    if (syncClock() != 0) {
+        LOG_ERROR("Could not join server");
         return 1;
     } else {
-        std::cout << "Successfully joined!" << std::endl;
+        LOG_INFO("Successfully joined!");
     }
     return 0;
 }
 
+/*!
+ * Send a clock sync request: a command 0 packet stamped with the local send time. The server
+ * answers with its receive and send times (see UDPNetworkServer::sendClockSync).
+ * @return int representing success of sending the request (0 = success)
+ */
+int UDPNetworkClient::syncClock() {
+    myPacket p;
+    m_syncSentAt = monotonicMicros();
+    m_syncTimer.restart();
+    p << PaintMessage{0, 0, 0, 0, 0, m_syncSentAt};
+    if (socket.send(p, serverIpAddress, serverPort) != sf::Socket::Done) {
+        return 1;
+    }
+    countSent(p.getDataSize());
+    return 0;
+}
+
+/*!
+ * If a packet is the reply to our outstanding clock sync request, feed the exchange to the
+ * peer clock. The first reply, the welcome, also gives the size of the session's canvas.
+ * @param in the packet received from the server
+ * @return void
+ */
+void UDPNetworkClient::handleClockSync(const sf::Packet &in) {
+    sf::Packet reply = in;
+    PaintMessage message;
+    sf::Int64 serverReceived = 0;
+    sf::Int64 serverSent = 0;
+    if (!(reply >> message >> serverReceived >> serverSent)) {
+        return;
+    }
+    if (message.command != 0 || m_syncSentAt == 0 || message.stamp != m_syncSentAt) {
+        return;
+    }
+    // Servers which do not say leave x and y 0
+    if (m_canvasWidth == 0 && message.x > 0 && message.y > 0) {
+        m_canvasWidth = static_cast<unsigned>(message.x);
+        m_canvasHeight = static_cast<unsigned>(message.y);
+        m_canvasSizePending = true;
+    }
+    m_clock.addSample(m_syncSentAt, serverReceived, serverSent, monotonicMicros());
+    m_syncSentAt = 0;
+    LOG_DEBUG("Clock offset to server " << m_clock.getOffset() << " us (round trip "
+                                        << m_clock.getRoundTrip() << " us)");
+}
+
+/*!
+ * Method to get the estimated offset between this client's clock and the server's
+ * @return const PeerClock& the client's peer clock
+ */
+const PeerClock &UDPNetworkClient::getClock() const {
+    return m_clock;
+}
+
+/*!
+ * Method to get the size of the session's canvas the server's welcome gave, once
+ * @param width receives the canvas width
+ * @param height receives the canvas height
+ * @return bool whether the size arrived since the last call
+ */
+bool UDPNetworkClient::takeCanvasSize(unsigned &width, unsigned &height) {
+    if (!m_canvasSizePending) {
+        return false;
+    }
+    m_canvasSizePending = false;
+    width = m_canvasWidth;
+    height = m_canvasHeight;
+    return true;
+}
+
 /*!
  * Method to send command data from UDPNetworkClient to server
  * @param p the packet command to be sent to server
@@ -67,14 +159,15 @@ int UDPNetworkClient::joinServer(sf::IpAddress ip, unsigned short servPort) {
 int UDPNetworkClient::sendCommand(myPacket p) {
     try {
         if (socket.send(p, serverIpAddress, serverPort) != sf::Socket::Done) {
-            std::cout << "Client error? Wrong IP?" << std::endl;
+            LOG_WARN("Client error? Wrong IP?");
             return 1;
         } else {
-            std::cout << "Client (" << username << ") sending packet" << std::endl;
+            countSent(p.getDataSize());
+            LOG_DEBUG("Client (" << username << ") sending packet");
         }
     }
     catch (const std::exception &e) {
-        std::cout << "Exception has been caught!" << std::endl;
+        LOG_ERROR("Exception has been caught! " << e.what());
     }
     return 0;
 }
@@ -90,7 +183,8 @@ int UDPNetworkClient::sendString(std::string s) {
     }
     s += " (from " + username + ")";
     if (socket.send(s.c_str(), s.length() + 1, serverIpAddress, serverPort) == sf::Socket::Done) {
-        std::cout << "Client (" << username << ") sending string" << std::endl;
+        countSent(s.length() + 1);
+        LOG_DEBUG("Client (" << username << ") sending string");
     }
     return 0;
 }
@@ -105,8 +199,15 @@ myPacket UDPNetworkClient::receiveData() {
     std::string command = " ";
     sf::IpAddress copyAddress = sf::IpAddress::getLocalAddress();
     unsigned short copyPort = m_port;
+    // Refresh the clock offset every few seconds so drift does not accumulate
+    if (serverPort != 0 && m_syncTimer.getElapsedTime() > sf::seconds(5)) {
+        syncClock();
+    }
     if (socket.receive(in, copyAddress, copyPort) == sf::Socket::Done) {
-        std::cout << "From Server: " << std::endl;
+        m_packetsIn->increment();
+        m_bytesIn->increment(in.getDataSize());
+        LOG_DEBUG("From Server: ");
+        handleClockSync(in);
     }
     return in;
 }
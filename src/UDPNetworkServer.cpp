@@ -6,6 +6,9 @@
  ***********************************************/
 
 #include "UDPNetworkServer.hpp"
+#include "Latency.hpp"
+#include "Logger.hpp"
+#include "Profiler.hpp"
 
 #include <SFML/Network.hpp>
 #include <iostream>
@@ -13,7 +16,11 @@
 /*!
  * Constructor for a UDPNetwork server, with no parameters.
  */UDPNetworkServer::UDPNetworkServer() {
-    std::cout << "Default Constructor" << std::endl;
+    m_opLog = nullptr;
+    m_canvasWidth = 0;
+    m_canvasHeight = 0;
+    registerMetrics();
+    LOG_DEBUG("Default Constructor");
 }
 
 /*!
@@ -25,14 +32,46 @@
     name = n;
     serverIp = address;
     m_port = port;
-    std::cout << "Server Constructor" << std::endl;
+    m_opLog = nullptr;
+    m_canvasWidth = 0;
+    m_canvasHeight = 0;
+    registerMetrics();
+    LOG_DEBUG("Server Constructor");
+}
+
+/*!
+ * Look up the server's packet, byte and client metrics in the MetricsRegistry.
+ */
+void UDPNetworkServer::registerMetrics() {
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    m_packetsIn = &metrics.counter("server.packets_in");
+    m_packetsOut = &metrics.counter("server.packets_out");
+    m_bytesIn = &metrics.counter("server.bytes_in");
+    m_bytesOut = &metrics.counter("server.bytes_out");
+    m_activeClientsMetric = &metrics.gauge("server.active_clients");
+}
+
+/*!
+ * Send a packet to a single client, counting it towards the outbound metrics.
+ * @param p the packet to send
+ * @param ip the client's IP address
+ * @param port the client's port
+ * @return the socket status of the send
+ */
+sf::Socket::Status UDPNetworkServer::sendTo(sf::Packet &p, const sf::IpAddress &ip, unsigned short port) {
+    sf::Socket::Status status = sock.send(p, ip, port);
+    if (status == sf::Socket::Done) {
+        m_packetsOut->increment();
+        m_bytesOut->increment(p.getDataSize());
+    }
+    return status;
 }
 
 /*!
  * Default destructor for UDPNetworkServer
  */
 UDPNetworkServer::~UDPNetworkServer() {
-    std::cout << "Server Destructor" << std::endl;
+    LOG_DEBUG("Server Destructor");
 }
 
 /*!
@@ -40,10 +79,10 @@ UDPNetworkServer::~UDPNetworkServer() {
  * @return int representing success of operation (0 = success)
  */
 int UDPNetworkServer::start() {
-    std::cout << "Starting UDP Network Server" << std::endl;
+    LOG_INFO("Starting UDP Network Server");
     int status;
     if (status == (sock.bind(m_port) != sf::Socket::Done)) {
-        std::cout << "Error! Unable to bind. " << status << std::endl;
+        LOG_ERROR("Error! Unable to bind. " << status);
         return status;
     }
     m_status = true;
@@ -56,6 +95,7 @@ int UDPNetworkServer::start() {
  * @return myPacket data packet
  */
 myPacket UDPNetworkServer::listener() {
+    PROFILE_FUNCTION();
     // Set our boolean flag to true and create non-blocking
     // UDP server
 
@@ -64,23 +104,34 @@ myPacket UDPNetworkServer::listener() {
     sf::IpAddress senderIp;
     unsigned short senderPort;
     if (sock.receive(in, senderIp, senderPort) == sf::Socket::Done) {
-        std::cout << "From Client: " << std::endl;
+        sf::Int64 receivedAt = monotonicMicros();
+        m_packetsIn->increment();
+        m_bytesIn->increment(in.getDataSize());
+        LOG_DEBUG("From Client: ");
         flag = true;
+        sf::Packet header = in;
+        PaintMessage message;
+        header >> message;
         std::map<unsigned short, sf::IpAddress>::iterator clientIter;
         clientIter = activeClients.find(senderPort);
         if (clientIter == activeClients.end()) {
-            std::cout << "First time joiner!" << std::endl;
-            clientJoining(senderPort, senderIp);
+            LOG_INFO("First time joiner!");
+            clientJoining(senderPort, senderIp, message.stamp, receivedAt);
             activeClients[senderPort] = senderIp;
+            m_activeClientsMetric->set(static_cast<std::int64_t>(activeClients.size()));
+        } else if (message.command == 0) {
+            sendClockSync(senderPort, senderIp, message.stamp, receivedAt);
         }
 
+        // Join and clock sync requests are only meant for the server
         std::map<unsigned short, sf::IpAddress>::iterator ipIter;
-        for (ipIter = activeClients.begin(); ipIter != activeClients.end(); ipIter++) {
+        for (ipIter = activeClients.begin(); ipIter != activeClients.end() && message.command != 0; ipIter++) {
             if (senderPort != ipIter->first) {
-                std::cout << "recieved and sending data to" << ipIter->first << std::endl;
-                sock.send(in, ipIter->second, ipIter->first);
+                LOG_DEBUG("recieved and sending data to" << ipIter->first);
+                sendTo(in, ipIter->second, ipIter->first);
             }
         }
+        logOperation(in, message);
     }
     return in;
 }
@@ -91,34 +142,57 @@ myPacket UDPNetworkServer::listener() {
  * @return an int representing success of the operation (success = 0)
  */
 int UDPNetworkServer::send(myPacket p) {
-    unsigned short senderPort;
+    PaintMessage message;
+    sf::Packet header = p;
+    header >> message;
+    logOperation(p, message);
     std::map<unsigned short, sf::IpAddress>::iterator ipIter;
     for (ipIter = activeClients.begin(); ipIter != activeClients.end(); ipIter++) {
-        std::cout << "sending data to" << ipIter->first << std::endl;
-        sock.send(p, ipIter->second, ipIter->first);
+        LOG_DEBUG("sending data to" << ipIter->first);
+        sendTo(p, ipIter->second, ipIter->first);
     }
     return 0;
 }
 
 /*!
- * Method to handle a client joining the server
+ * Method to handle a client joining the server. The welcome packet is also the reply to the
+ * client's first clock sync request, and tells the client the size of the canvas.
  * @param clientPort the client's port
  * @param clientIp the client's IP address
+ * @param requestSent the client's send time from the join packet (client clock)
+ * @param requestReceived when the join packet arrived (server clock)
  * @return an int representing success of the operation (success = 0)
  */
-int UDPNetworkServer::clientJoining(unsigned short clientPort, sf::IpAddress clientIp) {
-    std::cout << "Updating new client" << std::endl;
-    myPacket p;
-    p << 0 << 0 << 0 << 0 << 0;
-    if (sock.send(p, clientIp, clientPort) != sf::Socket::Done) {
-        std::cout << "Could not update new client" << std::endl;
+int UDPNetworkServer::clientJoining(unsigned short clientPort, sf::IpAddress clientIp, sf::Int64 requestSent,
+                                    sf::Int64 requestReceived) {
+    LOG_INFO("Updating new client");
+    if (sendClockSync(clientPort, clientIp, requestSent, requestReceived) != sf::Socket::Done) {
+        LOG_ERROR("Could not update new client");
         return 1;
     } else {
-        std::cout << "Successfully updated new client!" << std::endl;
+        LOG_INFO("Successfully updated new client!");
     }
     return 0;
 }
 
+/*!
+ * Method to answer a clock sync request. The reply echoes the client's send time and adds when
+ * the server received the request and when it sent the reply, which is everything the client
+ * needs to estimate the offset between the two clocks. Its x and y are the canvas's size.
+ * @param clientPort the client's port
+ * @param clientIp the client's IP address
+ * @param requestSent the client's send time from the request (client clock)
+ * @param requestReceived when the request arrived (server clock)
+ * @return the socket status of the send
+ */
+sf::Socket::Status UDPNetworkServer::sendClockSync(unsigned short clientPort, sf::IpAddress clientIp,
+                                                   sf::Int64 requestSent, sf::Int64 requestReceived) {
+    myPacket p;
+    p << PaintMessage{0, static_cast<int>(m_canvasWidth), static_cast<int>(m_canvasHeight), 0, 0, requestSent}
+      << requestReceived << static_cast<sf::Int64>(monotonicMicros());
+    return sendTo(p, clientIp, clientPort);
+}
+
 /*!
  * Method to stop the server
  * @return an int representing success of the operation (success = 0)
@@ -134,10 +208,43 @@ int UDPNetworkServer::stop() {
  * @return an int representing success of the operation (success = 0)
  */
 int UDPNetworkServer::clientLeaving() {
-    std::cout << "Client has left!" << std::endl;
+    LOG_INFO("Client has left!");
     return 0;
 }
 
+/*!
+ * Method to log every operation from now on. The server is the one place every operation passes
+ * through, so the order of the log is the order peers apply them in, and replaying it rebuilds the
+ * canvas. The log is not owned and must outlive the server's use of it.
+ * @param log the op log, or nullptr to stop logging
+ */
+void UDPNetworkServer::setOpLog(OpLog *log) {
+    m_opLog = log;
+}
+
+/*!
+ * Method to set the size of the session's canvas. Every peer must paint on a canvas of the same
+ * size for the same messages to give the same drawing, so clients take this one when they join.
+ * @param width the canvas width
+ * @param height the canvas height
+ */
+void UDPNetworkServer::setCanvasSize(unsigned width, unsigned height) {
+    m_canvasWidth = width;
+    m_canvasHeight = height;
+}
+
+/*!
+ * Append a packet to the op log if it is an operation. Joins and clock syncs (command 0) are not.
+ * The packet's bytes are logged as they are, so replay reads them as any peer would.
+ * @param p the packet
+ * @param message the packet decoded
+ */
+void UDPNetworkServer::logOperation(const sf::Packet &p, const PaintMessage &message) {
+    if (m_opLog != nullptr && message.command != 0 && p.getDataSize() > 0) {
+        m_opLog->append(p.getData(), p.getDataSize());
+    }
+}
+
 /*!
  * Method to set server username
  * @param new_name the new username
@@ -9,16 +9,33 @@
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Network.hpp>
 // Include standard library C++ libraries.
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <typeinfo>
 #include <stdlib.h>
+#include <cstdlib>
+#include <vector>
 // Project header files
 #include "App.hpp"
 #include "Command.hpp"
 #include "Draw.hpp"
 #include "FillDisplay.hpp"
+#include "FloodFill.hpp"
+#include "HistoryTimeline.hpp"
+#include "LayerCommand.hpp"
+#include "Latency.hpp"
+#include "Logger.hpp"
+#include "Metrics.hpp"
 #include "Packet.hpp"
+#include "OpLog.hpp"
+#include "Profiler.hpp"
+#include "ProjectFile.hpp"
+#include "SessionRecording.hpp"
+#include "StrokeSimplifier.hpp"
+#include "ThreadPool.hpp"
 #include "UDPNetworkServer.hpp"
 #include "UDPNetworkClient.hpp"
 
@@ -46,7 +63,60 @@
 *
 */
 void initialization(void){
-    std::cout << "Starting the App" << std::endl;
+    LOG_INFO("Starting the App");
+}
+
+/*! \brief 	Timestamp for input captured now, on the server's clock. The server's own clock is the
+ * reference; clients convert using the offset estimated during the join handshake.
+ * @param minipaint the App capturing the input
+ * @return sf::Int64 the capture time in microseconds on the server's clock
+*
+*/
+sf::Int64 captureStamp(App* minipaint) {
+    std::int64_t now = monotonicMicros();
+    if (minipaint->isServer) {
+        return now;
+    }
+    return minipaint->appClient->getClock().toServerTime(now);
+}
+
+/*! \brief 	Convert a capture stamp from a packet back to this machine's clock.
+ * @param minipaint the App which received the stamp
+ * @param stamp the capture time on the server's clock
+ * @return std::int64_t the capture time on the local clock
+*
+*/
+std::int64_t localCaptureTime(App* minipaint, sf::Int64 stamp) {
+    if (minipaint->isServer) {
+        return stamp;
+    }
+    return minipaint->appClient->getClock().toLocalTime(stamp);
+}
+
+// Defined below; applies a packet to the App
+void packetHandler(App* minipaint, myPacket p, bool remote = false);
+
+/*!
+ * \brief The recorder of this session's messages; open only if PAINT_RECORD_FILE is set.
+ * @return SessionRecorder & the recorder, static so that it is closed during exit()
+ */
+SessionRecorder &sessionRecorder() {
+    static SessionRecorder recorder;
+    return recorder;
+}
+
+/*! \brief 	Write a message from the user at this App into a packet, tagged with their client id and
+ * the layer they paint on.
+ * @param minipaint the App whose user the message is from
+ * @param p the packet to write into
+ * @param message the message to write
+ * @return void
+*
+*/
+void writeMessage(App* minipaint, myPacket &p, PaintMessage message) {
+    message.client = minipaint->GetLocalClient();
+    message.layer = minipaint->GetActiveLayer();
+    p << message;
 }
 
 /*! \brief 	Send package to either the client or to the server.
@@ -63,6 +133,161 @@ void packetSender(App* minipaint, myPacket p) {
     }
 }
 
+/*!
+ * /brief Send a change of one layer to every peer; it is applied here when the packet is handled.
+ * @param minipaint the App whose user changes the layer
+ * @param p the packet to write into
+ * @param kind what to change
+ * @param layer the layer id
+ * @param value the new position, opacity or blend mode
+ * @return void
+ */
+void sendLayerChange(App *minipaint, myPacket &p, LayerCommand::Kind kind, int layer, int value) {
+    writeMessage(minipaint, p, PaintMessage{8, static_cast<int>(kind), layer, value, 0});
+    packetSender(minipaint, p);
+}
+
+/*!
+ * /brief Draw the layer controls: add a layer above the active one, move the active layer up or
+ * down, pick the layer to paint on (cycling from the bottom), and set its blend mode and opacity.
+ * @param minipaint the App whose layers are shown
+ * @param ctx context for Nuklear
+ * @param p the packet to write a layer change into
+ * @return void
+ */
+void drawLayerControls(App *minipaint, struct nk_context *ctx, myPacket &p) {
+    LayerStack &layers = minipaint->GetLayers();
+    LayerStack::Layer *active = layers.find(minipaint->GetActiveLayer());
+    int index = layers.indexOf(minipaint->GetActiveLayer());
+    if (active == nullptr || index < 0) {
+        minipaint->SelectLayer(LayerStack::kBaseLayer);
+        return;
+    }
+    if (nk_button_label(ctx, "+ layer")) {
+        int id = minipaint->NewLayerId();
+        if (id < 0) {
+            LOG_WARN("No layer added: every layer id of this client is in use");
+        } else {
+            sendLayerChange(minipaint, p, LayerCommand::Kind::Add, id, index + 1);
+        }
+    }
+    if (nk_button_label(ctx, "layer up")) {
+        sendLayerChange(minipaint, p, LayerCommand::Kind::Move, active->id, index + 1);
+    }
+    if (nk_button_label(ctx, "layer down") && index > 0) {
+        sendLayerChange(minipaint, p, LayerCommand::Kind::Move, active->id, index - 1);
+    }
+    char label[32];
+    std::snprintf(label, sizeof(label), "layer %d/%d", index + 1, static_cast<int>(layers.size()));
+    if (nk_button_label(ctx, label)) {
+        minipaint->SelectLayer(layers.at((index + 1) % layers.size()).id);
+    }
+    if (nk_button_label(ctx, BlendKernels::getName(active->blend))) {
+        int next = (static_cast<int>(active->blend) + 1) % static_cast<int>(BlendMode::Count);
+        sendLayerChange(minipaint, p, LayerCommand::Kind::Blend, active->id, next);
+    }
+    int opacity = active->opacity;
+    if (nk_slider_int(ctx, 0, &opacity, 255, 8) && opacity != active->opacity) {
+        sendLayerChange(minipaint, p, LayerCommand::Kind::Opacity, active->id, opacity);
+    }
+}
+
+// What the windows show while the user scrubs through the timeline instead of the live drawing
+struct HistoryView {
+    // Frame shown, or -1 for the live drawing
+    int frame = -1;
+    Canvas image;
+    sf::Texture texture;
+    sf::Sprite sprite;
+};
+
+/*!
+ * \brief The history view of this session.
+ * @return HistoryView & the view, static so that it lives as long as the windows
+ */
+HistoryView &historyView() {
+    static HistoryView view;
+    return view;
+}
+
+/*!
+ * \brief Draw the time-lapse controls: a slider over the timeline's frames, whose last position
+ * follows the live drawing, a button back to the live drawing and one which exports the frames
+ * to PAINT_TIMELINE_EXPORT (default timelapse_) in the background, unless an export still runs. The
+ * export holds the timeline, so it finishes even if the App is destroyed first. Showing a frame
+ * only reads the timeline; painting and the network carry on with the live drawing meanwhile.
+ * @param minipaint the App whose timeline is shown
+ * @param ctx context for Nuklear
+ * @return void
+ */
+void drawHistoryControls(App *minipaint, struct nk_context *ctx) {
+    std::shared_ptr<HistoryTimeline> timeline = minipaint->GetTimeline();
+    if (timeline == nullptr) {
+        return;
+    }
+    HistoryView &view = historyView();
+    const int frames = static_cast<int>(timeline->getFrameCount());
+    if (frames == 0) {
+        return;
+    }
+    // With paging on, the frame shown pages under the drawing's budget like everything else
+    std::string error;
+    const std::shared_ptr<TileBudget> &budget = minipaint->GetLayers().getTileBudget();
+    if (budget != nullptr && view.image.getTileBudget() != budget
+        && !view.image.enablePaging(minipaint->GetLayers().getPagingDirectory(), budget, error)) {
+        LOG_WARN("The time-lapse frame shown stays in memory: " << error);
+    }
+    nk_layout_row_dynamic(ctx, 30, 3);
+    int frame = view.frame < 0 ? frames - 1 : view.frame;
+    if (nk_slider_int(ctx, 0, &frame, frames - 1, 1)) {
+        if (frame == frames - 1) {
+            view.frame = -1;
+        } else if (frame != view.frame && timeline->seek(static_cast<std::size_t>(frame), view.image)) {
+            view.frame = frame;
+            minipaint->UploadView(view.image, view.texture);
+            view.image.trimTiles();
+            view.sprite.setTexture(view.texture, true);
+        }
+    }
+    if (nk_button_label(ctx, view.frame < 0 ? "live" : "back to live")) {
+        view.frame = -1;
+    }
+    if (nk_button_label(ctx, "export time-lapse")) {
+        const char *prefix = std::getenv("PAINT_TIMELINE_EXPORT");
+        const std::string path = prefix != nullptr ? prefix : "timelapse_";
+        // Claimed here, not in the task, so that a second click before the task starts is refused
+        if (!timeline->tryBeginExport()) {
+            LOG_WARN("The time-lapse is still being exported");
+            return;
+        }
+        ThreadPool::Get().submit([timeline, path]() {
+            // Frames may have been dropped since the click
+            const std::size_t frames = timeline->getFrameCount();
+            if (frames == 0) {
+                timeline->cancelExport();
+                LOG_WARN("The time-lapse has no frames left to export");
+                return;
+            }
+            std::string error;
+            if (!timeline->exportClaimedFrames(0, frames - 1, 1, path, error)) {
+                LOG_ERROR("Could not export the time-lapse: " << error);
+            } else {
+                LOG_INFO("Exported " << frames << " frames to " << path << "*.ppm");
+            }
+        });
+    }
+}
+
+/*!
+ * \brief The project file the drawing is saved to and loaded from: PAINT_PROJECT_FILE, or drawing.cpnt
+ * in the working directory.
+ * @return std::string the path
+ */
+std::string projectPath() {
+    const char *path = std::getenv("PAINT_PROJECT_FILE");
+    return path != nullptr ? path : "drawing.cpnt";
+}
+
 /*!
  * /brief The drawLayout function processes user interactions with buttons in the GUI.
  * It updates the paintbrush color and size, undoes/redoes an action,
@@ -73,26 +298,33 @@ void packetSender(App* minipaint, myPacket p) {
  * @return Packet storing command
  */
 myPacket drawLayout(App *minipaint, struct nk_context *ctx, struct nk_colorf &bg) {
+    PROFILE_FUNCTION();
     myPacket p;
     int command;
 
-    if (nk_begin(ctx, "Minipaint App", nk_rect(0, 0, 1000, 150),
+    if (nk_begin(ctx, "Minipaint App", nk_rect(0, 0, 1000, 225),
                  NK_WINDOW_BORDER | NK_WINDOW_MOVABLE | NK_WINDOW_SCALABLE |
                  NK_WINDOW_MINIMIZABLE | NK_WINDOW_TITLE)) {
-        /* fixed widget pixel width for undo or redo command */
-        nk_layout_row_static(ctx, 30, 80, 2);
+        /* fixed widget pixel width for undo or redo command, the bucket tool and the layers */
+        nk_layout_row_static(ctx, 30, 80, 10);
         // Create packet for undo command
         if (nk_button_label(ctx, "undo")) {
             command = 3;
-            p << command << 0 << 0 << 0 << 0;
+            writeMessage(minipaint, p, PaintMessage{command, 0, 0, 0, 0});
             packetSender(minipaint, p);
         }
         // Create packet for redo command
         if (nk_button_label(ctx, "redo")) {
             command = 4;
-            p << command << 0 << 0 << 0 << 0;
+            writeMessage(minipaint, p, PaintMessage{command, 0, 0, 0, 0});
             packetSender(minipaint, p);
         }
+        // Switch between the brush and the bucket (flood fill) tool, and set the bucket's tolerance
+        if (nk_button_label(ctx, minipaint->bucketTool ? "brush" : "bucket")) {
+            minipaint->bucketTool = !minipaint->bucketTool;
+        }
+        nk_slider_int(ctx, 0, &minipaint->fillTolerance, 255, 1);
+        drawLayerControls(minipaint, ctx, p);
 
         /* fixed widget pixel width for setting brush size */
         nk_layout_row_dynamic(ctx, 30, 6);
@@ -111,19 +343,36 @@ myPacket drawLayout(App *minipaint, struct nk_context *ctx, struct nk_colorf &bg
                 minipaint->strokeSize--;
             }
         }
-        if (nk_button_label(ctx, "+")) {
+        if (nk_button_label(ctx, "+") && minipaint->strokeSize < PaintMessage::kMaxBrushSize) {
             minipaint->strokeSize++;
         }
         // Send packet for fill command
         if (nk_button_label(ctx, "fill")) {
             command = 5;
-            p << command << 0 << 0 << minipaint->getColor() << 0;
+            writeMessage(minipaint, p, PaintMessage{command, 0, 0, minipaint->getColor(), 0});
             packetSender(minipaint, p);
-            minipaint->GetTexture().loadFromImage(minipaint->GetImage());
+            minipaint->UploadCanvas();
+        }
+
+        // Switch between the square and the round brush, and set the round brush's hardness and opacity
+        nk_layout_row_dynamic(ctx, 30, 3);
+        BrushTip tip = minipaint->brushTip;
+        if (nk_button_label(ctx, tip.id == BrushId::Round ? "square brush" : "round brush")) {
+            tip.id = tip.id == BrushId::Round ? BrushId::Square : BrushId::Round;
+        }
+        int hardness = tip.hardness;
+        nk_slider_int(ctx, 0, &hardness, 255, 1);
+        tip.hardness = static_cast<std::uint8_t>(hardness);
+        int opacity = tip.opacity;
+        nk_slider_int(ctx, 1, &opacity, 255, 1);
+        tip.opacity = static_cast<std::uint8_t>(opacity);
+        // Only a change of tip switches to the brush engine, so a custom paint function stays in use
+        if (!(tip == minipaint->brushTip)) {
+            minipaint->UpdatePaintbrush(tip);
         }
 
         /* fixed widget window ratio width */
-        nk_layout_row_dynamic(ctx, 30, 6);
+        nk_layout_row_dynamic(ctx, 30, 7);
         if (nk_button_label(ctx, "black")) {
             minipaint->m_color = sf::Color::Black;
         }
@@ -140,61 +389,307 @@ myPacket drawLayout(App *minipaint, struct nk_context *ctx, struct nk_colorf &bg
             minipaint->m_color = sf::Color::Blue;
         }
         if (nk_button_label(ctx, "eraser")) {
-            minipaint->m_color = minipaint->m_canvas;
+            minipaint->m_color = minipaint->EraserColor();
+        }
+        // Save in the background; the GUI carries on while the file is written
+        if (nk_button_label(ctx, "save")) {
+            minipaint->SaveProject(projectPath());
         }
+        drawHistoryControls(minipaint, ctx);
 
     }
     nk_end(ctx);
-    minipaint->GetTexture().loadFromImage(minipaint->GetImage());
-    minipaint->GetSprite().setTexture(minipaint->GetTexture());
+    {
+        PROFILE_ZONE("texture upload");
+        minipaint->UploadCanvas();
+    }
 
     return p;
 }
 
 /*!
- * \brief The paint function takes an App and a color, and paints the app's window with the specified color.
- * The paint function is sensitive to the app's paintbrush size and will paint neighboring pixels of the mouse
- * position, so that the proper diameter of brushstroke is applied.
- * @param minipaint the App to paint upon
- * @param color the color to be painted with
- * @param radius the radius of the brushstroke
- * @param m_x the x-value of the central pixel for this paint action
- * @param m_y the y-value of the central pixel for this paint action
- * @return std::map<std::pair<int, int>, sf::Color> a map of the affected pixel colors prior to paint action
- *
+ * \brief Send the stroke segments kept by the stroke simplifier and paint them locally, in the
+ * current color and brush size.
+ * @param minipaint the App whose stroke is being drawn
+ * @param segments the segments to send
+ * @return void
  */
-std::map<std::pair<int, int>, sf::Color> paint(App *minipaint, sf::Color color, int radius, int m_x, int m_y) {
-    std::map<std::pair<int, int>, sf::Color> priorPixelValues;
-    for (int i = m_x - radius; i < m_x + radius; i++) {
-        for (int j = m_y - radius; j < m_y + radius; j++) {
-            if (minipaint->GetSprite().getGlobalBounds().contains(i, j)) {
-                priorPixelValues[std::make_pair(i, j)] = minipaint->GetImage().getPixel(i, j);
-                minipaint->GetImage().setPixel(i, j, color);
-            }
-        }
+void sendStrokeSegments(App* minipaint, const std::vector<StrokeSimplifier::Segment> &segments) {
+    for (const StrokeSimplifier::Segment &segment : segments) {
+        myPacket p;
+        PaintMessage message{1, segment.x, segment.y, minipaint->getColor(), minipaint->strokeSize, segment.stamp};
+        message.fromX = segment.fromX;
+        message.fromY = segment.fromY;
+        message.brush = minipaint->brushTip.pack();
+        writeMessage(minipaint, p, message);
+        packetSender(minipaint, p);
+        packetHandler(minipaint, p);
+    }
+    if (!segments.empty()) {
+        minipaint->UploadCanvas();
     }
-    return priorPixelValues;
 }
 
 /*!
- * \brief Similar to the paint function, this will allow for each participant to receive information to be drawn.
- * @param minipaint the App to paint upon
- * @param color the color to draw with
- * @param m_x the central pixel of the draw action
- * @param m_y the central pixel of the draw action
- * @return std::map<std::pair<int, int>, sf::Color> map of the affected pixels' colors prior to this action
- *
+ * \brief Send the held samples of the local stroke which have waited past the simplifier's delay bound.
+ * @param minipaint the App whose stroke is being drawn
+ * @return void
  */
-std::map<std::pair<int, int>, sf::Color> receivePaint(App* minipaint, sf::Color color, int m_x, int m_y) {
-    std::map<std::pair<int, int>, sf::Color> priorPixelValues;
-    for (int i = m_x - minipaint->receivedSize; i < m_x + minipaint->receivedSize; i++) {
-        for (int j = m_y -minipaint->receivedSize; j < m_y + minipaint->receivedSize; j++) {
-            if (minipaint->GetSprite().getGlobalBounds().contains(i, j)) {
-                minipaint->GetImage().setPixel(i, j, color);
-            }
+void pollStroke(App* minipaint) {
+    std::vector<StrokeSimplifier::Segment> segments;
+    minipaint->GetStrokeSimplifier().poll(monotonicMicros(), segments);
+    sendStrokeSegments(minipaint, segments);
+}
+
+/*!
+ * \brief Configure the stroke simplifier from PAINT_STROKE_TOLERANCE (pixels a dropped sample may
+ * stray from the sent stroke, 0 to send every sample off the line) and PAINT_STROKE_MAX_DELAY_MS
+ * (longest a sample may be held back).
+ * @param minipaint the App to configure
+ * @return void
+ */
+void configureStrokeSimplifier(App* minipaint) {
+    const char *tolerance = std::getenv("PAINT_STROKE_TOLERANCE");
+    const char *maxDelay = std::getenv("PAINT_STROKE_MAX_DELAY_MS");
+    if (tolerance != nullptr) {
+        minipaint->GetStrokeSimplifier().setTolerance(std::atof(tolerance));
+    }
+    if (maxDelay != nullptr) {
+        minipaint->GetStrokeSimplifier().setMaxDelay(std::atoll(maxDelay) * 1000);
+    }
+}
+
+/*!
+ * \brief Load the project file, if there is one of the canvas's size. The load time is logged.
+ * @param minipaint the App to load into
+ * @return void
+ */
+void loadProject(App* minipaint) {
+    ProjectReader reader;
+    if (!reader.open(projectPath())) {
+        return;
+    }
+    if (reader.getInfo().width != minipaint->canvasWidth || reader.getInfo().height != minipaint->canvasHeight) {
+        LOG_WARN("Not loading " << projectPath() << ": its canvas is " << reader.getInfo().width << "x"
+                 << reader.getInfo().height);
+        return;
+    }
+    std::string error;
+    if (!minipaint->LoadProject(projectPath(), error)) {
+        LOG_ERROR("Could not load " << projectPath() << ": " << error);
+    }
+}
+
+/*!
+ * \brief Autosave the drawing, if PAINT_AUTOSAVE_FILE or PAINT_AUTOSAVE_SECONDS is set, every
+ * PAINT_AUTOSAVE_SECONDS seconds (default 5, 0 for never) to PAINT_AUTOSAVE_FILE and its journal,
+ * and recover what a previous session autosaved there. The file defaults to one per instance,
+ * drawing-<client id>.autosave, so peers on one machine never share a journal. Without an
+ * autosave to recover, the project file is loaded.
+ * @param minipaint the App to configure
+ * @param restore whether to restore the drawing, or keep it (e.g. rebuilt from the op log, or
+ * joined from a session)
+ * @return void
+ */
+void configureAutosave(App* minipaint, bool restore) {
+    const char *path = std::getenv("PAINT_AUTOSAVE_FILE");
+    const char *seconds = std::getenv("PAINT_AUTOSAVE_SECONDS");
+    const long long interval = seconds != nullptr ? std::atoll(seconds) : path != nullptr ? 5 : 0;
+    if (interval <= 0) {
+        if (restore) {
+            loadProject(minipaint);
         }
+        return;
+    }
+    const std::string file = path != nullptr ? path : "drawing-" + std::to_string(minipaint->GetLocalClient()) +
+                                                      ".autosave";
+    minipaint->EnableAutosave(file, std::chrono::seconds(interval));
+    std::string error;
+    if (restore && !minipaint->RecoverAutosave(error)) {
+        LOG_INFO("No autosave recovered: " << error);
+        loadProject(minipaint);
+    }
+}
+
+/*!
+ * \brief On the server, log every operation to the op log at PAINT_OPLOG, if set, after rebuilding
+ * the drawing from what the log already holds. PAINT_OPLOG_FLUSH_MS is the group commit interval
+ * (default 10), PAINT_OPLOG_SEGMENT_MB the segment size (default 64) and PAINT_OPLOG_DURABLE=0
+ * skips fdatasync.
+ * @param minipaint the App to configure
+ * @return bool whether the drawing was rebuilt from the log
+ */
+bool configureOpLog(App* minipaint) {
+    // Static so that it is flushed and closed during exit()
+    static std::unique_ptr<OpLog> opLog;
+    const char *prefix = std::getenv("PAINT_OPLOG");
+    if (!minipaint->isServer || prefix == nullptr) {
+        return false;
+    }
+    const char *flushMs = std::getenv("PAINT_OPLOG_FLUSH_MS");
+    const char *segmentMb = std::getenv("PAINT_OPLOG_SEGMENT_MB");
+    const char *durable = std::getenv("PAINT_OPLOG_DURABLE");
+    OpLog::Options options;
+    if (flushMs != nullptr) {
+        options.flushInterval = std::chrono::milliseconds(std::max(1LL, std::atoll(flushMs)));
+    }
+    if (segmentMb != nullptr) {
+        options.segmentBytes = static_cast<std::uint64_t>(std::max(1LL, std::atoll(segmentMb))) * 1024 * 1024;
+    }
+    options.durable = durable == nullptr || std::atoi(durable) != 0;
+    const bool replayed = minipaint->ReplayOpLog(prefix) > 0;
+    opLog.reset(new OpLog(prefix, options));
+    minipaint->appServer->setOpLog(opLog.get());
+    return replayed;
+}
+
+/*!
+ * \brief Keep a time-lapse of the drawing for the history slider, with a keyframe every
+ * PAINT_TIMELINE_KEYFRAMES frames (default 64; 0 turns the time-lapse off), in at most
+ * PAINT_TIMELINE_MB megabytes (default 64) before the oldest frames are dropped.
+ * @param minipaint the App to configure
+ * @return void
+ */
+void configureTimeline(App* minipaint) {
+    const char *keyframes = std::getenv("PAINT_TIMELINE_KEYFRAMES");
+    const char *megabytes = std::getenv("PAINT_TIMELINE_MB");
+    const long long interval = keyframes != nullptr ? std::atoll(keyframes) : 64;
+    const long long budget = megabytes != nullptr ? std::max(1LL, std::atoll(megabytes)) : 64;
+    if (interval > 0) {
+        minipaint->EnableTimeline(static_cast<std::size_t>(interval),
+                                  static_cast<std::uint64_t>(budget) * 1024 * 1024);
+    }
+}
+
+/*!
+ * \brief Record every message this session applies to PAINT_RECORD_FILE, if set, for the replay
+ * tool (App_Replay). A recording replays onto a blank canvas, so while recording the drawing is
+ * not restored from the autosave or the project file.
+ * @param minipaint the App to record
+ * @return bool whether the session is being recorded
+ */
+bool configureSessionRecording(App* minipaint) {
+    const char *path = std::getenv("PAINT_RECORD_FILE");
+    if (path == nullptr) {
+        return false;
+    }
+    const Canvas &canvas = minipaint->GetFlattened();
+    if (!sessionRecorder().open(path, canvas.getWidth(), canvas.getHeight(), minipaint->GetLocalClient(),
+                                monotonicMicros())) {
+        return false;
+    }
+    LOG_INFO("Recording the session to " << path);
+    return true;
+}
+
+/*!
+ * \brief Cap the memory held by the undo and redo history at PAINT_HISTORY_BUDGET_MB megabytes, if set.
+ * The oldest actions are released beyond it.
+ * @param minipaint the App to configure
+ * @return void
+ */
+void configureHistoryBudget(App* minipaint) {
+    const char *budget = std::getenv("PAINT_HISTORY_BUDGET_MB");
+    if (budget != nullptr) {
+        minipaint->SetHistoryBudget(static_cast<std::size_t>(std::atoll(budget)) * 1024 * 1024);
+    }
+}
+
+/*!
+ * \brief Make the canvas PAINT_CANVAS_SIZE (e.g. 8192x8192, at most 65536 a side) instead of the
+ * window's size. The windows then show a part of it, which the arrow keys move. The server's size
+ * is the session's: a client takes it when it joins, whatever it set (see adoptCanvasSize()).
+ * @param minipaint the App to configure
+ * @return void
+ */
+void configureCanvasSize(App* minipaint) {
+    const char *size = std::getenv("PAINT_CANVAS_SIZE");
+    unsigned width = 0;
+    unsigned height = 0;
+    if (size == nullptr) {
+        return;
+    }
+    if (std::sscanf(size, "%ux%u", &width, &height) != 2 || width == 0 || height == 0) {
+        LOG_WARN("Ignoring PAINT_CANVAS_SIZE " << size << ": expected WIDTHxHEIGHT");
+        return;
+    }
+    minipaint->canvasWidth = std::min(width, Canvas::kMaxSize);
+    minipaint->canvasHeight = std::min(height, Canvas::kMaxSize);
+    LOG_INFO("Canvas is " << minipaint->canvasWidth << "x" << minipaint->canvasHeight);
+}
+
+/*!
+ * \brief On a client, take the size of the session's canvas from the server's welcome, once it
+ * arrives. Every peer applies the same messages, which only give the same drawing on canvases of
+ * the same size, so a client started with another size recreates its canvas, blank, at the
+ * server's. The welcome answers the join, before the user has drawn anything that matters.
+ * @param minipaint the App of the client
+ * @return void
+ */
+void adoptCanvasSize(App* minipaint) {
+    unsigned width = 0;
+    unsigned height = 0;
+    if (!minipaint->appClient->takeCanvasSize(width, height)) {
+        return;
+    }
+    width = std::min(width, Canvas::kMaxSize);
+    height = std::min(height, Canvas::kMaxSize);
+    const Canvas &canvas = minipaint->GetFlattened();
+    if (width == canvas.getWidth() && height == canvas.getHeight()) {
+        return;
+    }
+    LOG_WARN("Using the session's " << width << "x" << height << " canvas instead of " << canvas.getWidth() << "x"
+             << canvas.getHeight());
+    minipaint->ResizeCanvas(width, height);
+}
+
+/*!
+ * \brief Keep only PAINT_TILE_CACHE_MB megabytes of tiles in memory, if set, shared by every layer,
+ * the image shown and the time-lapse; the others are paged out to files in PAINT_TILE_DIR (default
+ * /tmp), which are removed on exit. For canvases larger than memory, e.g. 32768x32768 posters.
+ * @param minipaint the App to configure
+ * @return void
+ */
+void configureTilePaging(App* minipaint) {
+    const char *megabytes = std::getenv("PAINT_TILE_CACHE_MB");
+    const char *directory = std::getenv("PAINT_TILE_DIR");
+    if (megabytes == nullptr || std::atoll(megabytes) <= 0) {
+        return;
+    }
+    std::string error;
+    if (!minipaint->EnableTilePaging(directory != nullptr ? directory : "/tmp",
+                                     static_cast<std::size_t>(std::atoll(megabytes)) * 1024 * 1024, error)) {
+        LOG_WARN("Keeping every tile in memory: " << error);
+    }
+}
+
+/*!
+ * \brief Scroll the view a quarter of its size in the direction of an arrow key, and show the new
+ * part of the canvas, or of the timeline frame being shown.
+ * @param minipaint the App whose view moves
+ * @param key the arrow key
+ * @return void
+ */
+void panView(App* minipaint, sf::Keyboard::Key key) {
+    const sf::Vector2u size = minipaint->GetViewSize();
+    const int stepX = static_cast<int>(size.x) / 4;
+    const int stepY = static_cast<int>(size.y) / 4;
+    sf::Vector2i view = minipaint->GetView();
+    if (key == sf::Keyboard::Left) {
+        view.x -= stepX;
+    } else if (key == sf::Keyboard::Right) {
+        view.x += stepX;
+    } else if (key == sf::Keyboard::Up) {
+        view.y -= stepY;
+    } else if (key == sf::Keyboard::Down) {
+        view.y += stepY;
+    }
+    minipaint->SetView(view.x, view.y);
+    minipaint->UploadCanvas();
+    HistoryView &history = historyView();
+    if (history.frame >= 0) {
+        minipaint->UploadView(history.image, history.texture);
     }
-    return priorPixelValues;
 }
 
 /*!
@@ -211,29 +706,34 @@ myPacket keyEvent(sf::Event event, App* minipaint) {
     if (event.key.code == sf::Keyboard::Z) {
         // send this command
         command = 3;
-        p << command << 0 << 0 << 0 << 0;
+        writeMessage(minipaint, p, PaintMessage{command, 0, 0, 0, 0});
         packetSender(minipaint, p);
     }
     else if (event.key.code == sf::Keyboard::Y) {
         command = 4;
-        p << command << 0 << 0 << 0 << 0;
+        writeMessage(minipaint, p, PaintMessage{command, 0, 0, 0, 0});
         packetSender(minipaint, p);
     }
 
     else if (event.key.code == sf::Keyboard::Space) {
         command = 5;
-        p << command << 0 << 0 << minipaint->getColor() << 0;
+        writeMessage(minipaint, p, PaintMessage{command, 0, 0, minipaint->getColor(), 0});
         packetSender(minipaint, p);
     }
 
     else if(event.key.code == sf::Keyboard::Escape) {
         command = 6;
-        p << command << 0 << 0 << 0 << 0;
+        writeMessage(minipaint, p, PaintMessage{command, 0, 0, 0, 0});
         packetSender(minipaint, p);
         minipaint->GetGui().close();
         exit(EXIT_SUCCESS);
     }
 
+    else if (event.key.code == sf::Keyboard::F9) {
+        // Write the profiler's trace buffers to disk (no-op unless built with profiling)
+        PROFILE_FLUSH();
+    }
+
 
     switch(event.key.code) {
         case sf::Keyboard::Num1 :
@@ -280,7 +780,13 @@ myPacket keyEvent(sf::Event event, App* minipaint) {
             }
             break;
         case sf::Keyboard::E:
-            minipaint->m_color = minipaint->m_canvas;
+            minipaint->m_color = minipaint->EraserColor();
+            break;
+        case sf::Keyboard::Left:
+        case sf::Keyboard::Right:
+        case sf::Keyboard::Up:
+        case sf::Keyboard::Down:
+            panView(minipaint, event.key.code);
             break;
         default :
             break;
@@ -300,31 +806,52 @@ myPacket mouseEvent(sf::Event event, App* minipaint) {
     myPacket p;
     int command;
     sf::Vector2i mousePosition = sf::Mouse::getPosition(minipaint->GetGui());
+    //Tools work in canvas coordinates, whichever part of the canvas is in view
+    const sf::Vector2i canvasPosition = minipaint->ToCanvas(mousePosition.x,
+                                                            mousePosition.y - minipaint->GetDisplayOffset());
     //Check for duplicates to prevent waste from idle
-    bool rpts = (minipaint->mouseX != mousePosition.x || minipaint->mouseY != mousePosition.y);
+    bool rpts = (static_cast<int>(minipaint->mouseX) != canvasPosition.x ||
+                 static_cast<int>(minipaint->mouseY) != canvasPosition.y);
     //Check if within window to prevent segfault
     bool inBounds = minipaint->GetSprite().getGlobalBounds().contains(mousePosition.x,
                                                                       mousePosition.y -
                                                                       minipaint->GetDisplayOffset());
     //Check both this is not a duplicate pixel recording and the pixel's coordinate is in-bounds
+    //A stroke ends as soon as the button is up, even if the release happened out of bounds
+    if (!sf::Mouse::isButtonPressed(sf::Mouse::Left) && minipaint->GetStrokeSimplifier().isActive()) {
+        std::vector<StrokeSimplifier::Segment> segments;
+        minipaint->GetStrokeSimplifier().finish(segments);
+        sendStrokeSegments(minipaint, segments);
+    }
+    //With the bucket tool a click flood fills the region under it; only the seed travels over the network
+    if (minipaint->bucketTool) {
+        if (inBounds && event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left) {
+            command = 7;
+            writeMessage(minipaint, p, PaintMessage{command, canvasPosition.x, canvasPosition.y, minipaint->getColor(),
+                                                    minipaint->fillTolerance});
+            packetSender(minipaint, p);
+        }
+        return p;
+    }
     if (rpts && inBounds) {
         if (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
-            minipaint->mouseX = mousePosition.x;
-            minipaint->mouseY = mousePosition.y - minipaint->GetDisplayOffset();
-            int color = minipaint->getColor();
-            command = 1;
-            p << command << minipaint->mouseX << minipaint->mouseY << color << minipaint->strokeSize;
-            packetSender(minipaint, p);
-            minipaint->GetTexture().loadFromImage(minipaint->GetImage());
+            minipaint->mouseX = canvasPosition.x;
+            minipaint->mouseY = canvasPosition.y;
+            //Only samples which change the shape of the stroke are sent, each joined to the last one sent
+            StrokeSimplifier::Sample sample{static_cast<int>(minipaint->mouseX), static_cast<int>(minipaint->mouseY),
+                                            captureStamp(minipaint)};
+            std::vector<StrokeSimplifier::Segment> segments;
+            minipaint->GetStrokeSimplifier().addSample(sample, monotonicMicros(), segments);
+            sendStrokeSegments(minipaint, segments);
         }
 
 
         else if (event.type == sf::Event::MouseButtonReleased) {
 
-            std::cout << "Mouse released" << std::endl;
+            LOG_DEBUG("Mouse released");
             if (!minipaint->m_paintedPixels.empty()) {
                 command = 2;
-                p << command << 0 << 0 << 0 << 0;
+                writeMessage(minipaint, p, PaintMessage{command, 0, 0, 0, 0});
                 packetSender(minipaint, p);
             }
         }
@@ -337,43 +864,31 @@ myPacket mouseEvent(sf::Event event, App* minipaint) {
  * packetHandler function translates myPacket objects into actions done upon the App via networking.
  * @param minipaint the App to act upon
  * @param p the myPacket object storing command information
+ * @param remote whether the packet came from another peer (for latency tracking)
  * @return void
  */
-void packetHandler(App* minipaint, myPacket p) {
-    int command;
-    int x;
-    int y;
-    int color;
-    int size;
-    p >> command >> x >> y >> color >> size;
-    if (command == 1) {
-        sf::Color p_color = sf::Color(color);
-        Draw *pixel = new Draw(minipaint, x, y, p_color, size);
-        minipaint->ExecuteCommand(pixel);
-    }
-    else if (command == 2) {
-        std::cout << "released mouse button" << std::endl;
-        if (!minipaint->m_paintedPixels.empty()) {
-            minipaint->AddCommand();
-            //Reload for the next stroke
-            minipaint->m_paintedPixels = std::list<Command *>();
-        }
+void packetHandler(App* minipaint, myPacket p, bool remote) {
+    PROFILE_FUNCTION();
+    if (sessionRecorder().isOpen() && p.getDataSize() > 0) {
+        sessionRecorder().record(remote ? SessionEvent::Direction::Inbound : SessionEvent::Direction::Outbound,
+                                 monotonicMicros(), p.getData(), p.getDataSize());
     }
-    else if (command == 3) {
-        std::cout << "undo" << std::endl;
-        minipaint->UndoCommand();
+    PaintMessage message;
+    p >> message;
+    int command = message.command;
+    {
+        PROFILE_ZONE("apply");
+        minipaint->ApplyMessage(message);
     }
-    else if(command == 4) {
-        std::cout << "redo" << std::endl;
-        minipaint->RedoCommand();
-    }
-    else if(command == 5) {
-        std::cout << "fill screen" << std::endl;
-        minipaint->FillDisplay(new FillDisplay(minipaint, color));
-        minipaint->GetTexture().loadFromImage(minipaint->GetImage());
+    if (command == 1) {
+        if (message.stamp != 0) {
+            minipaint->GetLatencyTracker().applied(localCaptureTime(minipaint, message.stamp), remote);
+        }
+    } else if (command >= 3 && command != 6) {
+        // Undo, redo, fills and layer changes can touch much of the canvas at once
+        PROFILE_ZONE("texture upload");
+        minipaint->UploadCanvas();
     }
-
-
 }
 
 /*!
@@ -384,22 +899,34 @@ void packetHandler(App* minipaint, myPacket p) {
  * @return void
  */
 void updateDisplay(App *minipaint, struct nk_colorf &bg) {
+    PROFILE_FUNCTION();
     // Perform GUI window updates
     minipaint->GetGui().setActive(true);
     minipaint->GetGui().clear();
     // Clear color
     glClearColor(bg.r, bg.g, bg.b, bg.a);
     glClear(GL_COLOR_BUFFER_BIT);
-    nk_sfml_render(NK_ANTI_ALIASING_ON);
-    minipaint->GetGui().draw(minipaint->GetSprite());
-    minipaint->GetGui().display();
+    {
+        PROFILE_ZONE("nuklear render");
+        nk_sfml_render(NK_ANTI_ALIASING_ON);
+    }
+    // A frame of the timeline, while the user scrubs through it, else the live drawing
+    const sf::Sprite &sprite = historyView().frame >= 0 ? historyView().sprite : minipaint->GetSprite();
+    minipaint->GetGui().draw(sprite);
+    {
+        PROFILE_ZONE("gui display");
+        minipaint->GetGui().display();
+    }
 
     // Perform display window updates
     minipaint->GetDisplayWindow().setActive(true);
     minipaint->GetDisplayWindow().clear();
     // Draw our sprite
-    minipaint->GetDisplayWindow().draw(minipaint->GetSprite());
-    minipaint->GetDisplayWindow().display();
+    minipaint->GetDisplayWindow().draw(sprite);
+    {
+        PROFILE_ZONE("canvas display");
+        minipaint->GetDisplayWindow().display();
+    }
 }
 
 /*!
@@ -409,12 +936,8 @@ void updateDisplay(App *minipaint, struct nk_colorf &bg) {
  * @return void
  */
 void update(App* minipaint) {
+    PROFILE_THREAD_NAME("main");
 
-    int command;
-    int x;
-    int y;
-    int color;
-    int size;
     myPacket r;
 
     myPacket p;
@@ -434,22 +957,32 @@ void update(App* minipaint) {
     bg.r = 255.00f, bg.g = 255.00f, bg.b = 255.00f, bg.a = 1.0f;
 
     sf::Event event;
+    sf::Clock frameClock;
+    sf::Clock latencyReportClock;
 
     while (minipaint->GetDisplayWindow().isOpen() && minipaint->GetGui().isOpen()) {
-
-        if (minipaint->isServer) {
-            r = minipaint->appServer->listener();
-        } else {
-            r = minipaint->appClient->receiveData();
+        PROFILE_ZONE("frame");
+
+        {
+            PROFILE_ZONE("network receive");
+            if (minipaint->isServer) {
+                r = minipaint->appServer->listener();
+            } else {
+                r = minipaint->appClient->receiveData();
+                adoptCanvasSize(minipaint);
+            }
         }
 
-        packetHandler(minipaint, r);
-        r >> command >> x >> y >> color >> size;
-        if (command == 1) {
-            sf::Color r_color = sf::Color(color);
-            minipaint->receivedSize = size;
-            minipaint->receivedColor = r_color;
-            receivePaint(minipaint, r_color, x, y);
+        sf::Clock applyClock;
+        packetHandler(minipaint, r, true);
+        if (r.getDataSize() > 0) {
+            minipaint->RecordRemoteApplyTime(applyClock.getElapsedTime().asMicroseconds());
+        }
+        PaintMessage received;
+        r >> received;
+        if (received.command == 1) {
+            minipaint->receivedSize = received.size;
+            minipaint->receivedColor = sf::Color(received.color);
         }
         // Poll the display window for the user closing the window
         while (minipaint->GetDisplayWindow().pollEvent(event)) {
@@ -495,19 +1028,30 @@ void update(App* minipaint) {
             } else if (event.type == sf::Event::KeyReleased) {
                 p = keyEvent(event, minipaint);
             }
-            std::cout << "handling packet for display window" << std::endl;
+            LOG_TRACE("handling packet for display window");
             packetHandler(minipaint, p);
         }
 
         // Complete input from nuklear GUI
         nk_input_end(ctx);
 
+        // Send stroke samples held back for longer than the delay bound
+        pollStroke(minipaint);
+
         // Implement GUI commands
         p = drawLayout(minipaint, ctx, bg);
         packetHandler(minipaint, p);
 
         // Update the display
         updateDisplay(minipaint, bg);
+        minipaint->GetLatencyTracker().presented(monotonicMicros());
+        // Checkpoint the tiles changed since the last autosave, if it is time
+        minipaint->AutosaveIfDue();
+        minipaint->RecordFrameTime(frameClock.restart().asMicroseconds());
+        if (latencyReportClock.getElapsedTime() > sf::seconds(10)) {
+            LOG_INFO(minipaint->GetLatencyTracker().summary());
+            latencyReportClock.restart();
+        }
     }
 
 }
@@ -521,27 +1065,66 @@ void draw(App* minipaint){
     static int refreshRate = 0;
     ++refreshRate;
     if (refreshRate > 10) {
-        minipaint->GetTexture().loadFromImage(minipaint->GetImage());
+        minipaint->UploadCanvas();
         refreshRate = 0;
     }
 
 }
 
+/*! \brief 	Start publishing runtime metrics in the background when PAINT_STATS_FILE (a text
+ * file rewritten every few seconds) and/or PAINT_STATS_SOCKET (a Unix socket which answers each
+ * connection with the current stats) are set. The reporter never touches the GUI thread.
+ * @return void
+*/
+void startStatsReporter() {
+    // Static so that it is stopped and joined during exit()
+    static StatsReporter statsReporter;
+    const char *statsFile = std::getenv("PAINT_STATS_FILE");
+    const char *statsSocket = std::getenv("PAINT_STATS_SOCKET");
+    if (statsFile == nullptr && statsSocket == nullptr) {
+        return;
+    }
+    if (statsReporter.start(statsFile != nullptr ? statsFile : "",
+                            statsSocket != nullptr ? statsSocket : "", 5000) != 0) {
+        LOG_ERROR("Could not open stats socket " << statsSocket);
+    }
+}
+
 /*! \brief 	Run the app
  * @param minipaint the App object to run
  * @return void
 *
 */
 void runApp(App* minipaint){
+    // Publish metrics if requested
+    startStatsReporter();
+    configureStrokeSimplifier(minipaint);
+    configureHistoryBudget(minipaint);
+    configureCanvasSize(minipaint);
     // Setup the update function
     minipaint->UpdateCallback(&update);
 
     // Set up window and canvas components
     minipaint->Init(&initialization);
+    configureTilePaging(minipaint);
+    // Clients are told the size of the canvas when they join
+    if (minipaint->isServer) {
+        minipaint->appServer->setCanvasSize(minipaint->canvasWidth, minipaint->canvasHeight);
+    }
+    // Pick up the drawing where the last session left it: the server's op log holds all of it,
+    // else the last autosave or save. A recorded session starts from a blank canvas, and a client
+    // takes the drawing of the session it joins rather than its own.
+    configureTimeline(minipaint);
+    const bool recording = configureSessionRecording(minipaint);
+    const bool replayed = configureOpLog(minipaint);
+    if (recording && replayed) {
+        LOG_WARN("The op log was replayed before recording; the recording will not replay to the same drawing");
+    }
+    configureAutosave(minipaint, minipaint->isServer && !recording && !replayed);
     // Setup the Draw Function for reloading screen per refresh rate
     minipaint->DrawCallback(&draw);
-    // Set up the initial paintbrush function
-    minipaint->UpdatePaintbrush(&paint);
+    // Set up the initial paintbrush: the brush engine's square brush
+    minipaint->UpdatePaintbrush(BrushTip(BrushId::Square));
     // Call the main loop function
     minipaint->Loop();
     // Destroy our app
@@ -567,6 +1150,8 @@ void runServer(App* minipaint){
     UDPNetworkServer* server = new UDPNetworkServer("Server Name", sf::IpAddress::getLocalAddress(), 50001);
     minipaint->appServer = server;
     minipaint->appServer->setUsername(uname);
+    // Clients know the server by the port its packets come from
+    minipaint->SetLocalClient(50001);
     minipaint->appServer->start();
 }
 
@@ -587,6 +1172,7 @@ void runClient(App* minipaint){
     minipaint->appClient = cli;
     minipaint->appClient->joinServer(sf::IpAddress::getLocalAddress(), 50001);
     minipaint->appClient->setUsername(uname);
+    minipaint->SetLocalClient(cport);
 }
 
 /*! \brief 	The entry point into our program.
@@ -0,0 +1,136 @@
+/**
+ *  @file   gui_test.cpp
+ *  @brief  Unit tests of the App windows, which need a display
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+
+// Include our Third-Party SFML header
+#include <SFML/Graphics/Sprite.hpp>
+// Include standard library C++ libraries.
+#include <iostream>
+// Project header files
+#include "App.hpp"
+#include "Draw.hpp"
+
+// Setup for tests: Define initialization function
+void initialization() {
+    std::cout << "Starting the App" << std::endl;
+}
+
+// Setup for tests: Define standard paint function
+std::map<std::pair<int, int>, sf::Color> standardPaintFunc(PaintCore *minipaint, sf::Color color,
+                                                           int radius, int m_x, int m_y) {
+    std::map<std::pair<int, int>, sf::Color> priorPixelValues;
+    Canvas &canvas = minipaint->GetCanvas();
+    for (int i = m_x - radius; i < m_x + radius; i++) {
+        for (int j = m_y - radius; j < m_y + radius; j++) {
+            if (canvas.contains(i, j)) {
+                priorPixelValues[std::make_pair(i, j)] = colorFromPixel(canvas.getPixel(i, j));
+                canvas.setPixel(i, j, pixelFromColor(color));
+            }
+        }
+    }
+    return priorPixelValues;
+}
+
+/*! \brief 	Basic test to initialize and destroy the program
+*
+*/
+TEST_CASE("Basic init and destroy test") {
+    App *minipaint = new App();
+    minipaint->Init(&initialization);
+    // Destroy our app
+    minipaint->Destroy();
+}
+
+/*! \brief 	Test that the App's image and texture show what was painted on its canvas
+*
+*/
+TEST_CASE("App image shows the canvas after a draw command") {
+    App *minipaint = new App();
+    minipaint->Init(&initialization);
+    minipaint->mouseX = 150;
+    minipaint->mouseY = 200;
+    minipaint->m_color = sf::Color::Red;
+    minipaint->UpdatePaintbrush(&standardPaintFunc);
+    minipaint->ExecuteCommand(new Draw(minipaint));
+    minipaint->UploadCanvas();
+    REQUIRE(minipaint->GetImage().getPixel(150, 200) == sf::Color::Red);
+    REQUIRE(minipaint->GetImage().getPixel(300, 300) == sf::Color::White);
+    minipaint->Destroy();
+}
+
+/*! \brief 	Test the application can correctly translate the "Offset" attribute,
+ * which indicates the offset from the GUI buttons to the window in which users can draw, into
+ * judgments about whether a pixel is in bounds for drawing.
+*
+*/
+TEST_CASE("test mouse behaviors inside the GUI button coordinates don't result in draw actions") {
+    App *minipaint = new App();
+    minipaint->Init(&initialization);
+    minipaint->mouseX = 400;
+    minipaint->mouseY = 10; // If the Y value of the GUI is 10, then the coordinate is not in-bounds
+    minipaint->m_color = sf::Color::Red;
+    minipaint->strokeSize = 1;
+    minipaint->UpdatePaintbrush(&standardPaintFunc);
+    bool inBounds = minipaint->GetSprite().getGlobalBounds().contains(minipaint->mouseX,
+                                                                      minipaint->mouseY -
+                                                                      minipaint->GetDisplayOffset());
+    REQUIRE(!inBounds);
+    minipaint->Destroy();
+}
+
+/*! \brief 	Test that the window shows a scrolled view of a canvas larger than itself, and that window
+ * points translate to canvas coordinates through the view
+*
+*/
+TEST_CASE("A canvas larger than the window is shown through a view which scrolls over it") {
+    App *minipaint = new App();
+    minipaint->canvasWidth = 4000;
+    minipaint->canvasHeight = 3000;
+    minipaint->Init(&initialization);
+    REQUIRE(minipaint->GetFlattened().getWidth() == 4000);
+    REQUIRE(minipaint->GetViewSize() == sf::Vector2u(1000, 850));
+    minipaint->SetView(2500, 2000);
+    REQUIRE(minipaint->GetView() == sf::Vector2i(2500, 2000));
+    REQUIRE(minipaint->ToCanvas(100, 100) == sf::Vector2i(2600, 2100));
+    minipaint->mouseX = 2600;
+    minipaint->mouseY = 2100;
+    minipaint->m_color = sf::Color::Red;
+    minipaint->UpdatePaintbrush(&standardPaintFunc);
+    minipaint->ExecuteCommand(new Draw(minipaint));
+    minipaint->UploadCanvas();
+    REQUIRE(minipaint->GetTexture().getSize() == sf::Vector2u(1000, 850));
+    REQUIRE(minipaint->GetImage().getPixel(100, 100) == sf::Color::Red);
+    REQUIRE(minipaint->GetImage().getPixel(300, 300) == sf::Color::White);
+    // The view stops at the canvas's edge
+    minipaint->SetView(5000, -10);
+    REQUIRE(minipaint->GetView() == sf::Vector2i(3000, 0));
+    minipaint->Destroy();
+}
+
+/*! \brief 	Test that a client taking the session's canvas size gets a blank canvas of that size,
+ * shown from its top-left
+*
+*/
+TEST_CASE("Resizing the canvas recreates it blank and resets the view") {
+    App *minipaint = new App();
+    minipaint->canvasWidth = 4000;
+    minipaint->canvasHeight = 3000;
+    minipaint->Init(&initialization);
+    minipaint->SetView(2500, 2000);
+    minipaint->ResizeCanvas(640, 480);
+    REQUIRE(minipaint->canvasWidth == 640);
+    REQUIRE(minipaint->GetFlattened().getWidth() == 640);
+    REQUIRE(minipaint->GetFlattened().getHeight() == 480);
+    REQUIRE(minipaint->GetView() == sf::Vector2i(0, 0));
+    REQUIRE(minipaint->GetViewSize() == sf::Vector2u(640, 480));
+    REQUIRE(minipaint->GetTexture().getSize() == sf::Vector2u(640, 480));
+    REQUIRE(minipaint->GetImage().getPixel(100, 100) == sf::Color::White);
+    minipaint->Destroy();
+}
@@ -10,33 +10,91 @@
 #include "catch.hpp"
 
 // Include our Third-Party SFML header
-#include <SFML/Graphics/Sprite.hpp>
+#include <SFML/Graphics/Color.hpp>
 // Include standard library C++ libraries.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <string>
+// POSIX headers for the stats socket
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 // Project header files
-#include "App.hpp"
+#include "Autosave.hpp"
+#include "BlendKernels.hpp"
+#include "Brush.hpp"
+#include "Canvas.hpp"
 #include "Command.hpp"
+#include "CommandPool.hpp"
 #include "Draw.hpp"
 #include "FillDisplay.hpp"
+#include "FloodFill.hpp"
+#include "HistoryTimeline.hpp"
+#include "Latency.hpp"
+#include "LayerCommand.hpp"
+#include "LayerStack.hpp"
+#include "Logger.hpp"
+#include "Metrics.hpp"
+#include "OpLog.hpp"
 #include "Packet.hpp"
+#include "PaintCore.hpp"
+#include "Profiler.hpp"
+#include "ProjectFile.hpp"
+#include "RegionOps.hpp"
+#include "ScanlineFill.hpp"
+#include "SessionRecording.hpp"
+#include "SpatialIndex.hpp"
+#include "StrokeSimplifier.hpp"
+#include "StrokeStore.hpp"
+#include "ThreadPool.hpp"
+#include "TileStore.hpp"
 #include "UDPNetworkServer.hpp"
 #include "UDPNetworkClient.hpp"
 
-// Setup for tests: Define initialization function
-void initialization() {
-    std::cout << "Starting the App" << std::endl;
+// Setup for tests: Color of a pixel of the drawing
+sf::Color pixelColor(PaintCore *minipaint, int x, int y) {
+    return colorFromPixel(minipaint->GetCanvas().getPixel(x, y));
+}
+
+// Setup for tests: whether two canvases hold the same pixels
+bool samePixels(const Canvas &a, const Canvas &b) {
+    if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight()) {
+        return false;
+    }
+    std::vector<Canvas::Pixel> rowA(a.getWidth());
+    std::vector<Canvas::Pixel> rowB(b.getWidth());
+    for (int y = 0; y < static_cast<int>(a.getHeight()); y++) {
+        a.readSpan(y, 0, static_cast<int>(rowA.size()), rowA.data());
+        b.readSpan(y, 0, static_cast<int>(rowB.size()), rowB.data());
+        if (rowA != rowB) {
+            return false;
+        }
+    }
+    return true;
 }
 
 // Setup for tests: Define standard paint function
-std::map<std::pair<int, int>, sf::Color> standardPaintFunc(App *minipaint, sf::Color color,
-                                                           int radius, int m_x, int m_y) {
+std::map<std::pair<int, int>, sf::Color> standardPaintFunc(PaintCore *minipaint, sf::Color color,
+                                                                 int radius, int m_x, int m_y) {
     std::map<std::pair<int, int>, sf::Color> priorPixelValues;
+    Canvas &canvas = minipaint->GetCanvas();
     for (int i = m_x - radius; i < m_x + radius; i++) {
         for (int j = m_y - radius; j < m_y + radius; j++) {
-            if (minipaint->GetSprite().getGlobalBounds().contains(i, j)) {
-                priorPixelValues[std::make_pair(i, j)] = minipaint->GetImage().getPixel(i, j);
-                minipaint->GetImage().setPixel(i, j, color);
+            if (canvas.contains(i, j)) {
+                priorPixelValues[std::make_pair(i, j)] = colorFromPixel(canvas.getPixel(i, j));
+                canvas.setPixel(i, j, pixelFromColor(color));
             }
         }
     }
@@ -44,29 +102,17 @@ std::map<std::pair<int, int>, sf::Color> standardPaintFunc(App *minipaint, sf::C
 }
 
 // Setup for tests: Define new (empty) paint function to test that minipaint can switch brushes
-std::map<std::pair<int, int>, sf::Color> newPaintFunc(App *minipaint,
+std::map<std::pair<int, int>, sf::Color> newPaintFunc(PaintCore *minipaint,
                                                       sf::Color color, int radius, int m_x, int m_y) {
     return std::map<std::pair<int, int>, sf::Color>();
 }
 
-/*! \brief 	Basic test to initialize and destroy the program
-*
-*/
-TEST_CASE("Basic init and destroy test") {
-    App *minipaint = new App();
-    minipaint->Init(&initialization);
-    // Destroy our app
-    minipaint->Destroy();
-}
-
-
-
 /*! \brief 	Test that the app can change its paintbrush function. (Test case for new feature)
 *
 */
 TEST_CASE("Change app paintbrush") {
-    App *minipaint = new App();
-    minipaint->Init(&initialization);
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
     minipaint->UpdatePaintbrush(&newPaintFunc);
     REQUIRE(minipaint->m_paintFunc == newPaintFunc);
     // Destroy our app
@@ -78,8 +124,8 @@ TEST_CASE("Change app paintbrush") {
 *
 */
 TEST_CASE("Change app paintbrush diameter affects correct pixels - test three diameters") {
-    App *minipaint = new App();
-    minipaint->Init(&initialization);
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
     // Draw at this pixel
     minipaint->mouseX = 150;
     minipaint->mouseY = 200;
@@ -95,7 +141,7 @@ TEST_CASE("Change app paintbrush diameter affects correct pixels - test three di
         for (int j = minipaint->mouseX - minipaint->strokeSize; j < minipaint->mouseX + minipaint->strokeSize; j++) {
             for (int k = minipaint->mouseY - minipaint->strokeSize;
                  k < minipaint->mouseY + minipaint->strokeSize; k++) {
-                REQUIRE(minipaint->GetImage().getPixel(j, k) == sf::Color::Black);
+                REQUIRE(pixelColor(minipaint, j, k) == sf::Color::Black);
             }
         }
     }
@@ -109,8 +155,8 @@ TEST_CASE("Change app paintbrush diameter affects correct pixels - test three di
  * stroke as a single stack in undo
  */
 TEST_CASE("App differentiates different brush strokes by adding one stroke as a single stack to undo list") {
-    App *minipaint = new App();
-    minipaint->Init(&initialization);
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
     minipaint->mouseX = 150;
     minipaint->mouseY = 200;
     minipaint->m_color = sf::Color::Red;
@@ -133,14 +179,14 @@ TEST_CASE("App differentiates different brush strokes by adding one stroke as a
 
     // Empty the current brush stroke stack by calling "AddCommand" which adds current stroke to undo list
     minipaint->AddCommand();
-    minipaint->m_paintedPixels = std::list<Command *>();
+    minipaint->m_paintedPixels.clear();
 
     // Run an "undo"
     minipaint->UndoCommand();
 
     // Ensure the stack of painted pixels for the full brush stroke is empty
     for (int i = 0; i < 3; i++) {
-        REQUIRE(minipaint->GetImage().getPixel(x_pos[i], y_pos[i]) == sf::Color::White);
+        REQUIRE(pixelColor(minipaint, x_pos[i], y_pos[i]) == sf::Color::White);
     }
 }
 
@@ -149,8 +195,8 @@ TEST_CASE("App differentiates different brush strokes by adding one stroke as a
 *
 */
 TEST_CASE("test undoing a fill color operation") {
-    App *minipaint = new App();
-    minipaint->Init(&initialization);
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
     minipaint->mouseX = 150;
     minipaint->mouseY = 200;
     minipaint->m_color = sf::Color::Red;
@@ -164,38 +210,17 @@ TEST_CASE("test undoing a fill color operation") {
 
     minipaint->m_color = sf::Color::Blue;
     minipaint->FillDisplay(new FillDisplay(minipaint, minipaint->getColor()));
-    minipaint->GetTexture().loadFromImage(minipaint->GetImage());
 
     //undo pixel on blue canvas, pixel should be red
     minipaint->UndoCommand();
-    REQUIRE(minipaint->GetImage().getPixel(150, 200) == sf::Color::Red);
+    REQUIRE(pixelColor(minipaint, 150, 200) == sf::Color::Red);
     // Pixel not drawn upon before the "fill" command should be white
-    REQUIRE(minipaint->GetImage().getPixel(200, 200) == sf::Color::White);
+    REQUIRE(pixelColor(minipaint, 200, 200) == sf::Color::White);
 
     // Destroy our app
     minipaint->Destroy();
 }
 
-/*! \brief 	Test the application can correctly translate the "Offset" attribute,
- * which indicates the offset from the GUI buttons to the window in which users can draw, into
- * judgments about whether a pixel is in bounds for drawing.
-*
-*/
-TEST_CASE("test mouse behaviors inside the GUI button coordinates don't result in draw actions") {
-    App *minipaint = new App();
-    minipaint->Init(&initialization);
-    minipaint->mouseX = 400;
-    minipaint->mouseY = 10; // If the Y value of the GUI is 10, then the coordinate is not in-bounds
-    minipaint->m_color = sf::Color::Red;
-    minipaint->strokeSize = 1;
-    minipaint->UpdatePaintbrush(&standardPaintFunc);
-    bool inBounds = minipaint->GetSprite().getGlobalBounds().contains(minipaint->mouseX,
-                                                                      minipaint->mouseY -
-                                                                      minipaint->GetDisplayOffset());
-    REQUIRE(!inBounds);
-    minipaint->Destroy();
-}
-
 /*! \brief 	Test client joining server and sending packet to server
 *
 */
@@ -222,3 +247,2613 @@ TEST_CASE("Test client joining server and sending packet") {
 server->~UDPNetworkServer();
 client1->~UDPNetworkClient();
 }
+
+
+/*! \brief 	Test that recorded zones are written out as Chrome trace events
+*
+*/
+TEST_CASE("Profiler writes recorded zones as Chrome trace events") {
+    Profiler &profiler = Profiler::Get();
+    profiler.clear();
+    {
+        Profiler::Zone zone("test zone");
+    }
+    std::vector<Profiler::Event> events = profiler.snapshot();
+    REQUIRE(events.size() == 1);
+    REQUIRE(std::string(events[0].name) == "test zone");
+    REQUIRE(events[0].durationNs >= 0);
+
+    REQUIRE(profiler.flush("test_trace.json"));
+    std::ifstream in("test_trace.json");
+    std::string trace((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    REQUIRE(trace.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(trace.find("\"name\":\"test zone\",\"ph\":\"X\"") != std::string::npos);
+    std::remove("test_trace.json");
+}
+
+/*! \brief 	Test that histogram buckets keep percentiles within their precision and that the
+ * registry reports every metric as a "name value" line
+*
+*/
+TEST_CASE("Metrics registry reports counters, gauges and histogram percentiles") {
+    MetricsRegistry &metrics = MetricsRegistry::Get();
+    Counter &counter = metrics.counter("test.counter");
+    counter.increment(3);
+    REQUIRE(&metrics.counter("test.counter") == &counter);
+    metrics.gauge("test.gauge").set(-7);
+
+    Histogram &histogram = metrics.histogram("test.histogram_us");
+    histogram.reset();
+    for (std::uint64_t value = 1; value <= 1000; value++) {
+        histogram.record(value);
+    }
+    REQUIRE(histogram.count() == 1000);
+    REQUIRE(histogram.max() == 1000);
+    // Buckets are within 1/16 of the true value
+    REQUIRE(histogram.percentile(0.5) >= 500);
+    REQUIRE(histogram.percentile(0.5) <= 500 + 500 / Histogram::kSubBuckets);
+    REQUIRE(histogram.percentile(0.99) >= 990);
+    REQUIRE(Histogram::bucketUpperBound(Histogram::bucketIndex(12345)) >= 12345);
+
+    std::string text = metrics.format();
+    REQUIRE(text.find("test.counter 3\n") != std::string::npos);
+    REQUIRE(text.find("test.gauge -7\n") != std::string::npos);
+    REQUIRE(text.find("test.histogram_us.count 1000\n") != std::string::npos);
+    REQUIRE(text.find("test.histogram_us.max 1000\n") != std::string::npos);
+}
+
+// Setup for tests: connect to the stats socket at path; returns the connection, or -1
+int connectStats(const std::string &path) {
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", path.c_str());
+    if (connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        close(connection);
+        return -1;
+    }
+    return connection;
+}
+
+/*! \brief Test that the stats socket answers a scraper, and that scrapers which hang up before
+ * reading do not take the process down with SIGPIPE
+*
+*/
+TEST_CASE("Stats socket answers scrapers and survives those which hang up") {
+    const std::string path = "test_stats.sock";
+    MetricsRegistry::Get().gauge("test.stats_socket").set(42);
+    StatsReporter reporter;
+    REQUIRE(reporter.start("", path, 1000) == 0);
+    for (int i = 0; i < 20; i++) {
+        int connection = connectStats(path);
+        REQUIRE(connection >= 0);
+        close(connection);
+    }
+    int connection = connectStats(path);
+    REQUIRE(connection >= 0);
+    std::string text;
+    char buffer[4096];
+    for (ssize_t got; (got = read(connection, buffer, sizeof(buffer))) > 0;) {
+        text.append(buffer, static_cast<std::size_t>(got));
+    }
+    close(connection);
+    REQUIRE(text.find("test.stats_socket 42\n") != std::string::npos);
+    reporter.stop();
+}
+
+/*! \brief 	Test that the logger filters by runtime level, writes queued messages on flush and
+ * rate limits a message repeated in a tight loop
+*
+*/
+TEST_CASE("Logger filters by level and rate limits repeated messages") {
+    Logger &logger = Logger::Get();
+    std::ostringstream out;
+    LogLevel previousLevel = logger.getLevel();
+    logger.setOutput(&out);
+    logger.setLevel(LogLevel::Info);
+
+    LOG_DEBUG("hidden debug message");
+    LOG_INFO("visible " << 42);
+    for (int i = 0; i < 100; i++) {
+        LOG_WARN("repeated warning");
+    }
+    logger.flush();
+
+    std::string text = out.str();
+    REQUIRE(text.find("hidden debug message") == std::string::npos);
+    REQUIRE(text.find("INFO  visible 42") != std::string::npos);
+    std::size_t repeats = 0;
+    for (std::size_t pos = text.find("repeated warning"); pos != std::string::npos;
+         pos = text.find("repeated warning", pos + 1)) {
+        repeats++;
+    }
+    REQUIRE(repeats == LogRateLimiter::kBurst);
+
+    logger.setOutput(nullptr);
+    logger.setLevel(previousLevel);
+}
+
+/*! \brief 	Test that paint messages survive a round trip through a packet, and that packets from
+ * older peers without a capture stamp still decode
+*
+*/
+TEST_CASE("PaintMessage round trip and packets without a stamp") {
+    myPacket p;
+    p << PaintMessage{1, 150, 200, static_cast<int>(sf::Color::Red.toInteger()), 4, 123456789};
+    PaintMessage message;
+    p >> message;
+    REQUIRE(message.command == 1);
+    REQUIRE(message.x == 150);
+    REQUIRE(message.y == 200);
+    REQUIRE(sf::Color(message.color) == sf::Color::Red);
+    REQUIRE(message.size == 4);
+    REQUIRE(message.stamp == 123456789);
+
+    myPacket old;
+    old << 3 << 0 << 0 << 0 << 0;
+    PaintMessage undo;
+    old >> undo;
+    REQUIRE(undo.command == 3);
+    REQUIRE(undo.stamp == 0);
+    REQUIRE(undo.client == -1);
+
+    myPacket tagged;
+    PaintMessage redo{4, 0, 0, 0, 0};
+    redo.client = 50002;
+    tagged << redo;
+    PaintMessage decoded;
+    tagged >> decoded;
+    REQUIRE(decoded.command == 4);
+    REQUIRE(decoded.client == 50002);
+}
+
+/*! \brief 	Test that the peer clock recovers a known offset and prefers the exchange with the
+ * shortest round trip
+*
+*/
+TEST_CASE("Peer clock estimates the server offset from sync exchanges") {
+    PeerClock clock;
+    REQUIRE(!clock.isSynchronized());
+    // Server clock is 5000 us ahead; symmetric 100 us each way, 20 us server processing
+    clock.addSample(1000, 6100, 6120, 1220);
+    REQUIRE(clock.isSynchronized());
+    REQUIRE(clock.getOffset() == 5000);
+    REQUIRE(clock.getRoundTrip() == 200);
+    // A slow, asymmetric exchange must not replace the better estimate
+    clock.addSample(2000, 7900, 7920, 2950);
+    REQUIRE(clock.getOffset() == 5000);
+    REQUIRE(clock.toServerTime(10) == 5010);
+    REQUIRE(clock.toLocalTime(5010) == 10);
+}
+
+/*! \brief Test that stroke segments leave no gaps between samples, that an axis-aligned segment covers
+ * exactly the dabs at its ends and everything between them, and that undo restores the canvas.
+ */
+TEST_CASE("Stroke segments are continuous and undo restores the canvas") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    minipaint->UpdatePaintbrush(&standardPaintFunc);
+    Canvas before = minipaint->GetCanvas();
+    const int radius = 3;
+
+    // A stroke with samples far apart, as from a fast mouse movement
+    int xs[] = {100, 300, 120, 160};
+    int ys[] = {100, 180, 400, 400};
+    minipaint->ExecuteCommand(new Draw(minipaint, xs[0], ys[0], sf::Color::Black, radius));
+    for (int i = 1; i < 4; i++) {
+        minipaint->ExecuteCommand(new Draw(minipaint, xs[i - 1], ys[i - 1], xs[i], ys[i], sf::Color::Black, radius));
+    }
+    REQUIRE(minipaint->m_paintedPixels.size() == 4);
+
+    // Every point along every segment is painted
+    const Canvas &canvas = minipaint->GetCanvas();
+    Canvas::Pixel black = pixelFromColor(sf::Color::Black);
+    for (int i = 1; i < 4; i++) {
+        for (int k = 0; k <= 100; k++) {
+            int x = xs[i - 1] + (xs[i] - xs[i - 1]) * k / 100;
+            int y = ys[i - 1] + (ys[i] - ys[i - 1]) * k / 100;
+            REQUIRE(canvas.getPixel(x, y) == black);
+        }
+    }
+    REQUIRE(pixelColor(minipaint, 200, 140) == sf::Color::Black);
+
+    // The horizontal segment covers columns [120 - radius, 160 + radius) of rows [400 - radius, 400 + radius)
+    for (int y = 400 - radius - 1; y <= 400 + radius; y++) {
+        for (int x = 140; x <= 160 + radius + 1; x++) {
+            bool inside = y >= 400 - radius && y < 400 + radius && x < 160 + radius;
+            REQUIRE((canvas.getPixel(x, y) == black) == inside);
+        }
+    }
+
+    // Undoing the stroke puts back every pixel
+    minipaint->AddCommand();
+    minipaint->m_paintedPixels.clear();
+    minipaint->UndoCommand();
+    REQUIRE(samePixels(canvas, before));
+    minipaint->Destroy();
+}
+
+/*! \brief Test that a brush partly off the canvas paints its visible part, and that undo takes it back.
+ */
+TEST_CASE("A stroke partly off the canvas is kept in the history and undone") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    minipaint->UpdatePaintbrush(&standardPaintFunc);
+    Canvas before = minipaint->GetCanvas();
+    const int radius = 3;
+
+    // A dab and a segment whose centers are just off the left edge
+    minipaint->ExecuteCommand(new Draw(minipaint, -1, 50, sf::Color::Black, radius));
+    minipaint->ExecuteCommand(new Draw(minipaint, -20, 80, -1, 80, sf::Color::Black, radius));
+    REQUIRE(minipaint->m_paintedPixels.size() == 2);
+    const Canvas &canvas = minipaint->GetCanvas();
+    Canvas::Pixel black = pixelFromColor(sf::Color::Black);
+    REQUIRE(canvas.getPixel(0, 50) == black);
+    REQUIRE(canvas.getPixel(0, 80) == black);
+
+    minipaint->AddCommand();
+    minipaint->m_paintedPixels.clear();
+    minipaint->UndoCommand();
+    REQUIRE(samePixels(canvas, before));
+    minipaint->Destroy();
+}
+
+/*! \brief Test that the stroke simplifier sends far fewer points than it is given while painting nearly
+ * the same pixels, keeps both ends of the stroke, and never holds a sample past the delay bound.
+ */
+TEST_CASE("Stroke simplifier reduces packets with a bounded pixel difference") {
+    // A recorded drag: a straight run, then a slow arc, sampled at every pixel the mouse crossed
+    std::vector<StrokeSimplifier::Sample> samples;
+    for (int x = 100; x < 400; x++) {
+        samples.push_back(StrokeSimplifier::Sample{x, 300, x});
+    }
+    for (int i = 0; i <= 400; i++) {
+        double angle = i * 3.14159265 / 400;
+        samples.push_back(StrokeSimplifier::Sample{400 + static_cast<int>(std::lround(150 * std::sin(angle))),
+                                                   450 - static_cast<int>(std::lround(150 * std::cos(angle))),
+                                                   400 + i});
+    }
+
+    // Paint the stroke as sent unsimplified and as sent simplified, and compare
+    const int radius = 2;
+    Canvas::Pixel black = Canvas::fromRGBA(0x000000ff);
+    Canvas original(800, 800, Canvas::fromRGBA(0xffffffff));
+    for (std::size_t i = 1; i < samples.size(); i++) {
+        BrushEngine::strokeSegment(original, samples[i - 1].x, samples[i - 1].y, samples[i].x, samples[i].y,
+                                   radius, black, nullptr);
+    }
+    double tolerances[] = {0.0, 1.0};
+    for (double tolerance : tolerances) {
+        std::vector<StrokeSimplifier::Segment> segments = StrokeSimplifier::simplify(samples, tolerance);
+        REQUIRE(segments.front().fromX == -1);
+        REQUIRE(segments.front().x == samples.front().x);
+        REQUIRE(segments.back().x == samples.back().x);
+        REQUIRE(segments.back().y == samples.back().y);
+
+        Canvas simplified(800, 800, Canvas::fromRGBA(0xffffffff));
+        std::size_t painted = 0;
+        std::size_t different = 0;
+        for (const StrokeSimplifier::Segment &segment : segments) {
+            int fromX = segment.fromX < 0 ? segment.x : segment.fromX;
+            int fromY = segment.fromY < 0 ? segment.y : segment.fromY;
+            BrushEngine::strokeSegment(simplified, fromX, fromY, segment.x, segment.y, radius, black, nullptr);
+        }
+        for (int y = 0; y < 800; y++) {
+            for (int x = 0; x < 800; x++) {
+                painted += original.getPixel(x, y) == black;
+                different += original.getPixel(x, y) != simplified.getPixel(x, y);
+            }
+        }
+        INFO("tolerance " << tolerance << ": " << samples.size() << " samples -> " << segments.size()
+             << " packets, " << different << " of " << painted << " pixels differ");
+        if (tolerance == 0.0) {
+            // Only samples exactly on the line are dropped, so the pixels are identical; the
+            // straight run is only broken up by the window limit
+            REQUIRE(segments[1].x - segments[0].x == static_cast<int>(StrokeSimplifier::kMaxWindow));
+            REQUIRE(different == 0);
+        } else {
+            REQUIRE(segments.size() * 4 < samples.size());
+            REQUIRE(different * 100 < painted * 15);
+        }
+    }
+
+    // A held sample goes out once the delay bound passes, without waiting for the stroke to end
+    StrokeSimplifier simplifier(1.0, 30000);
+    std::vector<StrokeSimplifier::Segment> out;
+    simplifier.addSample(StrokeSimplifier::Sample{10, 10, 0}, 0, out);
+    simplifier.addSample(StrokeSimplifier::Sample{11, 10, 0}, 1000, out);
+    REQUIRE(out.size() == 1);
+    simplifier.poll(20000, out);
+    REQUIRE(out.size() == 1);
+    simplifier.poll(31000, out);
+    REQUIRE(out.size() == 2);
+    REQUIRE(out.back().fromX == 10);
+    REQUIRE(out.back().x == 11);
+    simplifier.finish(out);
+    REQUIRE(out.size() == 2);
+    REQUIRE_FALSE(simplifier.isActive());
+}
+
+/*! \brief Test that undo and redo rebuild the canvas from the stroke store: undoing a stroke which
+ * crosses an older one restores the older stroke underneath and rebuilds only the tiles it covered.
+ */
+TEST_CASE("Stroke store rebuilds the tiles an undone stroke covered") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    const Canvas &canvas = minipaint->GetCanvas();
+    Canvas::Pixel white = pixelFromColor(sf::Color::White);
+
+    // Stroke A runs across the canvas, stroke B crosses it
+    minipaint->ExecuteCommand(new Draw(minipaint, 100, 200, sf::Color::Red, 3));
+    minipaint->ExecuteCommand(new Draw(minipaint, 100, 200, 700, 200, sf::Color::Red, 3));
+    minipaint->AddCommand();
+    minipaint->m_paintedPixels.clear();
+    minipaint->ExecuteCommand(new Draw(minipaint, 500, 100, sf::Color::Blue, 3));
+    minipaint->ExecuteCommand(new Draw(minipaint, 500, 100, 500, 300, sf::Color::Blue, 3));
+    minipaint->AddCommand();
+    minipaint->m_paintedPixels.clear();
+    REQUIRE(minipaint->GetStrokeStore().size() == 4);
+    REQUIRE(minipaint->GetStrokeStore().strokeCount() == 2);
+
+    Canvas onlyA(canvas.getWidth(), canvas.getHeight(), white);
+    BrushEngine::strokeSegment(onlyA, 100, 200, 700, 200, 3, pixelFromColor(sf::Color::Red), nullptr);
+    Canvas both = onlyA;
+    BrushEngine::strokeSegment(both, 500, 100, 500, 300, 3, pixelFromColor(sf::Color::Blue), nullptr);
+    REQUIRE(samePixels(canvas, both));
+
+    // Undoing B rebuilds the column of tiles it covered: rows 97..302 of tile column 7
+    Counter &tilesRepaired = MetricsRegistry::Get().counter("strokes.tiles_repaired");
+    std::uint64_t repairedBefore = tilesRepaired.get();
+    minipaint->UndoCommand();
+    REQUIRE(tilesRepaired.get() - repairedBefore == 4);
+    REQUIRE(samePixels(canvas, onlyA));
+    minipaint->RedoCommand();
+    REQUIRE(samePixels(canvas, both));
+
+    // A fill and its undo are single operations too
+    minipaint->FillDisplay(new FillDisplay(minipaint, sf::Color::Green.toInteger()));
+    REQUIRE(canvas.getPixel(10, 10) == pixelFromColor(sf::Color::Green));
+    minipaint->UndoCommand();
+    REQUIRE(samePixels(canvas, both));
+
+    // The whole history, with its spatial index, is a few hundred bytes rather than a saved copy of
+    // every painted pixel
+    REQUIRE(minipaint->GetStrokeStore().getByteSize() < 2048);
+    minipaint->Destroy();
+}
+
+/*! \brief Test the spatial index against a linear scan over 100k strokes, and that a store holding
+ * them repairs an undone stroke from the operations which touch it rather than the whole history.
+ */
+TEST_CASE("Spatial index finds the operations touching a rectangle after a sequence number") {
+    const int strokes = 100000;
+    std::vector<CanvasRect> bounds;
+    SpatialIndex index;
+    StrokeStore store;
+    std::uint32_t seed = 12345;
+    auto next = [&seed](int range) {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<int>((seed >> 8) % static_cast<std::uint32_t>(range));
+    };
+    for (int i = 0; i < strokes; i++) {
+        int x = next(4000) - 1000;
+        int y = next(3000) - 1000;
+        int radius = 1 + next(8);
+        CanvasRect rect = BrushEngine::segmentBounds(x, y, x + next(120) - 60, y + next(120) - 60, radius);
+        bounds.push_back(rect);
+        index.insert(index.size(), rect);
+    }
+    store.addFill(pixelFromColor(sf::Color::White));
+    for (int i = 0; i < strokes; i++) {
+        store.addSegment(BrushId::Square, pixelFromColor(sf::Color::Red), 2, false, 0, 0, next(800), next(600));
+    }
+    REQUIRE(index.size() == static_cast<std::size_t>(strokes));
+
+    for (int query = 0; query < 50; query++) {
+        int left = next(3000) - 800;
+        int top = next(2000) - 800;
+        CanvasRect rect{left, top, left + 1 + next(200), top + 1 + next(200)};
+        SpatialIndex::Id since = static_cast<SpatialIndex::Id>(next(strokes));
+        std::vector<SpatialIndex::Id> found;
+        index.query(rect, since, found);
+        std::vector<SpatialIndex::Id> expected;
+        for (std::size_t id = since; id < bounds.size(); id++) {
+            if (bounds[id].intersects(rect)) {
+                expected.push_back(id);
+            }
+        }
+        REQUIRE(found == expected);
+    }
+
+    // Undoing one recent stroke rebuilds its tile from the few operations touching it
+    Canvas canvas(800, 600, pixelFromColor(sf::Color::White));
+    Canvas reference = canvas;
+    for (StrokeStore::OpId op = 0; op < store.size(); op++) {
+        store.rasterize(op, canvas, canvas.getBounds());
+    }
+    StrokeStore::OpId last = store.size() - 1;
+    store.setVisible(last, false);
+    for (StrokeStore::OpId op = 0; op < last; op++) {
+        store.rasterize(op, reference, canvas.getBounds());
+    }
+    std::size_t tiles = store.repair(canvas, pixelFromColor(sf::Color::White));
+    REQUIRE(tiles >= 1);
+    REQUIRE(tiles <= 4);
+    REQUIRE(samePixels(canvas, reference));
+}
+
+/*! \brief Test that baking the settled operations at the start of a stroke store drops them and
+ * their records but leaves the drawing, and what undoing a later operation rebuilds, the same.
+ */
+TEST_CASE("Settled operations are baked and dropped without changing the drawing") {
+    const int operations = 10000;
+    const Canvas::Pixel white = pixelFromColor(sf::Color::White);
+    const Canvas::Pixel colors[3] = {pixelFromColor(sf::Color::Red), pixelFromColor(sf::Color::Blue),
+                                     pixelFromColor(sf::Color::Green)};
+    StrokeStore store;
+    std::uint32_t seed = 777;
+    auto next = [&seed](int range) {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<int>((seed >> 8) % static_cast<std::uint32_t>(range));
+    };
+    Canvas canvas(400, 300, white);
+    int x = 200;
+    int y = 150;
+    for (int i = 0; i < operations; i++) {
+        StrokeStore::OpId op;
+        if (i % 2500 == 1000) {
+            op = store.addFill(colors[next(3)]);
+        } else {
+            int toX = std::max(0, std::min(399, x + next(41) - 20));
+            int toY = std::max(0, std::min(299, y + next(41) - 20));
+            op = store.addSegment(BrushId::Square, colors[i / 50 % 3], 1 + i / 50 % 4, i % 50 != 0, x, y, toX, toY);
+            x = toX;
+            y = toY;
+        }
+        store.rasterize(op, canvas, canvas.getBounds());
+        // Some operations were undone, and their actions released, before they settled
+        if (i < operations - 2000 && next(10) == 0) {
+            store.setVisible(op, false);
+        }
+        if (i % 50 == 49) {
+            store.closeStrokes();
+        }
+    }
+    store.repair(canvas, white);
+    const Canvas drawn = canvas;
+    // What the canvas looks like with a late operation undone, rebuilt from the whole history
+    const StrokeStore::OpId undone = operations - 1500;
+    Canvas withoutUndone(400, 300, white);
+    store.setVisible(undone, false);
+    store.rebuild(withoutUndone, withoutUndone.getBounds(), white);
+    store.setVisible(undone, true);
+    store.repair(canvas, white);
+
+    // Nothing is dropped while the settled run is short
+    for (StrokeStore::OpId op = 0; op < 1000; op++) {
+        store.settle(op);
+    }
+    REQUIRE(store.compact(canvas, white) == 0);
+    REQUIRE(store.getBaked() == nullptr);
+
+    const std::size_t bytes = store.getByteSize();
+    for (StrokeStore::OpId op = 0; op < operations - 2000; op++) {
+        store.settle(op);
+    }
+    REQUIRE(store.compact(canvas, white) == static_cast<std::size_t>(operations - 2000));
+    REQUIRE(store.size() == 2000);
+    REQUIRE(store.nextOp() == static_cast<StrokeStore::OpId>(operations));
+    REQUIRE(store.getBaked() != nullptr);
+    REQUIRE(store.strokeCount() < 50);
+    REQUIRE(store.getByteSize() - store.getBaked()->getByteSize() < bytes / 4);
+
+    // Rebuilding from what was baked gives the same pixels
+    Canvas rebuilt(400, 300, white);
+    store.rebuild(rebuilt, rebuilt.getBounds(), white);
+    REQUIRE(samePixels(rebuilt, drawn));
+
+    // Undoing a kept operation rebuilds its tiles from what was baked and the operations after it
+    store.setVisible(undone, false);
+    store.repair(canvas, white);
+    REQUIRE(samePixels(canvas, withoutUndone));
+    store.setVisible(undone, true);
+    store.repair(canvas, white);
+    REQUIRE(samePixels(canvas, drawn));
+}
+
+/*! \brief Test that each client undoes only their own strokes: undoing user A's stroke rebuilds just
+ * the tiles it covered, keeps user B's later stroke on top, and leaves B's history alone.
+ */
+TEST_CASE("Per-client undo only removes that client's strokes") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    const Canvas &canvas = minipaint->GetCanvas();
+    Canvas::Pixel white = pixelFromColor(sf::Color::White);
+    const int userA = 50002;
+    const int userB = 50003;
+
+    // A starts a stroke, B draws a crossing stroke while A is still drawing, then both finish
+    minipaint->ExecuteCommand(new Draw(minipaint, 100, 200, sf::Color::Red, 3), userA);
+    minipaint->ExecuteCommand(new Draw(minipaint, 150, 100, sf::Color::Blue, 3), userB);
+    minipaint->ExecuteCommand(new Draw(minipaint, 100, 200, 300, 200, sf::Color::Red, 3), userA);
+    minipaint->ExecuteCommand(new Draw(minipaint, 150, 100, 150, 300, sf::Color::Blue, 3), userB);
+    minipaint->AddCommand(userA);
+    minipaint->AddCommand(userB);
+    REQUIRE(minipaint->m_paintedPixels.empty());
+
+    Canvas onlyB(canvas.getWidth(), canvas.getHeight(), white);
+    BrushEngine::strokeSegment(onlyB, 150, 100, 150, 300, 3, pixelFromColor(sf::Color::Blue), nullptr);
+    Canvas both(canvas.getWidth(), canvas.getHeight(), white);
+    BrushEngine::strokeSegment(both, 100, 200, 300, 200, 3, pixelFromColor(sf::Color::Red), nullptr);
+    BrushEngine::strokeSegment(both, 150, 100, 150, 300, 3, pixelFromColor(sf::Color::Blue), nullptr);
+    REQUIRE(samePixels(canvas, both));
+
+    // The local user has nothing to undo
+    minipaint->UndoCommand();
+    REQUIRE(samePixels(canvas, both));
+
+    // A's stroke covers rows 197..202 of tile columns 1..4; B's later stroke stays on top
+    Counter &tilesRepaired = MetricsRegistry::Get().counter("strokes.tiles_repaired");
+    std::uint64_t repairedBefore = tilesRepaired.get();
+    minipaint->UndoCommand(userA);
+    REQUIRE(tilesRepaired.get() - repairedBefore == 4);
+    REQUIRE(samePixels(canvas, onlyB));
+
+    // B drawing again does not discard A's redo
+    minipaint->ExecuteCommand(new Draw(minipaint, 600, 600, sf::Color::Blue, 3), userB);
+    minipaint->AddCommand(userB);
+    minipaint->UndoCommand(userB);
+    REQUIRE(samePixels(canvas, onlyB));
+    minipaint->RedoCommand(userA);
+    REQUIRE(samePixels(canvas, both));
+    minipaint->Destroy();
+}
+
+/*! \brief Test that the PaintCore owns its commands: invalidated redo actions and actions past the history
+ * budget are released back to the command pool, which stops growing once warmed up.
+ */
+TEST_CASE("Commands are released when redo is invalidated or history exceeds its budget") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    CommandPool &pool = CommandPool::Get();
+    const std::size_t liveBefore = pool.liveCount();
+    std::size_t reservedAfterWarmUp = 0;
+
+    // Draw a stroke and undo it, over and over; each new stroke drops the previous redo action
+    for (int round = 0; round < 200; round++) {
+        minipaint->ExecuteCommand(new Draw(minipaint, 100, 100 + round, sf::Color::Red, 2));
+        for (int i = 1; i < 10; i++) {
+            minipaint->ExecuteCommand(new Draw(minipaint, 100 + 10 * (i - 1), 100 + round, 100 + 10 * i,
+                                               100 + round, sf::Color::Red, 2));
+        }
+        minipaint->AddCommand();
+        minipaint->UndoCommand();
+        if (round == 0) {
+            reservedAfterWarmUp = pool.reservedBytes();
+        }
+    }
+    REQUIRE(pool.liveCount() - liveBefore == 10);
+    REQUIRE(pool.reservedBytes() == reservedAfterWarmUp);
+
+    // With a budget of three strokes, only the last three can be undone
+    minipaint->SetHistoryBudget(0);
+    minipaint->ExecuteCommand(new Draw(minipaint, 10, 10, sf::Color::Blue, 2));
+    minipaint->AddCommand();
+    const std::size_t strokeBytes = minipaint->GetHistoryBytes();
+    minipaint->SetHistoryBudget(3 * strokeBytes);
+    for (int stroke = 1; stroke < 10; stroke++) {
+        minipaint->ExecuteCommand(new Draw(minipaint, 10 + 20 * stroke, 10, sf::Color::Blue, 2));
+        minipaint->AddCommand();
+    }
+    REQUIRE(minipaint->GetHistoryBytes() == 3 * strokeBytes);
+    REQUIRE(pool.liveCount() - liveBefore == 3);
+    for (int stroke = 0; stroke < 10; stroke++) {
+        minipaint->UndoCommand();
+    }
+    REQUIRE(pixelColor(minipaint, 10 + 20 * 6, 10) == sf::Color::Blue);
+    REQUIRE(pixelColor(minipaint, 10 + 20 * 7, 10) == sf::Color::White);
+
+    minipaint->Destroy();
+    REQUIRE(pool.liveCount() == liveBefore);
+    REQUIRE(MetricsRegistry::Get().gauge("commands.live_bytes").get() == static_cast<std::int64_t>(pool.liveBytes()));
+}
+
+// Setup for tests: 4-connected flood fill one pixel at a time, through getPixel, as a reference
+std::vector<bool> naiveRegion(const Canvas &canvas, int x, int y, int tolerance) {
+    const int width = static_cast<int>(canvas.getWidth());
+    std::vector<bool> inRegion(canvas.getWidth() * canvas.getHeight(), false);
+    sf::Color seed = colorFromPixel(canvas.getPixel(x, y));
+    auto matches = [&](int px, int py) {
+        sf::Color color = colorFromPixel(canvas.getPixel(px, py));
+        return std::abs(color.r - seed.r) <= tolerance && std::abs(color.g - seed.g) <= tolerance &&
+               std::abs(color.b - seed.b) <= tolerance && std::abs(color.a - seed.a) <= tolerance;
+    };
+    std::deque<std::pair<int, int>> queue{std::make_pair(x, y)};
+    inRegion[y * width + x] = true;
+    while (!queue.empty()) {
+        std::pair<int, int> pixel = queue.front();
+        queue.pop_front();
+        const int dx[] = {1, -1, 0, 0};
+        const int dy[] = {0, 0, 1, -1};
+        for (int i = 0; i < 4; i++) {
+            int nx = pixel.first + dx[i];
+            int ny = pixel.second + dy[i];
+            if (canvas.contains(nx, ny) && !inRegion[ny * width + nx] && matches(nx, ny)) {
+                inRegion[ny * width + nx] = true;
+                queue.emplace_back(nx, ny);
+            }
+        }
+    }
+    return inRegion;
+}
+
+/*! \brief Test that the scanline fill finds the same region as a pixel-by-pixel fill, exactly and with a
+ * tolerance, and that a flood fill command undoes, redoes and replays identically on another peer.
+ */
+TEST_CASE("Scanline flood fill matches a per-pixel fill and undoes as a span list") {
+    // Noise of a few close colors: regions are ragged, and a tolerance joins neighbouring shades
+    Canvas noise(160, 120, pixelFromColor(sf::Color::White));
+    std::uint32_t seed = 777;
+    for (int y = 0; y < 120; y++) {
+        for (int x = 0; x < 160; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            std::uint8_t shade = static_cast<std::uint8_t>(100 + ((seed >> 12) % 4) * 10);
+            noise.setPixel(x, y, pixelFromColor(sf::Color(shade, shade, shade)));
+        }
+    }
+    for (int tolerance : {0, 10, 20, 30}) {
+        FillRegion region;
+        ScanlineFill::findRegion(noise, 80, 60, tolerance, region);
+        std::vector<bool> expected = naiveRegion(noise, 80, 60, tolerance);
+        std::size_t expectedCount = 0;
+        int differences = 0;
+        for (int y = 0; y < 120; y++) {
+            for (int x = 0; x < 160; x++) {
+                differences += region.contains(x, y) != expected[y * 160 + x] ? 1 : 0;
+                expectedCount += expected[y * 160 + x] ? 1 : 0;
+            }
+        }
+        REQUIRE(differences == 0);
+        REQUIRE(region.pixelCount() == expectedCount);
+    }
+    FillRegion offCanvas;
+    ScanlineFill::findRegion(noise, -1, 5, 0, offCanvas);
+    REQUIRE(offCanvas.empty());
+
+    // Fill the inside of a closed box, on two peers given the same operations
+    PaintCore *peers[2] = {new PaintCore(), new PaintCore()};
+    for (PaintCore *minipaint : peers) {
+        minipaint->InitCanvas();
+        minipaint->ExecuteCommand(new Draw(minipaint, 100, 100, 300, 100, sf::Color::Black, 2));
+        minipaint->ExecuteCommand(new Draw(minipaint, 300, 100, 300, 300, sf::Color::Black, 2));
+        minipaint->ExecuteCommand(new Draw(minipaint, 300, 300, 100, 300, sf::Color::Black, 2));
+        minipaint->ExecuteCommand(new Draw(minipaint, 100, 300, 100, 100, sf::Color::Black, 2));
+        minipaint->AddCommand();
+        minipaint->m_paintedPixels.clear();
+        minipaint->FillDisplay(new FloodFill(minipaint, 200, 200, sf::Color::Red.toInteger(), 0));
+    }
+    PaintCore *minipaint = peers[0];
+    REQUIRE(pixelColor(minipaint, 200, 200) == sf::Color::Red);
+    REQUIRE(pixelColor(minipaint, 103, 103) == sf::Color::Red);
+    REQUIRE(pixelColor(minipaint, 100, 200) == sf::Color::Black);
+    REQUIRE(pixelColor(minipaint, 50, 50) == sf::Color::White);
+    REQUIRE(samePixels(peers[0]->GetCanvas(), peers[1]->GetCanvas()));
+    // The fill is stored as one span per row, not a pixel per pixel
+    REQUIRE(minipaint->GetStrokeStore().getByteSize() < 8192);
+
+    // A seed off the canvas fills nothing and is not added to the history
+    minipaint->FillDisplay(new FloodFill(minipaint, -5, 2000, sf::Color::Blue.toInteger(), 0));
+    minipaint->UndoCommand();
+    REQUIRE(pixelColor(minipaint, 200, 200) == sf::Color::White);
+    REQUIRE(pixelColor(minipaint, 100, 200) == sf::Color::Black);
+    minipaint->RedoCommand();
+    REQUIRE(pixelColor(minipaint, 200, 200) == sf::Color::Red);
+    for (PaintCore *peer : peers) {
+        peer->Destroy();
+        delete peer;
+    }
+}
+
+/*! \brief Benchmark flood fills covering the whole canvas: a blank canvas (one long span per row), a
+ * serpentine maze (the region winds through every row many times) and a noise canvas with a tolerance
+ * which joins every pixel. Each is checked against a pixel-by-pixel fill.
+ */
+TEST_CASE("Scanline flood fill benchmark over whole-canvas worst cases", "[.benchmark]") {
+    const int width = 1000;
+    const int height = 850;
+    Canvas blank(width, height, pixelFromColor(sf::Color::White));
+    Canvas maze = blank;
+    // Vertical walls every 4 columns, with a gap alternately at the top and the bottom
+    for (int x = 2; x < width; x += 4) {
+        int gap = (x / 4) % 2 == 0 ? height - 1 : 0;
+        for (int y = 0; y < height; y++) {
+            if (y != gap) {
+                maze.setPixel(x, y, pixelFromColor(sf::Color::Black));
+            }
+        }
+    }
+    Canvas noise = blank;
+    std::uint32_t seed = 99;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            std::uint8_t shade = static_cast<std::uint8_t>(200 + (seed >> 12) % 40);
+            noise.setPixel(x, y, pixelFromColor(sf::Color(shade, shade, shade)));
+        }
+    }
+    struct Case {
+        const char *name;
+        const Canvas *canvas;
+        int tolerance;
+    };
+    for (const Case &test : {Case{"blank", &blank, 0}, Case{"maze", &maze, 0}, Case{"noise", &noise, 64}}) {
+        FillRegion region;
+        ScanlineFill::findRegion(*test.canvas, 0, 0, test.tolerance, region);
+        std::vector<bool> expected = naiveRegion(*test.canvas, 0, 0, test.tolerance);
+        std::size_t expectedCount = 0;
+        for (bool pixel : expected) {
+            expectedCount += pixel ? 1 : 0;
+        }
+        REQUIRE(region.pixelCount() == expectedCount);
+        REQUIRE(region.pixelCount() > static_cast<std::size_t>(width * height / 2));
+    }
+}
+
+// Setup for tests: a canvas of vertical walls every 4 columns, each with a gap alternately at the
+// top and the bottom, so the free pixels form one corridor winding through every row
+Canvas mazeCanvas(int width, int height) {
+    Canvas maze(width, height, pixelFromColor(sf::Color::White));
+    for (int x = 2; x < width; x += 4) {
+        int gap = (x / 4) % 2 == 0 ? height - 1 : 0;
+        for (int y = 0; y < height; y++) {
+            if (y != gap) {
+                maze.setPixel(x, y, pixelFromColor(sf::Color::Black));
+            }
+        }
+    }
+    return maze;
+}
+
+// Setup for tests: whether two regions hold the same spans
+bool sameSpans(const FillRegion &a, const FillRegion &b) {
+    if (a.getSpans().size() != b.getSpans().size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.getSpans().size(); i++) {
+        const FillRegion::Span &left = a.getSpans()[i];
+        const FillRegion::Span &right = b.getSpans()[i];
+        if (left.y != right.y || left.x0 != right.x0 || left.x1 != right.x1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! \brief Test that fills, color replace, clears, snapshot restores and tile repairs split across
+ * threads give exactly the pixels and spans of the serial versions.
+ */
+TEST_CASE("Parallel region operations are bit-identical to serial") {
+    const int width = 700;
+    const int height = 530;
+    Canvas maze = mazeCanvas(width, height);
+    // Blobs of a few close shades, so a tolerance changes which of them connect
+    Canvas blobs(width, height, pixelFromColor(sf::Color::White));
+    std::uint32_t seed = 4242;
+    for (int blob = 0; blob < 400; blob++) {
+        seed = seed * 1664525u + 1013904223u;
+        int cx = static_cast<int>((seed >> 8) % width);
+        int cy = static_cast<int>((seed >> 4) % height);
+        std::uint8_t shade = static_cast<std::uint8_t>(90 + (seed >> 20) % 5 * 8);
+        BrushEngine::strokeSegment(blobs, cx, cy, cx + 40, cy + 25, 6, pixelFromColor(sf::Color(shade, shade, shade)),
+                                   nullptr);
+    }
+
+    ThreadPool serial(1);
+    for (unsigned threads : {2u, 4u, 8u}) {
+        ThreadPool pool(threads);
+        REQUIRE(pool.size() == threads);
+        for (const Canvas *canvas : {&maze, &blobs}) {
+            for (int tolerance : {0, 8, 16}) {
+                for (int seedX : {0, 351, 699}) {
+                    FillRegion expected;
+                    FillRegion parallel;
+                    ScanlineFill::findRegion(*canvas, seedX, 265, tolerance, expected);
+                    ScanlineFill::findRegion(*canvas, seedX, 265, tolerance, parallel, pool);
+                    REQUIRE(sameSpans(expected, parallel));
+                }
+            }
+            FillRegion matching;
+            FillRegion matchingSerial;
+            ScanlineFill::findMatching(*canvas, pixelFromColor(sf::Color(98, 98, 98)), 8, matching, pool);
+            ScanlineFill::findMatching(*canvas, pixelFromColor(sf::Color(98, 98, 98)), 8, matchingSerial, serial);
+            REQUIRE(sameSpans(matching, matchingSerial));
+        }
+
+        // Clear, fill a region and restore a snapshot
+        Canvas a = blobs;
+        Canvas b = blobs;
+        FillRegion region;
+        ScanlineFill::findRegion(maze, 0, 0, 0, region);
+        RegionOps::fillRegion(a, region, pixelFromColor(sf::Color::Red), a.getBounds(), pool);
+        RegionOps::fillRegion(b, region, pixelFromColor(sf::Color::Red), b.getBounds(), serial);
+        REQUIRE(samePixels(a, b));
+        int firstRow;
+        int lastRow;
+        REQUIRE(a.takeDirtyRows(firstRow, lastRow));
+        REQUIRE(firstRow == 0);
+        REQUIRE(lastRow == height - 1);
+        RegionOps::fillRect(a, CanvasRect{13, 40, 650, 470}, pixelFromColor(sf::Color::Blue), pool);
+        RegionOps::fillRect(b, CanvasRect{13, 40, 650, 470}, pixelFromColor(sf::Color::Blue), serial);
+        REQUIRE(samePixels(a, b));
+        RegionOps::restore(a, blobs, pool);
+        REQUIRE(samePixels(a, blobs));
+    }
+
+    // Undoing a fill under many strokes repairs every tile; the threads must not change a pixel
+    StrokeStore stores[2];
+    Canvas canvases[2] = {Canvas(width, height, pixelFromColor(sf::Color::White)),
+                          Canvas(width, height, pixelFromColor(sf::Color::White))};
+    ThreadPool pool(4);
+    stores[1].setThreadPool(pool);
+    for (int i = 0; i < 2; i++) {
+        stores[i].setThreadPool(i == 0 ? serial : pool);
+        StrokeStore::OpId fill = stores[i].addFill(pixelFromColor(sf::Color::Green));
+        stores[i].rasterize(fill, canvases[i], canvases[i].getBounds());
+        std::uint32_t strokeSeed = 5;
+        for (int stroke = 0; stroke < 2000; stroke++) {
+            strokeSeed = strokeSeed * 1664525u + 1013904223u;
+            int x = static_cast<int>((strokeSeed >> 8) % width);
+            int y = static_cast<int>((strokeSeed >> 4) % height);
+            StrokeStore::OpId op = stores[i].addSegment(BrushId::Square, pixelFromColor(sf::Color::Black), 3, false, 0,
+                                                       0, x, y);
+            stores[i].rasterize(op, canvases[i], canvases[i].getBounds());
+        }
+        stores[i].setVisible(fill, false);
+        stores[i].repair(canvases[i], pixelFromColor(sf::Color::White));
+    }
+    REQUIRE(samePixels(canvases[0], canvases[1]));
+    REQUIRE(colorFromPixel(canvases[1].getPixel(0, 0)) != sf::Color::Green);
+}
+
+/*! \brief Benchmark region operations on a large canvas with 1, 2, 4 and 8 threads: a flood fill
+ * of a winding corridor, replacing a color, clearing the canvas and restoring a snapshot. Each thread
+ * count is a section, so --durations shows how they scale.
+ */
+TEST_CASE("Parallel region operations scaling benchmark", "[.benchmark]") {
+    const int width = 4000;
+    const int height = 3000;
+    Canvas maze = mazeCanvas(width, height);
+    FillRegion reference;
+    ScanlineFill::findRegion(maze, 0, 0, 0, reference);
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        SECTION(std::to_string(threads) + " threads") {
+            ThreadPool pool(threads);
+            Canvas canvas = maze;
+            FillRegion region;
+            ScanlineFill::findRegion(maze, 0, 0, 0, region, pool);
+            REQUIRE(sameSpans(region, reference));
+            FillRegion walls;
+            ScanlineFill::findMatching(maze, pixelFromColor(sf::Color::Black), 0, walls, pool);
+            RegionOps::fillRegion(canvas, walls, pixelFromColor(sf::Color::Red), canvas.getBounds(), pool);
+            RegionOps::fillRect(canvas, canvas.getBounds(), pixelFromColor(sf::Color::White), pool);
+            RegionOps::restore(canvas, maze, pool);
+            REQUIRE(samePixels(canvas, maze));
+        }
+    }
+}
+
+/*! \brief Test the work-stealing pool: loops over items and ranges cover everything exactly once,
+ * even nested inside tasks; pinned tasks run on their worker; queued tasks run before the pool is
+ * destroyed; and the workers report what they did.
+ */
+TEST_CASE("Work-stealing pool runs nested loops, task groups and pinned tasks") {
+    ThreadPool pool(4);
+    std::vector<std::atomic<int>> hits(5000);
+    for (std::atomic<int> &hit : hits) {
+        hit.store(0);
+    }
+    // Each outer item splits into a nested loop, so workers steal what the others split off
+    pool.parallelFor(50, [&](std::size_t outer) {
+        pool.parallelFor(outer * 100, outer * 100 + 100, 7, [&](std::size_t first, std::size_t last) {
+            for (std::size_t item = first; item < last; item++) {
+                hits[item].fetch_add(1);
+            }
+        });
+    });
+    int wrong = 0;
+    for (std::atomic<int> &hit : hits) {
+        wrong += hit.load() != 1 ? 1 : 0;
+    }
+    REQUIRE(wrong == 0);
+
+    // A group of groups
+    std::atomic<int> total(0);
+    {
+        TaskGroup outer(pool);
+        for (int i = 0; i < 20; i++) {
+            outer.run([&pool, &total] {
+                TaskGroup inner(pool);
+                for (int j = 0; j < 10; j++) {
+                    inner.run([&total] { total.fetch_add(1); });
+                }
+                inner.wait();
+            });
+        }
+        outer.wait();
+        REQUIRE(total.load() == 200);
+    }
+
+    // Affinity: a pinned task runs on the worker it was pinned to
+    std::vector<int> ranOn(3, -2);
+    TaskGroup pinned(pool);
+    for (int worker = 0; worker < 3; worker++) {
+        pinned.runOn(worker, [&pool, &ranOn, worker] { ranOn[worker] = pool.currentWorker(); });
+    }
+    pinned.wait();
+    REQUIRE(ranOn == std::vector<int>({0, 1, 2}));
+    REQUIRE(pool.currentWorker() == -1);
+
+    std::vector<ThreadPool::WorkerStats> stats = pool.getWorkerStats();
+    REQUIRE(stats.size() == 3);
+    std::uint64_t tasks = 0;
+    for (const ThreadPool::WorkerStats &worker : stats) {
+        tasks += worker.tasks;
+        REQUIRE(worker.utilization >= 0.0);
+        REQUIRE(worker.utilization <= 1.0);
+    }
+    REQUIRE(tasks >= 3);
+
+    // Tasks nobody waits for still run before the pool goes away; a one-thread pool still runs them on
+    // its worker, off the caller
+    std::atomic<int> submitted(0);
+    {
+        ThreadPool background(3);
+        for (int i = 0; i < 10; i++) {
+            background.submit([&submitted] { submitted.fetch_add(1); });
+        }
+    }
+    REQUIRE(submitted.load() == 10);
+    ThreadPool single(1);
+    REQUIRE(single.size() == 1);
+    std::promise<int> ranOnWorker;
+    single.submit([&single, &ranOnWorker] { ranOnWorker.set_value(single.currentWorker()); });
+    REQUIRE(ranOnWorker.get_future().get() == 0);
+}
+
+/*! \brief Test the priority lanes: while long background jobs keep the pool busy, at most all but
+ * one worker runs them, and an interactive loop still finishes long before they do.
+ */
+TEST_CASE("Interactive tasks are not starved by background tasks") {
+    ThreadPool pool(4);
+    std::atomic<int> running(0);
+    std::atomic<int> mostRunning(0);
+    std::atomic<int> finished(0);
+    for (int i = 0; i < 6; i++) {
+        pool.submit([&] {
+            int now = running.fetch_add(1) + 1;
+            int most = mostRunning.load();
+            while (now > most && !mostRunning.compare_exchange_weak(most, now)) {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(40));
+            running.fetch_sub(1);
+            finished.fetch_add(1);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    std::atomic<int> interactive(0);
+    auto start = std::chrono::steady_clock::now();
+    pool.parallelFor(64, [&interactive](std::size_t) { interactive.fetch_add(1); });
+    double interactiveMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    REQUIRE(interactive.load() == 64);
+    INFO("interactive loop finished in " << interactiveMs << " ms behind 6 x 40 ms background jobs");
+    REQUIRE(finished.load() < 6);
+    while (finished.load() < 6) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    REQUIRE(mostRunning.load() <= 2);
+}
+
+/*! \brief Test that the SIMD blend kernel gives exactly the scalar kernel's pixels for every mode,
+ * opacity and row length (including the leftover pixels past a multiple of four)
+*
+*/
+TEST_CASE("Blend kernels match the scalar reference for every mode") {
+    std::uint32_t seed = 4242;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed;
+    };
+    const std::uint8_t opacities[] = {0, 1, 77, 128, 254, 255};
+    int mismatches = 0;
+    for (int mode = 0; mode < static_cast<int>(BlendMode::Count); mode++) {
+        for (std::uint8_t opacity : opacities) {
+            for (int count = 0; count < 40; count++) {
+                std::vector<Canvas::Pixel> source(count);
+                std::vector<Canvas::Pixel> below(count);
+                for (int i = 0; i < count; i++) {
+                    source[i] = next();
+                    // Some runs of fully transparent pixels, which the SIMD kernel skips
+                    if (i % 9 < 4 && count % 3 == 0) {
+                        source[i] &= ~Canvas::fromRGBA(0xFF);
+                    }
+                    below[i] = next() | Canvas::fromRGBA(0xFF);
+                }
+                std::vector<Canvas::Pixel> simd = below;
+                std::vector<Canvas::Pixel> scalar = below;
+                BlendKernels::blendRow(simd.data(), source.data(), count, static_cast<BlendMode>(mode), opacity);
+                BlendKernels::blendRowScalar(scalar.data(), source.data(), count, static_cast<BlendMode>(mode),
+                                             opacity);
+                mismatches += simd == scalar ? 0 : 1;
+            }
+        }
+    }
+    REQUIRE(mismatches == 0);
+
+    // Half-transparent red over white, and the modes against known values
+    Canvas::Pixel white = Canvas::fromRGBA(0xFFFFFFFF);
+    Canvas::Pixel halfRed = Canvas::fromRGBA(0xFF000080);
+    Canvas::Pixel out = white;
+    BlendKernels::blendRow(&out, &halfRed, 1, BlendMode::Normal, 255);
+    REQUIRE(Canvas::toRGBA(out) == 0xFF7F7FFF);
+    out = white;
+    Canvas::Pixel red = Canvas::fromRGBA(0xFF0000FF);
+    BlendKernels::blendRow(&out, &red, 1, BlendMode::Multiply, 255);
+    REQUIRE(Canvas::toRGBA(out) == 0xFF0000FF);
+    BlendKernels::blendRow(&out, &white, 1, BlendMode::Screen, 255);
+    REQUIRE(Canvas::toRGBA(out) == 0xFFFFFFFF);
+    out = Canvas::fromRGBA(0x102030FF);
+    Canvas::Pixel grey = Canvas::fromRGBA(0x808080FF);
+    BlendKernels::blendRow(&out, &grey, 1, BlendMode::Add, 255);
+    REQUIRE(Canvas::toRGBA(out) == 0x90A0B0FF);
+}
+
+// Setup for tests: the layers of a PaintCore composited from scratch with the scalar kernel
+Canvas referenceFlatten(PaintCore *minipaint) {
+    LayerStack &layers = minipaint->GetLayers();
+    const Canvas &base = minipaint->GetCanvas(LayerStack::kBaseLayer);
+    Canvas flat(base.getWidth(), base.getHeight(), pixelFromColor(minipaint->m_canvas));
+    std::vector<Canvas::Pixel> row(base.getWidth());
+    std::vector<Canvas::Pixel> source(base.getWidth());
+    for (int y = 0; y < static_cast<int>(base.getHeight()); y++) {
+        flat.readSpan(y, 0, static_cast<int>(row.size()), row.data());
+        for (std::size_t i = 0; i < layers.size(); i++) {
+            LayerStack::Layer &layer = layers.at(i);
+            layer.canvas.readSpan(y, 0, static_cast<int>(source.size()), source.data());
+            BlendKernels::blendRowScalar(row.data(), source.data(), static_cast<int>(row.size()), layer.blend,
+                                         layer.opacity);
+        }
+        flat.writeSpan(y, 0, static_cast<int>(row.size()), row.data());
+    }
+    return flat;
+}
+
+/*! \brief Test the layer stack: painting on a layer composites only the tiles it touched, opacity,
+ * blend mode and order changes are undoable commands holding no pixels, and the cached flattened
+ * image always equals compositing every layer from scratch
+*
+*/
+TEST_CASE("Layers composite with blend modes and opacity, recomputing only dirty tiles") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    LayerStack &layers = minipaint->GetLayers();
+    Canvas &flat = minipaint->GetFlattened();
+    ThreadPool &pool = ThreadPool::Get();
+    REQUIRE(layers.size() == 1);
+    REQUIRE(layers.flatten(flat, pool) == 0);
+
+    // An empty layer changes no tile
+    int layer = minipaint->NewLayerId();
+    REQUIRE(layer != LayerStack::kBaseLayer);
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Add, layer, 1), 0);
+    REQUIRE(layers.size() == 2);
+    REQUIRE(layers.indexOf(layer) == 1);
+    REQUIRE(layers.flatten(flat, pool) == 0);
+    minipaint->SelectLayer(layer);
+    REQUIRE(minipaint->EraserColor() == sf::Color::Transparent);
+
+    // A dab inside one tile composites that tile only, and leaves the base layer alone
+    minipaint->ExecuteCommand(new Draw(minipaint, 100, 100, sf::Color::Red, 4));
+    minipaint->AddCommand();
+    REQUIRE(layers.flatten(flat, pool) == 1);
+    REQUIRE(colorFromPixel(flat.getPixel(100, 100)) == sf::Color::Red);
+    REQUIRE(colorFromPixel(minipaint->GetCanvas(LayerStack::kBaseLayer).getPixel(100, 100)) == sf::Color::White);
+
+    // Property changes composite the tiles the layer was painted on, nothing else
+    std::size_t historyBefore = minipaint->GetHistoryBytes();
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Opacity, layer, 128), 0);
+    REQUIRE(layers.flatten(flat, pool) == 1);
+    REQUIRE(Canvas::toRGBA(flat.getPixel(100, 100)) == 0xFF7F7FFF);
+    minipaint->ExecuteAction(
+            new LayerCommand(minipaint, LayerCommand::Kind::Blend, layer, static_cast<int>(BlendMode::Screen)), 0);
+    REQUIRE(layers.flatten(flat, pool) == 1);
+    REQUIRE(colorFromPixel(flat.getPixel(100, 100)) == sf::Color::White);
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Blend, layer, 0), 0);
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Move, layer, 0), 0);
+    REQUIRE(layers.indexOf(layer) == 0);
+    REQUIRE(colorFromPixel(minipaint->GetFlattened().getPixel(100, 100)) == sf::Color::White);
+    // A change to what the layer already is, or of a missing layer, is not an action
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Move, layer, 0), 0);
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Opacity, 9999, 10), 0);
+    // Four layer changes, none of which copied the layer
+    REQUIRE(minipaint->GetHistoryBytes() - historyBefore == 4 * sizeof(LayerCommand));
+
+    // Undo walks the changes back
+    minipaint->UndoCommand();
+    REQUIRE(layers.indexOf(layer) == 1);
+    REQUIRE(Canvas::toRGBA(minipaint->GetFlattened().getPixel(100, 100)) == 0xFF7F7FFF);
+    minipaint->UndoCommand();
+    minipaint->UndoCommand();
+    minipaint->UndoCommand();
+    REQUIRE(colorFromPixel(minipaint->GetFlattened().getPixel(100, 100)) == sf::Color::Red);
+    REQUIRE(samePixels(minipaint->GetFlattened(), referenceFlatten(minipaint)));
+
+    // Erasing on the layer shows the base layer through it
+    minipaint->ExecuteCommand(new Draw(minipaint, 100, 100, minipaint->EraserColor(), 2));
+    minipaint->AddCommand();
+    REQUIRE(colorFromPixel(minipaint->GetFlattened().getPixel(100, 100)) == sf::Color::White);
+    REQUIRE(colorFromPixel(minipaint->GetFlattened().getPixel(103, 103)) == sf::Color::Red);
+    minipaint->UndoCommand();
+
+    // Undoing the add takes the layer out with its strokes and goes back to the base layer; redo restores both
+    minipaint->UndoCommand();
+    minipaint->UndoCommand();
+    REQUIRE(layers.size() == 1);
+    REQUIRE(minipaint->GetActiveLayer() == LayerStack::kBaseLayer);
+    REQUIRE(colorFromPixel(minipaint->GetFlattened().getPixel(100, 100)) == sf::Color::White);
+    minipaint->RedoCommand();
+    REQUIRE(layers.size() == 2);
+    minipaint->RedoCommand();
+    REQUIRE(colorFromPixel(minipaint->GetFlattened().getPixel(100, 100)) == sf::Color::Red);
+
+    // A peer's draw names its layer; an unknown layer falls back to the base layer
+    Draw *remote = new Draw(minipaint, 500, 500, sf::Color::Blue, 3);
+    remote->setLayer(layer);
+    minipaint->ExecuteCommand(remote, 7);
+    Draw *stray = new Draw(minipaint, 700, 700, sf::Color::Green, 3);
+    stray->setLayer(12345);
+    minipaint->ExecuteCommand(stray, 7);
+    minipaint->AddCommand(7);
+    REQUIRE(colorFromPixel(minipaint->GetCanvas(layer).getPixel(500, 500)) == sf::Color::Blue);
+    REQUIRE(colorFromPixel(minipaint->GetCanvas(LayerStack::kBaseLayer).getPixel(700, 700)) == sf::Color::Green);
+    REQUIRE(samePixels(minipaint->GetFlattened(), referenceFlatten(minipaint)));
+
+    // Layer changes travel as the layer id and the new value
+    myPacket p;
+    PaintMessage change{8, static_cast<int>(LayerCommand::Kind::Opacity), layer, 200, 0};
+    change.layer = layer;
+    p << change;
+    PaintMessage decoded;
+    p >> decoded;
+    REQUIRE(decoded.command == 8);
+    REQUIRE(decoded.y == layer);
+    REQUIRE(decoded.color == 200);
+    REQUIRE(decoded.layer == layer);
+    minipaint->Destroy();
+    delete minipaint;
+}
+
+/*! \brief Benchmark compositing eight full layers with the SIMD and the scalar kernel, and the cost
+ * of keeping the flattened image up to date after one dab; each is a section of its own
+*
+*/
+TEST_CASE("Layer compositing benchmark", "[.benchmark]") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    LayerStack &layers = minipaint->GetLayers();
+    std::uint32_t seed = 99;
+    for (int i = 0; i < 8; i++) {
+        int layer = minipaint->NewLayerId();
+        minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Add, layer, i + 1), 0);
+        minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Opacity, layer, 60 + i * 20), 0);
+        minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Blend, layer, i % 4), 0);
+        Canvas &canvas = minipaint->GetCanvas(layer);
+        for (int y = 0; y < static_cast<int>(canvas.getHeight()); y++) {
+            for (int x = 0; x < static_cast<int>(canvas.getWidth()); x += 16) {
+                seed = seed * 1664525u + 1013904223u;
+                canvas.fillSpan(y, x, x + 16, seed);
+            }
+        }
+    }
+    Canvas &flat = minipaint->GetFlattened();
+    const int width = static_cast<int>(flat.getWidth());
+    const int height = static_cast<int>(flat.getHeight());
+    std::vector<Canvas::Pixel> row(width);
+    // Every layer's rows, copied out of their tiles beforehand so that the kernel sections time only the kernels
+    std::vector<std::vector<Canvas::Pixel>> sources(layers.size());
+    for (std::size_t i = 0; i < layers.size(); i++) {
+        sources[i].resize(static_cast<std::size_t>(width) * height);
+        for (int y = 0; y < height; y++) {
+            layers.at(i).canvas.readSpan(y, 0, width, &sources[i][static_cast<std::size_t>(y) * width]);
+        }
+    }
+    auto composite = [&](bool simd) {
+        for (int y = 0; y < height; y++) {
+            std::fill(row.begin(), row.end(), Canvas::fromRGBA(0xFFFFFFFF));
+            for (std::size_t i = 0; i < layers.size(); i++) {
+                LayerStack::Layer &layer = layers.at(i);
+                const Canvas::Pixel *source = &sources[i][static_cast<std::size_t>(y) * width];
+                if (simd) {
+                    BlendKernels::blendRow(row.data(), source, width, layer.blend, layer.opacity);
+                } else {
+                    BlendKernels::blendRowScalar(row.data(), source, width, layer.blend, layer.opacity);
+                }
+            }
+        }
+    };
+    SECTION("SIMD kernel") {
+        composite(true);
+    }
+    SECTION("scalar kernel") {
+        composite(false);
+    }
+    SECTION("flatten all tiles, then after a dab") {
+        layers.invalidate();
+        std::size_t allTiles = layers.flatten(flat, ThreadPool::Get());
+        minipaint->SelectLayer(layers.at(4).id);
+        minipaint->ExecuteCommand(new Draw(minipaint, 300, 300, sf::Color::Red, 4));
+        minipaint->AddCommand();
+        std::size_t dabTiles = layers.flatten(flat, ThreadPool::Get());
+        REQUIRE(dabTiles == 1);
+        REQUIRE(allTiles == static_cast<std::size_t>(flat.getTileColumns() * flat.getTileRows()));
+        REQUIRE(samePixels(flat, referenceFlatten(minipaint)));
+    }
+    minipaint->Destroy();
+    delete minipaint;
+}
+
+/*! \brief Test that a client's layer ids skip those still in use and run out after 255 layers,
+ * rather than wrapping onto a live layer.
+ */
+TEST_CASE("New layer ids never collide with live layers") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    std::set<int> ids;
+    for (int i = 0; i < 255; i++) {
+        int layer = minipaint->NewLayerId();
+        REQUIRE(layer > 0);
+        REQUIRE(ids.insert(layer).second);
+        minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Add, layer, 1), 0);
+    }
+    REQUIRE(minipaint->NewLayerId() == -1);
+
+    // Starting over frees every id again
+    minipaint->InitCanvas();
+    int layer = minipaint->NewLayerId();
+    REQUIRE(ids.count(layer) == 1);
+    minipaint->Destroy();
+    delete minipaint;
+}
+
+TEST_CASE("Round brush stamps and the masked kernel are exact and match their references") {
+    std::uint32_t seed = 777;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed;
+    };
+    const std::uint8_t strengths[] = {1, 64, 200, 255};
+    int mismatches = 0;
+    for (std::uint8_t strength : strengths) {
+        for (int count = 0; count < 40; count++) {
+            std::vector<std::uint8_t> coverage(count);
+            std::vector<Canvas::Pixel> below(count);
+            for (int i = 0; i < count; i++) {
+                coverage[i] = i % 7 < 3 ? 0 : static_cast<std::uint8_t>(next() >> 24);
+                // Mostly opaque pixels, which the SIMD kernel handles, with some translucent ones
+                below[i] = next();
+                if (count % 4 != 1) {
+                    below[i] |= Canvas::fromRGBA(0xFF);
+                }
+            }
+            Canvas::Pixel color = next();
+            std::vector<Canvas::Pixel> simd = below;
+            std::vector<Canvas::Pixel> scalar = below;
+            BlendKernels::sourceOverMasked(simd.data(), coverage.data(), count, color, strength);
+            BlendKernels::sourceOverMaskedScalar(scalar.data(), coverage.data(), count, color, strength);
+            mismatches += simd == scalar ? 0 : 1;
+        }
+    }
+    REQUIRE(mismatches == 0);
+
+    // Full coverage replaces; over transparent pixels the color keeps its value at any alpha
+    Canvas::Pixel out = Canvas::fromRGBA(0xFFFFFFFF);
+    std::uint8_t full = 255;
+    BlendKernels::sourceOverMasked(&out, &full, 1, Canvas::fromRGBA(0xFF0000FF), 255);
+    REQUIRE(Canvas::toRGBA(out) == 0xFF0000FF);
+    out = 0;
+    std::uint8_t half = 128;
+    BlendKernels::sourceOverMasked(&out, &half, 1, Canvas::fromRGBA(0x00FF00FF), 255);
+    REQUIRE(Canvas::toRGBA(out) == 0x00FF0080);
+    BlendKernels::eraseMasked(&out, &full, 1, 255);
+    REQUIRE((Canvas::toRGBA(out) & 0xFF) == 0);
+
+    // The compile-time tables are what the generator makes at run time
+    std::vector<std::uint8_t> generated;
+    for (int radius = 1; radius <= BrushStamps::kMaxTableRadius; radius++) {
+        BrushStamps::StampSet stamps = BrushStamps::get(radius, 255);
+        REQUIRE(stamps.owner == nullptr);
+        REQUIRE(stamps.size == 2 * radius + 1);
+        for (int subY = 0; subY < BrushStamps::kSubPixel; subY++) {
+            for (int subX = 0; subX < BrushStamps::kSubPixel; subX++) {
+                generated.assign(static_cast<std::size_t>(stamps.size) * stamps.size, 0);
+                BrushStamps::generate(radius, 255, subX, subY, generated.data());
+                REQUIRE(std::equal(generated.begin(), generated.end(), stamps.at(subX, subY)));
+            }
+        }
+    }
+
+    // A dab centered on a pixel corner covers the pixels around it fully and its rim partly
+    BrushStamps::StampSet hard = BrushStamps::get(6, 255);
+    const std::uint8_t *centered = hard.at(0, 0);
+    REQUIRE(centered[6 * hard.size + 6] == 255);
+    REQUIRE(centered[0] == 0);
+    int partial = static_cast<int>(std::count_if(centered, centered + hard.size * hard.size,
+                                                 [](std::uint8_t c) { return c > 0 && c < 255; }));
+    REQUIRE(partial > 0);
+    // A soft stamp is made once, cached, and fades towards its rim
+    std::size_t cached = BrushStamps::cachedCount();
+    BrushStamps::StampSet soft = BrushStamps::get(6, 0);
+    REQUIRE(soft.owner != nullptr);
+    REQUIRE(BrushStamps::get(6, 0).coverage == soft.coverage);
+    REQUIRE(BrushStamps::cachedCount() >= cached);
+    const std::uint8_t *fading = soft.at(0, 0);
+    REQUIRE(fading[6 * soft.size + 6] > fading[6 * soft.size + 9]);
+    REQUIRE(fading[6 * soft.size + 9] > fading[6 * soft.size + 11]);
+    REQUIRE(fading[6 * soft.size + 9] < centered[6 * hard.size + 9]);
+}
+
+TEST_CASE("Round brush strokes blend, and replay the same on every peer and after undo") {
+    BrushTip tip(BrushId::Round, 100, 180);
+    REQUIRE(BrushTip::unpack(tip.pack()) == tip);
+    REQUIRE(BrushTip::unpack(0) == BrushTip());
+
+    PaintMessage sent{1, 40, 50, 0, 5};
+    sent.brush = tip.pack();
+    sf::Packet packet;
+    packet << sent;
+    PaintMessage received;
+    packet >> received;
+    REQUIRE(received.brush == sent.brush);
+
+    // Two peers paint the same overlapping strokes, one of them also undoing and redoing
+    PaintCore *peers[2] = {new PaintCore(), new PaintCore()};
+    for (PaintCore *peer : peers) {
+        peer->InitCanvas();
+        peer->brushTip = tip;
+        int x = 100;
+        int y = 100;
+        for (int i = 0; i < 30; i++) {
+            int toX = 100 + (i * 37) % 200;
+            int toY = 100 + (i * 53) % 150;
+            peer->ExecuteCommand(new Draw(peer, x, y, toX, toY, i % 2 ? sf::Color::Red : sf::Color::Blue, 3 + i % 9));
+            x = toX;
+            y = toY;
+        }
+        peer->AddCommand();
+        peer->ExecuteCommand(new Draw(peer, 400, 300, sf::Color::Black, 12));
+        peer->AddCommand();
+        peer->GetFlattened();
+    }
+    Canvas before(peers[0]->GetCanvas());
+    REQUIRE(samePixels(before, peers[1]->GetCanvas()));
+    peers[1]->UndoCommand();
+    peers[1]->UndoCommand();
+    peers[1]->RedoCommand();
+    peers[1]->RedoCommand();
+    REQUIRE(samePixels(before, peers[1]->GetCanvas()));
+
+    // The dab is solid at its center and blends into the white canvas at its rim
+    std::uint32_t center = Canvas::toRGBA(before.getPixel(400, 300));
+    REQUIRE(center != 0xFFFFFFFF);
+    REQUIRE((center & 0xFF) == 0xFF);
+    int blended = 0;
+    for (int x = 386; x <= 414; x++) {
+        std::uint32_t value = Canvas::toRGBA(before.getPixel(x, 300));
+        blended += value != 0xFFFFFFFF && value != center ? 1 : 0;
+    }
+    REQUIRE(blended >= 2);
+
+    // Rebuilding tile by tile gives what painting whole segments gave
+    Canvas rebuilt(before.getWidth(), before.getHeight(), 0);
+    peers[0]->GetStrokeStore().rebuild(rebuilt, rebuilt.getBounds(), pixelFromColor(peers[0]->m_canvas));
+    REQUIRE(samePixels(before, rebuilt));
+    for (PaintCore *peer : peers) {
+        peer->Destroy();
+        delete peer;
+    }
+}
+
+/*! \brief Benchmark 4000 dabs of the round brush, hard and soft, at a few radii, and of the square
+ * brush for comparison; each brush and radius is a section.
+ */
+TEST_CASE("Round brush dab benchmark", "[.benchmark]") {
+    Canvas canvas(1024, 1024, Canvas::fromRGBA(0xFFFFFFFF));
+    const BrushTip tips[] = {BrushTip(BrushId::Round), BrushTip(BrushId::Round, 64, 200)};
+    const int radii[] = {2, 8, 24};
+    for (const BrushTip &tip : tips) {
+        for (int radius : radii) {
+            SECTION("round dab radius " + std::to_string(radius) + " hardness " + std::to_string(tip.hardness)) {
+                for (int i = 0; i < 4000; i++) {
+                    int x = 50 + (i * 31) % 900;
+                    int y = 50 + (i * 17) % 900;
+                    BrushEngine::paintSegment(canvas, x, y, x, y, false,
+                                              BrushDescriptor{tip, radius, Canvas::fromRGBA(0x3366CCFF)},
+                                              canvas.getBounds());
+                }
+                REQUIRE(canvas.getPixel(50, 50) != Canvas::fromRGBA(0xFFFFFFFF));
+            }
+        }
+    }
+    SECTION("square dab radius 8") {
+        for (int i = 0; i < 4000; i++) {
+            int x = 50 + (i * 31) % 900;
+            int y = 50 + (i * 17) % 900;
+            BrushEngine::strokeSegment(canvas, x, y, x, y, 8, Canvas::fromRGBA(0x3366CCFF), nullptr);
+        }
+        REQUIRE(canvas.getPixel(50, 50) != Canvas::fromRGBA(0xFFFFFFFF));
+    }
+}
+
+/*! \brief Test that brush sizes from the network are clamped to what the UI can send, and flood
+ * fill tolerances to their range, while other commands keep their size field as it is.
+ */
+TEST_CASE("Received brush sizes are clamped") {
+    sf::Packet packet;
+    packet << PaintMessage{1, 10, 10, 0, 1000000} << PaintMessage{1, 10, 10, 0, -5}
+           << PaintMessage{7, 10, 10, 0, 300} << PaintMessage{1, 10, 10, 0, 12};
+    PaintMessage huge;
+    PaintMessage negative;
+    PaintMessage tolerance;
+    PaintMessage normal;
+    packet >> huge >> negative >> tolerance >> normal;
+    REQUIRE(huge.size == PaintMessage::kMaxBrushSize);
+    REQUIRE(negative.size == 1);
+    REQUIRE(tolerance.size == 255);
+    REQUIRE(normal.size == 12);
+}
+
+TEST_CASE("Specialized brush kernels paint exactly what the generic kernels paint") {
+    std::uint32_t seed = 31337;
+    auto next = [&seed](int range) {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<int>((seed >> 8) % static_cast<std::uint32_t>(range));
+    };
+    const BrushTip tips[] = {BrushTip(BrushId::Square), BrushTip(BrushId::Round), BrushTip(BrushId::Round, 90, 170)};
+    const Canvas::Pixel colors[] = {Canvas::fromRGBA(0xC03020FF), Canvas::fromRGBA(0x2040F080), 0};
+    int mismatches = 0;
+    for (const BrushTip &tip : tips) {
+        for (Canvas::Pixel color : colors) {
+            for (int radius = 1; radius <= BrushKernels::kMaxFixedRadius + 2; radius++) {
+                BrushDescriptor brush{tip, radius, color};
+                REQUIRE((BrushKernels::select(brush) == BrushKernels::generic(brush)) ==
+                        (radius > BrushKernels::kMaxFixedRadius));
+                Canvas specialized(160, 120, Canvas::fromRGBA(0x80808080));
+                Canvas generic(specialized);
+                for (int i = 0; i < 20; i++) {
+                    int x0 = next(180) - 10;
+                    int y0 = next(140) - 10;
+                    int x1 = i % 3 == 0 ? x0 : x0 + next(40) - 20;
+                    int y1 = i % 3 == 0 ? y0 : y0 + next(40) - 20;
+                    bool continues = i % 2 == 1;
+                    CanvasRect clip = i % 4 == 0 ? CanvasRect{next(80), next(60), 80 + next(80), 60 + next(60)}
+                                                 : specialized.getBounds();
+                    BrushEngine::paintSegment(specialized, x0, y0, x1, y1, continues, brush, clip);
+                    BrushKernels::generic(brush)(generic, x0, y0, x1, y1, continues, brush, clip);
+                }
+                mismatches += samePixels(specialized, generic) ? 0 : 1;
+            }
+        }
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(BrushKernels::blendOf(BrushDescriptor{BrushTip(BrushId::Round), 3, 0}) == BrushBlend::Erase);
+    REQUIRE(BrushKernels::blendOf(BrushDescriptor{BrushTip(BrushId::Square), 3, 0}) == BrushBlend::Replace);
+
+    // Choosing an engine brush replaces the paint function; Draw then records a stroke with it
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    minipaint->UpdatePaintbrush(&standardPaintFunc);
+    minipaint->UpdatePaintbrush(BrushTip(BrushId::Round, 200, 255));
+    REQUIRE(minipaint->m_paintFunc == nullptr);
+    REQUIRE(minipaint->brushTip == BrushTip(BrushId::Round, 200, 255));
+    minipaint->mouseX = 200;
+    minipaint->mouseY = 150;
+    minipaint->strokeSize = 5;
+    minipaint->ExecuteCommand(new Draw(minipaint));
+    minipaint->AddCommand();
+    REQUIRE(minipaint->GetStrokeStore().strokeCount() == 1);
+    REQUIRE(pixelColor(minipaint, 200, 150) == sf::Color::Black);
+    REQUIRE(pixelColor(minipaint, 200, 156) == sf::Color::White);
+    minipaint->Destroy();
+    delete minipaint;
+}
+
+/*! \brief Benchmark the kernel specialized for each brush and radius against the generic one, over
+ * 20000 dabs and short segments; each brush, radius and kernel is a section.
+ */
+TEST_CASE("Specialized brush kernel benchmark", "[.benchmark]") {
+    Canvas canvas(1024, 1024, Canvas::fromRGBA(0xFFFFFFFF));
+    const BrushTip tips[] = {BrushTip(BrushId::Square), BrushTip(BrushId::Round)};
+    const int radii[] = {2, 4, 8};
+    for (const BrushTip &tip : tips) {
+        for (int radius : radii) {
+            BrushDescriptor brush{tip, radius, Canvas::fromRGBA(0x3366CCFF)};
+            auto run = [&](SegmentKernel kernel) {
+                for (int i = 0; i < 20000; i++) {
+                    int x = 50 + (i * 31) % 900;
+                    int y = 50 + (i * 17) % 900;
+                    // Dabs, and short segments as mouse samples give
+                    int toX = i % 2 == 0 ? x : x + 5;
+                    int toY = i % 2 == 0 ? y : y + 3;
+                    kernel(canvas, x, y, toX, toY, i % 2 == 1, brush, canvas.getBounds());
+                }
+                REQUIRE(canvas.getPixel(50, 50) != Canvas::fromRGBA(0xFFFFFFFF));
+            };
+            const std::string name = std::string(tip.id == BrushId::Round ? "round" : "square") + " brush radius " +
+                                     std::to_string(radius);
+            SECTION(name + ", generic kernel") {
+                run(BrushKernels::generic(brush));
+            }
+            SECTION(name + ", specialized kernel") {
+                run(BrushKernels::select(brush));
+            }
+        }
+    }
+}
+
+TEST_CASE("Run-length encoding round trips and gives up on noise") {
+    std::vector<Canvas::Pixel> pixels(5000, Canvas::fromRGBA(0xFFFFFFFF));
+    for (std::size_t i = 1000; i < 1300; i++) {
+        pixels[i] = Canvas::fromRGBA(0x10203000u | static_cast<std::uint32_t>(i % 7));
+    }
+    std::vector<std::uint8_t> encoded;
+    REQUIRE(ProjectFile::encodeRuns(pixels.data(), pixels.size(), encoded));
+    REQUIRE(encoded.size() < pixels.size() * sizeof(Canvas::Pixel) / 4);
+    std::vector<Canvas::Pixel> decoded(pixels.size());
+    REQUIRE(ProjectFile::decodeRuns(encoded.data(), encoded.size(), decoded.data(), decoded.size()));
+    REQUIRE(decoded == pixels);
+    // Too few or too many pixels in the data is malformed
+    REQUIRE_FALSE(ProjectFile::decodeRuns(encoded.data(), encoded.size(), decoded.data(), decoded.size() - 1));
+    REQUIRE_FALSE(ProjectFile::decodeRuns(encoded.data(), encoded.size() - 1, decoded.data(), decoded.size()));
+
+    std::uint32_t seed = 7;
+    for (Canvas::Pixel &pixel : pixels) {
+        seed = seed * 1664525u + 1013904223u;
+        pixel = Canvas::fromRGBA(seed);
+    }
+    REQUIRE_FALSE(ProjectFile::encodeRuns(pixels.data(), pixels.size(), encoded));
+    REQUIRE(encoded.empty());
+}
+
+TEST_CASE("Projects save and load their layers, and damage is detected") {
+    const std::string path = "test_project.cpnt";
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    minipaint->ExecuteCommand(new Draw(minipaint, 100, 100, 300, 200, sf::Color::Red, 6));
+    minipaint->AddCommand();
+    int top = minipaint->NewLayerId();
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Add, top, 1), 0);
+    minipaint->SelectLayer(top);
+    minipaint->ExecuteCommand(new Draw(minipaint, 200, 150, sf::Color::Blue, 30));
+    minipaint->AddCommand();
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Opacity, top, 140), 0);
+    minipaint->ExecuteAction(
+            new LayerCommand(minipaint, LayerCommand::Kind::Blend, top, static_cast<int>(BlendMode::Multiply)), 0);
+    // A layer which was added, painted and then undone is kept, out of the stack
+    int undone = minipaint->NewLayerId();
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Add, undone, 2), 0);
+    minipaint->SelectLayer(undone);
+    minipaint->ExecuteCommand(new Draw(minipaint, 900, 800, sf::Color::Green, 10));
+    minipaint->AddCommand();
+    minipaint->UndoCommand();
+    minipaint->UndoCommand();
+    minipaint->SelectLayer(top);
+
+    std::shared_future<bool> saved = minipaint->SaveProject(path);
+    // The drawing can change while the file is written; the file holds it as it was
+    Canvas flattened(minipaint->GetFlattened());
+    Canvas topCanvas(minipaint->GetCanvas(top));
+    Canvas undoneCanvas(minipaint->GetCanvas(undone));
+    minipaint->ExecuteCommand(new Draw(minipaint, 500, 500, sf::Color::Black, 20));
+    minipaint->AddCommand();
+    REQUIRE(saved.get());
+
+    PaintCore *loaded = new PaintCore();
+    loaded->InitCanvas();
+    std::string error;
+    REQUIRE(loaded->LoadProject(path, error));
+    REQUIRE(samePixels(loaded->GetFlattened(), flattened));
+    REQUIRE(samePixels(loaded->GetCanvas(top), topCanvas));
+    REQUIRE(samePixels(loaded->GetCanvas(undone), undoneCanvas));
+    LayerStack &layers = loaded->GetLayers();
+    REQUIRE(layers.size() == 2);
+    REQUIRE(layers.indexOf(top) == 1);
+    REQUIRE(layers.indexOf(undone) == -1);
+    REQUIRE(layers.find(top)->opacity == 140);
+    REQUIRE(layers.find(top)->blend == BlendMode::Multiply);
+    REQUIRE(loaded->GetActiveLayer() == top);
+
+    // Painting and undoing after a load goes back to what was loaded, not to a blank canvas
+    loaded->ExecuteCommand(new Draw(loaded, 210, 160, sf::Color::Yellow, 15));
+    loaded->AddCommand();
+    loaded->UndoCommand();
+    REQUIRE(samePixels(loaded->GetFlattened(), flattened));
+
+    // The index reads any one chunk on its own
+    ProjectReader reader;
+    REQUIRE(reader.open(path));
+    REQUIRE(reader.getInfo().width == flattened.getWidth());
+    REQUIRE(reader.getInfo().layers.size() == 3);
+    REQUIRE_FALSE(reader.getChunks().empty());
+    // Untouched base tiles are not stored
+    REQUIRE(reader.getChunks().size() < static_cast<std::size_t>(flattened.getTileColumns() * flattened.getTileRows()));
+    ProjectChunk chunk;
+    REQUIRE(reader.readChunk(reader.getChunks().size() - 1, chunk));
+    REQUIRE(chunk.pixels.size() <= static_cast<std::size_t>(Canvas::kTileSize * Canvas::kTileSize));
+
+    // Flipping a byte of a chunk, or of the header, is caught by its checksum
+    std::vector<char> bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto corrupt = [&](std::size_t offset) {
+        std::vector<char> damaged(bytes);
+        damaged[offset] ^= 0x40;
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(damaged.data(), static_cast<std::streamsize>(damaged.size()));
+    };
+    corrupt(static_cast<std::size_t>(reader.getChunks().front().offset));
+    REQUIRE_FALSE(loaded->LoadProject(path, error));
+    REQUIRE_FALSE(error.empty());
+    corrupt(8);
+    REQUIRE_FALSE(loaded->LoadProject(path, error));
+    // A failed load leaves the drawing alone
+    REQUIRE(samePixels(loaded->GetFlattened(), flattened));
+    REQUIRE_FALSE(loaded->LoadProject("missing_project.cpnt", error));
+
+    std::remove(path.c_str());
+    for (PaintCore *core : {minipaint, loaded}) {
+        core->Destroy();
+        delete core;
+    }
+}
+
+/*! \brief Benchmark saving a 4096x4096 project with 400 strokes on it and loading it back.
+ */
+TEST_CASE("Project save and load benchmark", "[.benchmark]") {
+    const std::string path = "test_project_benchmark.cpnt";
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas(4096, 4096);
+    for (int i = 0; i < 400; i++) {
+        minipaint->ExecuteCommand(new Draw(minipaint, (i * 97) % 4096, (i * 61) % 4096, ((i + 1) * 97) % 4096,
+                                           ((i + 1) * 61) % 4096, i % 2 ? sf::Color::Red : sf::Color::Blue, 8));
+    }
+    minipaint->AddCommand();
+    REQUIRE(minipaint->SaveProject(path).get());
+
+    PaintCore *loaded = new PaintCore();
+    loaded->InitCanvas();
+    std::string error;
+    REQUIRE(loaded->LoadProject(path, error));
+    REQUIRE(samePixels(loaded->GetFlattened(), minipaint->GetFlattened()));
+    std::remove(path.c_str());
+    for (PaintCore *core : {minipaint, loaded}) {
+        core->Destroy();
+        delete core;
+    }
+}
+
+TEST_CASE("Autosave journals only the tiles changed and recovers after a crash") {
+    const std::string path = "test_autosave.cpnt";
+    for (const std::string &file : {path, path + ".journal", path + ".journal.old"}) {
+        std::remove(file.c_str());
+    }
+    Counter &tilesSaved = MetricsRegistry::Get().counter("autosave.tiles");
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas();
+    minipaint->EnableAutosave(path, std::chrono::milliseconds(0));
+    AutosaveJournal *journal = minipaint->GetAutosave();
+    REQUIRE(journal != nullptr);
+    REQUIRE_FALSE(minipaint->AutosaveIfDue());
+
+    // The first checkpoint holds everything drawn, which on a blank canvas is no tile at all: tiles
+    // holding only the background are not saved. Later ones hold only the tiles written since.
+    std::uint64_t tiles = tilesSaved.get();
+    REQUIRE(minipaint->Autosave());
+    journal->wait();
+    REQUIRE(tilesSaved.get() == tiles);
+    const std::uint64_t fullBytes = journal->getJournalBytes();
+    tiles = tilesSaved.get();
+    minipaint->ExecuteCommand(new Draw(minipaint, 100, 100, sf::Color::Red, 5));
+    minipaint->AddCommand();
+    REQUIRE(minipaint->Autosave());
+    journal->wait();
+    REQUIRE(tilesSaved.get() - tiles == 1);
+    REQUIRE(journal->getJournalBytes() - fullBytes < 1024);
+    // Nothing changed, nothing written
+    std::uint64_t bytes = journal->getJournalBytes();
+    REQUIRE(minipaint->Autosave());
+    journal->wait();
+    REQUIRE(journal->getJournalBytes() == bytes);
+
+    // Layer changes are journaled, and so is a tile going back to what it was
+    int layer = minipaint->NewLayerId();
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Add, layer, 1), 0);
+    minipaint->SelectLayer(layer);
+    minipaint->ExecuteCommand(new Draw(minipaint, 400, 300, 600, 320, sf::Color::Blue, 8));
+    minipaint->AddCommand();
+    minipaint->ExecuteAction(new LayerCommand(minipaint, LayerCommand::Kind::Opacity, layer, 99), 0);
+    REQUIRE(minipaint->Autosave());
+    journal->wait();
+    minipaint->SelectLayer(LayerStack::kBaseLayer);
+    minipaint->ExecuteCommand(new Draw(minipaint, 700, 700, sf::Color::Green, 5));
+    minipaint->AddCommand();
+    minipaint->UndoCommand();
+    REQUIRE(minipaint->Autosave());
+    journal->wait();
+    Canvas expected(minipaint->GetFlattened());
+    Canvas expectedLayer(minipaint->GetCanvas(layer));
+    bytes = journal->getJournalBytes();
+
+    // A crash part way through an append leaves a torn record, which recovery skips
+    minipaint->ExecuteCommand(new Draw(minipaint, 50, 50, sf::Color::Black, 5));
+    minipaint->AddCommand();
+    std::vector<std::uint8_t> record;
+    AutosaveJournal::encodeRecord(*journal->capture(minipaint->GetLayers(), LayerStack::kBaseLayer), record);
+    {
+        std::ofstream file(path + ".journal", std::ios::binary | std::ios::app);
+        file.write(reinterpret_cast<const char *>(record.data()), static_cast<std::streamsize>(record.size() / 2));
+    }
+    minipaint->Destroy();
+    delete minipaint;
+
+    PaintCore *recovered = new PaintCore();
+    recovered->InitCanvas();
+    recovered->EnableAutosave(path, std::chrono::milliseconds(0));
+    std::string error;
+    REQUIRE(recovered->RecoverAutosave(error));
+    REQUIRE(samePixels(recovered->GetFlattened(), expected));
+    REQUIRE(samePixels(recovered->GetCanvas(layer), expectedLayer));
+    REQUIRE(recovered->GetLayers().find(layer)->opacity == 99);
+    // Recovery starts the files over from the recovered drawing
+    REQUIRE(std::ifstream(path).good());
+    REQUIRE_FALSE(std::ifstream(path + ".journal").good());
+    AutosaveJournal *resumed = recovered->GetAutosave();
+    REQUIRE(resumed->getJournalBytes() == 0);
+    tiles = tilesSaved.get();
+    recovered->ExecuteCommand(new Draw(recovered, 300, 600, sf::Color::Magenta, 4));
+    recovered->AddCommand();
+    REQUIRE(recovered->Autosave());
+    resumed->wait();
+    REQUIRE(tilesSaved.get() - tiles == 1);
+
+    // Once the journal outgrows the base, compaction folds it into the base in the background
+    resumed->setCompactBytes(0);
+    recovered->ExecuteCommand(new Draw(recovered, 0, 0, 999, 849, sf::Color::Cyan, 20));
+    recovered->AddCommand();
+    REQUIRE(recovered->Autosave());
+    resumed->wait();
+    REQUIRE_FALSE(std::ifstream(path + ".journal").good());
+    REQUIRE_FALSE(std::ifstream(path + ".journal.old").good());
+    ProjectSnapshot snapshot;
+    REQUIRE(AutosaveJournal::recover(path, snapshot, error));
+    PaintCore *check = new PaintCore();
+    check->InitCanvas();
+    REQUIRE(check->LoadProject(path, error));
+    REQUIRE(samePixels(check->GetFlattened(), recovered->GetFlattened()));
+
+    // A compaction interrupted after moving the journal aside is replayed before the newer journal
+    resumed->setCompactBytes(AutosaveJournal::kMinCompactBytes);
+    recovered->ExecuteCommand(new Draw(recovered, 500, 500, sf::Color::Red, 9));
+    recovered->AddCommand();
+    recovered->Autosave();
+    resumed->wait();
+    std::rename((path + ".journal").c_str(), (path + ".journal.old").c_str());
+    recovered->ExecuteCommand(new Draw(recovered, 505, 500, sf::Color::Blue, 9));
+    recovered->AddCommand();
+    recovered->Autosave();
+    resumed->wait();
+    REQUIRE(AutosaveJournal::recover(path, snapshot, error));
+    std::string restoreError;
+    check->EnableAutosave(path, std::chrono::milliseconds(0));
+    REQUIRE(check->RecoverAutosave(restoreError));
+    REQUIRE(samePixels(check->GetFlattened(), recovered->GetFlattened()));
+
+    for (PaintCore *core : {recovered, check}) {
+        core->Destroy();
+        delete core;
+    }
+    for (const std::string &file : {path, path + ".journal", path + ".journal.old"}) {
+        std::remove(file.c_str());
+    }
+}
+
+/*! \brief Benchmark a first autosave checkpoint of a filled 4096x4096 canvas, then one after a
+ * stroke, which journals only the tiles the stroke changed.
+ */
+TEST_CASE("Autosave checkpoint benchmark", "[.benchmark]") {
+    const std::string path = "test_autosave_benchmark.cpnt";
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas(4096, 4096);
+    minipaint->EnableAutosave(path, std::chrono::milliseconds(0));
+    AutosaveJournal *journal = minipaint->GetAutosave();
+    // Something on every tile, so that the first checkpoint holds them all
+    minipaint->FillDisplay(new FillDisplay(minipaint, sf::Color::Yellow.toInteger()));
+    minipaint->Autosave();
+    journal->wait();
+    std::uint64_t bytes = journal->getJournalBytes();
+    // A busy few seconds: a stroke across a corner of the canvas
+    for (int i = 0; i < 40; i++) {
+        minipaint->ExecuteCommand(new Draw(minipaint, 100 + i * 10, 100 + i * 5, 110 + i * 10, 105 + i * 5,
+                                           sf::Color::Red, 6));
+    }
+    minipaint->AddCommand();
+    minipaint->Autosave();
+    journal->wait();
+    REQUIRE(journal->getJournalBytes() - bytes < bytes);
+    minipaint->Destroy();
+    delete minipaint;
+    for (const std::string &file : {path, path + ".journal", path + ".journal.old"}) {
+        std::remove(file.c_str());
+    }
+}
+
+// Setup for tests: delete every segment of an op log
+void removeOpLog(const std::string &prefix) {
+    for (std::uint32_t segment = 0; std::remove(OpLog::segmentPath(prefix, segment).c_str()) == 0; segment++) {
+    }
+}
+
+TEST_CASE("Op log frames, rotates and reopens, and stops at a torn record") {
+    const std::string prefix = "test_oplog";
+    removeOpLog(prefix);
+    OpLog::Options options;
+    options.segmentBytes = 512;
+    std::vector<std::string> records;
+    {
+        OpLog log(prefix, options);
+        REQUIRE(log.getNextSequence() == 1);
+        for (int i = 0; i < 100; i++) {
+            records.push_back(std::string(static_cast<std::size_t>(i % 37), static_cast<char>('a' + i % 26)));
+            REQUIRE(log.append(records.back().data(), records.back().size()) == static_cast<std::uint64_t>(i + 1));
+            if (i % 10 == 9) {
+                REQUIRE(log.flush());
+            }
+        }
+        REQUIRE(log.flush());
+        REQUIRE(log.getDurableSequence() == 100);
+    }
+    // Small segments rotate between batches
+    REQUIRE(std::ifstream(OpLog::segmentPath(prefix, 1)).good());
+    std::vector<std::string> read;
+    std::uint64_t expected = 1;
+    bool ordered = true;
+    REQUIRE(OpLog::replay(prefix, [&](std::uint64_t sequence, const std::uint8_t *data, std::size_t size) {
+        ordered = ordered && sequence == expected++;
+        read.push_back(std::string(reinterpret_cast<const char *>(data), size));
+    }) == 100);
+    REQUIRE(ordered);
+    REQUIRE(read == records);
+
+    // A crash part way through a write leaves a partial record at the end of the last segment
+    std::uint32_t last = 0;
+    while (std::ifstream(OpLog::segmentPath(prefix, last + 1)).good()) {
+        last++;
+    }
+    {
+        std::ofstream torn(OpLog::segmentPath(prefix, last), std::ios::binary | std::ios::app);
+        torn.write("\x43\x50\x4F\x4C\x40\x00\x00\x00\x65", 9);
+    }
+    REQUIRE(OpLog::replay(prefix, [](std::uint64_t, const std::uint8_t *, std::size_t) {}) == 100);
+
+    // Reopening carries on the sequence in a new segment, after the torn one
+    {
+        OpLog log(prefix, options);
+        REQUIRE(log.getNextSequence() == 101);
+        REQUIRE(log.append("more", 4) == 101);
+    }
+    REQUIRE(std::ifstream(OpLog::segmentPath(prefix, last + 1)).good());
+    std::uint64_t lastSequence = 0;
+    REQUIRE(OpLog::replay(prefix, [&](std::uint64_t sequence, const std::uint8_t *data, std::size_t size) {
+        lastSequence = sequence;
+        read.push_back(std::string(reinterpret_cast<const char *>(data), size));
+    }) == 101);
+    REQUIRE(lastSequence == 101);
+    REQUIRE(read.back() == "more");
+    removeOpLog(prefix);
+}
+
+TEST_CASE("Op log syncs once per batch, not once per record") {
+    const std::string prefix = "test_oplog_batches";
+    removeOpLog(prefix);
+    Counter &flushes = MetricsRegistry::Get().counter("oplog.flushes");
+    const char record[] = "a relayed packet";
+    {
+        // Records arriving every 100 us gather for a flush interval of 5 ms, so about 50 share each sync
+        OpLog::Options options;
+        options.flushInterval = std::chrono::milliseconds(5);
+        OpLog log(prefix, options);
+        const std::uint64_t flushesBefore = flushes.get();
+        std::uint64_t last = 0;
+        for (int i = 0; i < 2000; i++) {
+            last = log.append(record, sizeof(record));
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        const auto appended = std::chrono::steady_clock::now();
+        while (log.getDurableSequence() < last &&
+               std::chrono::steady_clock::now() - appended < std::chrono::seconds(10)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        REQUIRE(log.getDurableSequence() == last);
+        REQUIRE(flushes.get() - flushesBefore > 0);
+        REQUIRE(flushes.get() - flushesBefore < last / 10);
+    }
+    {
+        // A batch which reaches flushBytes is written without waiting out the interval
+        OpLog::Options options;
+        options.flushInterval = std::chrono::seconds(60);
+        options.flushBytes = 64 * (OpLog::kFrameBytes + sizeof(record));
+        OpLog log(prefix, options);
+        std::uint64_t last = 0;
+        for (int i = 0; i < 64; i++) {
+            last = log.append(record, sizeof(record));
+        }
+        const auto appended = std::chrono::steady_clock::now();
+        while (log.getDurableSequence() < last &&
+               std::chrono::steady_clock::now() - appended < std::chrono::seconds(10)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        REQUIRE(log.getDurableSequence() == last);
+    }
+    REQUIRE(OpLog::replay(prefix, [](std::uint64_t, const std::uint8_t *, std::size_t) {}) == 2064);
+    removeOpLog(prefix);
+}
+
+TEST_CASE("Replaying the server's op log rebuilds the canvas") {
+    const std::string prefix = "test_oplog_replay";
+    removeOpLog(prefix);
+    PaintCore *live = new PaintCore();
+    live->InitCanvas();
+    {
+        OpLog log(prefix, OpLog::Options());
+        UDPNetworkServer server;
+        server.setOpLog(&log);
+        // What two clients send, relayed by the server in this order
+        std::vector<PaintMessage> messages;
+        for (int i = 0; i < 40; i++) {
+            PaintMessage draw{1, 100 + i * 7, 200 + (i * 13) % 90, static_cast<int>(0xFF0000FFu), 4};
+            draw.fromX = i % 10 == 0 ? -1 : 93 + i * 7;
+            draw.fromY = 200;
+            draw.client = 1 + i / 20;
+            draw.brush = BrushTip(i < 20 ? BrushId::Square : BrushId::Round).pack();
+            messages.push_back(draw);
+            if (i % 10 == 9) {
+                PaintMessage release{2, 0, 0, 0, 0};
+                release.client = draw.client;
+                messages.push_back(release);
+            }
+        }
+        PaintMessage undo{3, 0, 0, 0, 0};
+        undo.client = 2;
+        messages.push_back(undo);
+        PaintMessage layer{8, static_cast<int>(LayerCommand::Kind::Add), 1 << 16, 1, 0};
+        layer.client = 1;
+        messages.push_back(layer);
+        PaintMessage flood{7, 500, 500, static_cast<int>(0x00FF00FFu), 0};
+        flood.client = 2;
+        messages.push_back(flood);
+        PaintMessage onLayer{1, 150, 210, static_cast<int>(0x0000FFFFu), 9};
+        onLayer.client = 1;
+        onLayer.layer = 1 << 16;
+        messages.push_back(onLayer);
+        // A join is not an operation and is not logged
+        messages.push_back(PaintMessage{0, 0, 0, 0, 0});
+        for (const PaintMessage &message : messages) {
+            myPacket packet;
+            packet << message;
+            server.send(packet);
+            live->ApplyMessage(message);
+        }
+        REQUIRE(log.getNextSequence() == messages.size());
+    }
+    PaintCore *replayed = new PaintCore();
+    replayed->InitCanvas();
+    REQUIRE(replayed->ReplayOpLog(prefix) == 48);
+    REQUIRE(samePixels(replayed->GetFlattened(), live->GetFlattened()));
+    REQUIRE(replayed->GetLayers().size() == 2);
+    REQUIRE(colorFromPixel(replayed->GetFlattened().getPixel(150, 210)) == sf::Color::Blue);
+    removeOpLog(prefix);
+    for (PaintCore *core : {live, replayed}) {
+        core->Destroy();
+        delete core;
+    }
+}
+
+TEST_CASE("The timeline seeks to any frame without disturbing the live drawing, and exports frames") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas(512, 384);
+    minipaint->EnableTimeline(4, HistoryTimeline::kDefaultByteBudget);
+    std::shared_ptr<HistoryTimeline> timeline = minipaint->GetTimeline();
+    // The image after each frame, as the live drawing had it
+    std::vector<Canvas> expected;
+    auto frameIfNew = [&]() {
+        timeline->wait();
+        if (timeline->getFrameCount() > expected.size()) {
+            expected.push_back(minipaint->GetFlattened());
+        }
+        REQUIRE(timeline->getFrameCount() == expected.size());
+    };
+    frameIfNew();
+    REQUIRE(expected.size() == 1);
+    for (int i = 0; i < 12; i++) {
+        // A stroke of 40 segments: one frame once 32 are drawn, one at its end
+        for (int j = 0; j < 40; j++) {
+            PaintMessage draw{1, 20 + j * 10, 20 + i * 30, static_cast<int>(i % 2 ? 0xFF0000FFu : 0x0000FFFFu), 3};
+            draw.fromX = j == 0 ? -1 : 10 + j * 10;
+            draw.fromY = 20 + i * 30;
+            draw.client = 1;
+            minipaint->ApplyMessage(draw);
+            frameIfNew();
+        }
+        PaintMessage release{2, 0, 0, 0, 0};
+        release.client = 1;
+        minipaint->ApplyMessage(release);
+        frameIfNew();
+    }
+    PaintMessage undo{3, 0, 0, 0, 0};
+    undo.client = 1;
+    minipaint->ApplyMessage(undo);
+    frameIfNew();
+    PaintMessage flood{7, 120, 20, static_cast<int>(0x00FF00FFu), 0};
+    flood.client = 2;
+    minipaint->ApplyMessage(flood);
+    frameIfNew();
+    // A join paints nothing and an undo with nothing to undo changes nothing: no frames
+    minipaint->ApplyMessage(PaintMessage{0, 0, 0, 0, 0});
+    PaintMessage nothing{3, 0, 0, 0, 0};
+    nothing.client = 3;
+    minipaint->ApplyMessage(nothing);
+    frameIfNew();
+    REQUIRE(expected.size() == 1 + 12 * 2 + 2);
+
+    const Canvas live = minipaint->GetFlattened();
+    Canvas image;
+    for (std::size_t frame = expected.size(); frame-- > 0;) {
+        REQUIRE(timeline->seek(frame, image));
+        REQUIRE(samePixels(image, expected[frame]));
+    }
+    REQUIRE_FALSE(timeline->seek(expected.size(), image));
+    REQUIRE(timeline->findFrame(timeline->getFrameTime(5)) == 5);
+    REQUIRE(timeline->findFrame(0) == 0);
+    // Compressed diffs and keyframes hold far less than a copy of every frame
+    REQUIRE(timeline->getByteSize() < 4 * live.getWidth() * live.getHeight());
+
+    // Seeking left the live drawing and its history alone: the last stroke can still be redone
+    REQUIRE(samePixels(minipaint->GetFlattened(), live));
+    PaintMessage redo{4, 0, 0, 0, 0};
+    redo.client = 1;
+    minipaint->ApplyMessage(redo);
+    frameIfNew();
+    REQUIRE(colorFromPixel(minipaint->GetFlattened().getPixel(30, 20 + 11 * 30)) == sf::Color::Red);
+
+    std::string error;
+    REQUIRE(timeline->exportFrames(2, 10, 4, "test_timelapse_", error));
+    for (int i = 0; i < 3; i++) {
+        const std::string path = "test_timelapse_00000" + std::to_string(i) + ".ppm";
+        std::ifstream file(path, std::ios::binary);
+        std::string header;
+        std::getline(file, header);
+        REQUIRE(header == "P6");
+        std::getline(file, header);
+        REQUIRE(header == "512 384");
+        std::getline(file, header);
+        std::vector<std::uint8_t> rgb(3 * 512 * 384);
+        REQUIRE(file.read(reinterpret_cast<char *>(rgb.data()), static_cast<std::streamsize>(rgb.size())));
+        // The middle of the first stroke, as frame 2 + 4i has it
+        const Canvas::Pixel pixel = expected[2 + 4 * i].getPixel(120, 20);
+        REQUIRE(std::memcmp(&rgb[(20 * 512 + 120) * 3], &pixel, 3) == 0);
+        file.close();
+        std::remove(path.c_str());
+    }
+    REQUIRE_FALSE(std::ifstream("test_timelapse_000003.ppm").good());
+    REQUIRE_FALSE(timeline->exportFrames(0, expected.size() + 1, 1, "test_timelapse_", error));
+    REQUIRE_FALSE(timeline->isExporting());
+
+    // An export claimed ahead of its task refuses others until it is done or given back
+    REQUIRE(timeline->tryBeginExport());
+    REQUIRE_FALSE(timeline->tryBeginExport());
+    REQUIRE_FALSE(timeline->exportFrames(0, 0, 1, "test_timelapse_", error));
+    REQUIRE(timeline->exportClaimedFrames(0, 0, 1, "test_timelapse_", error));
+    REQUIRE(std::remove("test_timelapse_000000.ppm") == 0);
+    REQUIRE(timeline->tryBeginExport());
+    timeline->cancelExport();
+    REQUIRE_FALSE(timeline->isExporting());
+    minipaint->Destroy();
+    delete minipaint;
+    // Whoever still holds the timeline can go on using it
+    REQUIRE(timeline->seek(expected.size() - 1, image));
+    REQUIRE(samePixels(image, expected.back()));
+}
+
+TEST_CASE("The timeline drops its oldest frames beyond its byte budget") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas(512, 384);
+    const std::uint64_t budget = 16 * 1024;
+    minipaint->EnableTimeline(4, budget);
+    std::shared_ptr<HistoryTimeline> timeline = minipaint->GetTimeline();
+    const std::uint64_t droppedBefore = MetricsRegistry::Get().counter("timeline.dropped_frames").get();
+    std::uint64_t frames = 1;
+    for (int i = 0; i < 200; i++) {
+        // Scattered dots, so every frame compresses a fresh tile
+        PaintMessage draw{1, (i * 97) % 512, (i * 61) % 384, static_cast<int>(i % 2 ? 0xFF0000FFu : 0x0000FFFFu), 5};
+        draw.fromX = -1;
+        draw.client = 1;
+        minipaint->ApplyMessage(draw);
+        PaintMessage release{2, 0, 0, 0, 0};
+        release.client = 1;
+        minipaint->ApplyMessage(release);
+        frames++;
+        timeline->wait();
+        // The budget holds, apart from the last keyframe and its diffs, which are always kept
+        REQUIRE((timeline->getByteSize() <= budget || timeline->getFrameCount() <= 4));
+    }
+    const std::uint64_t dropped = MetricsRegistry::Get().counter("timeline.dropped_frames").get() - droppedBefore;
+    REQUIRE(dropped > 0);
+    REQUIRE(timeline->getFrameCount() + dropped == frames);
+    // What is left still seeks to the right images
+    Canvas image;
+    REQUIRE(timeline->seek(timeline->getFrameCount() - 1, image));
+    REQUIRE(samePixels(image, minipaint->GetFlattened()));
+    REQUIRE(timeline->seek(0, image));
+    minipaint->Destroy();
+    delete minipaint;
+}
+
+TEST_CASE("Timeline seek benchmark", "[.benchmark]") {
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas(2048, 2048);
+    minipaint->EnableTimeline(HistoryTimeline::kDefaultKeyframeInterval, HistoryTimeline::kDefaultByteBudget);
+    std::shared_ptr<HistoryTimeline> timeline = minipaint->GetTimeline();
+    SECTION("paint 2000 strokes") {
+        for (int i = 0; i < 2000; i++) {
+            PaintMessage draw{1, (i * 97) % 2048, (i * 61) % 2048, static_cast<int>(i % 2 ? 0xFF0000FFu : 0x0000FFFFu),
+                              6};
+            draw.fromX = ((i + 1) * 97) % 2048;
+            draw.fromY = ((i + 1) * 61) % 2048;
+            draw.client = 1;
+            minipaint->ApplyMessage(draw);
+            PaintMessage release{2, 0, 0, 0, 0};
+            release.client = 1;
+            minipaint->ApplyMessage(release);
+        }
+        timeline->wait();
+        const std::size_t frames = timeline->getFrameCount();
+        REQUIRE(frames == 2001);
+        Canvas image;
+        SECTION("seek 50 frames") {
+            for (std::size_t i = 0; i < 50; i++) {
+                REQUIRE(timeline->seek((i * 7919) % frames, image));
+            }
+        }
+        REQUIRE(timeline->seek(frames - 1, image));
+        REQUIRE(samePixels(image, minipaint->GetFlattened()));
+    }
+    minipaint->Destroy();
+    delete minipaint;
+}
+
+TEST_CASE("A recorded session replays to the same canvas, at recorded speed if asked") {
+    const std::string path = "test_session.rec";
+    PaintCore *live = new PaintCore();
+    live->InitCanvas();
+    live->SetLocalClient(1);
+    std::uint64_t recorded = 0;
+    {
+        SessionRecorder recorder;
+        REQUIRE(recorder.open(path, PaintCore::kCanvasWidth, PaintCore::kCanvasHeight, 1, 5000));
+        std::vector<PaintMessage> messages;
+        for (int i = 0; i < 60; i++) {
+            PaintMessage draw{1, 300 + i * 5, 100 + (i * 11) % 70, static_cast<int>(0x202080FFu), 3};
+            draw.fromX = i % 15 == 0 ? -1 : 295 + i * 5;
+            draw.fromY = 100;
+            draw.client = 1 + i % 2;
+            messages.push_back(draw);
+        }
+        PaintMessage release{2, 0, 0, 0, 0};
+        release.client = 2;
+        messages.push_back(release);
+        PaintMessage undo{3, 0, 0, 0, 0};
+        undo.client = 2;
+        messages.push_back(undo);
+        PaintMessage fill{7, 20, 700, static_cast<int>(0x00FF00FFu), 0};
+        fill.client = 1;
+        messages.push_back(fill);
+        PaintMessage layer{8, static_cast<int>(LayerCommand::Kind::Add), 1 << 16, 1, 0};
+        layer.client = 1;
+        messages.push_back(layer);
+        std::int64_t time = 5000;
+        for (const PaintMessage &message : messages) {
+            sf::Packet packet;
+            packet << message;
+            const bool local = message.client == 1;
+            recorder.record(local ? SessionEvent::Direction::Outbound : SessionEvent::Direction::Inbound, time,
+                            packet.getData(), packet.getDataSize());
+            live->ApplyMessage(message);
+            // Messages arrive 0 to 3 ms apart, so the 80 ms session spans several frames
+            time += (recorder.getEventCount() % 4) * 1000;
+        }
+        recorded = recorder.getEventCount();
+        REQUIRE(recorded == messages.size());
+    }
+    // Compact: a draw message takes its packet plus a few bytes
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    const std::size_t fileBytes = static_cast<std::size_t>(file.tellg());
+    file.close();
+    REQUIRE(fileBytes < 20 + recorded * 60);
+
+    SessionReader reader;
+    REQUIRE(reader.open(path));
+    REQUIRE(reader.getWidth() == PaintCore::kCanvasWidth);
+    REQUIRE(reader.getLocalClient() == 1);
+    SessionEvent first;
+    REQUIRE(reader.next(first));
+    REQUIRE(first.direction == SessionEvent::Direction::Outbound);
+    REQUIRE(first.time == 0);
+
+    SessionReplay::Report report;
+    std::string error;
+    REQUIRE(SessionReplay::run(path, false, report, error));
+    REQUIRE(report.events == recorded);
+    REQUIRE(report.canvasHash == SessionReplay::canvasHash(live->GetFlattened()));
+    REQUIRE(report.calls[static_cast<std::size_t>(SessionReplay::Subsystem::Paint)] == 61);
+    REQUIRE(report.calls[static_cast<std::size_t>(SessionReplay::Subsystem::History)] == 1);
+    REQUIRE(report.calls[static_cast<std::size_t>(SessionReplay::Subsystem::Fill)] == 1);
+    REQUIRE(report.calls[static_cast<std::size_t>(SessionReplay::Subsystem::Layers)] == 1);
+    REQUIRE(report.calls[static_cast<std::size_t>(SessionReplay::Subsystem::Composite)] > 3);
+    REQUIRE(report.summary().find("composite") != std::string::npos);
+
+    // At recorded speed the replay takes as long as the session did
+    SessionReplay::Report paced;
+    REQUIRE(SessionReplay::run(path, true, paced, error));
+    REQUIRE(paced.canvasHash == report.canvasHash);
+    REQUIRE(paced.wallMilliseconds >= paced.recordedMilliseconds);
+    REQUIRE(paced.recordedMilliseconds > 50);
+
+    // A recording cut short by a crash replays up to its last whole message
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 3));
+    }
+    REQUIRE(SessionReplay::run(path, false, report, error));
+    REQUIRE(report.events == recorded - 1);
+    std::remove(path.c_str());
+    REQUIRE_FALSE(SessionReplay::run(path, false, report, error));
+    live->Destroy();
+    delete live;
+}
+
+TEST_CASE("Op log throughput benchmark with durability", "[.benchmark]") {
+    const std::string prefix = "test_oplog_benchmark";
+    removeOpLog(prefix);
+    myPacket packet;
+    PaintMessage draw{1, 320, 240, static_cast<int>(0xFF0000FFu), 4};
+    draw.fromX = 316;
+    draw.fromY = 238;
+    draw.client = 3;
+    packet << draw;
+    Counter &flushes = MetricsRegistry::Get().counter("oplog.flushes");
+    // Packets arrive at a steady rate for a fixed time, as from busy clients; the log keeps up if every
+    // one of them is durable soon after the last arrives. A sync per packet, for comparison, is offered
+    // far fewer.
+    const auto duration = std::chrono::seconds(2);
+    const auto tick = std::chrono::milliseconds(1);
+    for (int groupCommit = 1; groupCommit >= 0; groupCommit--) {
+        SECTION(groupCommit ? "group commit" : "fdatasync per packet") {
+            OpLog log(prefix, OpLog::Options());
+            const int rate = groupCommit ? 50000 : 500;
+            const std::uint64_t flushesBefore = flushes.get();
+            std::uint64_t last = 0;
+            const auto start = std::chrono::steady_clock::now();
+            auto next = start;
+            for (int ticks = 0; next - start < duration; ticks++) {
+                // Catch up on the packets due by the end of this tick
+                const std::uint64_t due = static_cast<std::uint64_t>(rate) * (ticks + 1) * tick.count() / 1000;
+                while (last < due) {
+                    last = log.append(packet.getData(), packet.getDataSize());
+                    if (!groupCommit) {
+                        log.flush();
+                    }
+                }
+                next += tick;
+                std::this_thread::sleep_until(next);
+            }
+            const auto arrived = std::chrono::steady_clock::now();
+            while (log.getDurableSequence() < last &&
+                   std::chrono::steady_clock::now() - arrived < std::chrono::seconds(30)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            const auto durable = std::chrono::steady_clock::now();
+            const double seconds = std::chrono::duration<double>(durable - start).count();
+            WARN((groupCommit ? "group commit: " : "fdatasync per packet: ")
+                 << last << " packets offered at " << rate << "/s, "
+                 << static_cast<std::uint64_t>(log.getDurableSequence() / seconds) << " durable ops/s, "
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(durable - arrived).count()
+                 << " ms behind at the end, " << flushes.get() - flushesBefore << " fdatasyncs");
+            if (groupCommit) {
+                REQUIRE(log.getDurableSequence() == last);
+            }
+        }
+        removeOpLog(prefix);
+    }
+}
+
+/*! \brief 	Test that a canvas far larger than any window costs memory only for the tiles drawn on, and
+ * that strokes, fills, flood fills, undo and project files all work on it in canvas coordinates
+*
+*/
+TEST_CASE("A huge canvas allocates only the tiles drawn on") {
+    const std::string path = "test_huge.cpnt";
+    PaintCore *minipaint = new PaintCore();
+    minipaint->InitCanvas(Canvas::kMaxSize, Canvas::kMaxSize);
+    const Canvas &flat = minipaint->GetFlattened();
+    REQUIRE(flat.getWidth() == Canvas::kMaxSize);
+    REQUIRE(flat.getAllocatedTiles() == 0);
+
+    // A square outline far from the part a window shows at first, then a flood fill inside it
+    const int corners[5][2] = {{40000, 30000}, {40200, 30000}, {40200, 30200}, {40000, 30200}, {40000, 30000}};
+    for (int i = 1; i < 5; i++) {
+        PaintMessage draw{1, corners[i][0], corners[i][1], static_cast<int>(0x0000FFFFu), 3};
+        draw.fromX = corners[i - 1][0];
+        draw.fromY = corners[i - 1][1];
+        draw.client = 1;
+        minipaint->ApplyMessage(draw);
+    }
+    PaintMessage release{2, 0, 0, 0, 0};
+    release.client = 1;
+    minipaint->ApplyMessage(release);
+    PaintMessage flood{7, 40100, 30100, static_cast<int>(0xFF0000FFu), 0};
+    flood.client = 1;
+    minipaint->ApplyMessage(flood);
+    minipaint->GetFlattened();
+    REQUIRE(colorFromPixel(flat.getPixel(40100, 30100)) == sf::Color::Red);
+    REQUIRE(colorFromPixel(flat.getPixel(40000, 30100)) == sf::Color::Blue);
+    REQUIRE(colorFromPixel(flat.getPixel(39990, 30100)) == sf::Color::White);
+    // The square spans at most 5 x 5 of the million tiles
+    const std::size_t drawn = flat.getAllocatedTiles();
+    REQUIRE(drawn > 0);
+    REQUIRE(drawn <= 25);
+    REQUIRE(minipaint->GetLayers().getByteSize() < (64u << 20));
+
+    // A fill covers the canvas without allocating a tile; undoing it brings back the square
+    PaintMessage fill{5, 0, 0, static_cast<int>(0x00FF00FFu), 0};
+    fill.client = 2;
+    minipaint->ApplyMessage(fill);
+    minipaint->GetFlattened();
+    REQUIRE(flat.getAllocatedTiles() == 0);
+    REQUIRE(colorFromPixel(flat.getPixel(65000, 65000)) == sf::Color::Green);
+    PaintMessage undo{3, 0, 0, 0, 0};
+    undo.client = 2;
+    minipaint->ApplyMessage(undo);
+    minipaint->GetFlattened();
+    REQUIRE(colorFromPixel(flat.getPixel(40100, 30100)) == sf::Color::Red);
+    REQUIRE(colorFromPixel(flat.getPixel(65000, 65000)) == sf::Color::White);
+    REQUIRE(flat.getAllocatedTiles() == drawn);
+
+    // The project file holds just the square, and loads back onto a canvas of the same size
+    REQUIRE(minipaint->SaveProject(path).get());
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    REQUIRE(file.tellg() < 256 * 1024);
+    file.close();
+    PaintCore *loaded = new PaintCore();
+    loaded->InitCanvas();
+    std::string error;
+    REQUIRE(loaded->LoadProject(path, error));
+    const Canvas &reloaded = loaded->GetFlattened();
+    REQUIRE(reloaded.getWidth() == Canvas::kMaxSize);
+    REQUIRE(reloaded.getAllocatedTiles() == drawn);
+    for (int y = 29990; y < 30210; y += 7) {
+        for (int x = 39990; x < 40210; x += 7) {
+            REQUIRE(reloaded.getPixel(x, y) == flat.getPixel(x, y));
+        }
+    }
+    std::remove(path.c_str());
+    for (PaintCore *core : {minipaint, loaded}) {
+        core->Destroy();
+        delete core;
+    }
+}
+
+TEST_CASE("A paging canvas keeps its budget of tiles in memory and reads back what it paged out") {
+    const Canvas::Pixel white = Canvas::fromRGBA(0xFFFFFFFF);
+    Canvas canvas(4096, 4096, white);
+    Canvas expected(4096, 4096, white);
+    std::string error;
+    REQUIRE(canvas.enablePaging(".", 16, error));
+    REQUIRE(canvas.isPaging());
+
+    // A value of its own in 300 tiles, each span reaching into the next tile
+    for (int i = 0; i < 300; i++) {
+        const int x = (i % 60) * Canvas::kTileSize + 20;
+        const int y = (i / 60) * 5 * Canvas::kTileSize + i % 50;
+        for (Canvas *target : {&canvas, &expected}) {
+            target->fillSpan(y, x, x + 100, static_cast<Canvas::Pixel>(i + 1));
+        }
+    }
+    canvas.trimTiles();
+    REQUIRE(canvas.getResidentTiles() <= 16);
+    REQUIRE(canvas.getAllocatedTiles() == expected.getAllocatedTiles());
+    REQUIRE(canvas.getByteSize() < expected.getByteSize() / 8);
+    REQUIRE(samePixels(canvas, expected));
+    canvas.trimTiles();
+    REQUIRE(canvas.getResidentTiles() <= 16);
+
+    // Writing to a paged tile keeps the rest of it; filling one whole frees it
+    canvas.setPixel(25, 3, 7);
+    expected.setPixel(25, 3, 7);
+    canvas.fillRect(CanvasRect{0, 0, 2 * Canvas::kTileSize, Canvas::kTileSize}, white);
+    expected.fillRect(CanvasRect{0, 0, 2 * Canvas::kTileSize, Canvas::kTileSize}, white);
+    canvas.trimTiles();
+    REQUIRE(canvas.getAllocatedTiles() == expected.getAllocatedTiles());
+    REQUIRE(samePixels(canvas, expected));
+    canvas.trimTiles();
+
+    // Prefetched tiles come back without waiting for the disk
+    Counter &prefetched = MetricsRegistry::Get().counter("tiles.prefetched");
+    Counter &hits = MetricsRegistry::Get().counter("tiles.prefetch_hits");
+    const std::uint64_t prefetchedBefore = prefetched.get();
+    const std::uint64_t hitsBefore = hits.get();
+    canvas.waitForPaging();
+    canvas.prefetch(canvas.getBounds());
+    canvas.waitForPaging();
+    REQUIRE(prefetched.get() > prefetchedBefore);
+    REQUIRE(samePixels(canvas, expected));
+    REQUIRE(hits.get() > hitsBefore);
+
+    // A copy pages too, under the same budget; recreating forgets what was paged out
+    canvas.trimTiles();
+    Canvas copy(canvas);
+    REQUIRE(copy.isPaging());
+    REQUIRE(copy.getTileBudget() == canvas.getTileBudget());
+    REQUIRE(copy.getAllocatedTiles() == expected.getAllocatedTiles());
+    canvas.trimTiles();
+    REQUIRE(canvas.getResidentTiles() + copy.getResidentTiles() <= 16);
+    REQUIRE(samePixels(copy, expected));
+    canvas.create(4096, 4096, white);
+    REQUIRE(canvas.getAllocatedTiles() == 0);
+    REQUIRE(canvas.getPixel(20, 0) == white);
+    REQUIRE(samePixels(copy, expected));
+}
+
+TEST_CASE("Paging canvases keep their tiles within one shared budget") {
+    const Canvas::Pixel white = Canvas::fromRGBA(0xFFFFFFFF);
+    std::shared_ptr<TileBudget> budget = std::make_shared<TileBudget>(32);
+    Canvas first(2048, 2048, white);
+    Canvas second(2048, 2048, white);
+    Canvas expected(2048, 2048, white);
+    std::string error;
+    REQUIRE(first.enablePaging(".", budget, error));
+    REQUIRE(second.enablePaging(".", budget, error));
+    REQUIRE(budget->getShare() == 16);
+
+    // Alone in memory, a canvas keeps the whole budget rather than its share
+    for (Canvas *target : {&first, &second}) {
+        for (int i = 0; i < 100; i++) {
+            target->setPixel((i % 32) * Canvas::kTileSize + 1, (i / 32) * Canvas::kTileSize + 2,
+                             static_cast<Canvas::Pixel>(i + 1));
+            if (target == &first) {
+                expected.setPixel((i % 32) * Canvas::kTileSize + 1, (i / 32) * Canvas::kTileSize + 2,
+                                  static_cast<Canvas::Pixel>(i + 1));
+            }
+        }
+        target->trimTiles();
+        if (target == &first) {
+            REQUIRE(first.getResidentTiles() == 32);
+        }
+    }
+    // The other canvas gives up what it holds beyond its share, then the first does
+    REQUIRE(second.getResidentTiles() == 16);
+    REQUIRE(budget->getResident() > budget->getLimit());
+    first.trimTiles();
+    REQUIRE(first.getResidentTiles() == 16);
+    REQUIRE(budget->getResident() == first.getResidentTiles() + second.getResidentTiles());
+    REQUIRE(budget->getResident() <= budget->getLimit());
+
+    // The tiles paged out are all there, and the budget gets them back when the canvases go
+    first.waitForPaging();
+    REQUIRE(samePixels(first, expected));
+    REQUIRE(samePixels(second, expected));
+    first.create(16, 16, white);
+    second.create(16, 16, white);
+    REQUIRE(budget->getResident() == 0);
+}
+
+TEST_CASE("A poster-sized canvas paints the same with its tiles paged out, within the budget") {
+    const std::size_t budget = 64;
+    // Paged and in memory, the same drawing on an 8192 square canvas
+    PaintCore *paged = new PaintCore();
+    PaintCore *plain = new PaintCore();
+    paged->InitCanvas(8192, 8192);
+    plain->InitCanvas(8192, 8192);
+    std::string error;
+    REQUIRE(paged->EnableTilePaging(".", budget * sizeof(Canvas::Tile), error));
+    for (int i = 0; i < 12; i++) {
+        for (PaintCore *core : {paged, plain}) {
+            PaintMessage draw{1, 8191 - i * 300, 8191, static_cast<int>(i % 2 ? 0xFF0000FFu : 0x0000FFFFu), 3};
+            draw.fromX = i * 500;
+            draw.fromY = 0;
+            draw.client = 1;
+            core->ApplyMessage(draw);
+            PaintMessage release{2, 0, 0, 0, 0};
+            release.client = 1;
+            core->ApplyMessage(release);
+            core->GetFlattened();
+        }
+    }
+    for (PaintCore *core : {paged, plain}) {
+        PaintMessage flood{7, 4000, 10, static_cast<int>(0x00FF00FFu), 0};
+        flood.client = 2;
+        core->ApplyMessage(flood);
+        PaintMessage undo{3, 0, 0, 0, 0};
+        undo.client = 1;
+        core->ApplyMessage(undo);
+        core->GetFlattened();
+    }
+    const Canvas &pagedImage = paged->GetFlattened();
+    const Canvas &plainImage = plain->GetFlattened();
+    REQUIRE(pagedImage.getAllocatedTiles() == plainImage.getAllocatedTiles());
+    REQUIRE(pagedImage.getAllocatedTiles() > 10 * budget);
+    REQUIRE(pagedImage.getResidentTiles() <= budget);
+    REQUIRE(paged->GetCanvas(LayerStack::kBaseLayer).getResidentTiles() <= budget);
+    REQUIRE(samePixels(pagedImage, plainImage));
+    REQUIRE(samePixels(paged->GetCanvas(LayerStack::kBaseLayer), plain->GetCanvas(LayerStack::kBaseLayer)));
+
+    // The layers, the flattened image and the time-lapse's image share the budget; capturing the
+    // time-lapse and saving read the tiles paged out without bringing them back
+    const std::shared_ptr<TileBudget> tiles = paged->GetLayers().getTileBudget();
+    REQUIRE(tiles != nullptr);
+    REQUIRE(tiles->getLimit() == budget);
+    paged->GetFlattened();
+    REQUIRE(tiles->getResident() <= budget);
+    paged->EnableTimeline(4, HistoryTimeline::kDefaultByteBudget);
+    paged->GetTimeline()->wait();
+    const std::string path = "test_paged_project.cpnt";
+    REQUIRE(paged->SaveProject(path).get());
+    paged->GetFlattened();
+    REQUIRE(tiles->getResident() <= budget);
+    Canvas frame;
+    REQUIRE(paged->GetTimeline()->seek(paged->GetTimeline()->getFrameCount() - 1, frame));
+    REQUIRE(samePixels(frame, plainImage));
+    PaintCore *loaded = new PaintCore();
+    loaded->InitCanvas();
+    REQUIRE(loaded->LoadProject(path, error));
+    REQUIRE(samePixels(loaded->GetFlattened(), plainImage));
+    std::remove(path.c_str());
+    loaded->Destroy();
+    delete loaded;
+
+    // On a 32768 square poster, drawing across it leaves no more tiles in memory than the budget
+    paged->InitCanvas(32768, 32768);
+    for (int i = 0; i < 4; i++) {
+        PaintMessage draw{1, 32767 - i * 4000, 32767, static_cast<int>(0x0000FFFFu), 3};
+        draw.fromX = i * 4000;
+        draw.fromY = 0;
+        draw.client = 1;
+        paged->ApplyMessage(draw);
+        paged->GetFlattened();
+    }
+    const Canvas &poster = paged->GetFlattened();
+    REQUIRE(poster.getAllocatedTiles() > 2000);
+    REQUIRE(poster.getResidentTiles() <= budget);
+    REQUIRE(paged->GetCanvas(LayerStack::kBaseLayer).getResidentTiles() <= budget);
+    REQUIRE(tiles->getResident() <= budget);
+    REQUIRE(paged->GetLayers().getByteSize() < (budget * sizeof(Canvas::Tile) + (48u << 20)));
+    REQUIRE(colorFromPixel(poster.getPixel(16383, 16383)) == sf::Color::Blue);
+    REQUIRE(colorFromPixel(poster.getPixel(100, 30000)) == sf::Color::White);
+    for (PaintCore *core : {paged, plain}) {
+        core->Destroy();
+        delete core;
+    }
+}
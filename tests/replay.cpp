@@ -0,0 +1,61 @@
+/**
+ *  @file   replay.cpp
+ *  @brief  Replays a recorded session through the headless core and reports where the time went.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Feeds the messages of a session recorded with PAINT_RECORD_FILE through a PaintCore without any
+// window, exactly as the app applied them, then prints the time spent per subsystem and a hash of
+// the final canvas. Replaying the same recording before and after a change shows both what the
+// change cost and whether it still paints the same.
+//
+// Usage: App_Replay <recording> [--realtime] [--expect <hash>]
+//   --realtime  wait for each message's recorded time instead of replaying as fast as possible
+//   --expect    exit with status 1 unless the final canvas hash (hex) is this one
+
+// Include standard library C++ libraries.
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+// Project header files
+#include "SessionRecording.hpp"
+
+int main(int argc, char **argv) {
+    std::string path;
+    bool realTime = false;
+    bool expect = false;
+    std::uint32_t expected = 0;
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        if (argument == "--realtime") {
+            realTime = true;
+        } else if (argument == "--expect" && i + 1 < argc) {
+            expect = true;
+            expected = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 16));
+        } else if (path.empty() && argument[0] != '-') {
+            path = argument;
+        } else {
+            path.clear();
+            break;
+        }
+    }
+    if (path.empty()) {
+        std::cerr << "usage: " << argv[0] << " <recording> [--realtime] [--expect <hash>]" << std::endl;
+        return 2;
+    }
+
+    SessionReplay::Report report;
+    std::string error;
+    if (!SessionReplay::run(path, realTime, report, error)) {
+        std::cerr << "replay: " << error << std::endl;
+        return 2;
+    }
+    std::cout << report.summary();
+    if (expect && report.canvasHash != expected) {
+        std::cout << "FAIL: expected canvas hash " << std::hex << expected << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,374 @@
+/**
+ *  @file   soak_test.cpp
+ *  @brief  Long-running soak test which checks that memory stays flat over a session.
+ *  @author Mike and Team FunctionalPointers
+ *  @date   2026-10-18
+ ***********************************************/
+
+// Drives the real PaintCore command pipeline without any window for a long, random but repeatable
+// mix of strokes, fills, undos and redos from several clients, so redo stacks are invalidated
+// all the time. Every heap allocation goes through the replaced global operator new below, which
+// counts it against the phase of the loop that made it. The run fails if memory grows by more
+// than the history and timeline budgets. The stroke store counts too: it bakes the operations which
+// have left the history, so it grows with the history and the area drawn on rather than with every
+// stroke. The time-lapse records a frame after every action, as the app does after every operation,
+// and drops its oldest frames beyond its budget.
+//
+// Usage: App_Soak [actions]
+//   PAINT_SOAK_ACTIONS      number of user actions (default 1000000)
+//   PAINT_SOAK_BUDGET_MB    history budget given to the PaintCore (default 16)
+//   PAINT_SOAK_TIMELINE_MB  time-lapse budget (default 8)
+//   PAINT_SOAK_SLACK_MB     allowed growth beyond the budgets (default 32)
+
+// Include standard library C++ libraries.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+// POSIX headers for the resident set size
+#include <sys/resource.h>
+#include <unistd.h>
+// Project header files
+#include "CommandPool.hpp"
+#include "Draw.hpp"
+#include "FillDisplay.hpp"
+#include "HistoryTimeline.hpp"
+#include "PaintCore.hpp"
+
+// Parts of the soak loop that allocations are charged to
+enum SoakPhase {
+    kPhaseOther,
+    kPhaseStroke,
+    kPhaseCommit,
+    kPhaseFill,
+    kPhaseUndo,
+    kPhaseRedo,
+    kPhaseCount
+};
+
+static const char *const kPhaseNames[kPhaseCount] = {"other", "stroke", "commit", "fill", "undo", "redo"};
+
+// Allocation counters of one phase
+struct PhaseStats {
+    std::atomic<std::uint64_t> allocations;
+    std::atomic<std::uint64_t> frees;
+    std::atomic<std::int64_t> liveBytes;
+};
+
+static PhaseStats g_phases[kPhaseCount];
+
+// Phase the current thread's allocations are charged to; other threads count as "other"
+static thread_local int t_phase = kPhaseOther;
+
+// The replaced operators must not be inlined into callers, where the compiler would see the block
+// header as an access before the object
+#if defined(__GNUC__)
+#define SOAK_NOINLINE __attribute__((noinline))
+#else
+#define SOAK_NOINLINE
+#endif
+
+// Bytes in front of every block, holding its size and phase; keeps malloc's alignment
+static constexpr std::size_t kHeaderBytes = alignof(std::max_align_t);
+
+struct AllocationHeader {
+    std::size_t size;
+    int phase;
+};
+
+static_assert(sizeof(AllocationHeader) <= kHeaderBytes, "allocation header does not fit");
+
+/*! \brief Allocate a block and charge it to the current phase.
+ * @param size the requested size
+ * @return void* the block, or nullptr if the system is out of memory
+ */
+static SOAK_NOINLINE void *countedAllocate(std::size_t size) {
+    unsigned char *raw = static_cast<unsigned char *>(std::malloc(size + kHeaderBytes));
+    if (raw == nullptr) {
+        return nullptr;
+    }
+    AllocationHeader *header = reinterpret_cast<AllocationHeader *>(raw);
+    header->size = size;
+    header->phase = t_phase;
+    g_phases[t_phase].allocations.fetch_add(1, std::memory_order_relaxed);
+    g_phases[t_phase].liveBytes.fetch_add(static_cast<std::int64_t>(size), std::memory_order_relaxed);
+    return raw + kHeaderBytes;
+}
+
+/*! \brief Free a block, crediting the phase which allocated it.
+ * @param block the block
+ * @return void
+ */
+static SOAK_NOINLINE void countedFree(void *block) {
+    if (block == nullptr) {
+        return;
+    }
+    unsigned char *raw = static_cast<unsigned char *>(block) - kHeaderBytes;
+    AllocationHeader *header = reinterpret_cast<AllocationHeader *>(raw);
+    g_phases[header->phase].frees.fetch_add(1, std::memory_order_relaxed);
+    g_phases[header->phase].liveBytes.fetch_sub(static_cast<std::int64_t>(header->size), std::memory_order_relaxed);
+    std::free(raw);
+}
+
+void *operator new(std::size_t size) {
+    void *block = countedAllocate(size);
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return countedAllocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return countedAllocate(size);
+}
+
+void operator delete(void *block) noexcept {
+    countedFree(block);
+}
+
+void operator delete[](void *block) noexcept {
+    countedFree(block);
+}
+
+void operator delete(void *block, std::size_t) noexcept {
+    countedFree(block);
+}
+
+void operator delete[](void *block, std::size_t) noexcept {
+    countedFree(block);
+}
+
+// Charges the allocations made while it is alive to one phase
+class PhaseScope {
+public:
+    explicit PhaseScope(int phase) : m_previous(t_phase) {
+        t_phase = phase;
+    }
+
+    ~PhaseScope() {
+        t_phase = m_previous;
+    }
+
+private:
+    int m_previous;
+};
+
+/*! \brief Resident set size of the process. On systems without /proc this is the peak instead.
+ * @return std::int64_t the number of bytes
+ */
+static std::int64_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    std::int64_t pages = 0;
+    std::int64_t resident = 0;
+    if (statm >> pages >> resident) {
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return static_cast<std::int64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/*! \brief Heap bytes live across all phases.
+ * @return std::int64_t the number of bytes
+ */
+static std::int64_t liveHeapBytes() {
+    std::int64_t bytes = 0;
+    for (PhaseStats &phase : g_phases) {
+        bytes += phase.liveBytes.load(std::memory_order_relaxed);
+    }
+    return bytes;
+}
+
+/*! \brief Read a size setting from the environment.
+ * @param name the variable
+ * @param fallback the value if it is not set
+ * @return std::int64_t the value
+ */
+static std::int64_t setting(const char *name, std::int64_t fallback) {
+    const char *value = std::getenv(name);
+    return value != nullptr ? std::atoll(value) : fallback;
+}
+
+/*! \brief Megabytes, for printing.
+ * @param bytes the number of bytes
+ * @return double the number of megabytes
+ */
+static double megabytes(std::int64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+// Memory figures sampled during the run
+struct SoakSample {
+    std::int64_t rss;
+    std::int64_t heap;
+    std::int64_t store;
+};
+
+/*! \brief Sample the process and the PaintCore's own accounting, and print one progress line.
+ * @param app the PaintCore being driven
+ * @param actions the number of actions done so far
+ * @return SoakSample the sample
+ */
+static SoakSample sample(PaintCore &app, std::int64_t actions) {
+    SoakSample current{residentBytes(), liveHeapBytes(), static_cast<std::int64_t>(app.GetStrokeStore().getByteSize())};
+    std::uint64_t allocations = 0;
+    for (PhaseStats &phase : g_phases) {
+        allocations += phase.allocations.load(std::memory_order_relaxed);
+    }
+    std::cout << std::fixed << std::setprecision(1) << std::setw(10) << actions << " actions  rss "
+              << megabytes(current.rss) << " MB  heap " << megabytes(current.heap) << " MB  history "
+              << megabytes(static_cast<std::int64_t>(app.GetHistoryBytes())) << " MB  store "
+              << megabytes(current.store) << " MB  allocations " << allocations << std::endl;
+    return current;
+}
+
+/*! \brief Run the soak test.
+ * @return int 0 if memory stayed within budget, 1 otherwise
+ */
+int main(int argc, char **argv) {
+    const std::int64_t actions = argc > 1 ? std::atoll(argv[1]) : setting("PAINT_SOAK_ACTIONS", 1000000);
+    const std::int64_t budget = setting("PAINT_SOAK_BUDGET_MB", 16) * 1024 * 1024;
+    const std::int64_t timelineBudget = setting("PAINT_SOAK_TIMELINE_MB", 8) * 1024 * 1024;
+    const std::int64_t slack = setting("PAINT_SOAK_SLACK_MB", 32) * 1024 * 1024;
+    const std::int64_t interval = actions >= 20 ? actions / 20 : 1;
+    const int clients = 3;
+
+    PaintCore *app = new PaintCore();
+    app->InitCanvas();
+    app->SetHistoryBudget(static_cast<std::size_t>(budget));
+    app->EnableTimeline(HistoryTimeline::kDefaultKeyframeInterval, static_cast<std::uint64_t>(timelineBudget));
+    std::shared_ptr<HistoryTimeline> timeline = app->GetTimeline();
+    const int width = static_cast<int>(app->GetCanvas().getWidth());
+    const int height = static_cast<int>(app->GetCanvas().getHeight());
+    const sf::Color colors[] = {sf::Color::Black, sf::Color::Red, sf::Color::Green, sf::Color::Blue};
+
+    std::uint32_t seed = 2026;
+    auto next = [&seed](int range) {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<int>((seed >> 8) % static_cast<std::uint32_t>(range));
+    };
+
+    std::cout << "soak: " << actions << " actions, history budget " << megabytes(budget) << " MB, timeline budget "
+              << megabytes(timelineBudget) << " MB, slack " << megabytes(slack) << " MB" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    SoakSample baseline{0, 0, 0};
+    SoakSample end{0, 0, 0};
+    bool warmedUp = false;
+    for (std::int64_t action = 1; action <= actions; action++) {
+        int client = next(clients);
+        int kind = next(100);
+        if (kind < 70) {
+            sf::Color color = colors[next(4)];
+            int size = 1 + next(6);
+            int x = next(width);
+            int y = next(height);
+            {
+                PhaseScope phase(kPhaseStroke);
+                app->ExecuteCommand(new Draw(app, x, y, color, size), client);
+                for (int segments = 1 + next(8); segments > 0; segments--) {
+                    int toX = x + next(41) - 20;
+                    int toY = y + next(41) - 20;
+                    app->ExecuteCommand(new Draw(app, x, y, toX, toY, color, size), client);
+                    x = toX;
+                    y = toY;
+                }
+            }
+            PhaseScope phase(kPhaseCommit);
+            app->AddCommand(client);
+        } else if (kind < 73) {
+            PhaseScope phase(kPhaseFill);
+            app->FillDisplay(new FillDisplay(app, colors[next(4)].toInteger()), client);
+        } else if (kind < 88) {
+            PhaseScope phase(kPhaseUndo);
+            app->UndoCommand(client);
+        } else {
+            PhaseScope phase(kPhaseRedo);
+            app->RedoCommand(client);
+        }
+        timeline->capture(app->GetFlattened(), action);
+        if (action % interval == 0 || action == actions) {
+            SoakSample current = sample(*app, action);
+            end = current;
+            // Growth is measured from the end of the warm-up: once the history has filled its budget,
+            // or half way through if it never does
+            bool historyFull = static_cast<std::int64_t>(app->GetHistoryBytes()) >= budget - budget / 20;
+            if (!warmedUp && (historyFull || action >= actions / 2)) {
+                baseline = current;
+                warmedUp = true;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::endl << "allocations by phase:" << std::endl;
+    for (int phase = 0; phase < kPhaseCount; phase++) {
+        std::cout << "  " << std::left << std::setw(8) << kPhaseNames[phase] << std::right << std::setw(12)
+                  << g_phases[phase].allocations.load() << " allocs " << std::setw(12) << g_phases[phase].frees.load()
+                  << " frees " << std::setw(10) << megabytes(g_phases[phase].liveBytes.load()) << " MB live"
+                  << std::endl;
+    }
+    const std::int64_t canvasBytes = static_cast<std::int64_t>(app->GetCanvas().getByteSize() +
+                                                               app->GetFlattened().getByteSize());
+    const std::int64_t poolBytes = static_cast<std::int64_t>(CommandPool::Get().reservedBytes());
+    const std::int64_t historyBytes = static_cast<std::int64_t>(app->GetHistoryBytes());
+    timeline->wait();
+    const std::int64_t timelineBytes = static_cast<std::int64_t>(timeline->getByteSize());
+    std::cout << "memory by subsystem:" << std::endl
+              << "  canvas          " << megabytes(canvasBytes) << " MB" << std::endl
+              << "  stroke store    " << megabytes(end.store) << " MB in " << app->GetStrokeStore().size()
+              << " operations" << std::endl
+              << "  history         " << megabytes(historyBytes) << " MB of commands, "
+              << megabytes(static_cast<std::int64_t>(CommandPool::Get().liveBytes())) << " MB live in a "
+              << megabytes(poolBytes) << " MB pool" << std::endl
+              << "  timeline        " << megabytes(timelineBytes) << " MB in " << timeline->getFrameCount()
+              << " frames" << std::endl
+              << "  unattributed    " << megabytes(end.heap - canvasBytes - end.store - poolBytes - timelineBytes)
+              << " MB (container capacity, index buckets, metrics)" << std::endl
+              << "  " << actions / seconds << " actions/s" << std::endl;
+
+    const std::int64_t heapGrowth = end.heap - baseline.heap;
+    const std::int64_t rssGrowth = end.rss - baseline.rss;
+    int status = 0;
+    if (historyBytes > budget) {
+        std::cout << "FAIL: history holds " << megabytes(historyBytes) << " MB, over its budget" << std::endl;
+        status = 1;
+    }
+    if (timelineBytes > timelineBudget) {
+        std::cout << "FAIL: timeline holds " << megabytes(timelineBytes) << " MB, over its budget" << std::endl;
+        status = 1;
+    }
+    if (heapGrowth > budget + timelineBudget + slack) {
+        std::cout << "FAIL: heap grew " << megabytes(heapGrowth) << " MB, of which the stroke store accounts for "
+                  << megabytes(end.store - baseline.store) << " MB" << std::endl;
+        status = 1;
+    }
+    if (rssGrowth > budget + timelineBudget + slack) {
+        std::cout << "FAIL: resident set grew " << megabytes(rssGrowth)
+                  << " MB, of which the stroke store accounts for " << megabytes(end.store - baseline.store) << " MB"
+                  << std::endl;
+        status = 1;
+    }
+    app->Destroy();
+    if (status == 0) {
+        std::cout << "PASS: heap grew " << megabytes(heapGrowth) << " MB and resident set " << megabytes(rssGrowth)
+                  << " MB after warm-up, stroke store " << megabytes(end.store - baseline.store) << " MB" << std::endl;
+    }
+    return status;
+}